@@ -183,6 +183,21 @@ static ssize_t skel_pread(vfs_handle_struct *handle, files_struct *fsp, void *da
 	return -1;
 }
 
+static struct tevent_req *skel_pread_send(struct vfs_handle_struct *handle,
+					  TALLOC_CTX *mem_ctx,
+					  struct tevent_context *ev,
+					  struct files_struct *fsp,
+					  void *data, size_t n, SMB_OFF_T offset)
+{
+	return NULL;
+}
+
+static ssize_t skel_pread_recv(struct tevent_req *req, int *perrno)
+{
+	*perrno = ENOSYS;
+	return -1;
+}
+
 static ssize_t skel_write(vfs_handle_struct *handle, files_struct *fsp, const void *data, size_t n)
 {
 	errno = ENOSYS;
@@ -195,6 +210,22 @@ static ssize_t skel_pwrite(vfs_handle_struct *handle, files_struct *fsp, const v
 	return -1;
 }
 
+static struct tevent_req *skel_pwrite_send(struct vfs_handle_struct *handle,
+					   TALLOC_CTX *mem_ctx,
+					   struct tevent_context *ev,
+					   struct files_struct *fsp,
+					   const void *data,
+					   size_t n, SMB_OFF_T offset)
+{
+	return NULL;
+}
+
+static ssize_t skel_pwrite_recv(struct tevent_req *req, int *perrno)
+{
+	*perrno = ENOSYS;
+	return -1;
+}
+
 static SMB_OFF_T skel_lseek(vfs_handle_struct *handle, files_struct *fsp, SMB_OFF_T offset, int whence)
 {
 	errno = ENOSYS;
@@ -227,6 +258,20 @@ static int skel_fsync(vfs_handle_struct *handle, files_struct *fsp)
 	return -1;
 }
 
+static struct tevent_req *skel_fsync_send(struct vfs_handle_struct *handle,
+					  TALLOC_CTX *mem_ctx,
+					  struct tevent_context *ev,
+					  struct files_struct *fsp)
+{
+	return NULL;
+}
+
+static int skel_fsync_recv(struct tevent_req *req, int *perrno)
+{
+	*perrno = ENOSYS;
+	return -1;
+}
+
 static int skel_stat(vfs_handle_struct *handle, struct smb_filename *smb_fname)
 {
 	errno = ENOSYS;
@@ -807,13 +852,19 @@ struct vfs_fn_pointers skel_transparent_fns = {
 	.close_fn = skel_close_fn,
 	.vfs_read = skel_vfs_read,
 	.pread = skel_pread,
+	.pread_send = skel_pread_send,
+	.pread_recv = skel_pread_recv,
 	.write = skel_write,
 	.pwrite = skel_pwrite,
+	.pwrite_send = skel_pwrite_send,
+	.pwrite_recv = skel_pwrite_recv,
 	.lseek = skel_lseek,
 	.sendfile = skel_sendfile,
 	.recvfile = skel_recvfile,
 	.rename = skel_rename,
 	.fsync = skel_fsync,
+	.fsync_send = skel_fsync_send,
+	.fsync_recv = skel_fsync_recv,
 	.stat = skel_stat,
 	.fstat = skel_fstat,
 	.lstat = skel_lstat,
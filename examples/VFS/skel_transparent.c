@@ -188,6 +188,21 @@ static ssize_t skel_pread(vfs_handle_struct *handle, files_struct *fsp, void *da
 	return SMB_VFS_NEXT_PREAD(handle, fsp, data, n, offset);
 }
 
+static struct tevent_req *skel_pread_send(struct vfs_handle_struct *handle,
+					  TALLOC_CTX *mem_ctx,
+					  struct tevent_context *ev,
+					  struct files_struct *fsp,
+					  void *data, size_t n, SMB_OFF_T offset)
+{
+	return SMB_VFS_NEXT_PREAD_SEND(handle, mem_ctx, ev, fsp, data, n,
+				       offset);
+}
+
+static ssize_t skel_pread_recv(struct tevent_req *req, int *perrno)
+{
+	return SMB_VFS_NEXT_PREAD_RECV(req, perrno);
+}
+
 static ssize_t skel_write(vfs_handle_struct *handle, files_struct *fsp, const void *data, size_t n)
 {
 	return SMB_VFS_NEXT_WRITE(handle, fsp, data, n);
@@ -198,6 +213,22 @@ static ssize_t skel_pwrite(vfs_handle_struct *handle, files_struct *fsp, const v
 	return SMB_VFS_NEXT_PWRITE(handle, fsp, data, n, offset);
 }
 
+static struct tevent_req *skel_pwrite_send(struct vfs_handle_struct *handle,
+					   TALLOC_CTX *mem_ctx,
+					   struct tevent_context *ev,
+					   struct files_struct *fsp,
+					   const void *data,
+					   size_t n, SMB_OFF_T offset)
+{
+	return SMB_VFS_NEXT_PWRITE_SEND(handle, mem_ctx, ev, fsp, data, n,
+					offset);
+}
+
+static ssize_t skel_pwrite_recv(struct tevent_req *req, int *perrno)
+{
+	return SMB_VFS_NEXT_PWRITE_RECV(req, perrno);
+}
+
 static SMB_OFF_T skel_lseek(vfs_handle_struct *handle, files_struct *fsp, SMB_OFF_T offset, int whence)
 {
 	return SMB_VFS_NEXT_LSEEK(handle, fsp, offset, whence);
@@ -225,6 +256,19 @@ static int skel_fsync(vfs_handle_struct *handle, files_struct *fsp)
 	return SMB_VFS_NEXT_FSYNC(handle, fsp);
 }
 
+static struct tevent_req *skel_fsync_send(struct vfs_handle_struct *handle,
+					  TALLOC_CTX *mem_ctx,
+					  struct tevent_context *ev,
+					  struct files_struct *fsp)
+{
+	return SMB_VFS_NEXT_FSYNC_SEND(handle, mem_ctx, ev, fsp);
+}
+
+static int skel_fsync_recv(struct tevent_req *req, int *perrno)
+{
+	return SMB_VFS_NEXT_FSYNC_RECV(req, perrno);
+}
+
 static int skel_stat(vfs_handle_struct *handle, struct smb_filename *smb_fname)
 {
 	return SMB_VFS_NEXT_STAT(handle, smb_fname);
@@ -751,13 +795,19 @@ struct vfs_fn_pointers skel_transparent_fns = {
 	.close_fn = skel_close_fn,
 	.vfs_read = skel_vfs_read,
 	.pread = skel_pread,
+	.pread_send = skel_pread_send,
+	.pread_recv = skel_pread_recv,
 	.write = skel_write,
 	.pwrite = skel_pwrite,
+	.pwrite_send = skel_pwrite_send,
+	.pwrite_recv = skel_pwrite_recv,
 	.lseek = skel_lseek,
 	.sendfile = skel_sendfile,
 	.recvfile = skel_recvfile,
 	.rename = skel_rename,
 	.fsync = skel_fsync,
+	.fsync_send = skel_fsync_send,
+	.fsync_recv = skel_fsync_recv,
 	.stat = skel_stat,
 	.fstat = skel_fstat,
 	.lstat = skel_lstat,
@@ -57,19 +57,104 @@
 ))
 #endif
 
+/*
+ * The match finder keeps hash chains of the positions in the window:
+ * head[] holds the most recent position whose next three bytes hash
+ * to a value, and prev[] links each position to the previous one with
+ * the same hash. prev[] is a ring over the window, as offsets are
+ * limited to LZXPRESS_MAX_OFFSET.
+ */
+#define LZXPRESS_MAX_OFFSET 0x1FFF
+#define LZXPRESS_MAX_MATCH (255 + 15 + 7 + 3)
+#define LZXPRESS_HASH_BITS 13
+#define LZXPRESS_HASH_SIZE (1 << LZXPRESS_HASH_BITS)
+#define LZXPRESS_WINDOW_SIZE (LZXPRESS_MAX_OFFSET + 1)
+#define LZXPRESS_NO_POS 0xFFFFFFFF
+
+struct lzxpress_chains {
+	uint32_t head[LZXPRESS_HASH_SIZE];
+	uint32_t prev[LZXPRESS_WINDOW_SIZE];
+};
+
+static inline uint32_t lzxpress_hash(const uint8_t *p)
+{
+	uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16);
+
+	return (v * 2654435761U) >> (32 - LZXPRESS_HASH_BITS);
+}
+
+static inline void lzxpress_chains_insert(struct lzxpress_chains *chains,
+					  const uint8_t *uncompressed,
+					  uint32_t pos)
+{
+	uint32_t h = lzxpress_hash(&uncompressed[pos]);
+
+	chains->prev[pos % LZXPRESS_WINDOW_SIZE] = chains->head[h];
+	chains->head[h] = pos;
+}
+
+/*
+ * Find the longest match for the bytes at pos, trying at most effort
+ * earlier positions, nearest first. Of equally long matches the
+ * nearest wins. Returns the length, or 0 if there is no match longer
+ * than two bytes.
+ */
+static uint32_t lzxpress_find_match(const struct lzxpress_chains *chains,
+				    const uint8_t *uncompressed,
+				    uint32_t pos, uint32_t max_len,
+				    uint32_t effort, uint32_t *best_offset)
+{
+	const uint8_t *str1 = &uncompressed[pos];
+	uint32_t best_len = 2;
+	uint32_t cand, len;
+
+	cand = chains->head[lzxpress_hash(str1)];
+
+	while (cand != LZXPRESS_NO_POS &&
+	       pos - cand <= LZXPRESS_MAX_OFFSET &&
+	       effort-- > 0) {
+		const uint8_t *str2 = &uncompressed[cand];
+
+		for (len = 0; (len < max_len) && (str1[len] == str2[len]); len++);
+
+		if (len > best_len) {
+			best_len = len;
+			*best_offset = pos - cand;
+			if (len == max_len) {
+				/* nothing further back can be longer */
+				break;
+			}
+		}
+		cand = chains->prev[cand % LZXPRESS_WINDOW_SIZE];
+	}
+
+	return best_len > 2 ? best_len : 0;
+}
+
 ssize_t lzxpress_compress(const uint8_t *uncompressed,
 			  uint32_t uncompressed_size,
 			  uint8_t *compressed,
 			  uint32_t max_compressed_size)
+{
+	return lzxpress_compress_effort(uncompressed, uncompressed_size,
+					compressed, max_compressed_size,
+					LZXPRESS_EFFORT_DEFAULT);
+}
+
+ssize_t lzxpress_compress_effort(const uint8_t *uncompressed,
+				 uint32_t uncompressed_size,
+				 uint8_t *compressed,
+				 uint32_t max_compressed_size,
+				 uint32_t effort)
 {
 	uint32_t uncompressed_pos, compressed_pos, byte_left;
-	uint32_t max_offset, best_offset;
-	int32_t offset;
-	uint32_t max_len, len, best_len;
-	const uint8_t *str1, *str2;
+	uint32_t best_offset;
+	uint32_t max_len, best_len;
 	uint32_t indic;
 	uint8_t *indic_pos;
 	uint32_t indic_bit, nibble_index;
+	struct lzxpress_chains *chains;
+	uint32_t hashed_pos;
 
 	uint32_t metadata_size;
 	uint16_t metadata;
@@ -79,6 +164,13 @@ ssize_t lzxpress_compress(const uint8_t *uncompressed,
 		return 0;
 	}
 
+	chains = malloc(sizeof(*chains));
+	if (chains == NULL) {
+		return -1;
+	}
+	memset(chains->head, 0xFF, sizeof(chains->head));
+	hashed_pos = 0;
+
 	uncompressed_pos = 0;
 	indic = 0;
 	*(uint32_t *)compressed = 0;
@@ -93,38 +185,28 @@ ssize_t lzxpress_compress(const uint8_t *uncompressed,
 		return 0;
 
 	do {
-		bool found = false;
-
-		max_offset = uncompressed_pos;
+		/* add the positions we have moved past to the chains */
+		for (; hashed_pos < uncompressed_pos; hashed_pos++) {
+			lzxpress_chains_insert(chains, uncompressed, hashed_pos);
+		}
 
-		str1 = &uncompressed[uncompressed_pos];
+		/* maximum len we can encode into metadata */
+		max_len = MIN(LZXPRESS_MAX_MATCH, byte_left);
 
-		best_len = 2;
+		/*
+		 * search for the longest match in the window for the
+		 * lookahead buffer. The hash reads three bytes, so a
+		 * shorter input has nothing to look for.
+		 */
 		best_offset = 0;
-
-		max_offset = MIN(0x1FFF, max_offset);
-
-		/* search for the longest match in the window for the lookahead buffer */
-		for (offset = 1; (uint32_t)offset <= max_offset; offset++) {
-			str2 = &str1[-offset];
-
-			/* maximum len we can encode into metadata */
-			max_len = MIN((255 + 15 + 7 + 3), byte_left);
-
-			for (len = 0; (len < max_len) && (str1[len] == str2[len]); len++);
-
-			/*
-			 * We check if len is better than the value found before, including the
-			 * sequence of identical bytes
-			 */
-			if (len > best_len) {
-				found = true;
-				best_len = len;
-				best_offset = offset;
-			}
+		best_len = 0;
+		if (max_len >= 3) {
+			best_len = lzxpress_find_match(chains, uncompressed,
+						       uncompressed_pos, max_len,
+						       effort, &best_offset);
 		}
 
-		if (found) {
+		if (best_len != 0) {
 			metadata_size = 0;
 			dest = (uint16_t *)&compressed[compressed_pos];
 
@@ -207,7 +289,10 @@ ssize_t lzxpress_compress(const uint8_t *uncompressed,
 		}
 	} while (byte_left > 3);
 
-	do {
+	free(chains);
+
+	/* a match may have consumed the whole input */
+	while (uncompressed_pos < uncompressed_size) {
 		compressed[compressed_pos] = uncompressed[uncompressed_pos];
 		indic_bit++;
 
@@ -219,7 +304,7 @@ ssize_t lzxpress_compress(const uint8_t *uncompressed,
 			indic_pos = &compressed[compressed_pos];
 			compressed_pos += sizeof(uint32_t);
 		}
-	} while (uncompressed_pos < uncompressed_size);
+	}
 
 	if ((indic_bit % 32) > 0) {
 		for (; (indic_bit % 32) != 0; indic_bit++)
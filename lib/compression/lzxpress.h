@@ -37,11 +37,26 @@
 
 #define XPRESS_BLOCK_SIZE 0x10000
 
+/*
+ * The effort is the number of earlier positions the compressor tries
+ * for each match. LZXPRESS_EFFORT_MAX tries every position in the
+ * window and gives the longest possible matches.
+ */
+#define LZXPRESS_EFFORT_FAST 8
+#define LZXPRESS_EFFORT_DEFAULT 64
+#define LZXPRESS_EFFORT_MAX 0x1FFF
+
 ssize_t lzxpress_compress(const uint8_t *uncompressed,
 			  uint32_t uncompressed_size,
 			  uint8_t *compressed,
 			  uint32_t max_compressed_size);
 
+ssize_t lzxpress_compress_effort(const uint8_t *uncompressed,
+				 uint32_t uncompressed_size,
+				 uint8_t *compressed,
+				 uint32_t max_compressed_size,
+				 uint32_t effort);
+
 ssize_t lzxpress_decompress(const uint8_t *input,
 			    uint32_t input_size,
 			    uint8_t *output,
@@ -66,12 +66,191 @@ static bool test_lzxpress(struct torture_context *test)
 	return true;
 }
 
+static const uint32_t lzxpress_efforts[] = {
+	1, LZXPRESS_EFFORT_FAST, LZXPRESS_EFFORT_DEFAULT, LZXPRESS_EFFORT_MAX
+};
+
+/*
+  fill a buffer with data of varying compressibility
+ */
+static void lzxpress_fill(uint8_t *data, uint32_t size, int kind)
+{
+	const char *words[] = { "this ", "is ", "a ", "test ", "of ",
+				"lzxpress ", "compression. ", "\r\n" };
+	uint32_t i, run;
+
+	switch (kind) {
+	case 0:
+		/* incompressible */
+		generate_random_buffer(data, size);
+		break;
+	case 1:
+		/* a small alphabet, lots of short matches */
+		for (i = 0; i < size; i++) {
+			data[i] = 'a' + random() % 4;
+		}
+		break;
+	case 2:
+		/* long runs, matches up to the maximum length */
+		for (i = 0; i < size; i += run) {
+			run = MIN(1 + random() % 600, size - i);
+			memset(&data[i], random(), run);
+		}
+		break;
+	default:
+		/* text made of a few words */
+		for (i = 0; i < size; i += run) {
+			const char *w = words[random() % ARRAY_SIZE(words)];
+			run = MIN(strlen(w), size - i);
+			memcpy(&data[i], w, run);
+		}
+		break;
+	}
+}
+
+/*
+  check that compressing and decompressing gives back the input, for
+  all kinds of input and every effort
+ */
+static bool test_lzxpress_round_trip(struct torture_context *test)
+{
+	TALLOC_CTX *tmp_ctx = talloc_new(test);
+	const uint32_t sizes[] = { 1, 2, 3, 4, 5, 31, 32, 33, 300, 8191,
+				   8192, 8193, 20000, XPRESS_BLOCK_SIZE };
+	uint8_t *data, *comp, *out;
+	ssize_t c_size, d_size;
+	int kind;
+	unsigned s, e;
+
+	data = talloc_size(tmp_ctx, XPRESS_BLOCK_SIZE);
+	comp = talloc_size(tmp_ctx, XPRESS_BLOCK_SIZE * 9 / 8 + 16);
+	out = talloc_size(tmp_ctx, XPRESS_BLOCK_SIZE);
+
+	for (kind = 0; kind < 4; kind++) {
+	for (s = 0; s < ARRAY_SIZE(sizes); s++) {
+		lzxpress_fill(data, sizes[s], kind);
+
+		for (e = 0; e < ARRAY_SIZE(lzxpress_efforts); e++) {
+			c_size = lzxpress_compress_effort(data, sizes[s],
+							  comp,
+							  talloc_get_size(comp),
+							  lzxpress_efforts[e]);
+			torture_assert(test, c_size > 0,
+				       "lzxpress_compress_effort failed");
+
+			d_size = lzxpress_decompress(comp, c_size,
+						     out, sizes[s]);
+			torture_assert_int_equal(test, d_size, sizes[s],
+				talloc_asprintf(tmp_ctx,
+					"round trip size (kind %d, effort %u)",
+					kind, lzxpress_efforts[e]));
+			torture_assert_mem_equal(test, out, data, sizes[s],
+				talloc_asprintf(tmp_ctx,
+					"round trip data (kind %d, effort %u)",
+					kind, lzxpress_efforts[e]));
+		}
+	}
+	}
+
+	talloc_free(tmp_ctx);
+	return true;
+}
+
+/*
+  compress inputs shorter than a match from exactly sized buffers, so
+  that valgrind or ASAN catch any read past the end
+ */
+static bool test_lzxpress_short(struct torture_context *test)
+{
+	TALLOC_CTX *tmp_ctx = talloc_new(test);
+	const uint8_t src[] = { 'a', 'a' };
+	uint8_t *data, *comp, *out;
+	ssize_t c_size, d_size;
+	uint32_t size;
+
+	comp = talloc_size(tmp_ctx, 64);
+	out = talloc_size(tmp_ctx, sizeof(src));
+
+	for (size = 1; size <= sizeof(src); size++) {
+		data = talloc_memdup(tmp_ctx, src, size);
+		torture_assert(test, data != NULL, "talloc_memdup failed");
+
+		c_size = lzxpress_compress(data, size,
+					   comp, talloc_get_size(comp));
+		torture_assert(test, c_size > 0, "lzxpress_compress failed");
+
+		d_size = lzxpress_decompress(comp, c_size, out, size);
+		torture_assert_int_equal(test, d_size, size,
+					 "short round trip size");
+		torture_assert_mem_equal(test, out, data, size,
+					 "short round trip data");
+		talloc_free(data);
+	}
+
+	talloc_free(tmp_ctx);
+	return true;
+}
+
+/*
+  report the compression speed and ratio at each effort
+ */
+static bool test_lzxpress_speed(struct torture_context *test)
+{
+	TALLOC_CTX *tmp_ctx = talloc_new(test);
+	const uint32_t total = 16 * XPRESS_BLOCK_SIZE;
+	uint8_t *data, *comp;
+	int kind;
+	unsigned e;
+
+	data = talloc_size(tmp_ctx, total);
+	comp = talloc_size(tmp_ctx, XPRESS_BLOCK_SIZE * 9 / 8 + 16);
+
+	for (kind = 0; kind < 4; kind++) {
+		lzxpress_fill(data, total, kind);
+
+		for (e = 0; e < ARRAY_SIZE(lzxpress_efforts); e++) {
+			struct timeval tv = timeval_current();
+			uint64_t c_total = 0;
+			uint32_t ofs;
+			double secs;
+
+			for (ofs = 0; ofs < total; ofs += XPRESS_BLOCK_SIZE) {
+				ssize_t c_size;
+
+				c_size = lzxpress_compress_effort(&data[ofs],
+							XPRESS_BLOCK_SIZE,
+							comp,
+							talloc_get_size(comp),
+							lzxpress_efforts[e]);
+				torture_assert(test, c_size > 0,
+					       "lzxpress_compress_effort failed");
+				c_total += c_size;
+			}
+			secs = timeval_elapsed(&tv);
+
+			torture_comment(test, "input %d effort %4u: "
+					"%8.2f MB/s, ratio %.3f\n",
+					kind, lzxpress_efforts[e],
+					total / (secs * 1024 * 1024),
+					(double)c_total / total);
+		}
+	}
+
+	talloc_free(tmp_ctx);
+	return true;
+}
 
 struct torture_suite *torture_local_compression(TALLOC_CTX *mem_ctx)
 {
 	struct torture_suite *suite = torture_suite_create(mem_ctx, "compression");
 
 	torture_suite_add_simple_test(suite, "lzxpress", test_lzxpress);
+	torture_suite_add_simple_test(suite, "lzxpress-short",
+				      test_lzxpress_short);
+	torture_suite_add_simple_test(suite, "lzxpress-round-trip",
+				      test_lzxpress_round_trip);
+	torture_suite_add_simple_test(suite, "lzxpress-speed",
+				      test_lzxpress_speed);
 
 	return suite;
 }
@@ -41,6 +41,19 @@
 #include "replace.h"
 #include "sha256.h"
 
+/*
+ * On x86_64 the block function can use the SHA extensions. They are
+ * compiled in with a function level target attribute and only used
+ * after cpuid has confirmed the CPU supports them, so the rest of the
+ * build keeps its default target.
+ */
+#if defined(__x86_64__) && \
+    ((defined(__GNUC__) && __GNUC__ >= 5) || defined(__clang__))
+#define SHA256_X86_SHANI 1
+#include <immintrin.h>
+#include <cpuid.h>
+#endif
+
 #define Ch(x,y,z) (((x) & (y)) ^ ((~(x)) & (z)))
 #define Maj(x,y,z) (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
 
@@ -94,97 +107,198 @@ samba_SHA256_Init (SHA256_CTX *m)
     H = 0x5be0cd19;
 }
 
+#define LOAD_BE32(p) \
+    (((uint32_t)(p)[0] << 24) | ((uint32_t)(p)[1] << 16) | \
+     ((uint32_t)(p)[2] << 8) | (uint32_t)(p)[3])
+
+/*
+ * One round, with the working variables renamed by the caller rather
+ * than shifted through eight assignments.
+ */
+#define ROUND(a,b,c,d,e,f,g,h,i) do {					\
+	uint32_t T1 = (h) + Sigma1(e) + Ch(e,f,g) + constant_256[i] + data[i]; \
+	(d) += T1;							\
+	(h) = T1 + Sigma0(a) + Maj(a,b,c);				\
+} while (0)
+
+/* process nblocks consecutive 64 byte blocks of big endian input */
 static void
-calc (SHA256_CTX *m, uint32_t *in)
+calc_blocks_c (uint32_t *state, const unsigned char *p, size_t nblocks)
 {
-    uint32_t AA, BB, CC, DD, EE, FF, GG, HH;
     uint32_t data[64];
     int i;
 
-    AA = A;
-    BB = B;
-    CC = C;
-    DD = D;
-    EE = E;
-    FF = F;
-    GG = G;
-    HH = H;
-
-    for (i = 0; i < 16; ++i)
-	data[i] = in[i];
-    for (i = 16; i < 64; ++i)
-	data[i] = sigma1(data[i-2]) + data[i-7] + 
-	    sigma0(data[i-15]) + data[i - 16];
-
-    for (i = 0; i < 64; i++) {
-	uint32_t T1, T2;
-
-	T1 = HH + Sigma1(EE) + Ch(EE, FF, GG) + constant_256[i] + data[i];
-	T2 = Sigma0(AA) + Maj(AA,BB,CC);
-			     
-	HH = GG;
-	GG = FF;
-	FF = EE;
-	EE = DD + T1;
-	DD = CC;
-	CC = BB;
-	BB = AA;
-	AA = T1 + T2;
-    }
+    while (nblocks-- > 0) {
+	uint32_t AA = state[0], BB = state[1], CC = state[2], DD = state[3];
+	uint32_t EE = state[4], FF = state[5], GG = state[6], HH = state[7];
+
+	for (i = 0; i < 16; ++i)
+	    data[i] = LOAD_BE32(p + 4*i);
+	for (i = 16; i < 64; ++i)
+	    data[i] = sigma1(data[i-2]) + data[i-7] +
+		sigma0(data[i-15]) + data[i - 16];
+
+	for (i = 0; i < 64; i += 8) {
+	    ROUND(AA,BB,CC,DD,EE,FF,GG,HH,i+0);
+	    ROUND(HH,AA,BB,CC,DD,EE,FF,GG,i+1);
+	    ROUND(GG,HH,AA,BB,CC,DD,EE,FF,i+2);
+	    ROUND(FF,GG,HH,AA,BB,CC,DD,EE,i+3);
+	    ROUND(EE,FF,GG,HH,AA,BB,CC,DD,i+4);
+	    ROUND(DD,EE,FF,GG,HH,AA,BB,CC,i+5);
+	    ROUND(CC,DD,EE,FF,GG,HH,AA,BB,i+6);
+	    ROUND(BB,CC,DD,EE,FF,GG,HH,AA,i+7);
+	}
 
-    A += AA;
-    B += BB;
-    C += CC;
-    D += DD;
-    E += EE;
-    F += FF;
-    G += GG;
-    H += HH;
+	state[0] += AA;
+	state[1] += BB;
+	state[2] += CC;
+	state[3] += DD;
+	state[4] += EE;
+	state[5] += FF;
+	state[6] += GG;
+	state[7] += HH;
+
+	p += 64;
+    }
 }
 
-/*
- * From `Performance analysis of MD5' by Joseph D. Touch <touch@isi.edu>
- */
+#ifdef SHA256_X86_SHANI
 
-#if !defined(WORDS_BIGENDIAN) || defined(_CRAY)
-/* Vector Crays doesn't have a good 32-bit type, or more precisely,
-   int32_t as defined by <bind/bitypes.h> isn't 32 bits, and we don't
-   want to depend in being able to redefine this type.  To cope with
-   this we have to clamp the result in some places to [0,2^32); no
-   need to do this on other machines.  Did I say this was a mess?
-   */
+#define SHANI_TARGET __attribute__((target("sha,sse4.1,ssse3")))
 
-#ifdef _CRAY
-#define CRAYFIX(X) ((X) & 0xffffffff)
-#else
-#define CRAYFIX(X) (X)
-#endif
+/* four rounds using the message words w (already byte swapped) */
+#define SHANI_ROUNDS(g, w) do {						\
+	MSG = _mm_add_epi32((w),					\
+		_mm_loadu_si128((const __m128i *)&constant_256[4*(g)])); \
+	STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);		\
+	MSG = _mm_shuffle_epi32(MSG, 0x0E);				\
+	STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG);		\
+} while (0)
 
-static inline uint32_t
-cshift (uint32_t x, unsigned int n)
+static SHANI_TARGET void
+calc_blocks_shani (uint32_t *state, const unsigned char *p, size_t nblocks)
 {
-    x = CRAYFIX(x);
-    return CRAYFIX((x << n) | (x >> (32 - n)));
+    const __m128i MASK = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+					0x0405060700010203ULL);
+    __m128i STATE0, STATE1, MSG, TMP, ABEF_SAVE, CDGH_SAVE;
+    __m128i W[4];
+    int g;
+
+    /* the instructions want the state as ABEF and CDGH */
+    TMP = _mm_loadu_si128((const __m128i *)&state[0]);
+    STATE1 = _mm_loadu_si128((const __m128i *)&state[4]);
+    TMP = _mm_shuffle_epi32(TMP, 0xB1);
+    STATE1 = _mm_shuffle_epi32(STATE1, 0x1B);
+    STATE0 = _mm_alignr_epi8(TMP, STATE1, 8);
+    STATE1 = _mm_blend_epi16(STATE1, TMP, 0xF0);
+
+    while (nblocks-- > 0) {
+	ABEF_SAVE = STATE0;
+	CDGH_SAVE = STATE1;
+
+	for (g = 0; g < 4; g++) {
+	    W[g] = _mm_shuffle_epi8(
+		_mm_loadu_si128((const __m128i *)(p + 16*g)), MASK);
+	}
+
+	/*
+	 * W[g & 3] holds message words 4g..4g+3 when group g runs;
+	 * the schedule for later groups is built alongside.
+	 */
+	for (g = 0; g < 16; g++) {
+	    SHANI_ROUNDS(g, W[g & 3]);
+	    if (g >= 3 && g <= 14) {
+		TMP = _mm_alignr_epi8(W[g & 3], W[(g - 1) & 3], 4);
+		W[(g + 1) & 3] = _mm_add_epi32(W[(g + 1) & 3], TMP);
+		W[(g + 1) & 3] = _mm_sha256msg2_epu32(W[(g + 1) & 3],
+						      W[g & 3]);
+	    }
+	    if (g >= 1 && g <= 12) {
+		W[(g - 1) & 3] = _mm_sha256msg1_epu32(W[(g - 1) & 3],
+						      W[g & 3]);
+	    }
+	}
+
+	STATE0 = _mm_add_epi32(STATE0, ABEF_SAVE);
+	STATE1 = _mm_add_epi32(STATE1, CDGH_SAVE);
+
+	p += 64;
+    }
+
+    TMP = _mm_shuffle_epi32(STATE0, 0x1B);
+    STATE1 = _mm_shuffle_epi32(STATE1, 0xB1);
+    STATE0 = _mm_blend_epi16(TMP, STATE1, 0xF0);
+    STATE1 = _mm_alignr_epi8(STATE1, TMP, 8);
+
+    _mm_storeu_si128((__m128i *)&state[0], STATE0);
+    _mm_storeu_si128((__m128i *)&state[4], STATE1);
 }
 
-static inline uint32_t
-swap_uint32_t (uint32_t t)
+static bool
+cpu_has_shani (void)
 {
-    uint32_t temp1, temp2;
-
-    temp1   = cshift(t, 16);
-    temp2   = temp1 >> 8;
-    temp1  &= 0x00ff00ff;
-    temp2  &= 0x00ff00ff;
-    temp1 <<= 8;
-    return temp1 | temp2;
+    unsigned int eax, ebx, ecx, edx;
+
+    if (__get_cpuid_max(0, NULL) < 7) {
+	return false;
+    }
+    __cpuid(1, eax, ebx, ecx, edx);
+    /* SSSE3 and SSE4.1 */
+    if ((ecx & (1 << 9)) == 0 || (ecx & (1 << 19)) == 0) {
+	return false;
+    }
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    return (ebx & (1 << 29)) != 0;
 }
+
+#endif /* SHA256_X86_SHANI */
+
+/*
+ * 0: not yet probed, 1: portable code, 2: SHA extensions. Probing is
+ * idempotent, so threads racing on the first call all store the same
+ * value.
+ */
+static int sha256_impl;
+
+static void
+calc_blocks (uint32_t *state, const unsigned char *p, size_t nblocks)
+{
+#ifdef SHA256_X86_SHANI
+    if (sha256_impl == 0) {
+	sha256_impl = cpu_has_shani() ? 2 : 1;
+    }
+    if (sha256_impl == 2) {
+	calc_blocks_shani(state, p, nblocks);
+	return;
+    }
 #endif
+    calc_blocks_c(state, p, nblocks);
+}
 
-struct x32{
-    unsigned int a:32;
-    unsigned int b:32;
-};
+/*
+ * Select the portable block function even on CPUs with SHA extensions,
+ * so tests and benchmarks can compare both. Returns false if the
+ * requested implementation is not available.
+ */
+bool
+samba_SHA256_select_impl (bool accelerated)
+{
+#ifdef SHA256_X86_SHANI
+    if (!accelerated) {
+	sha256_impl = 1;
+	return true;
+    }
+    if (!cpu_has_shani()) {
+	sha256_impl = 1;
+	return false;
+    }
+    sha256_impl = 2;
+    return true;
+#else
+    sha256_impl = 1;
+    return !accelerated;
+#endif
+}
 
 void
 samba_SHA256_Update (SHA256_CTX *m, const void *v, size_t len)
@@ -197,27 +311,28 @@ samba_SHA256_Update (SHA256_CTX *m, const void *v, size_t len)
     if (m->sz[0] < old_sz)
 	++m->sz[1];
     offset = (old_sz / 8) % 64;
-    while(len > 0){
+
+    if (offset > 0) {
 	size_t l = MIN(len, 64 - offset);
 	memcpy(m->save + offset, p, l);
 	offset += l;
 	p += l;
 	len -= l;
-	if(offset == 64){
-#if !defined(WORDS_BIGENDIAN) || defined(_CRAY)
-	    int i;
-	    uint32_t current[16];
-	    struct x32 *u = (struct x32*)m->save;
-	    for(i = 0; i < 8; i++){
-		current[2*i+0] = swap_uint32_t(u[i].a);
-		current[2*i+1] = swap_uint32_t(u[i].b);
-	    }
-	    calc(m, current);
-#else
-	    calc(m, (uint32_t*)m->save);
-#endif
-	    offset = 0;
+	if (offset < 64) {
+	    return;
 	}
+	calc_blocks(m->counter, m->save, 1);
+    }
+
+    /* whole blocks are hashed straight from the caller's buffer */
+    if (len >= 64) {
+	calc_blocks(m->counter, p, len / 64);
+	p += len & ~(size_t)63;
+	len &= 63;
+    }
+
+    if (len > 0) {
+	memcpy(m->save, p, len);
     }
 }
 
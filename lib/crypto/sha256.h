@@ -87,5 +87,6 @@ typedef struct hc_sha256state SHA256_CTX;
 void samba_SHA256_Init (SHA256_CTX *);
 void samba_SHA256_Update (SHA256_CTX *, const void *, size_t);
 void samba_SHA256_Final (void *, SHA256_CTX *);
+bool samba_SHA256_select_impl (bool accelerated);
 
 #endif /* HEIM_SHA_H */
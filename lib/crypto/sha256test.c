@@ -0,0 +1,409 @@
+/*
+   Unix SMB/CIFS implementation.
+   SHA-256 and HMAC-SHA256 tests
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "includes.h"
+#include "torture/torture.h"
+#include "system/time.h"
+#include "../lib/crypto/crypto.h"
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+static bool check_digest(struct torture_context *tctx,
+			 const uint8_t *digest, size_t digest_len,
+			 const char *hex, const char *what)
+{
+	DATA_BLOB expected = strhex_to_data_blob(tctx, hex);
+
+	if (expected.length != digest_len ||
+	    memcmp(expected.data, digest, digest_len) != 0) {
+		torture_comment(tctx, "%s: wrong digest\n", what);
+		dump_data(0, expected.data, expected.length);
+		dump_data(0, digest, digest_len);
+		return false;
+	}
+	return true;
+}
+
+/*
+ This uses the test values from FIPS 180-2, fed in whole and in pieces
+ of a few awkward sizes
+*/
+static bool test_sha256_vectors(struct torture_context *tctx)
+{
+	struct {
+		const char *data;
+		size_t repeat;
+		const char *sha256;
+	} testarray[] = {
+	{
+		.data	= "",
+		.repeat	= 1,
+		.sha256	= "e3b0c44298fc1c149afbf4c8996fb924"
+			  "27ae41e4649b934ca495991b7852b855"
+	},{
+		.data	= "abc",
+		.repeat	= 1,
+		.sha256	= "ba7816bf8f01cfea414140de5dae2223"
+			  "b00361a396177a9cb410ff61f20015ad"
+	},{
+		.data	= "abcdbcdecdefdefgefghfghighijhijk"
+			  "ijkljklmklmnlmnomnopnopq",
+		.repeat	= 1,
+		.sha256	= "248d6a61d20638b8e5c026930c3e6039"
+			  "a33ce45964ff2167f6ecedd419db06c1"
+	},{
+		.data	= "a",
+		.repeat	= 1000000,
+		.sha256	= "cdc76e5c9914fb9281a1c7e284d73e67"
+			  "f1809a48a497200e046d39ccc7112cd0"
+	}
+	};
+	const size_t pieces[] = { 0, 1, 55, 63, 64, 65, 4096 };
+	bool ret = true;
+	int impl;
+	uint32_t i, j;
+
+	for (impl = 0; impl < 2; impl++) {
+		if (!samba_SHA256_select_impl(impl == 1)) {
+			torture_comment(tctx, "no accelerated SHA-256 on "
+					"this CPU\n");
+			continue;
+		}
+		for (i = 0; i < ARRAY_SIZE(testarray); i++) {
+			size_t len = strlen(testarray[i].data);
+			size_t total = len * testarray[i].repeat;
+			uint8_t *buf;
+
+			buf = talloc_array(tctx, uint8_t, total + 1);
+			torture_assert(tctx, buf != NULL, "talloc_array");
+			for (j = 0; j < testarray[i].repeat; j++) {
+				memcpy(buf + j * len, testarray[i].data, len);
+			}
+
+			for (j = 0; j < ARRAY_SIZE(pieces); j++) {
+				SHA256_CTX ctx;
+				uint8_t digest[SHA256_DIGEST_LENGTH];
+				size_t ofs = 0;
+
+				samba_SHA256_Init(&ctx);
+				while (ofs < total) {
+					size_t n = pieces[j] ? pieces[j] : total;
+
+					n = MIN(n, total - ofs);
+					samba_SHA256_Update(&ctx, buf + ofs, n);
+					ofs += n;
+				}
+				samba_SHA256_Final(digest, &ctx);
+
+				ret &= check_digest(tctx, digest, sizeof(digest),
+						    testarray[i].sha256,
+						    talloc_asprintf(tctx,
+							"sha256 impl %d test[%u] "
+							"pieces %u", impl, i,
+							(unsigned)pieces[j]));
+			}
+			talloc_free(buf);
+		}
+	}
+	samba_SHA256_select_impl(true);
+
+	return ret;
+}
+
+/*
+ This uses the test values from RFC 4231 (test case 5 truncates the
+ output and is left out)
+*/
+static bool test_hmac_sha256_vectors(struct torture_context *tctx)
+{
+	struct {
+		const char *key;
+		const char *data;
+		const char *hmac;
+	} testarray[] = {
+	{
+		.key	= "0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b",
+		.data	= "4869205468657265",
+		.hmac	= "b0344c61d8db38535ca8afceaf0bf12b"
+			  "881dc200c9833da726e9376c2e32cff7"
+	},{
+		.key	= "4a656665",
+		.data	= "7768617420646f2079612077616e7420"
+			  "666f72206e6f7468696e673f",
+		.hmac	= "5bdcc146bf60754e6a042426089575c7"
+			  "5a003f089d2739839dec58b964ec3843"
+	},{
+		.key	= "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa",
+		.data	= "dddddddddddddddddddddddddddddddddddddddddddddddddd"
+			  "dddddddddddddddddddddddddddddddddddddddddddddddddd",
+		.hmac	= "773ea91e36800e46854db8ebd09181a7"
+			  "2959098b3ef8c122d9635514ced565fe"
+	},{
+		.key	= "0102030405060708090a0b0c0d0e0f10111213141516171819",
+		.data	= "cdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcd"
+			  "cdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcd",
+		.hmac	= "82558a389a443c0ea4cc819899f2083a"
+			  "85f0faa3e578f8077a2e3ff46729665b"
+	},{
+		.key	= "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+			  "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+			  "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+			  "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+			  "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+			  "aaaaaaaaaaaa",
+		.data	= "54657374205573696e67204c61726765"
+			  "72205468616e20426c6f636b2d53697a"
+			  "65204b6579202d2048617368204b6579"
+			  "204669727374",
+		.hmac	= "60e431591ee0b67f0d8a26aacbf5b77f"
+			  "8e0bc6213728c5140546040f0ee37f54"
+	}
+	};
+	bool ret = true;
+	uint32_t i;
+
+	for (i = 0; i < ARRAY_SIZE(testarray); i++) {
+		struct HMACSHA256Context ctx;
+		uint8_t digest[SHA256_DIGEST_LENGTH];
+		DATA_BLOB key = strhex_to_data_blob(tctx, testarray[i].key);
+		DATA_BLOB data = strhex_to_data_blob(tctx, testarray[i].data);
+
+		hmac_sha256_init(key.data, key.length, &ctx);
+		hmac_sha256_update(data.data, data.length, &ctx);
+		hmac_sha256_final(digest, &ctx);
+
+		ret &= check_digest(tctx, digest, sizeof(digest),
+				    testarray[i].hmac,
+				    talloc_asprintf(tctx, "hmac_sha256 test[%u]",
+						    i));
+	}
+
+	return ret;
+}
+
+/*
+ the accelerated and portable block functions must agree for every
+ length and split point around the block boundaries
+*/
+static bool test_sha256_impls_agree(struct torture_context *tctx)
+{
+	uint8_t buf[300];
+	size_t len, split;
+
+	if (!samba_SHA256_select_impl(true)) {
+		torture_skip(tctx, "no accelerated SHA-256 on this CPU\n");
+	}
+
+	for (len = 0; len < sizeof(buf); len++) {
+		buf[len] = (uint8_t)(len * 131 + 7);
+	}
+
+	for (len = 0; len < sizeof(buf); len++) {
+		for (split = 0; split <= len; split += 13) {
+			uint8_t d[2][SHA256_DIGEST_LENGTH];
+			int impl;
+
+			for (impl = 0; impl < 2; impl++) {
+				SHA256_CTX ctx;
+
+				samba_SHA256_select_impl(impl == 1);
+				samba_SHA256_Init(&ctx);
+				samba_SHA256_Update(&ctx, buf, split);
+				samba_SHA256_Update(&ctx, buf + split,
+						    len - split);
+				samba_SHA256_Final(d[impl], &ctx);
+			}
+			torture_assert(tctx, memcmp(d[0], d[1], sizeof(d[0])) == 0,
+				       talloc_asprintf(tctx, "len %u split %u",
+						       (unsigned)len,
+						       (unsigned)split));
+		}
+	}
+	samba_SHA256_select_impl(true);
+
+	return true;
+}
+
+static double bench_mb_per_sec(struct torture_context *tctx,
+			       const uint8_t *buf, size_t len, bool hmac)
+{
+	const double timelimit = torture_setting_int(tctx, "timelimit", 1);
+	struct timeval tv = timeval_current();
+	size_t total = 0;
+
+	while (timeval_elapsed(&tv) < timelimit) {
+		uint8_t digest[SHA256_DIGEST_LENGTH];
+		int i;
+
+		for (i = 0; i < 16; i++) {
+			if (hmac) {
+				struct HMACSHA256Context ctx;
+
+				hmac_sha256_init(buf, 16, &ctx);
+				hmac_sha256_update(buf, len, &ctx);
+				hmac_sha256_final(digest, &ctx);
+			} else {
+				SHA256_CTX ctx;
+
+				samba_SHA256_Init(&ctx);
+				samba_SHA256_Update(&ctx, buf, len);
+				samba_SHA256_Final(digest, &ctx);
+			}
+			total += len;
+		}
+	}
+
+	return total / timeval_elapsed(&tv) / 1e6;
+}
+
+#ifdef HAVE_PTHREAD
+
+struct bench_sign_job {
+	const uint8_t *buf;
+	size_t len;
+	int count;
+};
+
+static void *bench_sign_thread(void *private_data)
+{
+	struct bench_sign_job *job = (struct bench_sign_job *)private_data;
+	int i;
+
+	for (i = 0; i < job->count; i++) {
+		struct HMACSHA256Context ctx;
+		uint8_t digest[SHA256_DIGEST_LENGTH];
+
+		hmac_sha256_init(job->buf, 16, &ctx);
+		hmac_sha256_update(job->buf, job->len, &ctx);
+		hmac_sha256_final(digest, &ctx);
+	}
+	return NULL;
+}
+
+/*
+ sign count messages of len bytes spread over num_threads threads, the
+ way smbd hands large replies to its signing threads
+*/
+static double bench_sign_threads(struct torture_context *tctx,
+				 const uint8_t *buf, size_t len,
+				 int count, int num_threads)
+{
+	pthread_t *threads;
+	struct bench_sign_job job;
+	struct timeval tv;
+	int i, started = 0;
+
+	threads = talloc_array(tctx, pthread_t, num_threads);
+	if (threads == NULL) {
+		return -1;
+	}
+	job.buf = buf;
+	job.len = len;
+	job.count = count / num_threads;
+
+	tv = timeval_current();
+	for (i = 0; i < num_threads; i++) {
+		if (pthread_create(&threads[i], NULL, bench_sign_thread,
+				   &job) != 0) {
+			break;
+		}
+		started++;
+	}
+	for (i = 0; i < started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	talloc_free(threads);
+	if (started != num_threads) {
+		return -1;
+	}
+
+	return (double)job.count * num_threads * len /
+		timeval_elapsed(&tv) / 1e6;
+}
+
+#endif /* HAVE_PTHREAD */
+
+/*
+ report SHA-256 and HMAC-SHA256 throughput for SMB2-sized messages,
+ with the portable and the accelerated block functions, and the rate
+ at which a pool of threads signs 1MB READ responses
+*/
+static bool test_sha256_speed(struct torture_context *tctx)
+{
+	const size_t sizes[] = { 64, 1024, 65536, 1024*1024 };
+	uint8_t *buf;
+	int impl;
+	uint32_t i;
+
+	buf = talloc_zero_array(tctx, uint8_t, 1024*1024);
+	torture_assert(tctx, buf != NULL, "talloc_zero_array");
+
+	for (impl = 0; impl < 2; impl++) {
+		if (!samba_SHA256_select_impl(impl == 1)) {
+			torture_comment(tctx, "no accelerated SHA-256 on "
+					"this CPU\n");
+			continue;
+		}
+		for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+			torture_comment(tctx, "%s %7u bytes: sha256 %7.1f MB/sec, "
+					"hmac %7.1f MB/sec\n",
+					impl ? "accelerated" : "portable   ",
+					(unsigned)sizes[i],
+					bench_mb_per_sec(tctx, buf, sizes[i],
+							 false),
+					bench_mb_per_sec(tctx, buf, sizes[i],
+							 true));
+		}
+	}
+	samba_SHA256_select_impl(true);
+
+#ifdef HAVE_PTHREAD
+	{
+		int max_threads = torture_setting_int(tctx, "threads", 4);
+		int n;
+
+		for (n = 1; n <= max_threads; n *= 2) {
+			double rate = bench_sign_threads(tctx, buf, 1024*1024,
+							 64, n);
+
+			torture_assert(tctx, rate >= 0, "pthread_create");
+			torture_comment(tctx, "signing 1MB messages in %d "
+					"thread(s): %7.1f MB/sec\n", n, rate);
+		}
+	}
+#endif
+
+	return true;
+}
+
+struct torture_suite *torture_local_crypto_sha256(TALLOC_CTX *mem_ctx)
+{
+	struct torture_suite *suite = torture_suite_create(mem_ctx,
+							   "crypto.sha256");
+
+	torture_suite_add_simple_test(suite, "vectors", test_sha256_vectors);
+	torture_suite_add_simple_test(suite, "hmac vectors",
+				      test_hmac_sha256_vectors);
+	torture_suite_add_simple_test(suite, "impls agree",
+				      test_sha256_impls_agree);
+	torture_suite_add_simple_test(suite, "speed", test_sha256_speed);
+
+	return suite;
+}
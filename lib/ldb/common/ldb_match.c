@@ -75,29 +75,364 @@ static int ldb_match_scope(struct ldb_context *ldb,
 }
 
 
+/*
+  bitwise-and comparator
+*/
+static int ldb_comparator_bitmask(const char *oid, const struct ldb_val *v1, const struct ldb_val *v2,
+				  bool *matched)
+{
+	uint64_t i1, i2;
+	char ibuf[100];
+	char *endptr = NULL;
+
+	if (v1->length >= sizeof(ibuf)-1) {
+		return LDB_ERR_INVALID_ATTRIBUTE_SYNTAX;
+	}
+	memcpy(ibuf, (char *)v1->data, v1->length);
+	ibuf[v1->length] = 0;
+	i1 = strtoull(ibuf, &endptr, 0);
+	if (endptr != NULL) {
+		if (endptr == ibuf || *endptr != 0) {
+			return LDB_ERR_INVALID_ATTRIBUTE_SYNTAX;
+		}
+	}
+
+	if (v2->length >= sizeof(ibuf)-1) {
+		return LDB_ERR_INVALID_ATTRIBUTE_SYNTAX;
+	}
+	endptr = NULL;
+	memcpy(ibuf, (char *)v2->data, v2->length);
+	ibuf[v2->length] = 0;
+	i2 = strtoull(ibuf, &endptr, 0);
+	if (endptr != NULL) {
+		if (endptr == ibuf || *endptr != 0) {
+			return LDB_ERR_INVALID_ATTRIBUTE_SYNTAX;
+		}
+	}
+	if (strcmp(LDB_OID_COMPARATOR_AND, oid) == 0) {
+		*matched = ((i1 & i2) == i2);
+	} else if (strcmp(LDB_OID_COMPARATOR_OR, oid) == 0) {
+		*matched = ((i1 & i2) != 0);
+	} else {
+		return LDB_ERR_INAPPROPRIATE_MATCHING;
+	}
+	return LDB_SUCCESS;
+}
+
+/*
+  always return false
+*/
+static int ldb_comparator_false(const char *oid, const struct ldb_val *v1, const struct ldb_val *v2,
+				bool *matched)
+{
+	*matched = false;
+	return LDB_SUCCESS;
+}
+
+
+/*
+  a compiled filter. The parse tree is flattened into an array of
+  instructions in prefix order, with the attribute handlers looked up
+  and the filter values canonicalised once, instead of again for every
+  message and every value that is compared. The program points into
+  the parse tree, which has to outlive it.
+*/
+struct ldb_match_insn {
+	const struct ldb_parse_tree *tree;
+	/* index of the first instruction after this subtree */
+	unsigned int next;
+	const struct ldb_schema_attribute *a;
+	/* the filter value, canonicalised when that compares the same */
+	struct ldb_val value;
+	/* a (dn=...) match, compared against the message DN */
+	bool match_dn;
+	/* the filter value parsed as a DN, for dn= matches and
+	   attributes of the standard DN syntax */
+	struct ldb_dn *dn;
+	/* canonicalised substring chunks, NULL if one could not be
+	   canonicalised, in which case no value matches */
+	struct ldb_val *chunks;
+	int (*comparator)(const char *, const struct ldb_val *,
+			  const struct ldb_val *, bool *);
+	/* error to return when the node is evaluated */
+	int error;
+};
+
+struct ldb_match_program {
+	struct ldb_context *ldb;
+	unsigned int num_insns;
+	struct ldb_match_insn *insns;
+};
+
+/*
+  canonicalise the chunks of a substring filter
+*/
+static struct ldb_val *ldb_wildcard_chunks(struct ldb_context *ldb,
+					   TALLOC_CTX *mem_ctx,
+					   const struct ldb_schema_attribute *a,
+					   const struct ldb_parse_tree *tree)
+{
+	struct ldb_val *chunks;
+	unsigned int i, n;
+
+	for (n = 0; tree->u.substring.chunks && tree->u.substring.chunks[n]; n++) ;
+
+	chunks = talloc_array(mem_ctx, struct ldb_val, n);
+	if (chunks == NULL) {
+		return NULL;
+	}
+
+	for (i = 0; i < n; i++) {
+		if (a->syntax->canonicalise_fn(ldb, chunks,
+					       tree->u.substring.chunks[i],
+					       &chunks[i]) != 0) {
+			talloc_free(chunks);
+			return NULL;
+		}
+	}
+
+	return chunks;
+}
+
+/*
+  look up the comparator of an extended match
+*/
+static int ldb_match_extended_comparator(struct ldb_context *ldb,
+					 const struct ldb_parse_tree *tree,
+					 int (**comp)(const char *, const struct ldb_val *,
+						      const struct ldb_val *, bool *))
+{
+	unsigned int i;
+	const struct {
+		const char *oid;
+		int (*comparator)(const char *, const struct ldb_val *, const struct ldb_val *, bool *);
+	} rules[] = {
+		{ LDB_OID_COMPARATOR_AND, ldb_comparator_bitmask},
+		{ LDB_OID_COMPARATOR_OR, ldb_comparator_bitmask},
+		{ SAMBA_LDAP_MATCH_ALWAYS_FALSE, ldb_comparator_false}
+	};
+
+	if (tree->u.extended.dnAttributes) {
+		/* FIXME: We really need to find out what this ":dn" part in
+		 * an extended match means and how to handle it. For now print
+		 * only a warning to have s3 winbind and other tools working
+		 * against us. - Matthias */
+		ldb_debug(ldb, LDB_DEBUG_WARNING, "ldb: dnAttributes extended match not supported yet");
+	}
+	if (tree->u.extended.rule_id == NULL) {
+		ldb_debug(ldb, LDB_DEBUG_ERROR, "ldb: no-rule extended matches not supported yet");
+		return LDB_ERR_INAPPROPRIATE_MATCHING;
+	}
+	if (tree->u.extended.attr == NULL) {
+		ldb_debug(ldb, LDB_DEBUG_ERROR, "ldb: no-attribute extended matches not supported yet");
+		return LDB_ERR_INAPPROPRIATE_MATCHING;
+	}
+
+	for (i=0;i<ARRAY_SIZE(rules);i++) {
+		if (strcmp(rules[i].oid, tree->u.extended.rule_id) == 0) {
+			*comp = rules[i].comparator;
+			return LDB_SUCCESS;
+		}
+	}
+
+	ldb_debug(ldb, LDB_DEBUG_ERROR, "ldb: unknown extended rule_id %s",
+		  tree->u.extended.rule_id);
+	return LDB_ERR_INAPPROPRIATE_MATCHING;
+}
+
+/*
+  use the canonical form of a filter value if the syntax compares it
+  the same as the original, so comparisons don't canonicalise it again
+*/
+static void ldb_match_compile_value(struct ldb_context *ldb,
+				    TALLOC_CTX *mem_ctx,
+				    struct ldb_match_insn *insn,
+				    const struct ldb_val *value)
+{
+	const struct ldb_schema_attribute *a = insn->a;
+	struct ldb_val v;
+
+	insn->value = *value;
+
+	if (a == NULL || a->syntax->operator_fn != NULL) {
+		return;
+	}
+	if (a->syntax->canonicalise_fn(ldb, mem_ctx, value, &v) != 0) {
+		return;
+	}
+	if (a->syntax->comparison_fn(ldb, mem_ctx, value, &v) != 0) {
+		if (v.data != value->data) {
+			talloc_free(v.data);
+		}
+		return;
+	}
+	insn->value = v;
+}
+
+static unsigned int ldb_match_count_nodes(const struct ldb_parse_tree *tree)
+{
+	unsigned int i, n = 1;
+
+	switch (tree->operation) {
+	case LDB_OP_AND:
+	case LDB_OP_OR:
+		for (i = 0; i < tree->u.list.num_elements; i++) {
+			n += ldb_match_count_nodes(tree->u.list.elements[i]);
+		}
+		break;
+	case LDB_OP_NOT:
+		n += ldb_match_count_nodes(tree->u.isnot.child);
+		break;
+	default:
+		break;
+	}
+
+	return n;
+}
+
+static void ldb_match_compile_node(struct ldb_match_program *prog,
+				   const struct ldb_parse_tree *tree,
+				   unsigned int *idx)
+{
+	struct ldb_context *ldb = prog->ldb;
+	struct ldb_match_insn *insn = &prog->insns[(*idx)++];
+	const struct ldb_schema_syntax *dn_syntax;
+	unsigned int i;
+
+	insn->tree = tree;
+
+	switch (tree->operation) {
+	case LDB_OP_AND:
+	case LDB_OP_OR:
+		for (i = 0; i < tree->u.list.num_elements; i++) {
+			ldb_match_compile_node(prog, tree->u.list.elements[i], idx);
+		}
+		break;
+
+	case LDB_OP_NOT:
+		ldb_match_compile_node(prog, tree->u.isnot.child, idx);
+		break;
+
+	case LDB_OP_EQUALITY:
+		if (ldb_attr_dn(tree->u.equality.attr) == 0) {
+			insn->match_dn = true;
+			insn->dn = ldb_dn_from_ldb_val(prog, ldb,
+						       &tree->u.equality.value);
+			if (insn->dn == NULL) {
+				insn->error = LDB_ERR_INVALID_DN_SYNTAX;
+			}
+			break;
+		}
+		insn->a = ldb_schema_attribute_by_name(ldb, tree->u.equality.attr);
+		if (insn->a == NULL) {
+			break;
+		}
+		dn_syntax = ldb_standard_syntax_by_name(ldb, LDB_SYNTAX_DN);
+		if (insn->a->syntax == dn_syntax) {
+			/* parse the filter DN once rather than for
+			   every value it is compared with */
+			insn->dn = ldb_dn_from_ldb_val(prog, ldb,
+						       &tree->u.equality.value);
+			if (!ldb_dn_validate(insn->dn)) {
+				TALLOC_FREE(insn->dn);
+			}
+		}
+		ldb_match_compile_value(ldb, prog, insn, &tree->u.equality.value);
+		break;
+
+	case LDB_OP_GREATER:
+	case LDB_OP_LESS:
+		insn->a = ldb_schema_attribute_by_name(ldb, tree->u.comparison.attr);
+		ldb_match_compile_value(ldb, prog, insn, &tree->u.comparison.value);
+		break;
+
+	case LDB_OP_APPROX:
+		/* FIXME: APPROX comparison not handled yet */
+		insn->error = LDB_ERR_INAPPROPRIATE_MATCHING;
+		break;
+
+	case LDB_OP_PRESENT:
+		if (ldb_attr_dn(tree->u.present.attr) == 0) {
+			insn->match_dn = true;
+			break;
+		}
+		insn->a = ldb_schema_attribute_by_name(ldb, tree->u.present.attr);
+		break;
+
+	case LDB_OP_SUBSTRING:
+		insn->a = ldb_schema_attribute_by_name(ldb, tree->u.substring.attr);
+		if (insn->a != NULL) {
+			insn->chunks = ldb_wildcard_chunks(ldb, prog, insn->a, tree);
+		}
+		break;
+
+	case LDB_OP_EXTENDED:
+		insn->error = ldb_match_extended_comparator(ldb, tree,
+							    &insn->comparator);
+		break;
+
+	default:
+		insn->error = LDB_ERR_INAPPROPRIATE_MATCHING;
+		break;
+	}
+
+	insn->next = *idx;
+}
+
+/*
+  compile a parse tree into a program that can be run against many
+  messages with ldb_match_program_run(). The tree must outlive the
+  program
+*/
+int ldb_match_program_compile(struct ldb_context *ldb,
+			      TALLOC_CTX *mem_ctx,
+			      const struct ldb_parse_tree *tree,
+			      struct ldb_match_program **program)
+{
+	struct ldb_match_program *prog;
+	unsigned int idx = 0;
+
+	prog = talloc_zero(mem_ctx, struct ldb_match_program);
+	if (prog == NULL) {
+		return ldb_oom(ldb);
+	}
+	prog->ldb = ldb;
+	prog->num_insns = ldb_match_count_nodes(tree);
+	prog->insns = talloc_zero_array(prog, struct ldb_match_insn,
+					prog->num_insns);
+	if (prog->insns == NULL) {
+		talloc_free(prog);
+		return ldb_oom(ldb);
+	}
+
+	ldb_match_compile_node(prog, tree, &idx);
+
+	*program = prog;
+	return LDB_SUCCESS;
+}
+
 /*
   match if node is present
 */
 static int ldb_match_present(struct ldb_context *ldb, 
 			     const struct ldb_message *msg,
-			     const struct ldb_parse_tree *tree,
-			     enum ldb_scope scope, bool *matched)
+			     const struct ldb_match_insn *insn,
+			     bool *matched)
 {
-	const struct ldb_schema_attribute *a;
+	const struct ldb_schema_attribute *a = insn->a;
 	struct ldb_message_element *el;
 
-	if (ldb_attr_dn(tree->u.present.attr) == 0) {
+	if (insn->match_dn) {
 		*matched = true;
 		return LDB_SUCCESS;
 	}
 
-	el = ldb_msg_find_element(msg, tree->u.present.attr);
+	el = ldb_msg_find_element(msg, insn->tree->u.present.attr);
 	if (el == NULL) {
 		*matched = false;
 		return LDB_SUCCESS;
 	}
 
-	a = ldb_schema_attribute_by_name(ldb, el->name);
 	if (!a) {
 		return LDB_ERR_INVALID_ATTRIBUTE_SYNTAX;
 	}
@@ -119,26 +454,19 @@ static int ldb_match_present(struct ldb_context *ldb,
 
 static int ldb_match_comparison(struct ldb_context *ldb, 
 				const struct ldb_message *msg,
-				const struct ldb_parse_tree *tree,
-				enum ldb_scope scope,
+				const struct ldb_match_insn *insn,
 				enum ldb_parse_op comp_op, bool *matched)
 {
 	unsigned int i;
 	struct ldb_message_element *el;
-	const struct ldb_schema_attribute *a;
-
-	/* FIXME: APPROX comparison not handled yet */
-	if (comp_op == LDB_OP_APPROX) {
-		return LDB_ERR_INAPPROPRIATE_MATCHING;
-	}
+	const struct ldb_schema_attribute *a = insn->a;
 
-	el = ldb_msg_find_element(msg, tree->u.comparison.attr);
+	el = ldb_msg_find_element(msg, insn->tree->u.comparison.attr);
 	if (el == NULL) {
 		*matched = false;
 		return LDB_SUCCESS;
 	}
 
-	a = ldb_schema_attribute_by_name(ldb, el->name);
 	if (!a) {
 		return LDB_ERR_INVALID_ATTRIBUTE_SYNTAX;
 	}
@@ -146,11 +474,11 @@ static int ldb_match_comparison(struct ldb_context *ldb,
 	for (i = 0; i < el->num_values; i++) {
 		if (a->syntax->operator_fn) {
 			int ret;
-			ret = a->syntax->operator_fn(ldb, comp_op, a, &el->values[i], &tree->u.comparison.value, matched);
+			ret = a->syntax->operator_fn(ldb, comp_op, a, &el->values[i], &insn->value, matched);
 			if (ret != LDB_SUCCESS) return ret;
 			if (*matched) return LDB_SUCCESS;
 		} else {
-			int ret = a->syntax->comparison_fn(ldb, ldb, &el->values[i], &tree->u.comparison.value);
+			int ret = a->syntax->comparison_fn(ldb, ldb, &el->values[i], &insn->value);
 
 			if (ret == 0) {
 				*matched = true;
@@ -176,39 +504,27 @@ static int ldb_match_comparison(struct ldb_context *ldb,
 */
 static int ldb_match_equality(struct ldb_context *ldb, 
 			      const struct ldb_message *msg,
-			      const struct ldb_parse_tree *tree,
-			      enum ldb_scope scope,
+			      const struct ldb_match_insn *insn,
 			      bool *matched)
 {
 	unsigned int i;
 	struct ldb_message_element *el;
-	const struct ldb_schema_attribute *a;
-	struct ldb_dn *valuedn;
+	const struct ldb_schema_attribute *a = insn->a;
 	int ret;
 
-	if (ldb_attr_dn(tree->u.equality.attr) == 0) {
-		valuedn = ldb_dn_from_ldb_val(ldb, ldb, &tree->u.equality.value);
-		if (valuedn == NULL) {
-			return LDB_ERR_INVALID_DN_SYNTAX;
-		}
-
-		ret = ldb_dn_compare(msg->dn, valuedn);
-
-		talloc_free(valuedn);
-
-		*matched = (ret == 0);
+	if (insn->match_dn) {
+		*matched = (ldb_dn_compare(msg->dn, insn->dn) == 0);
 		return LDB_SUCCESS;
 	}
 
 	/* TODO: handle the "*" case derived from an extended search
 	   operation without the attibute type defined */
-	el = ldb_msg_find_element(msg, tree->u.equality.attr);
+	el = ldb_msg_find_element(msg, insn->tree->u.equality.attr);
 	if (el == NULL) {
 		*matched = false;
 		return LDB_SUCCESS;
 	}
 
-	a = ldb_schema_attribute_by_name(ldb, el->name);
 	if (a == NULL) {
 		return LDB_ERR_INVALID_ATTRIBUTE_SYNTAX;
 	}
@@ -216,11 +532,22 @@ static int ldb_match_equality(struct ldb_context *ldb,
 	for (i=0;i<el->num_values;i++) {
 		if (a->syntax->operator_fn) {
 			ret = a->syntax->operator_fn(ldb, LDB_OP_EQUALITY, a,
-						     &tree->u.equality.value, &el->values[i], matched);
+						     &insn->value, &el->values[i], matched);
 			if (ret != LDB_SUCCESS) return ret;
 			if (*matched) return LDB_SUCCESS;
+		} else if (insn->dn != NULL) {
+			struct ldb_dn *dn;
+
+			dn = ldb_dn_from_ldb_val(ldb, ldb, &el->values[i]);
+			if (ldb_dn_validate(dn) &&
+			    ldb_dn_compare(insn->dn, dn) == 0) {
+				talloc_free(dn);
+				*matched = true;
+				return LDB_SUCCESS;
+			}
+			talloc_free(dn);
 		} else {
-			if (a->syntax->comparison_fn(ldb, ldb, &tree->u.equality.value,
+			if (a->syntax->comparison_fn(ldb, ldb, &insn->value,
 						     &el->values[i]) == 0) {
 				*matched = true;
 				return LDB_SUCCESS;
@@ -234,64 +561,54 @@ static int ldb_match_equality(struct ldb_context *ldb,
 
 static int ldb_wildcard_compare(struct ldb_context *ldb,
 				const struct ldb_parse_tree *tree,
+				const struct ldb_schema_attribute *a,
+				const struct ldb_val *chunks,
 				const struct ldb_val value, bool *matched)
 {
-	const struct ldb_schema_attribute *a;
 	struct ldb_val val;
-	struct ldb_val cnk;
-	struct ldb_val *chunk;
+	const struct ldb_val *cnk;
 	char *p, *g;
 	uint8_t *save_p = NULL;
 	unsigned int c = 0;
 
-	a = ldb_schema_attribute_by_name(ldb, tree->u.substring.attr);
-	if (!a) {
-		return LDB_ERR_INVALID_ATTRIBUTE_SYNTAX;
-	}
-
 	if (a->syntax->canonicalise_fn(ldb, ldb, &value, &val) != 0) {
 		return LDB_ERR_INVALID_ATTRIBUTE_SYNTAX;
 	}
 
 	save_p = val.data;
-	cnk.data = NULL;
+
+	if (chunks == NULL) goto mismatch;
 
 	if ( ! tree->u.substring.start_with_wildcard ) {
 
-		chunk = tree->u.substring.chunks[c];
-		if (a->syntax->canonicalise_fn(ldb, ldb, chunk, &cnk) != 0) goto mismatch;
+		cnk = &chunks[c];
 
 		/* This deals with wildcard prefix searches on binary attributes (eg objectGUID) */
-		if (cnk.length > val.length) {
+		if (cnk->length > val.length) {
 			goto mismatch;
 		}
-		if (memcmp((char *)val.data, (char *)cnk.data, cnk.length) != 0) goto mismatch;
-		val.length -= cnk.length;
-		val.data += cnk.length;
+		if (memcmp((char *)val.data, (char *)cnk->data, cnk->length) != 0) goto mismatch;
+		val.length -= cnk->length;
+		val.data += cnk->length;
 		c++;
-		talloc_free(cnk.data);
-		cnk.data = NULL;
 	}
 
 	while (tree->u.substring.chunks[c]) {
 
-		chunk = tree->u.substring.chunks[c];
-		if(a->syntax->canonicalise_fn(ldb, ldb, chunk, &cnk) != 0) goto mismatch;
+		cnk = &chunks[c];
 
 		/* FIXME: case of embedded nulls */
-		p = strstr((char *)val.data, (char *)cnk.data);
+		p = strstr((char *)val.data, (char *)cnk->data);
 		if (p == NULL) goto mismatch;
 		if ( (! tree->u.substring.chunks[c + 1]) && (! tree->u.substring.end_with_wildcard) ) {
 			do { /* greedy */
-				g = strstr((char *)p + cnk.length, (char *)cnk.data);
+				g = strstr((char *)p + cnk->length, (char *)cnk->data);
 				if (g) p = g;
 			} while(g);
 		}
-		val.length = val.length - (p - (char *)(val.data)) - cnk.length;
-		val.data = (uint8_t *)(p + cnk.length);
+		val.length = val.length - (p - (char *)(val.data)) - cnk->length;
+		val.data = (uint8_t *)(p + cnk->length);
 		c++;
-		talloc_free(cnk.data);
-		cnk.data = NULL;
 	}
 
 	/* last chunk may not have reached end of string */
@@ -303,7 +620,6 @@ static int ldb_wildcard_compare(struct ldb_context *ldb,
 mismatch:
 	*matched = false;
 	talloc_free(save_p);
-	talloc_free(cnk.data);
 	return LDB_SUCCESS;
 }
 
@@ -312,21 +628,26 @@ mismatch:
 */
 static int ldb_match_substring(struct ldb_context *ldb, 
 			       const struct ldb_message *msg,
-			       const struct ldb_parse_tree *tree,
-			       enum ldb_scope scope, bool *matched)
+			       const struct ldb_match_insn *insn,
+			       bool *matched)
 {
 	unsigned int i;
 	struct ldb_message_element *el;
 
-	el = ldb_msg_find_element(msg, tree->u.substring.attr);
+	el = ldb_msg_find_element(msg, insn->tree->u.substring.attr);
 	if (el == NULL) {
 		*matched = false;
 		return LDB_SUCCESS;
 	}
 
+	if (!insn->a) {
+		return LDB_ERR_INVALID_ATTRIBUTE_SYNTAX;
+	}
+
 	for (i = 0; i < el->num_values; i++) {
 		int ret;
-		ret = ldb_wildcard_compare(ldb, tree, el->values[i], matched);
+		ret = ldb_wildcard_compare(ldb, insn->tree, insn->a, insn->chunks,
+					   el->values[i], matched);
 		if (ret != LDB_SUCCESS) return ret;
 		if (*matched) return LDB_SUCCESS;
 	}
@@ -335,109 +656,17 @@ static int ldb_match_substring(struct ldb_context *ldb,
 	return LDB_SUCCESS;
 }
 
-
-/*
-  bitwise-and comparator
-*/
-static int ldb_comparator_bitmask(const char *oid, const struct ldb_val *v1, const struct ldb_val *v2,
-				  bool *matched)
-{
-	uint64_t i1, i2;
-	char ibuf[100];
-	char *endptr = NULL;
-
-	if (v1->length >= sizeof(ibuf)-1) {
-		return LDB_ERR_INVALID_ATTRIBUTE_SYNTAX;
-	}
-	memcpy(ibuf, (char *)v1->data, v1->length);
-	ibuf[v1->length] = 0;
-	i1 = strtoull(ibuf, &endptr, 0);
-	if (endptr != NULL) {
-		if (endptr == ibuf || *endptr != 0) {
-			return LDB_ERR_INVALID_ATTRIBUTE_SYNTAX;
-		}
-	}
-
-	if (v2->length >= sizeof(ibuf)-1) {
-		return LDB_ERR_INVALID_ATTRIBUTE_SYNTAX;
-	}
-	endptr = NULL;
-	memcpy(ibuf, (char *)v2->data, v2->length);
-	ibuf[v2->length] = 0;
-	i2 = strtoull(ibuf, &endptr, 0);
-	if (endptr != NULL) {
-		if (endptr == ibuf || *endptr != 0) {
-			return LDB_ERR_INVALID_ATTRIBUTE_SYNTAX;
-		}
-	}
-	if (strcmp(LDB_OID_COMPARATOR_AND, oid) == 0) {
-		*matched = ((i1 & i2) == i2);
-	} else if (strcmp(LDB_OID_COMPARATOR_OR, oid) == 0) {
-		*matched = ((i1 & i2) != 0);
-	} else {
-		return LDB_ERR_INAPPROPRIATE_MATCHING;
-	}
-	return LDB_SUCCESS;
-}
-
-/*
-  always return false
-*/
-static int ldb_comparator_false(const char *oid, const struct ldb_val *v1, const struct ldb_val *v2,
-				bool *matched)
-{
-	*matched = false;
-	return LDB_SUCCESS;
-}
-
-
 /*
   extended match, handles things like bitops
 */
 static int ldb_match_extended(struct ldb_context *ldb, 
 			      const struct ldb_message *msg,
-			      const struct ldb_parse_tree *tree,
-			      enum ldb_scope scope, bool *matched)
+			      const struct ldb_match_insn *insn,
+			      bool *matched)
 {
-	unsigned int i;
-	const struct {
-		const char *oid;
-		int (*comparator)(const char *, const struct ldb_val *, const struct ldb_val *, bool *);
-	} rules[] = {
-		{ LDB_OID_COMPARATOR_AND, ldb_comparator_bitmask},
-		{ LDB_OID_COMPARATOR_OR, ldb_comparator_bitmask},
-		{ SAMBA_LDAP_MATCH_ALWAYS_FALSE, ldb_comparator_false}
-	};
-	int (*comp)(const char *,const struct ldb_val *, const struct ldb_val *, bool *) = NULL;
+	const struct ldb_parse_tree *tree = insn->tree;
 	struct ldb_message_element *el;
-
-	if (tree->u.extended.dnAttributes) {
-		/* FIXME: We really need to find out what this ":dn" part in
-		 * an extended match means and how to handle it. For now print
-		 * only a warning to have s3 winbind and other tools working
-		 * against us. - Matthias */
-		ldb_debug(ldb, LDB_DEBUG_WARNING, "ldb: dnAttributes extended match not supported yet");
-	}
-	if (tree->u.extended.rule_id == NULL) {
-		ldb_debug(ldb, LDB_DEBUG_ERROR, "ldb: no-rule extended matches not supported yet");
-		return LDB_ERR_INAPPROPRIATE_MATCHING;
-	}
-	if (tree->u.extended.attr == NULL) {
-		ldb_debug(ldb, LDB_DEBUG_ERROR, "ldb: no-attribute extended matches not supported yet");
-		return LDB_ERR_INAPPROPRIATE_MATCHING;
-	}
-
-	for (i=0;i<ARRAY_SIZE(rules);i++) {
-		if (strcmp(rules[i].oid, tree->u.extended.rule_id) == 0) {
-			comp = rules[i].comparator;
-			break;
-		}
-	}
-	if (comp == NULL) {
-		ldb_debug(ldb, LDB_DEBUG_ERROR, "ldb: unknown extended rule_id %s",
-			  tree->u.extended.rule_id);
-		return LDB_ERR_INAPPROPRIATE_MATCHING;
-	}
+	unsigned int i;
 
 	/* find the message element */
 	el = ldb_msg_find_element(msg, tree->u.extended.attr);
@@ -447,7 +676,8 @@ static int ldb_match_extended(struct ldb_context *ldb,
 	}
 
 	for (i=0;i<el->num_values;i++) {
-		int ret = comp(tree->u.extended.rule_id, &el->values[i], &tree->u.extended.value, matched);
+		int ret = insn->comparator(tree->u.extended.rule_id, &el->values[i],
+					   &tree->u.extended.value, matched);
 		if (ret != LDB_SUCCESS) return ret;
 		if (*matched) return LDB_SUCCESS;
 	}
@@ -457,32 +687,30 @@ static int ldb_match_extended(struct ldb_context *ldb,
 }
 
 /*
-  return 0 if the given parse tree matches the given message. Assumes
-  the message is in sorted order
-
-  return 1 if it matches, and 0 if it doesn't match
+  run the instruction at idx, and the subtree below it, against a
+  message
 
   this is a recursive function, and does short-circuit evaluation
  */
 static int ldb_match_message(struct ldb_context *ldb, 
 			     const struct ldb_message *msg,
-			     const struct ldb_parse_tree *tree,
-			     enum ldb_scope scope, bool *matched)
+			     const struct ldb_match_program *prog,
+			     unsigned int idx, bool *matched)
 {
+	const struct ldb_match_insn *insn = &prog->insns[idx];
 	unsigned int i;
 	int ret;
 
 	*matched = false;
 
-	if (scope != LDB_SCOPE_BASE && ldb_dn_is_special(msg->dn)) {
-		/* don't match special records except on base searches */
-		return LDB_SUCCESS;
+	if (insn->error != LDB_SUCCESS) {
+		return insn->error;
 	}
 
-	switch (tree->operation) {
+	switch (insn->tree->operation) {
 	case LDB_OP_AND:
-		for (i=0;i<tree->u.list.num_elements;i++) {
-			ret = ldb_match_message(ldb, msg, tree->u.list.elements[i], scope, matched);
+		for (i = idx + 1; i < insn->next; i = prog->insns[i].next) {
+			ret = ldb_match_message(ldb, msg, prog, i, matched);
 			if (ret != LDB_SUCCESS) return ret;
 			if (!*matched) return LDB_SUCCESS;
 		}
@@ -490,8 +718,8 @@ static int ldb_match_message(struct ldb_context *ldb,
 		return LDB_SUCCESS;
 
 	case LDB_OP_OR:
-		for (i=0;i<tree->u.list.num_elements;i++) {
-			ret = ldb_match_message(ldb, msg, tree->u.list.elements[i], scope, matched);
+		for (i = idx + 1; i < insn->next; i = prog->insns[i].next) {
+			ret = ldb_match_message(ldb, msg, prog, i, matched);
 			if (ret != LDB_SUCCESS) return ret;
 			if (*matched) return LDB_SUCCESS;
 		}
@@ -499,36 +727,61 @@ static int ldb_match_message(struct ldb_context *ldb,
 		return LDB_SUCCESS;
 
 	case LDB_OP_NOT:
-		ret = ldb_match_message(ldb, msg, tree->u.isnot.child, scope, matched);
+		ret = ldb_match_message(ldb, msg, prog, idx + 1, matched);
 		if (ret != LDB_SUCCESS) return ret;
 		*matched = ! *matched;
 		return LDB_SUCCESS;
 
 	case LDB_OP_EQUALITY:
-		return ldb_match_equality(ldb, msg, tree, scope, matched);
+		return ldb_match_equality(ldb, msg, insn, matched);
 
 	case LDB_OP_SUBSTRING:
-		return ldb_match_substring(ldb, msg, tree, scope, matched);
+		return ldb_match_substring(ldb, msg, insn, matched);
 
 	case LDB_OP_GREATER:
-		return ldb_match_comparison(ldb, msg, tree, scope, LDB_OP_GREATER, matched);
+		return ldb_match_comparison(ldb, msg, insn, LDB_OP_GREATER, matched);
 
 	case LDB_OP_LESS:
-		return ldb_match_comparison(ldb, msg, tree, scope, LDB_OP_LESS, matched);
+		return ldb_match_comparison(ldb, msg, insn, LDB_OP_LESS, matched);
 
 	case LDB_OP_PRESENT:
-		return ldb_match_present(ldb, msg, tree, scope, matched);
+		return ldb_match_present(ldb, msg, insn, matched);
 
 	case LDB_OP_APPROX:
-		return ldb_match_comparison(ldb, msg, tree, scope, LDB_OP_APPROX, matched);
+		return LDB_ERR_INAPPROPRIATE_MATCHING;
 
 	case LDB_OP_EXTENDED:
-		return ldb_match_extended(ldb, msg, tree, scope, matched);
+		return ldb_match_extended(ldb, msg, insn, matched);
 	}
 
 	return LDB_ERR_INAPPROPRIATE_MATCHING;
 }
 
+/*
+  run a compiled filter against a message
+*/
+int ldb_match_program_run(const struct ldb_match_program *program,
+			  const struct ldb_message *msg,
+			  struct ldb_dn *base,
+			  enum ldb_scope scope,
+			  bool *matched)
+{
+	struct ldb_context *ldb = program->ldb;
+
+	*matched = false;
+
+	if ( ! ldb_match_scope(ldb, base, msg->dn, scope) ) {
+		return LDB_SUCCESS;
+	}
+
+	if (scope != LDB_SCOPE_BASE && ldb_dn_is_special(msg->dn)) {
+		/* don't match special records except on base searches */
+		return LDB_SUCCESS;
+	}
+
+	return ldb_match_message(ldb, msg, program, 0, matched);
+}
+
 int ldb_match_msg(struct ldb_context *ldb,
 		  const struct ldb_message *msg,
 		  const struct ldb_parse_tree *tree,
@@ -538,11 +791,7 @@ int ldb_match_msg(struct ldb_context *ldb,
 	bool matched;
 	int ret;
 
-	if ( ! ldb_match_scope(ldb, base, msg->dn, scope) ) {
-		return 0;
-	}
-
-	ret = ldb_match_message(ldb, msg, tree, scope, &matched);
+	ret = ldb_match_msg_error(ldb, msg, tree, base, scope, &matched);
 	if (ret != LDB_SUCCESS) {
 		/* to match the old API, we need to consider this a
 		   failure to match */
@@ -558,12 +807,21 @@ int ldb_match_msg_error(struct ldb_context *ldb,
 			enum ldb_scope scope,
 			bool *matched)
 {
+	struct ldb_match_program *program;
+	int ret;
+
 	if ( ! ldb_match_scope(ldb, base, msg->dn, scope) ) {
 		*matched = false;
 		return LDB_SUCCESS;
 	}
 
-	return ldb_match_message(ldb, msg, tree, scope, matched);
+	ret = ldb_match_program_compile(ldb, ldb, tree, &program);
+	if (ret != LDB_SUCCESS) {
+		return ret;
+	}
+	ret = ldb_match_program_run(program, msg, NULL, scope, matched);
+	talloc_free(program);
+	return ret;
 }
 
 int ldb_match_msg_objectclass(const struct ldb_message *msg,
@@ -155,6 +155,22 @@ int ldb_match_msg_error(struct ldb_context *ldb,
 int ldb_match_msg_objectclass(const struct ldb_message *msg,
 			      const char *objectclass);
 
+/* a parse tree compiled for matching against many messages, with the
+ * attribute handlers resolved and the filter values canonicalised
+ * once. The tree must outlive the program */
+struct ldb_match_program;
+
+int ldb_match_program_compile(struct ldb_context *ldb,
+			      TALLOC_CTX *mem_ctx,
+			      const struct ldb_parse_tree *tree,
+			      struct ldb_match_program **program);
+
+int ldb_match_program_run(const struct ldb_match_program *program,
+			  const struct ldb_message *msg,
+			  struct ldb_dn *base,
+			  enum ldb_scope scope,
+			  bool *matched);
+
 /* The following definitions come from lib/ldb/common/ldb_modules.c  */
 
 struct ldb_module *ldb_module_new(TALLOC_CTX *memctx,
@@ -126,7 +126,7 @@ static int ltdb_attributes_load(struct ldb_module *module)
 	dn = ldb_dn_new(module, ldb, LTDB_ATTRIBUTES);
 	if (dn == NULL) goto failed;
 
-	r = ltdb_search_dn1(module, dn, msg);
+	r = ltdb_search_dn1(module, dn, msg, 0);
 	talloc_free(dn);
 	if (r != LDB_SUCCESS && r != LDB_ERR_NO_SUCH_OBJECT) {
 		goto failed;
@@ -301,7 +301,7 @@ int ltdb_cache_load(struct ldb_module *module)
 	baseinfo_dn = ldb_dn_new(baseinfo, ldb, LTDB_BASEINFO);
 	if (baseinfo_dn == NULL) goto failed;
 
-	r= ltdb_search_dn1(module, baseinfo_dn, baseinfo);
+	r= ltdb_search_dn1(module, baseinfo_dn, baseinfo, 0);
 	if (r != LDB_SUCCESS && r != LDB_ERR_NO_SUCH_OBJECT) {
 		goto failed;
 	}
@@ -311,7 +311,7 @@ int ltdb_cache_load(struct ldb_module *module)
 		if (ltdb_baseinfo_init(module) != LDB_SUCCESS) {
 			goto failed;
 		}
-		if (ltdb_search_dn1(module, baseinfo_dn, baseinfo) != LDB_SUCCESS) {
+		if (ltdb_search_dn1(module, baseinfo_dn, baseinfo, 0) != LDB_SUCCESS) {
 			goto failed;
 		}
 	}
@@ -333,7 +333,7 @@ int ltdb_cache_load(struct ldb_module *module)
 	options_dn = ldb_dn_new(options, ldb, LTDB_OPTIONS);
 	if (options_dn == NULL) goto failed;
 
-	r= ltdb_search_dn1(module, options_dn, options);
+	r= ltdb_search_dn1(module, options_dn, options, 0);
 	if (r != LDB_SUCCESS && r != LDB_ERR_NO_SUCH_OBJECT) {
 		goto failed;
 	}
@@ -356,11 +356,12 @@ int ltdb_cache_load(struct ldb_module *module)
 	}
 	ltdb->cache->one_level_indexes = false;
 	ltdb->cache->attribute_indexes = false;
+	ltdb->cache->GUID_index_attribute = NULL;
 	    
 	indexlist_dn = ldb_dn_new(module, ldb, LTDB_INDEXLIST);
 	if (indexlist_dn == NULL) goto failed;
 
-	r = ltdb_search_dn1(module, indexlist_dn, ltdb->cache->indexlist);
+	r = ltdb_search_dn1(module, indexlist_dn, ltdb->cache->indexlist, 0);
 	if (r != LDB_SUCCESS && r != LDB_ERR_NO_SUCH_OBJECT) {
 		goto failed;
 	}
@@ -368,9 +369,14 @@ int ltdb_cache_load(struct ldb_module *module)
 	if (ldb_msg_find_element(ltdb->cache->indexlist, LTDB_IDXONE) != NULL) {
 		ltdb->cache->one_level_indexes = true;
 	}
-	if (ldb_msg_find_element(ltdb->cache->indexlist, LTDB_IDXATTR) != NULL) {
+	if (ldb_msg_find_element(ltdb->cache->indexlist, LTDB_IDXATTR) != NULL ||
+	    ldb_msg_find_element(ltdb->cache->indexlist, LTDB_IDXRANGE) != NULL ||
+	    ldb_msg_find_element(ltdb->cache->indexlist, LTDB_IDXPRESENT) != NULL) {
 		ltdb->cache->attribute_indexes = true;
 	}
+	ltdb->cache->GUID_index_attribute
+		= ldb_msg_find_attr_as_string(ltdb->cache->indexlist,
+					      LTDB_IDXGUID, NULL);
 
 	if (ltdb_attributes_load(module) == -1) {
 		goto failed;
@@ -48,6 +48,10 @@ struct ltdb_idxptr {
 */
 #define LTDB_INDEXING_VERSION 2
 
+/* index entries of a GUID indexed database hold a single @IDX value,
+   a sorted packed array of 16 byte GUIDs, and use this version */
+#define LTDB_GUID_INDEXING_VERSION 3
+
 /* enable the idxptr mode when transactions start */
 int ltdb_index_transaction_start(struct ldb_module *module)
 {
@@ -70,13 +74,57 @@ static int dn_list_cmp(const struct ldb_val *v1, const struct ldb_val *v2)
 }
 
 
+/* compare two GUID entries in a dn_list */
+static int ltdb_guid_cmp(const struct ldb_val *v1, const struct ldb_val *v2)
+{
+	return memcmp(v1->data, v2->data, LTDB_GUID_SIZE);
+}
+
+/*
+  binary search a sorted list of GUIDs. Returns the index of the
+  entry, or -1 if not found, in which case *pos is where it would
+  need to be inserted to keep the list sorted
+ */
+static int ltdb_guid_list_find(const struct dn_list *list,
+			       const struct ldb_val *v,
+			       unsigned int *pos)
+{
+	unsigned int lo = 0, hi = list->count;
+
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+		int c = ltdb_guid_cmp(&list->dn[mid], v);
+		if (c == 0) {
+			if (pos != NULL) {
+				*pos = mid;
+			}
+			return mid;
+		}
+		if (c < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	if (pos != NULL) {
+		*pos = lo;
+	}
+	return -1;
+}
+
 /*
   find a entry in a dn_list, using a ldb_val. Uses a case sensitive
-  comparison with the dn returns -1 if not found
+  comparison with the dn (or the GUID for a GUID index) returns -1 if
+  not found
  */
-static int ltdb_dn_list_find_val(const struct dn_list *list, const struct ldb_val *v)
+static int ltdb_dn_list_find_val(struct ltdb_private *ltdb,
+				 const struct dn_list *list,
+				 const struct ldb_val *v)
 {
 	unsigned int i;
+	if (ltdb->cache->GUID_index_attribute != NULL) {
+		return ltdb_guid_list_find(list, v, NULL);
+	}
 	for (i=0; i<list->count; i++) {
 		if (dn_list_cmp(&list->dn[i], v) == 0) return i;
 	}
@@ -84,15 +132,36 @@ static int ltdb_dn_list_find_val(const struct dn_list *list, const struct ldb_va
 }
 
 /*
-  find a entry in a dn_list. Uses a case sensitive comparison with the dn
-  returns -1 if not found
+  fill in the value a message is listed under in an index: its GUID
+  for a GUID index, otherwise its linearized dn. The value is not
+  copied
  */
-static int ltdb_dn_list_find_str(struct dn_list *list, const char *dn)
+static int ltdb_index_entry_val(struct ldb_module *module,
+				struct ltdb_private *ltdb,
+				const struct ldb_message *msg,
+				struct ldb_val *v)
 {
-	struct ldb_val v;
-	v.data = discard_const_p(unsigned char, dn);
-	v.length = strlen(dn);
-	return ltdb_dn_list_find_val(list, &v);
+	if (ltdb->cache->GUID_index_attribute != NULL) {
+		const struct ldb_val *guid;
+		guid = ldb_msg_find_ldb_val(msg,
+					    ltdb->cache->GUID_index_attribute);
+		if (guid == NULL || guid->length != LTDB_GUID_SIZE) {
+			ldb_asprintf_errstring(ldb_module_get_ctx(module),
+					       "Entry %s has no valid %s for the GUID index",
+					       ldb_dn_get_linearized(msg->dn),
+					       ltdb->cache->GUID_index_attribute);
+			return LDB_ERR_UNWILLING_TO_PERFORM;
+		}
+		*v = *guid;
+		return LDB_SUCCESS;
+	}
+
+	v->data = discard_const_p(unsigned char, ldb_dn_get_linearized(msg->dn));
+	if (v->data == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+	v->length = strlen((char *)v->data);
+	return LDB_SUCCESS;
 }
 
 /*
@@ -142,6 +211,8 @@ static int ltdb_dn_list_load(struct ldb_module *module,
 	TDB_DATA rec;
 	struct dn_list *list2;
 	TDB_DATA key;
+	unsigned int i, count;
+	int version;
 
 	list->dn = NULL;
 	list->count = 0;
@@ -177,13 +248,21 @@ normal_index:
 		return LDB_ERR_OPERATIONS_ERROR;
 	}
 
-	ret = ltdb_search_dn1(module, dn, msg);
+	ret = ltdb_search_dn1(module, dn, msg, 0);
 	if (ret != LDB_SUCCESS) {
 		talloc_free(msg);
 		return ret;
 	}
 
-	/* TODO: check indexing version number */
+	version = ldb_msg_find_attr_as_int(msg, LTDB_IDXVERSION, 0);
+	if ((version == LTDB_GUID_INDEXING_VERSION) !=
+	    (ltdb->cache->GUID_index_attribute != NULL)) {
+		ldb_asprintf_errstring(ldb_module_get_ctx(module),
+				       "Index %s has version %d, which does not match the @INDEXLIST, reindex needed",
+				       ldb_dn_get_linearized(dn), version);
+		talloc_free(msg);
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
 
 	el = ldb_msg_find_element(msg, LTDB_IDX);
 	if (!el) {
@@ -191,10 +270,48 @@ normal_index:
 		return LDB_SUCCESS;
 	}
 
-	/* we avoid copying the strings by stealing the list */
-	list->dn = talloc_steal(list, el->values);
-	list->count = el->num_values;
+	if (ltdb->cache->GUID_index_attribute == NULL) {
+		/* we avoid copying the strings by stealing the list */
+		list->dn = talloc_steal(list, el->values);
+		list->count = el->num_values;
+		talloc_free(msg);
+		return LDB_SUCCESS;
+	}
+
+	/* a GUID index is a single sorted array of GUIDs. Point the
+	   list entries into it rather than copying them */
+	if (el->num_values != 1 ||
+	    el->values[0].length % LTDB_GUID_SIZE != 0) {
+		ldb_asprintf_errstring(ldb_module_get_ctx(module),
+				       "Corrupt GUID index %s",
+				       ldb_dn_get_linearized(dn));
+		talloc_free(msg);
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	count = el->values[0].length / LTDB_GUID_SIZE;
+	list->dn = talloc_array(list, struct ldb_val, count);
+	if (list->dn == NULL) {
+		talloc_free(msg);
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+	talloc_steal(list->dn, el->values[0].data);
+
+	for (i = 0; i < count; i++) {
+		list->dn[i].data = el->values[0].data + i * LTDB_GUID_SIZE;
+		list->dn[i].length = LTDB_GUID_SIZE;
+		if (i > 0 && ltdb_guid_cmp(&list->dn[i-1], &list->dn[i]) >= 0) {
+			ldb_asprintf_errstring(ldb_module_get_ctx(module),
+					       "GUID index %s is not sorted",
+					       ldb_dn_get_linearized(dn));
+			TALLOC_FREE(list->dn);
+			talloc_free(msg);
+			return LDB_ERR_OPERATIONS_ERROR;
+		}
+	}
+	list->count = count;
 
+	talloc_free(msg);
 	return LDB_SUCCESS;
 }
 
@@ -205,29 +322,33 @@ normal_index:
 static int ltdb_dn_list_store_full(struct ldb_module *module, struct ldb_dn *dn, 
 				   struct dn_list *list)
 {
+	struct ltdb_private *ltdb = talloc_get_type(ldb_module_get_private(module), struct ltdb_private);
 	struct ldb_message *msg;
 	int ret;
 
+	msg = ldb_msg_new(module);
+	if (!msg) {
+		return ldb_module_oom(module);
+	}
+	msg->dn = dn;
+
 	if (list->count == 0) {
-		ret = ltdb_delete_noindex(module, dn);
+		ret = ltdb_delete_noindex(module, msg);
+		talloc_free(msg);
 		if (ret == LDB_ERR_NO_SUCH_OBJECT) {
 			return LDB_SUCCESS;
 		}
 		return ret;
 	}
 
-	msg = ldb_msg_new(module);
-	if (!msg) {
-		return ldb_module_oom(module);
-	}
-
-	ret = ldb_msg_add_fmt(msg, LTDB_IDXVERSION, "%u", LTDB_INDEXING_VERSION);
+	ret = ldb_msg_add_fmt(msg, LTDB_IDXVERSION, "%u",
+			      ltdb->cache->GUID_index_attribute != NULL ?
+			      LTDB_GUID_INDEXING_VERSION : LTDB_INDEXING_VERSION);
 	if (ret != LDB_SUCCESS) {
 		talloc_free(msg);
 		return ldb_module_oom(module);
 	}
 
-	msg->dn = dn;
 	if (list->count > 0) {
 		struct ldb_message_element *el;
 
@@ -236,8 +357,33 @@ static int ltdb_dn_list_store_full(struct ldb_module *module, struct ldb_dn *dn,
 			talloc_free(msg);
 			return ldb_module_oom(module);
 		}
-		el->values = list->dn;
-		el->num_values = list->count;
+
+		if (ltdb->cache->GUID_index_attribute != NULL) {
+			/* pack the sorted GUIDs into a single value */
+			struct ldb_val *v;
+			unsigned int i;
+
+			v = talloc(msg, struct ldb_val);
+			if (v == NULL) {
+				talloc_free(msg);
+				return ldb_module_oom(module);
+			}
+			v->length = list->count * LTDB_GUID_SIZE;
+			v->data = talloc_size(v, v->length);
+			if (v->data == NULL) {
+				talloc_free(msg);
+				return ldb_module_oom(module);
+			}
+			for (i = 0; i < list->count; i++) {
+				memcpy(v->data + i * LTDB_GUID_SIZE,
+				       list->dn[i].data, LTDB_GUID_SIZE);
+			}
+			el->values = v;
+			el->num_values = 1;
+		} else {
+			el->values = list->dn;
+			el->num_values = list->count;
+		}
 	}
 
 	ret = ltdb_store(module, msg, TDB_REPLACE);
@@ -432,14 +578,87 @@ static struct ldb_dn *ltdb_index_key(struct ldb_context *ldb,
 }
 
 /*
-  see if a attribute value is in the list of indexed attributes
+  load the DN index entry for a dn. In a GUID indexed database this
+  maps the dn to the GUID the record is stored under
+ */
+static int ltdb_index_dn_guid_load(struct ldb_module *module,
+				   struct ldb_dn *dn, struct dn_list *list)
+{
+	struct ldb_context *ldb = ldb_module_get_ctx(module);
+	struct ldb_dn *key;
+	struct ldb_val val;
+	int ret;
+
+	val.data = (uint8_t *)((uintptr_t)ldb_dn_get_casefold(dn));
+	if (val.data == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+	val.length = strlen((char *)val.data);
+
+	key = ltdb_index_key(ldb, LTDB_IDXDN, &val, NULL);
+	if (key == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	ret = ltdb_dn_list_load(module, key, list);
+	talloc_free(key);
+	return ret;
+}
+
+/*
+  form the tdb key of the record for a dn in a GUID indexed database,
+  using the DN index
+  caller frees
 */
-static bool ltdb_is_indexed(const struct ldb_message *index_list, const char *attr)
+int ltdb_key_dn_from_idx(struct ldb_module *module, struct ldb_dn *dn,
+			 TDB_DATA *key)
+{
+	struct dn_list *list;
+	int ret;
+
+	list = talloc_zero(module, struct dn_list);
+	if (list == NULL) {
+		return ldb_module_oom(module);
+	}
+
+	ret = ltdb_index_dn_guid_load(module, dn, list);
+	if (ret != LDB_SUCCESS) {
+		talloc_free(list);
+		return ret;
+	}
+
+	if (list->count == 0) {
+		talloc_free(list);
+		return LDB_ERR_NO_SUCH_OBJECT;
+	}
+
+	if (list->count > 1) {
+		ldb_asprintf_errstring(ldb_module_get_ctx(module),
+				       "DN index for %s holds %u GUIDs",
+				       ldb_dn_get_linearized(dn), list->count);
+		talloc_free(list);
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	*key = ltdb_guid_to_key(module, &list->dn[0]);
+	talloc_free(list);
+	if (key->dptr == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+	return LDB_SUCCESS;
+}
+
+/*
+  see if a attribute is listed under list_attr (one of @IDXATTR,
+  @IDXRANGE or @IDXPRESENT) in the index list
+*/
+static bool ltdb_is_indexed_by(const struct ldb_message *index_list,
+			       const char *list_attr, const char *attr)
 {
 	unsigned int i;
 	struct ldb_message_element *el;
 
-	el = ldb_msg_find_element(index_list, LTDB_IDXATTR);
+	el = ldb_msg_find_element(index_list, list_attr);
 	if (el == NULL) {
 		return false;
 	}
@@ -453,6 +672,134 @@ static bool ltdb_is_indexed(const struct ldb_message *index_list, const char *at
 	return false;
 }
 
+/*
+  see if a attribute value is in the list of indexed attributes
+*/
+static bool ltdb_is_indexed(const struct ldb_message *index_list, const char *attr)
+{
+	return ltdb_is_indexed_by(index_list, LTDB_IDXATTR, attr);
+}
+
+/*
+  range indexes group the values of an attribute into buckets of
+  2^LTDB_RANGE_BUCKET_SHIFT consecutive integers (or seconds, for
+  generalized time values). Each bucket is an ordinary index record,
+  and a directory record lists the buckets in use in sorted order
+*/
+#define LTDB_RANGE_BUCKET_SHIFT 10
+#define LTDB_RANGE_BUCKET_SIZE 8
+
+/* values that are neither integers nor times go here, and every range
+   search includes this bucket */
+#define LTDB_RANGE_UNORDERED "unordered"
+
+/*
+  work out the range index bucket of a value. The bucket number is
+  returned big endian with the sign bit flipped so that memcmp() order
+  is numeric order, padded to LTDB_GUID_SIZE so the directory of
+  buckets can share the sorted GUID list code
+*/
+static int ltdb_range_bucket(struct ldb_context *ldb, const char *attr,
+			     const struct ldb_val *value,
+			     uint8_t bucket[LTDB_GUID_SIZE], bool *ordered)
+{
+	const struct ldb_schema_attribute *a;
+	struct ldb_val v;
+	char buf[32], *end;
+	int64_t ordinal = 0;
+	uint64_t b;
+	time_t t;
+	unsigned int i;
+	int ret;
+
+	a = ldb_schema_attribute_by_name(ldb, attr);
+	ret = a->syntax->canonicalise_fn(ldb, ldb, value, &v);
+	if (ret != LDB_SUCCESS) {
+		return ret;
+	}
+
+	*ordered = false;
+	if (v.length > 0 && v.length < sizeof(buf)) {
+		memcpy(buf, v.data, v.length);
+		buf[v.length] = 0;
+		errno = 0;
+		ordinal = strtoll(buf, &end, 10);
+		if (*end == 0 && errno == 0) {
+			*ordered = true;
+		} else if (ldb_val_to_time(&v, &t) == LDB_SUCCESS) {
+			ordinal = t;
+			*ordered = true;
+		}
+	}
+
+	if (v.data != value->data) {
+		talloc_free(v.data);
+	}
+
+	b = (uint64_t)(ordinal >> LTDB_RANGE_BUCKET_SHIFT) ^ 0x8000000000000000ULL;
+	for (i = 0; i < LTDB_RANGE_BUCKET_SIZE; i++) {
+		bucket[i] = b >> (8 * (LTDB_RANGE_BUCKET_SIZE - 1 - i));
+	}
+	memset(&bucket[LTDB_RANGE_BUCKET_SIZE], 0,
+	       LTDB_GUID_SIZE - LTDB_RANGE_BUCKET_SIZE);
+
+	return LDB_SUCCESS;
+}
+
+/*
+  fill in the pseudo element under which the index records of a
+  range index bucket are stored, "@IDXRANGE:<attr>". NULL for bucket
+  means the unordered bucket
+*/
+static int ltdb_range_bucket_el(TALLOC_CTX *mem_ctx, const char *attr,
+				const uint8_t *bucket,
+				struct ldb_message_element *el,
+				struct ldb_val *val)
+{
+	unsigned long long b = 0;
+	unsigned int i;
+	char *s;
+
+	el->name = talloc_asprintf(mem_ctx, "%s:%s", LTDB_IDXRANGE, attr);
+	if (bucket != NULL) {
+		for (i = 0; i < LTDB_RANGE_BUCKET_SIZE; i++) {
+			b = (b << 8) | bucket[i];
+		}
+		s = talloc_asprintf(mem_ctx, "%016llx", b);
+	} else {
+		s = talloc_strdup(mem_ctx, LTDB_RANGE_UNORDERED);
+	}
+	if (el->name == NULL || s == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+	val->data = (uint8_t *)s;
+	val->length = strlen(s);
+	el->values = val;
+	el->num_values = 1;
+	return LDB_SUCCESS;
+}
+
+/*
+  return the key of the directory record of a range index
+*/
+static struct ldb_dn *ltdb_range_dir_key(struct ldb_context *ldb,
+					 const char *attr)
+{
+	struct ldb_dn *dn;
+	struct ldb_val v;
+	char *attr_folded;
+
+	attr_folded = ldb_attr_casefold(ldb, attr);
+	if (attr_folded == NULL) {
+		return NULL;
+	}
+	v.data = (uint8_t *)attr_folded;
+	v.length = strlen(attr_folded);
+	dn = ltdb_index_key(ldb, LTDB_IDXRANGE, &v, NULL);
+	talloc_free(attr_folded);
+	return dn;
+}
+
 /*
   in the following logic functions, the return value is treated as
   follows:
@@ -500,7 +847,8 @@ static int ltdb_index_dn_simple(struct ldb_module *module,
 }
 
 
-static bool list_union(struct ldb_context *, struct dn_list *, const struct dn_list *);
+static bool list_union(struct ldb_context *, struct ltdb_private *,
+		       struct dn_list *, const struct dn_list *);
 
 /*
   return a list of dn's that might match a leaf indexed search
@@ -510,6 +858,22 @@ static int ltdb_index_dn_leaf(struct ldb_module *module,
 			      const struct ldb_message *index_list,
 			      struct dn_list *list)
 {
+	struct ltdb_private *ltdb = talloc_get_type(ldb_module_get_private(module), struct ltdb_private);
+
+	if (ldb_attr_dn(tree->u.equality.attr) == 0 &&
+	    ltdb->cache->GUID_index_attribute != NULL) {
+		struct ldb_dn *dn;
+		int ret;
+
+		dn = ldb_dn_from_ldb_val(list, ldb_module_get_ctx(module),
+					 &tree->u.equality.value);
+		if (dn == NULL) {
+			return LDB_ERR_OPERATIONS_ERROR;
+		}
+		ret = ltdb_index_dn_guid_load(module, dn, list);
+		talloc_free(dn);
+		return ret;
+	}
 	if (ldb_attr_dn(tree->u.equality.attr) == 0) {
 		list->dn = talloc_array(list, struct ldb_val, 1);
 		if (list->dn == NULL) {
@@ -523,66 +887,271 @@ static int ltdb_index_dn_leaf(struct ldb_module *module,
 	return ltdb_index_dn_simple(module, tree, index_list, list);
 }
 
-
 /*
-  list intersection
-  list = list & list2
-*/
-static bool list_intersect(struct ldb_context *ldb,
-			   struct dn_list *list, const struct dn_list *list2)
+  append the entries of one range index bucket to a list
+ */
+static int ltdb_range_bucket_append(struct ldb_module *module,
+				    const char *attr, const uint8_t *bucket,
+				    struct dn_list *list)
 {
-	struct dn_list *list3;
-	unsigned int i;
+	struct ldb_context *ldb = ldb_module_get_ctx(module);
+	struct ldb_message_element el;
+	struct ldb_val val;
+	struct ldb_dn *dn;
+	struct dn_list *list2;
+	int ret;
 
-	if (list->count == 0) {
-		/* 0 & X == 0 */
-		return true;
-	}
-	if (list2->count == 0) {
-		/* X & 0 == 0 */
-		list->count = 0;
-		list->dn = NULL;
-		return true;
+	list2 = talloc_zero(list, struct dn_list);
+	if (list2 == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
 	}
 
-	/* the indexing code is allowed to return a longer list than
-	   what really matches, as all results are filtered by the
-	   full expression at the end - this shortcut avoids a lot of
-	   work in some cases */
-	if (list->count < 2 && list2->count > 10) {
-		return true;
-	}
-	if (list2->count < 2 && list->count > 10) {
-		list->count = list2->count;
-		list->dn = list2->dn;
-		/* note that list2 may not be the parent of list2->dn,
-		   as list2->dn may be owned by ltdb->idxptr. In that
-		   case we expect this reparent call to fail, which is
-		   OK */
-		talloc_reparent(list2, list, list2->dn);
-		return true;
+	ret = ltdb_range_bucket_el(list2, attr, bucket, &el, &val);
+	if (ret != LDB_SUCCESS) {
+		talloc_free(list2);
+		return ret;
 	}
 
-	list3 = talloc_zero(list, struct dn_list);
-	if (list3 == NULL) {
-		return false;
+	dn = ltdb_index_key(ldb, el.name, &val, NULL);
+	if (dn == NULL) {
+		talloc_free(list2);
+		return LDB_ERR_OPERATIONS_ERROR;
 	}
 
-	list3->dn = talloc_array(list3, struct ldb_val, list->count);
-	if (!list3->dn) {
-		talloc_free(list3);
-		return false;
+	/* the entries of list2 stay owned by list2, which is a child of list */
+	ret = ltdb_dn_list_load(module, dn, list2);
+	talloc_free(dn);
+	if (ret == LDB_ERR_NO_SUCH_OBJECT || list2->count == 0) {
+		talloc_free(list2);
+		return LDB_SUCCESS;
+	}
+	if (ret != LDB_SUCCESS) {
+		talloc_free(list2);
+		return ret;
 	}
-	list3->count = 0;
 
-	for (i=0;i<list->count;i++) {
-		if (ltdb_dn_list_find_val(list2, &list->dn[i]) != -1) {
-			list3->dn[list3->count] = list->dn[i];
-			list3->count++;
-		}
+	list->dn = talloc_realloc(list, list->dn, struct ldb_val,
+				  list->count + list2->count);
+	if (list->dn == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
 	}
+	memcpy(&list->dn[list->count], list2->dn,
+	       sizeof(list->dn[0]) * list2->count);
+	list->count += list2->count;
 
-	list->dn = talloc_steal(list, list3->dn);
+	return LDB_SUCCESS;
+}
+
+/*
+  return a list of dn's that might match a >= or <= search on a range
+  indexed attribute. The list is a superset, as the buckets at the
+  edge of the range and the unordered bucket hold non-matching values
+  too, which the filter in ltdb_index_filter() removes
+ */
+static int ltdb_index_dn_range(struct ldb_module *module,
+			       const struct ldb_parse_tree *tree,
+			       const struct ldb_message *index_list,
+			       struct dn_list *list)
+{
+	struct ltdb_private *ltdb = talloc_get_type(ldb_module_get_private(module), struct ltdb_private);
+	struct ldb_context *ldb = ldb_module_get_ctx(module);
+	const char *attr = tree->u.comparison.attr;
+	uint8_t bucket[LTDB_GUID_SIZE];
+	struct dn_list *dir;
+	struct ldb_dn *dn;
+	struct ldb_val v;
+	unsigned int start, end, pos, i, j;
+	bool ordered;
+	int ret;
+
+	list->count = 0;
+	list->dn = NULL;
+
+	if (!ltdb_is_indexed_by(index_list, LTDB_IDXRANGE, attr)) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	ret = ltdb_range_bucket(ldb, attr, &tree->u.comparison.value,
+				bucket, &ordered);
+	if (ret != LDB_SUCCESS || !ordered) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	dir = talloc_zero(list, struct dn_list);
+	if (dir == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	dn = ltdb_range_dir_key(ldb, attr);
+	if (dn == NULL) {
+		talloc_free(dir);
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+	ret = ltdb_dn_list_load(module, dn, dir);
+	talloc_free(dn);
+	if (ret != LDB_SUCCESS && ret != LDB_ERR_NO_SUCH_OBJECT) {
+		talloc_free(dir);
+		return ret;
+	}
+
+	v.data = bucket;
+	v.length = LTDB_GUID_SIZE;
+	if (ltdb_guid_list_find(dir, &v, &pos) != -1) {
+		/* the bucket holding the value itself is at pos */
+		start = pos;
+		end = pos + 1;
+	} else {
+		start = pos;
+		end = pos;
+	}
+	if (tree->operation == LDB_OP_GREATER) {
+		end = dir->count;
+	} else {
+		start = 0;
+	}
+
+	for (i = start; i < end; i++) {
+		ret = ltdb_range_bucket_append(module, attr,
+					       dir->dn[i].data, list);
+		if (ret != LDB_SUCCESS) {
+			return ret;
+		}
+	}
+	ret = ltdb_range_bucket_append(module, attr, NULL, list);
+	if (ret != LDB_SUCCESS) {
+		return ret;
+	}
+
+	if (list->count == 0) {
+		return LDB_ERR_NO_SUCH_OBJECT;
+	}
+
+	/* a record with several values may be in more than one bucket.
+	   DN lists have their duplicates removed after filtering, but
+	   GUID lists are expected to be sorted and unique */
+	if (ltdb->cache->GUID_index_attribute != NULL) {
+		TYPESAFE_QSORT(list->dn, list->count, ltdb_guid_cmp);
+		for (i = 1, j = 1; i < list->count; i++) {
+			if (ltdb_guid_cmp(&list->dn[j-1], &list->dn[i]) != 0) {
+				list->dn[j++] = list->dn[i];
+			}
+		}
+		list->count = j;
+	}
+
+	return LDB_SUCCESS;
+}
+
+/*
+  return a list of dn's that have a value for a presence indexed
+  attribute
+ */
+static int ltdb_index_dn_present(struct ldb_module *module,
+				 const char *attr,
+				 const struct ldb_message *index_list,
+				 struct dn_list *list)
+{
+	struct ldb_context *ldb = ldb_module_get_ctx(module);
+	struct ldb_dn *dn;
+	struct ldb_val v;
+	int ret;
+
+	list->count = 0;
+	list->dn = NULL;
+
+	if (!ltdb_is_indexed_by(index_list, LTDB_IDXPRESENT, attr)) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	v.data = (uint8_t *)ldb_attr_casefold(list, attr);
+	if (v.data == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+	v.length = strlen((char *)v.data);
+
+	dn = ltdb_index_key(ldb, LTDB_IDXPRESENT, &v, NULL);
+	talloc_free(v.data);
+	if (dn == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	ret = ltdb_dn_list_load(module, dn, list);
+	talloc_free(dn);
+	return ret;
+}
+
+
+/*
+  list intersection
+  list = list & list2
+*/
+static bool list_intersect(struct ldb_context *ldb,
+			   struct ltdb_private *ltdb,
+			   struct dn_list *list, const struct dn_list *list2)
+{
+	struct dn_list *list3;
+	const struct dn_list *short_list, *long_list;
+	unsigned int i;
+
+	if (list->count == 0) {
+		/* 0 & X == 0 */
+		return true;
+	}
+	if (list2->count == 0) {
+		/* X & 0 == 0 */
+		list->count = 0;
+		list->dn = NULL;
+		return true;
+	}
+
+	/* the indexing code is allowed to return a longer list than
+	   what really matches, as all results are filtered by the
+	   full expression at the end - this shortcut avoids a lot of
+	   work in some cases */
+	if (list->count < 2 && list2->count > 10) {
+		return true;
+	}
+	if (list2->count < 2 && list->count > 10) {
+		list->count = list2->count;
+		list->dn = list2->dn;
+		/* note that list2 may not be the parent of list2->dn,
+		   as list2->dn may be owned by ltdb->idxptr. In that
+		   case we expect this reparent call to fail, which is
+		   OK */
+		talloc_reparent(list2, list, list2->dn);
+		return true;
+	}
+
+	list3 = talloc_zero(list, struct dn_list);
+	if (list3 == NULL) {
+		return false;
+	}
+
+	/* a GUID index keeps both lists sorted, so walk the shorter
+	   one and binary search the longer. The result stays sorted */
+	short_list = list;
+	long_list = list2;
+	if (ltdb->cache->GUID_index_attribute != NULL &&
+	    list2->count < list->count) {
+		short_list = list2;
+		long_list = list;
+	}
+
+	list3->dn = talloc_array(list3, struct ldb_val, short_list->count);
+	if (!list3->dn) {
+		talloc_free(list3);
+		return false;
+	}
+	list3->count = 0;
+
+	for (i=0;i<short_list->count;i++) {
+		if (ltdb_dn_list_find_val(ltdb, long_list, &short_list->dn[i]) != -1) {
+			list3->dn[list3->count] = short_list->dn[i];
+			list3->count++;
+		}
+	}
+
+	list->dn = talloc_steal(list, list3->dn);
 	list->count = list3->count;
 	talloc_free(list3);
 
@@ -595,9 +1164,11 @@ static bool list_intersect(struct ldb_context *ldb,
   list = list | list2
 */
 static bool list_union(struct ldb_context *ldb,
+		       struct ltdb_private *ltdb,
 		       struct dn_list *list, const struct dn_list *list2)
 {
 	struct ldb_val *dn3;
+	unsigned int i, j, k;
 
 	if (list2->count == 0) {
 		/* X | 0 == X */
@@ -622,12 +1193,39 @@ static bool list_union(struct ldb_context *ldb,
 		return false;
 	}
 
-	/* we allow for duplicates here, and get rid of them later */
-	memcpy(dn3, list->dn, sizeof(list->dn[0])*list->count);
-	memcpy(dn3+list->count, list2->dn, sizeof(list2->dn[0])*list2->count);
+	if (ltdb->cache->GUID_index_attribute == NULL) {
+		/* we allow for duplicates here, and get rid of them later */
+		memcpy(dn3, list->dn, sizeof(list->dn[0])*list->count);
+		memcpy(dn3+list->count, list2->dn, sizeof(list2->dn[0])*list2->count);
+
+		list->dn = dn3;
+		list->count += list2->count;
+
+		return true;
+	}
+
+	/* merge the two sorted GUID lists, dropping duplicates */
+	i = j = k = 0;
+	while (i < list->count && j < list2->count) {
+		int c = ltdb_guid_cmp(&list->dn[i], &list2->dn[j]);
+		if (c < 0) {
+			dn3[k++] = list->dn[i++];
+		} else if (c > 0) {
+			dn3[k++] = list2->dn[j++];
+		} else {
+			dn3[k++] = list->dn[i++];
+			j++;
+		}
+	}
+	while (i < list->count) {
+		dn3[k++] = list->dn[i++];
+	}
+	while (j < list2->count) {
+		dn3[k++] = list2->dn[j++];
+	}
 
 	list->dn = dn3;
-	list->count += list2->count;
+	list->count = k;
 
 	return true;
 }
@@ -646,6 +1244,7 @@ static int ltdb_index_dn_or(struct ldb_module *module,
 			    const struct ldb_message *index_list,
 			    struct dn_list *list)
 {
+	struct ltdb_private *ltdb = talloc_get_type(ldb_module_get_private(module), struct ltdb_private);
 	struct ldb_context *ldb;
 	unsigned int i;
 
@@ -677,7 +1276,7 @@ static int ltdb_index_dn_or(struct ldb_module *module,
 			return ret;
 		}
 
-		if (!list_union(ldb, list, list2)) {
+		if (!list_union(ldb, ltdb, list, list2)) {
 			talloc_free(list2);
 			return LDB_ERR_OPERATIONS_ERROR;
 		}
@@ -730,6 +1329,7 @@ static int ltdb_index_dn_and(struct ldb_module *module,
 			     const struct ldb_message *index_list,
 			     struct dn_list *list)
 {
+	struct ltdb_private *ltdb = talloc_get_type(ldb_module_get_private(module), struct ltdb_private);
 	struct ldb_context *ldb;
 	unsigned int i;
 	bool found;
@@ -799,7 +1399,7 @@ static int ltdb_index_dn_and(struct ldb_module *module,
 			list->dn = list2->dn;
 			list->count = list2->count;
 			found = true;
-		} else if (!list_intersect(ldb, list, list2)) {
+		} else if (!list_intersect(ldb, ltdb, list, list2)) {
 			talloc_free(list2);
 			return LDB_ERR_OPERATIONS_ERROR;
 		}
@@ -887,10 +1487,23 @@ static int ltdb_index_dn(struct ldb_module *module,
 		ret = ltdb_index_dn_leaf(module, tree, index_list, list);
 		break;
 
-	case LDB_OP_SUBSTRING:
 	case LDB_OP_GREATER:
 	case LDB_OP_LESS:
+		ret = ltdb_index_dn_range(module, tree, index_list, list);
+		break;
+
 	case LDB_OP_PRESENT:
+		ret = ltdb_index_dn_present(module, tree->u.present.attr,
+					    index_list, list);
+		break;
+
+	case LDB_OP_SUBSTRING:
+		/* every match has the attribute, so the presence index
+		   gives a superset for the filter to narrow down */
+		ret = ltdb_index_dn_present(module, tree->u.substring.attr,
+					    index_list, list);
+		break;
+
 	case LDB_OP_APPROX:
 	case LDB_OP_EXTENDED:
 		/* we can't index with fancy bitops yet */
@@ -909,8 +1522,9 @@ static int ltdb_index_filter(const struct dn_list *dn_list,
 			     struct ltdb_context *ac, 
 			     uint32_t *match_count)
 {
+	struct ltdb_private *ltdb = talloc_get_type(ldb_module_get_private(ac->module), struct ltdb_private);
 	struct ldb_context *ldb;
-	struct ldb_message *msg;
+	struct ldb_message *msg, *filtered_msg;
 	unsigned int i;
 
 	ldb = ldb_module_get_ctx(ac->module);
@@ -925,14 +1539,32 @@ static int ltdb_index_filter(const struct dn_list *dn_list,
 			return LDB_ERR_OPERATIONS_ERROR;
 		}
 
-		dn = ldb_dn_from_ldb_val(msg, ldb, &dn_list->dn[i]);
-		if (dn == NULL) {
-			talloc_free(msg);
-			return LDB_ERR_OPERATIONS_ERROR;
-		}
+		if (ltdb->cache->GUID_index_attribute != NULL) {
+			/* fetch the record straight from its GUID */
+			TDB_DATA key;
 
-		ret = ltdb_search_dn1(ac->module, dn, msg);
-		talloc_free(dn);
+			key = ltdb_guid_to_key(ac->module, &dn_list->dn[i]);
+			if (key.dptr == NULL) {
+				talloc_free(msg);
+				return LDB_ERR_OPERATIONS_ERROR;
+			}
+			ret = ltdb_search_key(ac->module, key, msg,
+					      LTDB_UNPACK_DATA_FLAG_NO_DATA_ALLOC);
+			talloc_free(key.dptr);
+			if (ret == LDB_SUCCESS && msg->dn == NULL) {
+				ret = LDB_ERR_OPERATIONS_ERROR;
+			}
+		} else {
+			dn = ldb_dn_from_ldb_val(msg, ldb, &dn_list->dn[i]);
+			if (dn == NULL) {
+				talloc_free(msg);
+				return LDB_ERR_OPERATIONS_ERROR;
+			}
+
+			ret = ltdb_search_dn1(ac->module, dn, msg,
+					      LTDB_UNPACK_DATA_FLAG_NO_DATA_ALLOC);
+			talloc_free(dn);
+		}
 		if (ret == LDB_ERR_NO_SUCH_OBJECT) {
 			/* the record has disappeared? yes, this can happen */
 			talloc_free(msg);
@@ -945,8 +1577,8 @@ static int ltdb_index_filter(const struct dn_list *dn_list,
 			return LDB_ERR_OPERATIONS_ERROR;
 		}
 
-		ret = ldb_match_msg_error(ldb, msg,
-					  ac->tree, ac->base, ac->scope, &matched);
+		ret = ldb_match_program_run(ac->match_program, msg,
+					    ac->base, ac->scope, &matched);
 		if (ret != LDB_SUCCESS) {
 			talloc_free(msg);
 			return ret;
@@ -957,14 +1589,14 @@ static int ltdb_index_filter(const struct dn_list *dn_list,
 		}
 
 		/* filter the attributes that the user wants */
-		ret = ltdb_filter_attrs(msg, ac->attrs);
+		ret = ltdb_filter_attrs(ac, msg, ac->attrs, &filtered_msg);
+		talloc_free(msg);
 
 		if (ret == -1) {
-			talloc_free(msg);
 			return LDB_ERR_OPERATIONS_ERROR;
 		}
 
-		ret = ldb_module_send_entry(ac->req, msg, NULL);
+		ret = ldb_module_send_entry(ac->req, filtered_msg, NULL);
 		if (ret != LDB_SUCCESS) {
 			/* Regardless of success or failure, the msg
 			 * is the callbacks responsiblity, and should
@@ -982,7 +1614,8 @@ static int ltdb_index_filter(const struct dn_list *dn_list,
 /*
   remove any duplicated entries in a indexed result
  */
-static void ltdb_dn_list_remove_duplicates(struct dn_list *list)
+static void ltdb_dn_list_remove_duplicates(struct ltdb_private *ltdb,
+					   struct dn_list *list)
 {
 	unsigned int i, new_count;
 
@@ -990,6 +1623,11 @@ static void ltdb_dn_list_remove_duplicates(struct dn_list *list)
 		return;
 	}
 
+	if (ltdb->cache->GUID_index_attribute != NULL) {
+		/* GUID lists are kept sorted and unique */
+		return;
+	}
+
 	TYPESAFE_QSORT(list->dn, list->count, dn_list_cmp);
 
 	new_count = 1;
@@ -1031,6 +1669,15 @@ int ltdb_search_indexed(struct ltdb_context *ac, uint32_t *match_count)
 
 	switch (ac->scope) {
 	case LDB_SCOPE_BASE:
+		if (ltdb->cache->GUID_index_attribute != NULL) {
+			ret = ltdb_index_dn_guid_load(ac->module, ac->base,
+						      dn_list);
+			if (ret != LDB_SUCCESS) {
+				talloc_free(dn_list);
+				return ret;
+			}
+			break;
+		}
 		dn_list->dn = talloc_array(dn_list, struct ldb_val, 1);
 		if (dn_list->dn == NULL) {
 			talloc_free(dn_list);
@@ -1068,7 +1715,7 @@ int ltdb_search_indexed(struct ltdb_context *ac, uint32_t *match_count)
 			talloc_free(dn_list);
 			return ret;
 		}
-		ltdb_dn_list_remove_duplicates(dn_list);
+		ltdb_dn_list_remove_duplicates(ltdb, dn_list);
 		break;
 	}
 
@@ -1080,18 +1727,27 @@ int ltdb_search_indexed(struct ltdb_context *ac, uint32_t *match_count)
 /*
   add an index entry for one message element
 */
-static int ltdb_index_add1(struct ldb_module *module, const char *dn,
+static int ltdb_index_add1(struct ldb_module *module,
+			   const struct ldb_message *msg,
 			   struct ldb_message_element *el, int v_idx)
 {
+	struct ltdb_private *ltdb = talloc_get_type(ldb_module_get_private(module), struct ltdb_private);
 	struct ldb_context *ldb;
 	struct ldb_dn *dn_key;
 	int ret;
 	const struct ldb_schema_attribute *a;
 	struct dn_list *list;
+	struct ldb_val v;
+	unsigned int pos;
 	unsigned alloc_len;
 
 	ldb = ldb_module_get_ctx(module);
 
+	ret = ltdb_index_entry_val(module, ltdb, msg, &v);
+	if (ret != LDB_SUCCESS) {
+		return ret;
+	}
+
 	list = talloc_zero(module, struct dn_list);
 	if (list == NULL) {
 		return LDB_ERR_OPERATIONS_ERROR;
@@ -1110,16 +1766,26 @@ static int ltdb_index_add1(struct ldb_module *module, const char *dn,
 		return ret;
 	}
 
-	if (ltdb_dn_list_find_str(list, dn) != -1) {
-		talloc_free(list);
-		return LDB_SUCCESS;
+	if (ltdb->cache->GUID_index_attribute != NULL) {
+		if (ltdb_guid_list_find(list, &v, &pos) != -1) {
+			talloc_free(list);
+			return LDB_SUCCESS;
+		}
+	} else {
+		if (ltdb_dn_list_find_val(ltdb, list, &v) != -1) {
+			talloc_free(list);
+			return LDB_SUCCESS;
+		}
+		pos = list->count;
 	}
 
+	/* the DN index of a GUID indexed database is always unique */
 	if (list->count > 0 &&
-	    a->flags & LDB_ATTR_FLAG_UNIQUE_INDEX) {
+	    (a->flags & LDB_ATTR_FLAG_UNIQUE_INDEX ||
+	     strcmp(el->name, LTDB_IDXDN) == 0)) {
 		talloc_free(list);
 		ldb_asprintf_errstring(ldb, __location__ ": unique index violation on %s in %s",
-				       el->name, dn);
+				       el->name, ldb_dn_get_linearized(msg->dn));
 		return LDB_ERR_ENTRY_ALREADY_EXISTS;		
 	}
 
@@ -1131,8 +1797,22 @@ static int ltdb_index_add1(struct ldb_module *module, const char *dn,
 		talloc_free(list);
 		return LDB_ERR_OPERATIONS_ERROR;
 	}
-	list->dn[list->count].data = (uint8_t *)talloc_strdup(list->dn, dn);
-	list->dn[list->count].length = strlen(dn);
+	if (pos != list->count) {
+		memmove(&list->dn[pos+1], &list->dn[pos],
+			sizeof(list->dn[0]) * (list->count - pos));
+	}
+	if (ltdb->cache->GUID_index_attribute != NULL) {
+		list->dn[pos].data = talloc_memdup(list->dn, v.data, v.length);
+	} else {
+		list->dn[pos].data = (uint8_t *)talloc_strndup(list->dn,
+							       (char *)v.data,
+							       v.length);
+	}
+	if (list->dn[pos].data == NULL) {
+		talloc_free(list);
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+	list->dn[pos].length = v.length;
 	list->count++;
 
 	ret = ltdb_dn_list_store(module, dn_key, list);
@@ -1142,33 +1822,235 @@ static int ltdb_index_add1(struct ldb_module *module, const char *dn,
 	return ret;
 }
 
+static int ltdb_index_del1(struct ldb_module *module,
+			   const struct ldb_message *msg,
+			   struct ldb_message_element *el, unsigned int v_idx);
+
+/*
+  add or remove a bucket in the directory record of a range index
+*/
+static int ltdb_range_dir_update(struct ldb_module *module, const char *attr,
+				 uint8_t bucket[LTDB_GUID_SIZE], bool add)
+{
+	struct ldb_context *ldb = ldb_module_get_ctx(module);
+	struct ldb_dn *dn_key;
+	struct dn_list *list;
+	struct ldb_val v;
+	unsigned int pos;
+	int i, ret;
+
+	list = talloc_zero(module, struct dn_list);
+	if (list == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	dn_key = ltdb_range_dir_key(ldb, attr);
+	if (dn_key == NULL) {
+		talloc_free(list);
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+	talloc_steal(list, dn_key);
+
+	ret = ltdb_dn_list_load(module, dn_key, list);
+	if (ret != LDB_SUCCESS && ret != LDB_ERR_NO_SUCH_OBJECT) {
+		talloc_free(list);
+		return ret;
+	}
+
+	v.data = bucket;
+	v.length = LTDB_GUID_SIZE;
+	i = ltdb_guid_list_find(list, &v, &pos);
+	if ((i != -1) == add) {
+		/* already there, or already gone */
+		talloc_free(list);
+		return LDB_SUCCESS;
+	}
+
+	if (add) {
+		list->dn = talloc_realloc(list, list->dn, struct ldb_val,
+					  list->count + 1);
+		if (list->dn == NULL) {
+			talloc_free(list);
+			return LDB_ERR_OPERATIONS_ERROR;
+		}
+		memmove(&list->dn[pos+1], &list->dn[pos],
+			sizeof(list->dn[0]) * (list->count - pos));
+		list->dn[pos].data = talloc_memdup(list->dn, bucket,
+						   LTDB_GUID_SIZE);
+		if (list->dn[pos].data == NULL) {
+			talloc_free(list);
+			return LDB_ERR_OPERATIONS_ERROR;
+		}
+		list->dn[pos].length = LTDB_GUID_SIZE;
+		list->count++;
+	} else {
+		memmove(&list->dn[i], &list->dn[i+1],
+			sizeof(list->dn[0]) * (list->count - (i+1)));
+		list->count--;
+	}
+
+	ret = ltdb_dn_list_store(module, dn_key, list);
+
+	talloc_free(list);
+
+	return ret;
+}
+
+/*
+  insert or remove the range index entry for one value of an element
+*/
+static int ltdb_index_range(struct ldb_module *module,
+			    const struct ldb_message *msg,
+			    struct ldb_message_element *el, unsigned int v_idx,
+			    bool add)
+{
+	struct ldb_context *ldb = ldb_module_get_ctx(module);
+	uint8_t bucket[LTDB_GUID_SIZE];
+	struct ldb_message_element bel;
+	struct ldb_val bval;
+	struct ldb_dn *dn_key;
+	struct dn_list *list;
+	TALLOC_CTX *tmp_ctx;
+	bool ordered;
+	int ret;
+
+	ret = ltdb_range_bucket(ldb, el->name, &el->values[v_idx],
+				bucket, &ordered);
+	if (ret != LDB_SUCCESS) {
+		return ret;
+	}
+
+	tmp_ctx = talloc_new(module);
+	if (tmp_ctx == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	ret = ltdb_range_bucket_el(tmp_ctx, el->name,
+				   ordered ? bucket : NULL, &bel, &bval);
+	if (ret != LDB_SUCCESS) {
+		talloc_free(tmp_ctx);
+		return ret;
+	}
+
+	if (add) {
+		ret = ltdb_index_add1(module, msg, &bel, 0);
+		if (ret == LDB_SUCCESS && ordered) {
+			ret = ltdb_range_dir_update(module, el->name,
+						    bucket, true);
+		}
+		talloc_free(tmp_ctx);
+		return ret;
+	}
+
+	ret = ltdb_index_del1(module, msg, &bel, 0);
+	if (ret != LDB_SUCCESS || !ordered) {
+		talloc_free(tmp_ctx);
+		return ret;
+	}
+
+	/* drop the bucket from the directory once it is empty */
+	dn_key = ltdb_index_key(ldb, bel.name, &bval, NULL);
+	if (dn_key == NULL) {
+		talloc_free(tmp_ctx);
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+	talloc_steal(tmp_ctx, dn_key);
+
+	list = talloc_zero(tmp_ctx, struct dn_list);
+	if (list == NULL) {
+		talloc_free(tmp_ctx);
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	ret = ltdb_dn_list_load(module, dn_key, list);
+	if (ret == LDB_ERR_NO_SUCH_OBJECT ||
+	    (ret == LDB_SUCCESS && list->count == 0)) {
+		ret = ltdb_range_dir_update(module, el->name, bucket, false);
+	}
+
+	talloc_free(tmp_ctx);
+	return ret;
+}
+
+/*
+  insert or remove the presence index entry of an attribute
+*/
+static int ltdb_index_presence(struct ldb_module *module,
+			       const struct ldb_message *msg,
+			       const char *attr, bool add)
+{
+	struct ldb_message_element el;
+	struct ldb_val val;
+	int ret;
+
+	val.data = (uint8_t *)ldb_attr_casefold(module, attr);
+	if (val.data == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+	val.length = strlen((char *)val.data);
+	el.name = LTDB_IDXPRESENT;
+	el.values = &val;
+	el.num_values = 1;
+
+	if (add) {
+		ret = ltdb_index_add1(module, msg, &el, 0);
+	} else {
+		ret = ltdb_index_del1(module, msg, &el, 0);
+	}
+
+	talloc_free(val.data);
+	return ret;
+}
+
 /*
   add index entries for one elements in a message
  */
-static int ltdb_index_add_el(struct ldb_module *module, const char *dn,
+static int ltdb_index_add_el(struct ldb_module *module,
+			     const struct ldb_message *msg,
 			     struct ldb_message_element *el)
 {
+	struct ltdb_private *ltdb = talloc_get_type(ldb_module_get_private(module), struct ltdb_private);
+	const struct ldb_message *index_list = ltdb->cache->indexlist;
+	bool equality, range;
 	unsigned int i;
-	for (i = 0; i < el->num_values; i++) {
-		int ret = ltdb_index_add1(module, dn, el, i);
-		if (ret != LDB_SUCCESS) {
-			return ret;
+	int ret;
+
+	equality = ltdb_is_indexed(index_list, el->name);
+	range = ltdb_is_indexed_by(index_list, LTDB_IDXRANGE, el->name);
+
+	for (i = 0; (equality || range) && i < el->num_values; i++) {
+		if (equality) {
+			ret = ltdb_index_add1(module, msg, el, i);
+			if (ret != LDB_SUCCESS) {
+				return ret;
+			}
+		}
+		if (range) {
+			ret = ltdb_index_range(module, msg, el, i, true);
+			if (ret != LDB_SUCCESS) {
+				return ret;
+			}
 		}
 	}
 
+	if (el->num_values > 0 &&
+	    ltdb_is_indexed_by(index_list, LTDB_IDXPRESENT, el->name)) {
+		return ltdb_index_presence(module, msg, el->name, true);
+	}
+
 	return LDB_SUCCESS;
 }
 
 /*
   add index entries for all elements in a message
  */
-static int ltdb_index_add_all(struct ldb_module *module, const char *dn,
-			      struct ldb_message_element *elements, int num_el)
+static int ltdb_index_add_all(struct ldb_module *module,
+			      const struct ldb_message *msg)
 {
 	struct ltdb_private *ltdb = talloc_get_type(ldb_module_get_private(module), struct ltdb_private);
 	unsigned int i;
 
-	if (dn[0] == '@') {
+	if (ldb_dn_is_special(msg->dn)) {
 		return LDB_SUCCESS;
 	}
 
@@ -1177,17 +2059,15 @@ static int ltdb_index_add_all(struct ldb_module *module, const char *dn,
 		return LDB_SUCCESS;
 	}
 
-	for (i = 0; i < num_el; i++) {
-		int ret;
-		if (!ltdb_is_indexed(ltdb->cache->indexlist, elements[i].name)) {
-			continue;
-		}
-		ret = ltdb_index_add_el(module, dn, &elements[i]);
+	for (i = 0; i < msg->num_elements; i++) {
+		int ret = ltdb_index_add_el(module, msg, &msg->elements[i]);
 		if (ret != LDB_SUCCESS) {
 			struct ldb_context *ldb = ldb_module_get_ctx(module);
 			ldb_asprintf_errstring(ldb,
 					       __location__ ": Failed to re-index %s in %s - %s",
-					       elements[i].name, dn, ldb_errstring(ldb));
+					       msg->elements[i].name,
+					       ldb_dn_get_linearized(msg->dn),
+					       ldb_errstring(ldb));
 			return ret;
 		}
 	}
@@ -1205,7 +2085,6 @@ static int ltdb_index_onelevel(struct ldb_module *module, const struct ldb_messa
 	struct ldb_message_element el;
 	struct ldb_val val;
 	struct ldb_dn *pdn;
-	const char *dn;
 	int ret;
 
 	/* We index for ONE Level only if requested */
@@ -1218,12 +2097,6 @@ static int ltdb_index_onelevel(struct ldb_module *module, const struct ldb_messa
 		return LDB_ERR_OPERATIONS_ERROR;
 	}
 
-	dn = ldb_dn_get_linearized(msg->dn);
-	if (dn == NULL) {
-		talloc_free(pdn);
-		return LDB_ERR_OPERATIONS_ERROR;
-	}
-
 	val.data = (uint8_t *)((uintptr_t)ldb_dn_get_casefold(pdn));
 	if (val.data == NULL) {
 		talloc_free(pdn);
@@ -1236,9 +2109,9 @@ static int ltdb_index_onelevel(struct ldb_module *module, const struct ldb_messa
 	el.num_values = 1;
 
 	if (add) {
-		ret = ltdb_index_add1(module, dn, &el, 0);
+		ret = ltdb_index_add1(module, msg, &el, 0);
 	} else { /* delete */
-		ret = ltdb_index_del_value(module, msg->dn, &el, 0);
+		ret = ltdb_index_del1(module, msg, &el, 0);
 	}
 
 	talloc_free(pdn);
@@ -1247,20 +2120,48 @@ static int ltdb_index_onelevel(struct ldb_module *module, const struct ldb_messa
 }
 
 /*
-  add the index entries for a new element in a record
-  The caller guarantees that these element values are not yet indexed
+  insert or remove the DN index entry of a message, which maps its DN
+  to its GUID in a GUID indexed database
 */
-int ltdb_index_add_element(struct ldb_module *module, struct ldb_dn *dn, 
-			   struct ldb_message_element *el)
+static int ltdb_index_dn_guid(struct ldb_module *module,
+			      const struct ldb_message *msg, int add)
 {
 	struct ltdb_private *ltdb = talloc_get_type(ldb_module_get_private(module), struct ltdb_private);
-	if (ldb_dn_is_special(dn)) {
+	struct ldb_message_element el;
+	struct ldb_val val;
+
+	if (ltdb->cache->GUID_index_attribute == NULL) {
 		return LDB_SUCCESS;
 	}
-	if (!ltdb_is_indexed(ltdb->cache->indexlist, el->name)) {
+
+	val.data = (uint8_t *)((uintptr_t)ldb_dn_get_casefold(msg->dn));
+	if (val.data == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	val.length = strlen((char *)val.data);
+	el.name = LTDB_IDXDN;
+	el.values = &val;
+	el.num_values = 1;
+
+	if (add) {
+		return ltdb_index_add1(module, msg, &el, 0);
+	}
+	return ltdb_index_del1(module, msg, &el, 0);
+}
+
+/*
+  add the index entries for a new element in a record
+  The caller guarantees that these element values are not yet indexed
+*/
+int ltdb_index_add_element(struct ldb_module *module,
+			   const struct ldb_message *msg,
+			   struct ldb_message_element *el)
+{
+	if (ldb_dn_is_special(msg->dn)) {
 		return LDB_SUCCESS;
 	}
-	return ltdb_index_add_el(module, ldb_dn_get_linearized(dn), el);
+	return ltdb_index_add_el(module, msg, el);
 }
 
 /*
@@ -1268,19 +2169,18 @@ int ltdb_index_add_element(struct ldb_module *module, struct ldb_dn *dn,
 */
 int ltdb_index_add_new(struct ldb_module *module, const struct ldb_message *msg)
 {
-	const char *dn;
 	int ret;
 
 	if (ldb_dn_is_special(msg->dn)) {
 		return LDB_SUCCESS;
 	}
 
-	dn = ldb_dn_get_linearized(msg->dn);
-	if (dn == NULL) {
-		return LDB_ERR_OPERATIONS_ERROR;
+	ret = ltdb_index_dn_guid(module, msg, 1);
+	if (ret != LDB_SUCCESS) {
+		return ret;
 	}
 
-	ret = ltdb_index_add_all(module, dn, msg->elements, msg->num_elements);
+	ret = ltdb_index_add_all(module, msg);
 	if (ret != LDB_SUCCESS) {
 		return ret;
 	}
@@ -1292,25 +2192,27 @@ int ltdb_index_add_new(struct ldb_module *module, const struct ldb_message *msg)
 /*
   delete an index entry for one message element
 */
-int ltdb_index_del_value(struct ldb_module *module, struct ldb_dn *dn,
-			 struct ldb_message_element *el, unsigned int v_idx)
+static int ltdb_index_del1(struct ldb_module *module,
+			   const struct ldb_message *msg,
+			   struct ldb_message_element *el, unsigned int v_idx)
 {
+	struct ltdb_private *ltdb = talloc_get_type(ldb_module_get_private(module), struct ltdb_private);
 	struct ldb_context *ldb;
 	struct ldb_dn *dn_key;
-	const char *dn_str;
+	struct ldb_val v;
 	int ret, i;
 	unsigned int j;
 	struct dn_list *list;
 
 	ldb = ldb_module_get_ctx(module);
 
-	dn_str = ldb_dn_get_linearized(dn);
-	if (dn_str == NULL) {
-		return LDB_ERR_OPERATIONS_ERROR;
+	if (ldb_dn_is_special(msg->dn)) {
+		return LDB_SUCCESS;
 	}
 
-	if (dn_str[0] == '@') {
-		return LDB_SUCCESS;
+	ret = ltdb_index_entry_val(module, ltdb, msg, &v);
+	if (ret != LDB_SUCCESS) {
+		return ret;
 	}
 
 	dn_key = ltdb_index_key(ldb, el->name, &el->values[v_idx], NULL);
@@ -1337,7 +2239,7 @@ int ltdb_index_del_value(struct ldb_module *module, struct ldb_dn *dn,
 		return ret;
 	}
 
-	i = ltdb_dn_list_find_str(list, dn_str);
+	i = ltdb_dn_list_find_val(ltdb, list, &v);
 	if (i == -1) {
 		/* nothing to delete */
 		talloc_free(dn_key);
@@ -1358,15 +2260,39 @@ int ltdb_index_del_value(struct ldb_module *module, struct ldb_dn *dn,
 	return ret;
 }
 
+/*
+  delete the index entries for one value of a message element
+*/
+int ltdb_index_del_value(struct ldb_module *module,
+			 const struct ldb_message *msg,
+			 struct ldb_message_element *el, unsigned int v_idx)
+{
+	struct ltdb_private *ltdb = talloc_get_type(ldb_module_get_private(module), struct ltdb_private);
+	int ret;
+
+	ret = ltdb_index_del1(module, msg, el, v_idx);
+	if (ret != LDB_SUCCESS) {
+		return ret;
+	}
+
+	if (ldb_dn_is_special(msg->dn) ||
+	    !ltdb_is_indexed_by(ltdb->cache->indexlist, LTDB_IDXRANGE, el->name)) {
+		return LDB_SUCCESS;
+	}
+	return ltdb_index_range(module, msg, el, v_idx, false);
+}
+
 /*
   delete the index entries for a element
   return -1 on failure
 */
-int ltdb_index_del_element(struct ldb_module *module, struct ldb_dn *dn,
+int ltdb_index_del_element(struct ldb_module *module,
+			   const struct ldb_message *msg,
 			   struct ldb_message_element *el)
 {
 	struct ltdb_private *ltdb = talloc_get_type(ldb_module_get_private(module), struct ltdb_private);
-	const char *dn_str;
+	const struct ldb_message *index_list = ltdb->cache->indexlist;
+	bool equality, range;
 	int ret;
 	unsigned int i;
 
@@ -1375,23 +2301,30 @@ int ltdb_index_del_element(struct ldb_module *module, struct ldb_dn *dn,
 		return LDB_SUCCESS;
 	}
 
-	dn_str = ldb_dn_get_linearized(dn);
-	if (dn_str == NULL) {
-		return LDB_ERR_OPERATIONS_ERROR;
-	}
-
-	if (dn_str[0] == '@') {
+	if (ldb_dn_is_special(msg->dn)) {
 		return LDB_SUCCESS;
 	}
 
-	if (!ltdb_is_indexed(ltdb->cache->indexlist, el->name)) {
-		return LDB_SUCCESS;
-	}
-	for (i = 0; i < el->num_values; i++) {
-		ret = ltdb_index_del_value(module, dn, el, i);
-		if (ret != LDB_SUCCESS) {
-			return ret;
+	equality = ltdb_is_indexed(index_list, el->name);
+	range = ltdb_is_indexed_by(index_list, LTDB_IDXRANGE, el->name);
+
+	for (i = 0; (equality || range) && i < el->num_values; i++) {
+		if (equality) {
+			ret = ltdb_index_del1(module, msg, el, i);
+			if (ret != LDB_SUCCESS) {
+				return ret;
+			}
 		}
+		if (range) {
+			ret = ltdb_index_range(module, msg, el, i, false);
+			if (ret != LDB_SUCCESS) {
+				return ret;
+			}
+		}
+	}
+
+	if (ltdb_is_indexed_by(index_list, LTDB_IDXPRESENT, el->name)) {
+		return ltdb_index_presence(module, msg, el->name, false);
 	}
 
 	return LDB_SUCCESS;
@@ -1416,13 +2349,18 @@ int ltdb_index_delete(struct ldb_module *module, const struct ldb_message *msg)
 		return ret;
 	}
 
+	ret = ltdb_index_dn_guid(module, msg, 0);
+	if (ret != LDB_SUCCESS) {
+		return ret;
+	}
+
 	if (!ltdb->cache->attribute_indexes) {
 		/* no indexed fields */
 		return LDB_SUCCESS;
 	}
 
 	for (i = 0; i < msg->num_elements; i++) {
-		ret = ltdb_index_del_element(module, msg->dn, &msg->elements[i]);
+		ret = ltdb_index_del_element(module, msg, &msg->elements[i]);
 		if (ret != LDB_SUCCESS) {
 			return ret;
 		}
@@ -1432,12 +2370,20 @@ int ltdb_index_delete(struct ldb_module *module, const struct ldb_message *msg)
 }
 
 
+struct ltdb_reindex_context {
+	struct ldb_module *module;
+	int error;
+	/* records stored under a GUID= key were seen */
+	bool guid_keys;
+};
+
 /*
   traversal function that deletes all @INDEX records
 */
 static int delete_index(struct tdb_context *tdb, TDB_DATA key, TDB_DATA data, void *state)
 {
-	struct ldb_module *module = state;
+	struct ltdb_reindex_context *ctx = (struct ltdb_reindex_context *)state;
+	struct ldb_module *module = ctx->module;
 	struct ltdb_private *ltdb = talloc_get_type(ldb_module_get_private(module), struct ltdb_private);
 	const char *dnstr = "DN=" LTDB_INDEX ":";
 	struct dn_list list;
@@ -1445,7 +2391,13 @@ static int delete_index(struct tdb_context *tdb, TDB_DATA key, TDB_DATA data, vo
 	struct ldb_val v;
 	int ret;
 
-	if (strncmp((char *)key.dptr, dnstr, strlen(dnstr)) != 0) {
+	if (ltdb_key_is_record(key) && key.dptr[0] == 'G') {
+		ctx->guid_keys = true;
+		return 0;
+	}
+
+	if (key.dsize < strlen(dnstr) ||
+	    strncmp((char *)key.dptr, dnstr, strlen(dnstr)) != 0) {
 		return 0;
 	}
 	/* we need to put a empty list in the internal tdb for this
@@ -1470,11 +2422,6 @@ static int delete_index(struct tdb_context *tdb, TDB_DATA key, TDB_DATA data, vo
 	return 0;
 }
 
-struct ltdb_reindex_context {
-	struct ldb_module *module;
-	int error;
-};
-
 /*
   traversal function that adds @INDEX records during a re index
 */
@@ -1483,15 +2430,15 @@ static int re_index(struct tdb_context *tdb, TDB_DATA key, TDB_DATA data, void *
 	struct ldb_context *ldb;
 	struct ltdb_reindex_context *ctx = (struct ltdb_reindex_context *)state;
 	struct ldb_module *module = ctx->module;
+	struct ltdb_private *ltdb = talloc_get_type(ldb_module_get_private(module), struct ltdb_private);
 	struct ldb_message *msg;
-	const char *dn = NULL;
 	int ret;
 	TDB_DATA key2;
 
 	ldb = ldb_module_get_ctx(module);
 
-	if (strncmp((char *)key.dptr, "DN=@", 4) == 0 ||
-	    strncmp((char *)key.dptr, "DN=", 3) != 0) {
+	if (!ltdb_key_is_record(key) ||
+	    strncmp((char *)key.dptr, "DN=@", 4) == 0) {
 		return 0;
 	}
 
@@ -1508,26 +2455,50 @@ static int re_index(struct tdb_context *tdb, TDB_DATA key, TDB_DATA data, void *
 		return -1;
 	}
 
-	/* check if the DN key has changed, perhaps due to the
-	   case insensitivity of an element changing */
-	key2 = ltdb_key(module, msg->dn);
+	if (msg->dn == NULL) {
+		if (key.dptr[0] != 'D') {
+			ldb_debug(ldb, LDB_DEBUG_ERROR,
+				  "GUID keyed record without a DN in re_index");
+			talloc_free(msg);
+			return -1;
+		}
+		msg->dn = ldb_dn_new(msg, ldb, (char *)key.dptr + 3);
+		if (msg->dn == NULL) {
+			talloc_free(msg);
+			return -1;
+		}
+	}
+
+	/* check if the record key has changed, perhaps due to the
+	   case insensitivity of an element changing, or because the
+	   GUID index was switched on or off in @INDEXLIST */
+	key2 = ltdb_key_msg(module, msg);
 	if (key2.dptr == NULL) {
+		if (ltdb->cache->GUID_index_attribute != NULL) {
+			/* we cannot leave the record behind under a
+			   key the GUID index will never look at */
+			ctx->error = LDB_ERR_UNWILLING_TO_PERFORM;
+			talloc_free(msg);
+			return -1;
+		}
 		/* probably a corrupt record ... darn */
 		ldb_debug(ldb, LDB_DEBUG_ERROR, "Invalid DN in re_index: %s",
 						ldb_dn_get_linearized(msg->dn));
 		talloc_free(msg);
 		return 0;
 	}
-	if (strcmp((char *)key2.dptr, (char *)key.dptr) != 0) {
+	if (key2.dsize != key.dsize ||
+	    memcmp(key2.dptr, key.dptr, key.dsize) != 0) {
 		tdb_delete(tdb, key);
 		tdb_store(tdb, key2, data, 0);
 	}
 	talloc_free(key2.dptr);
 
-	if (msg->dn == NULL) {
-		dn = (char *)key.dptr + 3;
-	} else {
-		dn = ldb_dn_get_linearized(msg->dn);
+	ret = ltdb_index_dn_guid(module, msg, 1);
+	if (ret != LDB_SUCCESS) {
+		ctx->error = ret;
+		talloc_free(msg);
+		return -1;
 	}
 
 	ret = ltdb_index_onelevel(module, msg, 1);
@@ -1539,7 +2510,7 @@ static int re_index(struct tdb_context *tdb, TDB_DATA key, TDB_DATA data, void *
 		return -1;
 	}
 
-	ret = ltdb_index_add_all(module, dn, msg->elements, msg->num_elements);
+	ret = ltdb_index_add_all(module, msg);
 
 	if (ret != LDB_SUCCESS) {
 		ctx->error = ret;
@@ -1565,22 +2536,24 @@ int ltdb_reindex(struct ldb_module *module)
 		return LDB_ERR_OPERATIONS_ERROR;
 	}
 
+	ctx.module = module;
+	ctx.error = 0;
+	ctx.guid_keys = false;
+
 	/* first traverse the database deleting any @INDEX records by
 	 * putting NULL entries in the in-memory tdb
 	 */
-	ret = tdb_traverse(ltdb->tdb, delete_index, module);
+	ret = tdb_traverse(ltdb->tdb, delete_index, &ctx);
 	if (ret < 0) {
 		return LDB_ERR_OPERATIONS_ERROR;
 	}
 
-	/* if we don't have indexes we have nothing todo */
-	if (ltdb->cache->indexlist->num_elements == 0) {
+	/* if we don't have indexes we have nothing todo, unless
+	 * records need moving back from GUID to DN keys */
+	if (ltdb->cache->indexlist->num_elements == 0 && !ctx.guid_keys) {
 		return LDB_SUCCESS;
 	}
 
-	ctx.module = module;
-	ctx.error = 0;
-
 	/* now traverse adding any indexes for normal LDB records */
 	ret = tdb_traverse(ltdb->tdb, re_index, &ctx);
 	if (ret < 0) {
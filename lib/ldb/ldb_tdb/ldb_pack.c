@@ -152,11 +152,16 @@ int ltdb_pack_data(struct ldb_module *module,
 /*
   unpack a ldb message from a linear buffer in TDB_DATA
 
+  With LTDB_UNPACK_DATA_FLAG_NO_DATA_ALLOC the element names and
+  values point into data->dptr rather than being copied, so the
+  buffer must outlive the message. The DN is always copied.
+
   Free with ltdb_unpack_data_free()
 */
-int ltdb_unpack_data(struct ldb_module *module,
-		     const TDB_DATA *data,
-		     struct ldb_message *message)
+int ltdb_unpack_data_flags(struct ldb_module *module,
+			   const TDB_DATA *data,
+			   struct ldb_message *message,
+			   unsigned int flags)
 {
 	struct ldb_context *ldb;
 	uint8_t *p;
@@ -238,7 +243,11 @@ int ltdb_unpack_data(struct ldb_module *module,
 			goto failed;
 		}
 		message->elements[i].flags = 0;
-		message->elements[i].name = talloc_strndup(message->elements, (char *)p, len);
+		if (flags & LTDB_UNPACK_DATA_FLAG_NO_DATA_ALLOC) {
+			message->elements[i].name = (const char *)p;
+		} else {
+			message->elements[i].name = talloc_strndup(message->elements, (char *)p, len);
+		}
 		if (message->elements[i].name == NULL) {
 			errno = ENOMEM;
 			goto failed;
@@ -266,6 +275,18 @@ int ltdb_unpack_data(struct ldb_module *module,
 			}
 
 			message->elements[i].values[j].length = len;
+			if (flags & LTDB_UNPACK_DATA_FLAG_NO_DATA_ALLOC) {
+				/* values are stored NUL terminated, which
+				   callers rely on */
+				if (p[4+len] != 0) {
+					errno = EIO;
+					goto failed;
+				}
+				message->elements[i].values[j].data = p+4;
+				remaining -= len+4+1;
+				p += len+4+1;
+				continue;
+			}
 			message->elements[i].values[j].data = talloc_size(message->elements[i].values, len+1);
 			if (message->elements[i].values[j].data == NULL) {
 				errno = ENOMEM;
@@ -290,3 +311,10 @@ failed:
 	talloc_free(message->elements);
 	return -1;
 }
+
+int ltdb_unpack_data(struct ldb_module *module,
+		     const TDB_DATA *data,
+		     struct ldb_message *message)
+{
+	return ltdb_unpack_data_flags(module, data, message, 0);
+}
@@ -234,6 +234,83 @@ static int ltdb_search_base(struct ldb_module *module, struct ldb_dn *dn)
 	return LDB_SUCCESS;
 }
 
+struct ltdb_parse_data_unpack_ctx {
+	struct ldb_module *module;
+	struct ldb_message *msg;
+	unsigned int unpack_flags;
+};
+
+/*
+  unpack a record in place, from inside tdb_parse_record()
+*/
+static int ltdb_parse_data_unpack(TDB_DATA key, TDB_DATA data,
+				  void *private_data)
+{
+	struct ltdb_parse_data_unpack_ctx *ctx = private_data;
+	TDB_DATA data_parse = data;
+	int ret;
+
+	if (ctx->unpack_flags & LTDB_UNPACK_DATA_FLAG_NO_DATA_ALLOC) {
+		/* the record is only valid during this callback, so
+		   keep one copy of it for the elements to point into
+		   rather than a copy of every name and value */
+		data_parse.dptr = (uint8_t *)talloc_memdup(ctx->msg, data.dptr,
+							   data.dsize);
+		if (data_parse.dptr == NULL) {
+			return LDB_ERR_OPERATIONS_ERROR;
+		}
+	}
+
+	ret = ltdb_unpack_data_flags(ctx->module, &data_parse, ctx->msg,
+				     ctx->unpack_flags);
+	if (ret == -1) {
+		struct ldb_context *ldb = ldb_module_get_ctx(ctx->module);
+		if (data_parse.dptr != data.dptr) {
+			talloc_free(data_parse.dptr);
+		}
+		ldb_debug(ldb, LDB_DEBUG_ERROR, "Invalid data for index %*.*s\n",
+			  (int)key.dsize, (int)key.dsize, key.dptr);
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	return LDB_SUCCESS;
+}
+
+/*
+  fetch and unpack the record stored under a tdb key
+
+  return LDB_ERR_NO_SUCH_OBJECT on record-not-found
+  and LDB_SUCCESS on success
+*/
+int ltdb_search_key(struct ldb_module *module, TDB_DATA tdb_key,
+		    struct ldb_message *msg, unsigned int unpack_flags)
+{
+	void *data = ldb_module_get_private(module);
+	struct ltdb_private *ltdb = talloc_get_type(data, struct ltdb_private);
+	struct ltdb_parse_data_unpack_ctx ctx = {
+		.module = module,
+		.msg = msg,
+		.unpack_flags = unpack_flags
+	};
+	int ret;
+
+	memset(msg, 0, sizeof(*msg));
+
+	msg->num_elements = 0;
+	msg->elements = NULL;
+
+	ret = tdb_parse_record(ltdb->tdb, tdb_key,
+			       ltdb_parse_data_unpack, &ctx);
+	if (ret == -1) {
+		if (tdb_error(ltdb->tdb) == TDB_ERR_NOEXIST) {
+			return LDB_ERR_NO_SUCH_OBJECT;
+		}
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	return ret;
+}
+
 /*
   search the database for a single simple dn, returning all attributes
   in a single message
@@ -241,37 +318,37 @@ static int ltdb_search_base(struct ldb_module *module, struct ldb_dn *dn)
   return LDB_ERR_NO_SUCH_OBJECT on record-not-found
   and LDB_SUCCESS on success
 */
-int ltdb_search_dn1(struct ldb_module *module, struct ldb_dn *dn, struct ldb_message *msg)
+int ltdb_search_dn1(struct ldb_module *module, struct ldb_dn *dn,
+		    struct ldb_message *msg, unsigned int unpack_flags)
 {
 	void *data = ldb_module_get_private(module);
 	struct ltdb_private *ltdb = talloc_get_type(data, struct ltdb_private);
 	int ret;
-	TDB_DATA tdb_key, tdb_data;
+	TDB_DATA tdb_key;
 
 	memset(msg, 0, sizeof(*msg));
 
 	/* form the key */
-	tdb_key = ltdb_key(module, dn);
-	if (!tdb_key.dptr) {
-		return LDB_ERR_OPERATIONS_ERROR;
+	if (ltdb->cache != NULL &&
+	    ltdb->cache->GUID_index_attribute != NULL &&
+	    !ldb_dn_is_special(dn)) {
+		/* the record is stored under its GUID, which we find
+		   in the DN index */
+		ret = ltdb_key_dn_from_idx(module, dn, &tdb_key);
+		if (ret != LDB_SUCCESS) {
+			return ret;
+		}
+	} else {
+		tdb_key = ltdb_key(module, dn);
+		if (!tdb_key.dptr) {
+			return LDB_ERR_OPERATIONS_ERROR;
+		}
 	}
 
-	tdb_data = tdb_fetch_compat(ltdb->tdb, tdb_key);
+	ret = ltdb_search_key(module, tdb_key, msg, unpack_flags);
 	talloc_free(tdb_key.dptr);
-	if (!tdb_data.dptr) {
-		return LDB_ERR_NO_SUCH_OBJECT;
-	}
-	
-	msg->num_elements = 0;
-	msg->elements = NULL;
-
-	ret = ltdb_unpack_data(module, &tdb_data, msg);
-	free(tdb_data.dptr);
-	if (ret == -1) {
-		struct ldb_context *ldb = ldb_module_get_ctx(module);
-		ldb_debug(ldb, LDB_DEBUG_ERROR, "Invalid data for index %s\n",
-			  ldb_dn_get_linearized(msg->dn));
-		return LDB_ERR_OPERATIONS_ERROR;		
+	if (ret != LDB_SUCCESS) {
+		return ret;
 	}
 
 	if (!msg->dn) {
@@ -323,15 +400,19 @@ int ltdb_add_attr_results(struct ldb_module *module,
 
 
 /*
-  filter the specified list of attributes from a message
-  removing not requested attrs.
+  filter the specified list of attributes from a message into a new
+  message on mem_ctx. Only the requested elements are copied, so msg
+  may point into a record buffer (see LTDB_UNPACK_DATA_FLAG_NO_DATA_ALLOC).
+  The DN is moved to the new message.
  */
-int ltdb_filter_attrs(struct ldb_message *msg, const char * const *attrs)
+int ltdb_filter_attrs(TALLOC_CTX *mem_ctx, struct ldb_message *msg,
+		      const char * const *attrs,
+		      struct ldb_message **filtered_msg)
 {
 	unsigned int i;
 	int keep_all = 0;
-	struct ldb_message_element *el2;
-	uint32_t num_elements;
+	int add_dn = 0;
+	struct ldb_message *msg2;
 
 	if (attrs) {
 		/* check for special attrs */
@@ -342,54 +423,70 @@ int ltdb_filter_attrs(struct ldb_message *msg, const char * const *attrs)
 			}
 
 			if (ldb_attr_cmp(attrs[i], "distinguishedName") == 0) {
-				if (msg_add_distinguished_name(msg) != 0) {
-					return -1;
-				}
+				add_dn = 1;
 			}
 		}
 	} else {
 		keep_all = 1;
 	}
-	
-	if (keep_all) {
-		if (msg_add_distinguished_name(msg) != 0) {
-			return -1;
-		}
-		return 0;
+
+	msg2 = ldb_msg_new(mem_ctx);
+	if (msg2 == NULL) {
+		return -1;
 	}
+	msg2->dn = talloc_steal(msg2, msg->dn);
 
-	el2 = talloc_array(msg, struct ldb_message_element, msg->num_elements);
-	if (el2 == NULL) {
+	msg2->elements = talloc_array(msg2, struct ldb_message_element,
+				      msg->num_elements + 1);
+	if (msg2->elements == NULL) {
+		talloc_free(msg2);
 		return -1;
 	}
-	num_elements = 0;
 
 	for (i = 0; i < msg->num_elements; i++) {
+		struct ldb_message_element *el = &msg->elements[i];
+		struct ldb_message_element *el2;
 		unsigned int j;
-		int found = 0;
-		
-		for (j = 0; attrs[j]; j++) {
-			if (ldb_attr_cmp(msg->elements[i].name, attrs[j]) == 0) {
+		int found = keep_all;
+
+		for (j = 0; !found && attrs[j]; j++) {
+			if (ldb_attr_cmp(el->name, attrs[j]) == 0) {
 				found = 1;
-				break;
 			}
 		}
+		if (!found) {
+			continue;
+		}
 
-		if (found) {
-			el2[num_elements] = msg->elements[i];
-			talloc_steal(el2, el2[num_elements].name);
-			talloc_steal(el2, el2[num_elements].values);
-			num_elements++;
+		el2 = &msg2->elements[msg2->num_elements];
+		el2->flags = el->flags;
+		el2->num_values = el->num_values;
+		el2->name = talloc_strdup(msg2->elements, el->name);
+		el2->values = talloc_array(msg2->elements, struct ldb_val,
+					   el->num_values);
+		if (el2->name == NULL ||
+		    (el->num_values != 0 && el2->values == NULL)) {
+			talloc_free(msg2);
+			return -1;
 		}
+		for (j = 0; j < el->num_values; j++) {
+			el2->values[j] = ldb_val_dup(el2->values, &el->values[j]);
+			if (el2->values[j].length != el->values[j].length) {
+				talloc_free(msg2);
+				return -1;
+			}
+		}
+		msg2->num_elements++;
 	}
 
-	talloc_free(msg->elements);
-	msg->elements = talloc_realloc(msg, el2, struct ldb_message_element, msg->num_elements);
-	if (msg->elements == NULL) {
-		return -1;
+	if (keep_all || add_dn) {
+		if (msg_add_distinguished_name(msg2) != 0) {
+			talloc_free(msg2);
+			return -1;
+		}
 	}
-	msg->num_elements = num_elements;
 
+	*filtered_msg = msg2;
 	return 0;
 }
 
@@ -400,15 +497,14 @@ static int search_func(struct tdb_context *tdb, TDB_DATA key, TDB_DATA data, voi
 {
 	struct ldb_context *ldb;
 	struct ltdb_context *ac;
-	struct ldb_message *msg;
+	struct ldb_message *msg, *filtered_msg;
 	int ret;
 	bool matched;
 
 	ac = talloc_get_type(state, struct ltdb_context);
 	ldb = ldb_module_get_ctx(ac->module);
 
-	if (key.dsize < 4 || 
-	    strncmp((char *)key.dptr, "DN=", 3) != 0) {
+	if (!ltdb_key_is_record(key)) {
 		return 0;
 	}
 
@@ -417,14 +513,21 @@ static int search_func(struct tdb_context *tdb, TDB_DATA key, TDB_DATA data, voi
 		return -1;
 	}
 
-	/* unpack the record */
-	ret = ltdb_unpack_data(ac->module, &data, msg);
+	/* unpack the record in place. Only what is returned to the
+	   caller gets copied, by ltdb_filter_attrs() */
+	ret = ltdb_unpack_data_flags(ac->module, &data, msg,
+				     LTDB_UNPACK_DATA_FLAG_NO_DATA_ALLOC);
 	if (ret == -1) {
 		talloc_free(msg);
 		return -1;
 	}
 
 	if (!msg->dn) {
+		if (key.dptr[0] != 'D') {
+			/* GUID keyed records always carry their DN */
+			talloc_free(msg);
+			return -1;
+		}
 		msg->dn = ldb_dn_new(msg, ldb,
 				     (char *)key.dptr + 3);
 		if (msg->dn == NULL) {
@@ -434,8 +537,8 @@ static int search_func(struct tdb_context *tdb, TDB_DATA key, TDB_DATA data, voi
 	}
 
 	/* see if it matches the given expression */
-	ret = ldb_match_msg_error(ldb, msg,
-				  ac->tree, ac->base, ac->scope, &matched);
+	ret = ldb_match_program_run(ac->match_program, msg,
+				    ac->base, ac->scope, &matched);
 	if (ret != LDB_SUCCESS) {
 		talloc_free(msg);
 		return -1;
@@ -446,14 +549,14 @@ static int search_func(struct tdb_context *tdb, TDB_DATA key, TDB_DATA data, voi
 	}
 
 	/* filter the attributes that the user wants */
-	ret = ltdb_filter_attrs(msg, ac->attrs);
+	ret = ltdb_filter_attrs(ac, msg, ac->attrs, &filtered_msg);
+	talloc_free(msg);
 
 	if (ret == -1) {
-		talloc_free(msg);
 		return -1;
 	}
 
-	ret = ldb_module_send_entry(ac->req, msg, NULL);
+	ret = ldb_module_send_entry(ac->req, filtered_msg, NULL);
 	if (ret != LDB_SUCCESS) {
 		ac->request_terminated = true;
 		/* the callback failed, abort the operation */
@@ -565,6 +668,12 @@ int ltdb_search(struct ltdb_context *ctx)
 	ctx->base = req->op.search.base;
 	ctx->attrs = req->op.search.attrs;
 
+	if (ret == LDB_SUCCESS) {
+		/* compile the filter once for all the candidates */
+		ret = ldb_match_program_compile(ldb, ctx, ctx->tree,
+						&ctx->match_program);
+	}
+
 	if (ret == LDB_SUCCESS) {
 		uint32_t match_count = 0;
 
@@ -601,6 +710,7 @@ int ltdb_search(struct ltdb_context *ctx)
 				 * full search or we may return
 				 * duplicate entries
 				 */
+				TALLOC_FREE(ctx->match_program);
 				ltdb_unlock_read(module);
 				return LDB_ERR_OPERATIONS_ERROR;
 			}
@@ -611,6 +721,7 @@ int ltdb_search(struct ltdb_context *ctx)
 		}
 	}
 
+	TALLOC_FREE(ctx->match_program);
 	ltdb_unlock_read(module);
 
 	return ret;
@@ -182,6 +182,89 @@ failed:
 	return key;
 }
 
+/*
+  form the TDB_DATA key for a record in a GUID indexed database
+  caller frees
+*/
+TDB_DATA ltdb_guid_to_key(struct ldb_module *module,
+			  const struct ldb_val *guid)
+{
+	struct ldb_context *ldb = ldb_module_get_ctx(module);
+	TDB_DATA key;
+
+	key.dptr = NULL;
+	key.dsize = 0;
+
+	if (guid->length != LTDB_GUID_SIZE) {
+		errno = EINVAL;
+		return key;
+	}
+
+	key.dptr = talloc_size(ldb, LTDB_GUID_KEY_SIZE);
+	if (key.dptr == NULL) {
+		errno = ENOMEM;
+		return key;
+	}
+	memcpy(key.dptr, LTDB_GUID_KEY_PREFIX, LTDB_GUID_KEY_PREFIX_LEN);
+	memcpy(key.dptr + LTDB_GUID_KEY_PREFIX_LEN, guid->data, LTDB_GUID_SIZE);
+	key.dsize = LTDB_GUID_KEY_SIZE;
+
+	return key;
+}
+
+/*
+  form the TDB_DATA key a message is stored under: its GUID when the
+  database has a GUID index, otherwise its DN
+  caller frees
+*/
+TDB_DATA ltdb_key_msg(struct ldb_module *module,
+		      const struct ldb_message *msg)
+{
+	void *data = ldb_module_get_private(module);
+	struct ltdb_private *ltdb = talloc_get_type(data, struct ltdb_private);
+	const struct ldb_val *guid;
+	TDB_DATA key;
+
+	if (ltdb->cache->GUID_index_attribute == NULL ||
+	    ldb_dn_is_special(msg->dn)) {
+		return ltdb_key(module, msg->dn);
+	}
+
+	guid = ldb_msg_find_ldb_val(msg, ltdb->cache->GUID_index_attribute);
+	if (guid == NULL || guid->length != LTDB_GUID_SIZE) {
+		ldb_asprintf_errstring(ldb_module_get_ctx(module),
+				       "Entry %s has no valid %s for the GUID index",
+				       ldb_dn_get_linearized(msg->dn),
+				       ltdb->cache->GUID_index_attribute);
+		errno = EINVAL;
+		key.dptr = NULL;
+		key.dsize = 0;
+		return key;
+	}
+
+	return ltdb_guid_to_key(module, guid);
+}
+
+/*
+  see if a tdb key is that of a DN or GUID keyed record, rather than
+  some other data stored in the same tdb
+*/
+bool ltdb_key_is_record(TDB_DATA key)
+{
+	if (key.dsize < 4) {
+		return false;
+	}
+	if (memcmp(key.dptr, "DN=", 3) == 0) {
+		return true;
+	}
+	if (key.dsize == LTDB_GUID_KEY_SIZE &&
+	    memcmp(key.dptr, LTDB_GUID_KEY_PREFIX,
+		   LTDB_GUID_KEY_PREFIX_LEN) == 0) {
+		return true;
+	}
+	return false;
+}
+
 /*
   check special dn's have valid attributes
   currently only @ATTRIBUTES is checked
@@ -263,8 +346,11 @@ int ltdb_store(struct ldb_module *module, const struct ldb_message *msg, int flg
 	TDB_DATA tdb_key, tdb_data;
 	int ret = LDB_SUCCESS;
 
-	tdb_key = ltdb_key(module, msg->dn);
+	tdb_key = ltdb_key_msg(module, msg);
 	if (tdb_key.dptr == NULL) {
+		if (errno == EINVAL) {
+			return LDB_ERR_UNWILLING_TO_PERFORM;
+		}
 		return LDB_ERR_OTHER;
 	}
 
@@ -321,6 +407,8 @@ static int ltdb_add_internal(struct ldb_module *module,
 			     bool check_single_value)
 {
 	struct ldb_context *ldb = ldb_module_get_ctx(module);
+	void *data = ldb_module_get_private(module);
+	struct ltdb_private *ltdb = talloc_get_type(data, struct ltdb_private);
 	int ret = LDB_SUCCESS;
 	unsigned int i;
 
@@ -342,7 +430,22 @@ static int ltdb_add_internal(struct ldb_module *module,
 		}
 	}
 
-	ret = ltdb_store(module, msg, TDB_INSERT);
+	if (ltdb->cache->GUID_index_attribute != NULL &&
+	    !ldb_dn_is_special(msg->dn)) {
+		/* records are keyed by GUID, so the DN index is what
+		   tells us if the DN is already taken */
+		TDB_DATA key;
+
+		ret = ltdb_key_dn_from_idx(module, msg->dn, &key);
+		if (ret == LDB_SUCCESS) {
+			talloc_free(key.dptr);
+			ret = LDB_ERR_ENTRY_ALREADY_EXISTS;
+		} else if (ret == LDB_ERR_NO_SUCH_OBJECT) {
+			ret = ltdb_store(module, msg, TDB_INSERT);
+		}
+	} else {
+		ret = ltdb_store(module, msg, TDB_INSERT);
+	}
 	if (ret != LDB_SUCCESS) {
 		if (ret == LDB_ERR_ENTRY_ALREADY_EXISTS) {
 			ldb_asprintf_errstring(ldb,
@@ -391,14 +494,15 @@ static int ltdb_add(struct ltdb_context *ctx)
   delete a record from the database, not updating indexes (used for deleting
   index records)
 */
-int ltdb_delete_noindex(struct ldb_module *module, struct ldb_dn *dn)
+int ltdb_delete_noindex(struct ldb_module *module,
+			const struct ldb_message *msg)
 {
 	void *data = ldb_module_get_private(module);
 	struct ltdb_private *ltdb = talloc_get_type(data, struct ltdb_private);
 	TDB_DATA tdb_key;
 	int ret;
 
-	tdb_key = ltdb_key(module, dn);
+	tdb_key = ltdb_key_msg(module, msg);
 	if (!tdb_key.dptr) {
 		return LDB_ERR_OTHER;
 	}
@@ -425,13 +529,13 @@ static int ltdb_delete_internal(struct ldb_module *module, struct ldb_dn *dn)
 
 	/* in case any attribute of the message was indexed, we need
 	   to fetch the old record */
-	ret = ltdb_search_dn1(module, dn, msg);
+	ret = ltdb_search_dn1(module, dn, msg, 0);
 	if (ret != LDB_SUCCESS) {
 		/* not finding the old record is an error */
 		goto done;
 	}
 
-	ret = ltdb_delete_noindex(module, dn);
+	ret = ltdb_delete_noindex(module, msg);
 	if (ret != LDB_SUCCESS) {
 		goto done;
 	}
@@ -556,7 +660,7 @@ static int msg_delete_attribute(struct ldb_module *module,
 	}
 	i = el - msg->elements;
 
-	ret = ltdb_index_del_element(module, msg->dn, el);
+	ret = ltdb_index_del_element(module, msg, el);
 	if (ret != LDB_SUCCESS) {
 		return ret;
 	}
@@ -613,7 +717,7 @@ static int msg_delete_element(struct ldb_module *module,
 				return msg_delete_attribute(module, ldb, msg, name);
 			}
 
-			ret = ltdb_index_del_value(module, msg->dn, el, i);
+			ret = ltdb_index_del_value(module, msg, el, i);
 			if (ret != LDB_SUCCESS) {
 				return ret;
 			}
@@ -652,8 +756,8 @@ int ltdb_modify_internal(struct ldb_module *module,
 	struct ldb_context *ldb = ldb_module_get_ctx(module);
 	void *data = ldb_module_get_private(module);
 	struct ltdb_private *ltdb = talloc_get_type(data, struct ltdb_private);
-	TDB_DATA tdb_key, tdb_data;
 	struct ldb_message *msg2;
+	struct ldb_val guid = { .data = NULL, .length = 0 };
 	unsigned int i, j, k;
 	int ret = LDB_SUCCESS, idx;
 	struct ldb_control *control_permissive = NULL;
@@ -663,33 +767,29 @@ int ltdb_modify_internal(struct ldb_module *module,
 					LDB_CONTROL_PERMISSIVE_MODIFY_OID);
 	}
 
-	tdb_key = ltdb_key(module, msg->dn);
-	if (!tdb_key.dptr) {
-		return LDB_ERR_OTHER;
-	}
-
-	tdb_data = tdb_fetch_compat(ltdb->tdb, tdb_key);
-	if (!tdb_data.dptr) {
-		talloc_free(tdb_key.dptr);
-		return ltdb_err_map(tdb_error(ltdb->tdb));
-	}
-
-	msg2 = ldb_msg_new(tdb_key.dptr);
+	msg2 = ldb_msg_new(module);
 	if (msg2 == NULL) {
-		free(tdb_data.dptr);
-		ret = LDB_ERR_OTHER;
-		goto done;
+		return LDB_ERR_OTHER;
 	}
 
-	ret = ltdb_unpack_data(module, &tdb_data, msg2);
-	free(tdb_data.dptr);
-	if (ret == -1) {
-		ret = LDB_ERR_OTHER;
+	ret = ltdb_search_dn1(module, msg->dn, msg2, 0);
+	if (ret != LDB_SUCCESS) {
+		if (ret == LDB_ERR_OPERATIONS_ERROR) {
+			ret = LDB_ERR_OTHER;
+		}
 		goto done;
 	}
 
-	if (!msg2->dn) {
-		msg2->dn = msg->dn;
+	if (ltdb->cache->GUID_index_attribute != NULL &&
+	    !ldb_dn_is_special(msg2->dn)) {
+		/* the record is stored under its GUID, so remember it
+		   to check that the modify leaves it alone */
+		const struct ldb_val *v;
+		v = ldb_msg_find_ldb_val(msg2,
+					 ltdb->cache->GUID_index_attribute);
+		if (v != NULL) {
+			guid = ldb_val_dup(msg2, v);
+		}
 	}
 
 	for (i=0; i<msg->num_elements; i++) {
@@ -745,8 +845,7 @@ int ltdb_modify_internal(struct ldb_module *module,
 					ret = LDB_ERR_OTHER;
 					goto done;
 				}
-				ret = ltdb_index_add_element(module, msg2->dn,
-							     el);
+				ret = ltdb_index_add_element(module, msg2, el);
 				if (ret != LDB_SUCCESS) {
 					goto done;
 				}
@@ -812,7 +911,7 @@ int ltdb_modify_internal(struct ldb_module *module,
 				el2->values = vals;
 				el2->num_values += el->num_values;
 
-				ret = ltdb_index_add_element(module, msg2->dn, el);
+				ret = ltdb_index_add_element(module, msg2, el);
 				if (ret != LDB_SUCCESS) {
 					goto done;
 				}
@@ -864,7 +963,7 @@ int ltdb_modify_internal(struct ldb_module *module,
 				goto done;
 			}
 
-			ret = ltdb_index_add_element(module, msg2->dn, el);
+			ret = ltdb_index_add_element(module, msg2, el);
 			if (ret != LDB_SUCCESS) {
 				goto done;
 			}
@@ -924,6 +1023,20 @@ int ltdb_modify_internal(struct ldb_module *module,
 		}
 	}
 
+	if (guid.data != NULL) {
+		const struct ldb_val *v;
+		v = ldb_msg_find_ldb_val(msg2,
+					 ltdb->cache->GUID_index_attribute);
+		if (v == NULL || ldb_val_equal_exact(v, &guid) == 0) {
+			ldb_asprintf_errstring(ldb,
+					       "attribute '%s': cannot change the GUID index attribute on '%s'",
+					       ltdb->cache->GUID_index_attribute,
+					       ldb_dn_get_linearized(msg2->dn));
+			ret = LDB_ERR_UNWILLING_TO_PERFORM;
+			goto done;
+		}
+	}
+
 	ret = ltdb_store(module, msg2, TDB_MODIFY);
 	if (ret != LDB_SUCCESS) {
 		goto done;
@@ -935,7 +1048,7 @@ int ltdb_modify_internal(struct ldb_module *module,
 	}
 
 done:
-	talloc_free(tdb_key.dptr);
+	talloc_free(msg2);
 	return ret;
 }
 
@@ -987,7 +1100,7 @@ static int ltdb_rename(struct ltdb_context *ctx)
 
 	/* in case any attribute of the message was indexed, we need
 	   to fetch the old record */
-	ret = ltdb_search_dn1(module, req->op.rename.olddn, msg);
+	ret = ltdb_search_dn1(module, req->op.rename.olddn, msg, 0);
 	if (ret != LDB_SUCCESS) {
 		/* not finding the old record is an error */
 		return ret;
@@ -1150,7 +1263,7 @@ static int ltdb_sequence_number(struct ltdb_context *ctx,
 		goto done;
 	}
 
-	ret = ltdb_search_dn1(module, dn, msg);
+	ret = ltdb_search_dn1(module, dn, msg, 0);
 	if (ret != LDB_SUCCESS) {
 		goto done;
 	}
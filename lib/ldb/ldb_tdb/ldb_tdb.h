@@ -21,6 +21,9 @@ struct ltdb_private {
 		struct ldb_message *attributes;
 		bool one_level_indexes;
 		bool attribute_indexes;
+		/* when set, records are keyed by this attribute and
+		   index lists hold sorted GUIDs rather than DNs */
+		const char *GUID_index_attribute;
 	} *cache;
 
 	int in_transaction;
@@ -45,6 +48,7 @@ struct ltdb_context {
 	struct ldb_dn *base;
 	enum ldb_scope scope;
 	const char * const *attrs;
+	struct ldb_match_program *match_program;
 	struct tevent_timer *timeout_event;
 };
 
@@ -55,10 +59,20 @@ struct ltdb_context {
 #define LTDB_IDXVERSION "@IDXVERSION"
 #define LTDB_IDXATTR    "@IDXATTR"
 #define LTDB_IDXONE     "@IDXONE"
+#define LTDB_IDXDN      "@IDXDN"
+#define LTDB_IDXGUID    "@IDXGUID"
+#define LTDB_IDXRANGE   "@IDXRANGE"
+#define LTDB_IDXPRESENT "@IDXPRESENT"
 #define LTDB_BASEINFO   "@BASEINFO"
 #define LTDB_OPTIONS    "@OPTIONS"
 #define LTDB_ATTRIBUTES "@ATTRIBUTES"
 
+/* GUID keyed records, see @IDXGUID in @INDEXLIST */
+#define LTDB_GUID_SIZE 16
+#define LTDB_GUID_KEY_PREFIX "GUID="
+#define LTDB_GUID_KEY_PREFIX_LEN (sizeof(LTDB_GUID_KEY_PREFIX) - 1)
+#define LTDB_GUID_KEY_SIZE (LTDB_GUID_KEY_PREFIX_LEN + LTDB_GUID_SIZE)
+
 /* special attribute types */
 #define LTDB_SEQUENCE_NUMBER "sequenceNumber"
 #define LTDB_CHECK_BASE "checkBaseOnSearch"
@@ -79,12 +93,17 @@ struct ldb_parse_tree;
 int ltdb_search_indexed(struct ltdb_context *ctx, uint32_t *);
 int ltdb_index_add_new(struct ldb_module *module, const struct ldb_message *msg);
 int ltdb_index_delete(struct ldb_module *module, const struct ldb_message *msg);
-int ltdb_index_del_element(struct ldb_module *module, struct ldb_dn *dn,
+int ltdb_index_del_element(struct ldb_module *module,
+			   const struct ldb_message *msg,
 			   struct ldb_message_element *el);
-int ltdb_index_add_element(struct ldb_module *module, struct ldb_dn *dn, 
+int ltdb_index_add_element(struct ldb_module *module,
+			   const struct ldb_message *msg,
 			   struct ldb_message_element *el);
-int ltdb_index_del_value(struct ldb_module *module, struct ldb_dn *dn,
+int ltdb_index_del_value(struct ldb_module *module,
+			 const struct ldb_message *msg,
 			 struct ldb_message_element *el, unsigned int v_idx);
+int ltdb_key_dn_from_idx(struct ldb_module *module, struct ldb_dn *dn,
+			 TDB_DATA *key);
 int ltdb_reindex(struct ldb_module *module);
 int ltdb_index_transaction_start(struct ldb_module *module);
 int ltdb_index_transaction_commit(struct ldb_module *module);
@@ -101,28 +120,48 @@ int ltdb_unpack_data(struct ldb_module *module,
 		     const TDB_DATA *data,
 		     struct ldb_message *message);
 
+/* point element names and values into the packed buffer instead of
+   copying them */
+#define LTDB_UNPACK_DATA_FLAG_NO_DATA_ALLOC 0x0001
+
+int ltdb_unpack_data_flags(struct ldb_module *module,
+			   const TDB_DATA *data,
+			   struct ldb_message *message,
+			   unsigned int flags);
+
 /* The following definitions come from lib/ldb/ldb_tdb/ldb_search.c  */
 
 int ltdb_has_wildcard(struct ldb_module *module, const char *attr_name, 
 		      const struct ldb_val *val);
 void ltdb_search_dn1_free(struct ldb_module *module, struct ldb_message *msg);
-int ltdb_search_dn1(struct ldb_module *module, struct ldb_dn *dn, struct ldb_message *msg);
+int ltdb_search_dn1(struct ldb_module *module, struct ldb_dn *dn,
+		    struct ldb_message *msg, unsigned int unpack_flags);
+int ltdb_search_key(struct ldb_module *module, TDB_DATA tdb_key,
+		    struct ldb_message *msg, unsigned int unpack_flags);
 int ltdb_add_attr_results(struct ldb_module *module,
  			  TALLOC_CTX *mem_ctx, 
 			  struct ldb_message *msg,
 			  const char * const attrs[], 
 			  unsigned int *count, 
 			  struct ldb_message ***res);
-int ltdb_filter_attrs(struct ldb_message *msg, const char * const *attrs);
+int ltdb_filter_attrs(TALLOC_CTX *mem_ctx, struct ldb_message *msg,
+		      const char * const *attrs,
+		      struct ldb_message **filtered_msg);
 int ltdb_search(struct ltdb_context *ctx);
 
 /* The following definitions come from lib/ldb/ldb_tdb/ldb_tdb.c  */
 int ltdb_lock_read(struct ldb_module *module);
 int ltdb_unlock_read(struct ldb_module *module);
 TDB_DATA ltdb_key(struct ldb_module *module, struct ldb_dn *dn);
+TDB_DATA ltdb_guid_to_key(struct ldb_module *module,
+			  const struct ldb_val *guid);
+TDB_DATA ltdb_key_msg(struct ldb_module *module,
+		      const struct ldb_message *msg);
+bool ltdb_key_is_record(TDB_DATA key);
 int ltdb_store(struct ldb_module *module, const struct ldb_message *msg, int flgs);
 int ltdb_modify_internal(struct ldb_module *module, const struct ldb_message *msg, struct ldb_request *req);
-int ltdb_delete_noindex(struct ldb_module *module, struct ldb_dn *dn);
+int ltdb_delete_noindex(struct ldb_module *module,
+			const struct ldb_message *msg);
 int ltdb_err_map(enum TDB_ERROR tdb_code);
 
 struct tdb_context *ltdb_wrap_open(TALLOC_CTX *mem_ctx,
@@ -226,7 +226,7 @@ class SimpleLdb(unittest.TestCase):
             rm = l.search(m.dn)[0]
             self.assertEquals(1, len(rm))
             rm = l.search(m.dn, attrs=["bla"])
-            self.assertEquals(0, len(rm))
+            self.assertEquals(1, len(rm))
         finally:
             l.delete(ldb.Dn(l, "dc=modifydelete"))
 
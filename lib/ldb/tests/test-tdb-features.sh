@@ -158,3 +158,73 @@ EOF
 checkone 3 "cn=t1,cn=TEST" '(test=one)'
 checkone 1 "cn=t1,cn=TEST" '(cn=two)'
 
+
+checkindexed() {
+    count=$1
+    expression="$2"
+    n=`LDB_WARN_UNINDEXED=1 $VALGRIND ldbsearch$EXEEXT "$expression" 2>&1 | grep -c 'FULL SEARCH'`
+    if [ $n != 0 ]; then
+	echo "Unindexed search for $expression"
+	exit 1
+    fi
+    checkcount $count "$expression"
+}
+
+echo "Adding range and presence indexes"
+cat <<EOF | $VALGRIND ldbmodify$EXEEXT || exit 1
+dn: @INDEXLIST
+changetype: modify
+add: @IDXRANGE
+@IDXRANGE: i
+-
+add: @IDXPRESENT
+@IDXPRESENT: i
+@IDXPRESENT: test
+EOF
+
+cat <<EOF | $VALGRIND ldbadd$EXEEXT || exit 1
+dn: cn=r1,cn=TEST
+objectClass: rangeclass
+i: -5000
+
+dn: cn=r2,cn=TEST
+objectClass: rangeclass
+i: 10
+i: 2000
+
+dn: cn=r3,cn=TEST
+objectClass: rangeclass
+i: 100000
+EOF
+checkindexed 4 '(i=*)'
+checkindexed 4 '(test=*)'
+checkindexed 3 '(test=o*)'
+checkindexed 3 '(i>=256)'
+checkindexed 2 '(i>=257)'
+checkindexed 1 '(i>=100000)'
+checkindexed 0 '(i>=100001)'
+checkindexed 3 '(i<=256)'
+checkindexed 2 '(i<=10)'
+checkindexed 1 '(i<=-1)'
+checkindexed 0 '(i<=-5001)'
+checkindexed 2 '(&(i>=0)(i<=2000))'
+
+echo "Testing range and presence index updates"
+cat <<EOF | $VALGRIND ldbmodify$EXEEXT || exit 1
+dn: cn=r2,cn=TEST
+changetype: modify
+delete: i
+i: 2000
+EOF
+checkindexed 1 '(i>=1000)'
+checkindexed 2 '(i<=10)'
+cat <<EOF | $VALGRIND ldbmodify$EXEEXT || exit 1
+dn: cn=r3,cn=TEST
+changetype: modify
+delete: i
+EOF
+checkindexed 0 '(i>=1000)'
+checkindexed 3 '(i=*)'
+$VALGRIND ldbdel$EXEEXT 'cn=r1,cn=TEST' || exit 1
+checkindexed 0 '(i<=-1)'
+checkindexed 2 '(i=*)'
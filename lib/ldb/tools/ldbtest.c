@@ -387,6 +387,235 @@ static void start_test_index(struct ldb_context **ldb)
 }
 
 
+/*
+  run the indexed searches of the GUID index benchmark, checking the
+  number of results against what add_guid_records() stored
+*/
+static void search_guid_test(struct ldb_context *ldb, struct ldb_dn *basedn,
+			     unsigned int nrecords, unsigned int nsearches,
+			     const char *label)
+{
+	unsigned int i;
+	int ret;
+	struct ldb_result *res = NULL;
+	struct ldb_dn *dn;
+
+	_start_timer();
+	for (i=0;i<nsearches;i++) {
+		unsigned int type = i % 10, expected = 0, j;
+		const char *expr;
+
+		for (j=0;j<nrecords;j++) {
+			if (j % 3 == 0 && j % 10 == type) {
+				expected++;
+			}
+		}
+
+		/* an intersection of two long index lists */
+		expr = talloc_asprintf(ldb,
+				       "(&(objectClass=OpenLDAPperson)(employeeType=type%u))",
+				       type);
+		ret = ldb_search(ldb, ldb, &res, basedn, LDB_SCOPE_SUBTREE,
+				 NULL, "%s", expr);
+		if (ret != LDB_SUCCESS || res->count != expected) {
+			printf("%s: search %s failed - %u of %u: %s\n", label,
+			       expr, ret == LDB_SUCCESS ? res->count : 0,
+			       expected, ldb_errstring(ldb));
+			exit(LDB_ERR_OPERATIONS_ERROR);
+		}
+		talloc_free(res);
+
+		/* a union of two and a base search by DN */
+		expr = talloc_asprintf(ldb,
+				       "(|(employeeType=type%u)(employeeType=type%u))",
+				       type, (type + 1) % 10);
+		ret = ldb_search(ldb, ldb, &res, basedn, LDB_SCOPE_SUBTREE,
+				 NULL, "%s", expr);
+		if (ret != LDB_SUCCESS || res->count == 0) {
+			printf("%s: search %s failed - %s\n", label, expr,
+			       ldb_errstring(ldb));
+			exit(LDB_ERR_OPERATIONS_ERROR);
+		}
+		talloc_free(res);
+
+		dn = ldb_dn_copy(ldb, basedn);
+		ldb_dn_add_child_fmt(dn, "cn=GuidTest%u", i % nrecords);
+		ret = ldb_search(ldb, ldb, &res, dn, LDB_SCOPE_BASE,
+				 NULL, NULL);
+		if (ret != LDB_SUCCESS || res->count != 1) {
+			printf("%s: base search on %s failed - %s\n", label,
+			       ldb_dn_get_linearized(dn), ldb_errstring(ldb));
+			exit(LDB_ERR_OPERATIONS_ERROR);
+		}
+		talloc_free(res);
+		talloc_free(dn);
+	}
+	printf("%s: %u indexed searches took %.2f seconds\n",
+	       label, nsearches * 3, _end_timer());
+
+	ret = ldb_search(ldb, ldb, &res, basedn, LDB_SCOPE_ONELEVEL,
+			 NULL, "(objectClass=person)");
+	if (ret != LDB_SUCCESS || res->count != nrecords) {
+		printf("%s: one level search failed - %s\n", label,
+		       ldb_errstring(ldb));
+		exit(LDB_ERR_OPERATIONS_ERROR);
+	}
+	talloc_free(res);
+}
+
+static void add_guid_records(struct ldb_context *ldb,
+			     struct ldb_dn *basedn,
+			     unsigned int count)
+{
+	unsigned int i;
+
+	if (ldb_transaction_start(ldb) != LDB_SUCCESS) {
+		printf("transaction start failed - %s\n", ldb_errstring(ldb));
+		exit(LDB_ERR_OPERATIONS_ERROR);
+	}
+
+	for (i=0;i<count;i++) {
+		struct ldb_message *msg;
+		struct ldb_val guid;
+		uint8_t guid_data[16];
+		unsigned int j;
+
+		msg = ldb_msg_new(ldb);
+		msg->dn = ldb_dn_copy(msg, basedn);
+		ldb_dn_add_child_fmt(msg->dn, "cn=GuidTest%u", i);
+
+		for (j=0;j<sizeof(guid_data);j++) {
+			guid_data[j] = random();
+		}
+		guid.data = guid_data;
+		guid.length = sizeof(guid_data);
+
+		ldb_msg_add_fmt(msg, "cn", "GuidTest%u", i);
+		ldb_msg_add_string(msg, "objectClass", "person");
+		if (i % 3 == 0) {
+			ldb_msg_add_string(msg, "objectClass", "OpenLDAPperson");
+		}
+		ldb_msg_add_fmt(msg, "employeeType", "type%u", i % 10);
+		ldb_msg_add_value(msg, "objectGUID", &guid, NULL);
+
+		if (ldb_add(ldb, msg) != LDB_SUCCESS) {
+			printf("Add of %s failed - %s\n",
+			       ldb_dn_get_linearized(msg->dn), ldb_errstring(ldb));
+			exit(LDB_ERR_OPERATIONS_ERROR);
+		}
+		talloc_free(msg);
+	}
+
+	if (ldb_transaction_commit(ldb) != LDB_SUCCESS) {
+		printf("transaction commit failed - %s\n", ldb_errstring(ldb));
+		exit(LDB_ERR_OPERATIONS_ERROR);
+	}
+}
+
+/*
+  change the @IDXGUID setting in the @INDEXLIST, which reindexes and
+  moves the records between DN and GUID keys
+*/
+static void set_guid_index(struct ldb_context *ldb, bool enable)
+{
+	struct ldb_message *msg;
+
+	msg = ldb_msg_new(ldb);
+	msg->dn = ldb_dn_new(msg, ldb, "@INDEXLIST");
+	ldb_msg_add_empty(msg, "@IDXGUID", LDB_FLAG_MOD_REPLACE, NULL);
+	if (enable) {
+		ldb_msg_add_string(msg, "@IDXGUID", "objectGUID");
+	}
+
+	_start_timer();
+	if (ldb_modify(ldb, msg) != LDB_SUCCESS) {
+		printf("Setting @IDXGUID failed - %s\n", ldb_errstring(ldb));
+		exit(LDB_ERR_OPERATIONS_ERROR);
+	}
+	printf("reindex %s the GUID index took %.2f seconds\n",
+	       enable ? "into" : "out of", _end_timer());
+	talloc_free(msg);
+}
+
+/*
+  benchmark the indexes of a database keyed by DN against one keyed by
+  objectGUID, including the migration between the two. This uses a
+  database of its own, as every record needs an objectGUID
+*/
+static void start_test_guid_index(unsigned int nrecords,
+				  unsigned int nsearches)
+{
+	struct ldb_context *ldb;
+	struct ldb_message *msg;
+	struct ldb_dn *basedn;
+	const char *specials, *url, *path;
+	unsigned int flags = 0;
+	int ret;
+
+	specials = getenv("LDB_SPECIALS");
+	if (specials && atoi(specials) == 0) {
+		printf("LDB_SPECIALS disabled - skipping GUID index test\n");
+		return;
+	}
+
+	if (strncmp(options->url, "tdb://", 6) == 0) {
+		path = options->url + 6;
+	} else if (strstr(options->url, "://") == NULL) {
+		path = options->url;
+	} else {
+		printf("not a tdb database - skipping GUID index test\n");
+		return;
+	}
+
+	if (options->nosync) {
+		flags |= LDB_FLG_NOSYNC;
+	}
+
+	printf("Starting GUID index test\n");
+
+	ldb = ldb_init(options, NULL);
+	path = talloc_asprintf(ldb, "%s.guidtest", path);
+	url = talloc_asprintf(ldb, "tdb://%s", path);
+	unlink(path);
+
+	ret = ldb_connect(ldb, url, flags, NULL);
+	if (ret != LDB_SUCCESS) {
+		printf("failed to connect to %s\n", url);
+		exit(LDB_ERR_OPERATIONS_ERROR);
+	}
+
+	msg = ldb_msg_new(ldb);
+	msg->dn = ldb_dn_new(msg, ldb, "@INDEXLIST");
+	ldb_msg_add_string(msg, "@IDXATTR", "objectClass");
+	ldb_msg_add_string(msg, "@IDXATTR", "employeeType");
+	ldb_msg_add_string(msg, "@IDXONE", "1");
+	if (ldb_add(ldb, msg) != LDB_SUCCESS) {
+		printf("Add of %s failed - %s\n", ldb_dn_get_linearized(msg->dn), ldb_errstring(ldb));
+		exit(LDB_ERR_OPERATIONS_ERROR);
+	}
+	talloc_free(msg);
+
+	basedn = ldb_dn_new(ldb, ldb, options->basedn);
+
+	_start_timer();
+	add_guid_records(ldb, basedn, nrecords);
+	printf("adding %u records took %.2f seconds\n", nrecords, _end_timer());
+
+	search_guid_test(ldb, basedn, nrecords, nsearches, "DN index");
+
+	set_guid_index(ldb, true);
+	search_guid_test(ldb, basedn, nrecords, nsearches, "GUID index");
+
+	set_guid_index(ldb, false);
+	search_guid_test(ldb, basedn, nrecords, nsearches, "DN index");
+
+	talloc_free(ldb);
+	unlink(path);
+
+	printf("Finished GUID index test\n");
+}
+
+
 static void usage(struct ldb_context *ldb)
 {
 	printf("Usage: ldbtest <options>\n");
@@ -428,6 +657,9 @@ int main(int argc, const char **argv)
 
 	start_test_index(&ldb);
 
+	start_test_guid_index((unsigned int) options->num_records,
+			      (unsigned int) options->num_searches);
+
 	talloc_free(mem_ctx);
 
 	return LDB_SUCCESS;
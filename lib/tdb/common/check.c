@@ -39,7 +39,14 @@ static bool tdb_check_header(struct tdb_context *tdb, tdb_off_t *recovery)
 	if (hdr.version != TDB_VERSION)
 		goto corrupt;
 
-	if (hdr.rwlocks != 0 && hdr.rwlocks != TDB_HASH_RWLOCK_MAGIC)
+	if (hdr.rwlocks != 0 && hdr.rwlocks != TDB_HASH_RWLOCK_MAGIC &&
+	    hdr.rwlocks != TDB_FEATURE_FLAG_MAGIC)
+		goto corrupt;
+
+	if (hdr.rwlocks == TDB_FEATURE_FLAG_MAGIC &&
+	    (hdr.feature_flags != tdb->header.feature_flags ||
+	     hdr.mutex_offset != tdb->header.mutex_offset ||
+	     hdr.mutex_size != tdb->header.mutex_size))
 		goto corrupt;
 
 	tdb_header_hash(tdb, &h1, &h2);
@@ -54,7 +61,7 @@ static bool tdb_check_header(struct tdb_context *tdb, tdb_off_t *recovery)
 		goto corrupt;
 
 	if (hdr.recovery_start != 0 &&
-	    hdr.recovery_start < TDB_DATA_START(tdb->header.hash_size))
+	    hdr.recovery_start < TDB_DATA_START(tdb, tdb->header.hash_size))
 		goto corrupt;
 
 	*recovery = hdr.recovery_start;
@@ -74,7 +81,7 @@ static bool tdb_check_record(struct tdb_context *tdb,
 	tdb_off_t tailer;
 
 	/* Check rec->next: 0 or points to record offset, aligned. */
-	if (rec->next > 0 && rec->next < TDB_DATA_START(tdb->header.hash_size)){
+	if (rec->next > 0 && rec->next < TDB_DATA_START(tdb, tdb->header.hash_size)){
 		TDB_LOG((tdb, TDB_DEBUG_ERROR,
 			 "Record offset %d too small next %d\n",
 			 off, rec->next));
@@ -352,7 +359,7 @@ _PUBLIC_ int tdb_check(struct tdb_context *tdb,
 		goto unlock;
 
 	/* We should have the whole header, too. */
-	if (tdb->map_size < TDB_DATA_START(tdb->header.hash_size)) {
+	if (tdb->map_size < TDB_DATA_START(tdb, tdb->header.hash_size)) {
 		tdb->ecode = TDB_ERR_CORRUPT;
 		TDB_LOG((tdb, TDB_DEBUG_ERROR, "File too short for hashes\n"));
 		goto unlock;
@@ -381,8 +388,16 @@ _PUBLIC_ int tdb_check(struct tdb_context *tdb,
 			record_offset(hashes[h], off);
 	}
 
+	/* All the freelists share hashes[0]. */
+	for (h = 1; h < TDB_FREELISTS(tdb); h++) {
+		if (tdb_ofs_read(tdb, TDB_FREELIST_HEAD(h), &off) == -1)
+			goto free;
+		if (off)
+			record_offset(hashes[0], off);
+	}
+
 	/* For each record, read it in and check it's ok. */
-	for (off = TDB_DATA_START(tdb->header.hash_size);
+	for (off = TDB_DATA_START(tdb, tdb->header.hash_size);
 	     off < tdb->map_size;
 	     off += sizeof(rec) + rec.rec_len) {
 		if (tdb->methods->tdb_read(tdb, off, &rec, sizeof(rec),
@@ -90,48 +90,61 @@ _PUBLIC_ void tdb_dump_all(struct tdb_context *tdb)
 	tdb_dump_chain(tdb, -1);
 }
 
-_PUBLIC_ int tdb_printfreelist(struct tdb_context *tdb)
+static int tdb_print_one_freelist(struct tdb_context *tdb, unsigned int c,
+				  long *total_free)
 {
-	int ret;
-	long total_free = 0;
-	tdb_off_t offset, rec_ptr;
+	tdb_off_t rec_ptr;
 	struct tdb_record rec;
 
-	if ((ret = tdb_lock(tdb, -1, F_WRLCK)) != 0)
-		return ret;
-
-	offset = FREELIST_TOP;
-
 	/* read in the freelist top */
-	if (tdb_ofs_read(tdb, offset, &rec_ptr) == -1) {
-		tdb_unlock(tdb, -1, F_WRLCK);
+	if (tdb_ofs_read(tdb, TDB_FREELIST_HEAD(c), &rec_ptr) == -1) {
 		return 0;
 	}
 
-	printf("freelist top=[0x%08x]\n", rec_ptr );
+	if (TDB_FREELIST_CLASSES_ON(tdb)) {
+		printf("freelist %u top=[0x%08x]\n", c, rec_ptr);
+	} else {
+		printf("freelist top=[0x%08x]\n", rec_ptr );
+	}
 	while (rec_ptr) {
 		if (tdb->methods->tdb_read(tdb, rec_ptr, (char *)&rec, 
 					   sizeof(rec), DOCONV()) == -1) {
-			tdb_unlock(tdb, -1, F_WRLCK);
 			return -1;
 		}
 
 		if (rec.magic != TDB_FREE_MAGIC) {
 			printf("bad magic 0x%08x in free list\n", rec.magic);
-			tdb_unlock(tdb, -1, F_WRLCK);
 			return -1;
 		}
 
 		printf("entry offset=[0x%08x], rec.rec_len = [0x%08x (%d)] (end = 0x%08x)\n", 
 		       rec_ptr, rec.rec_len, rec.rec_len, rec_ptr + rec.rec_len);
-		total_free += rec.rec_len;
+		*total_free += rec.rec_len;
 
 		/* move to the next record */
 		rec_ptr = rec.next;
 	}
+	return 0;
+}
+
+_PUBLIC_ int tdb_printfreelist(struct tdb_context *tdb)
+{
+	int ret;
+	long total_free = 0;
+	unsigned int c;
+
+	for (c = 0; c < TDB_FREELISTS(tdb); c++) {
+		if ((ret = tdb_lock(tdb, TDB_FREELIST_LIST(c), F_WRLCK)) != 0)
+			return ret;
+
+		ret = tdb_print_one_freelist(tdb, c, &total_free);
+		tdb_unlock(tdb, TDB_FREELIST_LIST(c), F_WRLCK);
+		if (ret != 0) {
+			return ret;
+		}
+	}
 	printf("total rec_len = [0x%08x (%d)]\n", (int)total_free, 
                (int)total_free);
 
-	return tdb_unlock(tdb, -1, F_WRLCK);
+	return 0;
 }
-
@@ -97,12 +97,86 @@ static int update_tailer(struct tdb_context *tdb, tdb_off_t offset,
 			 &totalsize);
 }
 
+/* the size class of a free record, 0 without TDB_FEATURE_FLAG_FREELIST_CLASSES */
+static unsigned int tdb_freelist_class(struct tdb_context *tdb, tdb_len_t len)
+{
+	unsigned int c;
+
+	if (!TDB_FREELIST_CLASSES_ON(tdb)) {
+		return 0;
+	}
+	for (c = TDB_NUM_FREELISTS - 1; c > 0; c--) {
+		if (len < TDB_FREELIST_CLASS_LIMIT(c)) {
+			break;
+		}
+	}
+	return c;
+}
+
+/* the freelist a free record is on. With size classes it is kept in
+   the full_hash field, which free records don't use otherwise */
+static unsigned int tdb_free_rec_class(struct tdb_context *tdb,
+				       const struct tdb_record *rec)
+{
+	return TDB_FREELIST_CLASSES_ON(tdb) ? rec->full_hash : 0;
+}
+
+/* find a free record directly left of offset, 0 if there is none */
+static tdb_off_t tdb_free_left(struct tdb_context *tdb, tdb_off_t offset,
+			       struct tdb_record *l)
+{
+	tdb_off_t left = offset - sizeof(tdb_off_t);
+	tdb_off_t leftsize;
+
+	if (offset - sizeof(tdb_off_t) <= TDB_DATA_START(tdb, tdb->header.hash_size)) {
+		return 0;
+	}
+
+	/* Read in tailer and jump back to header */
+	if (tdb_ofs_read(tdb, left, &leftsize) == -1) {
+		TDB_LOG((tdb, TDB_DEBUG_FATAL, "tdb_free: left offset read failed at %u\n", left));
+		return 0;
+	}
+
+	/* it could be uninitialised data */
+	if (leftsize == 0 || leftsize == TDB_PAD_U32) {
+		return 0;
+	}
+
+	left = offset - leftsize;
+
+	if (leftsize > offset ||
+	    left < TDB_DATA_START(tdb, tdb->header.hash_size)) {
+		return 0;
+	}
+
+	/* Now read in the left record */
+	if (tdb->methods->tdb_read(tdb, left, l, sizeof(*l), DOCONV()) == -1) {
+		TDB_LOG((tdb, TDB_DEBUG_FATAL, "tdb_free: left read failed at %u (%u)\n", left, leftsize));
+		return 0;
+	}
+
+	if (l->magic != TDB_FREE_MAGIC ||
+	    left + sizeof(*l) + l->rec_len != offset) {
+		return 0;
+	}
+
+	return left;
+}
+
 /* Add an element into the freelist. Merge adjacent records if
    necessary. */
 int tdb_free(struct tdb_context *tdb, tdb_off_t offset, struct tdb_record *rec)
 {
-	/* Allocation and tailer lock */
-	if (tdb_lock(tdb, -1, F_WRLCK) != 0)
+	tdb_off_t left;
+	struct tdb_record l;
+	unsigned int c;
+	uint32_t full_hash;
+	int ret;
+
+	/* Allocation and tailer lock. With size classes each freelist
+	   has its own lock, taken below when we know which one */
+	if (!TDB_FREELIST_CLASSES_ON(tdb) && tdb_lock(tdb, -1, F_WRLCK) != 0)
 		return -1;
 
 	/* set an initial tailer, so if we fail we don't leave a bogus record */
@@ -139,77 +213,117 @@ left:
 #endif
 
 	/* Look left */
-	if (offset - sizeof(tdb_off_t) > TDB_DATA_START(tdb->header.hash_size)) {
-		tdb_off_t left = offset - sizeof(tdb_off_t);
-		struct tdb_record l;
-		tdb_off_t leftsize;
-
-		/* Read in tailer and jump back to header */
-		if (tdb_ofs_read(tdb, left, &leftsize) == -1) {
-			TDB_LOG((tdb, TDB_DEBUG_FATAL, "tdb_free: left offset read failed at %u\n", left));
-			goto update;
-		}
-
-		/* it could be uninitialised data */
-		if (leftsize == 0 || leftsize == TDB_PAD_U32) {
-			goto update;
-		}
-
-		left = offset - leftsize;
-
-		if (leftsize > offset ||
-		    left < TDB_DATA_START(tdb->header.hash_size)) {
-			goto update;
-		}
-
-		/* Now read in the left record */
-		if (tdb->methods->tdb_read(tdb, left, &l, sizeof(l), DOCONV()) == -1) {
-			TDB_LOG((tdb, TDB_DEBUG_FATAL, "tdb_free: left read failed at %u (%u)\n", left, leftsize));
-			goto update;
-		}
-
-		/* If it's free, expand to include it. */
-		if (l.magic == TDB_FREE_MAGIC) {
+	left = tdb_free_left(tdb, offset, &l);
+	c = (left != 0) ? tdb_free_rec_class(tdb, &l) : TDB_NUM_FREELISTS;
+
+	if (c < TDB_NUM_FREELISTS &&
+	    tdb_lock(tdb, TDB_FREELIST_LIST(c), F_WRLCK) == 0) {
+		/* With size classes we looked without the lock of the
+		   left record's freelist, so look again now */
+		if (!TDB_FREELIST_CLASSES_ON(tdb) ||
+		    (tdb_free_left(tdb, offset, &l) == left &&
+		     tdb_free_rec_class(tdb, &l) == c)) {
 			/* we now merge the new record into the left record, rather than the other 
 			   way around. This makes the operation O(1) instead of O(n). This change
-			   prevents traverse from being O(n^2) after a lot of deletes */
+			   prevents traverse from being O(n^2) after a lot of deletes.
+			   The left record stays in its size class. */
 			l.rec_len += sizeof(*rec) + rec->rec_len;
 			if (tdb_rec_write(tdb, left, &l) == -1) {
 				TDB_LOG((tdb, TDB_DEBUG_FATAL, "tdb_free: update_left failed at %u\n", left));
+				tdb_unlock(tdb, TDB_FREELIST_LIST(c), F_WRLCK);
 				goto fail;
 			}
 			if (update_tailer(tdb, left, &l) == -1) {
 				TDB_LOG((tdb, TDB_DEBUG_FATAL, "tdb_free: update_tailer failed at %u\n", offset));
+				tdb_unlock(tdb, TDB_FREELIST_LIST(c), F_WRLCK);
 				goto fail;
 			}
-			tdb_unlock(tdb, -1, F_WRLCK);
-			return 0;
+			tdb_unlock(tdb, TDB_FREELIST_LIST(c), F_WRLCK);
+			goto done;
 		}
+		tdb_unlock(tdb, TDB_FREELIST_LIST(c), F_WRLCK);
 	}
 
-update:
+	/* Now, prepend to the free list of its size */
+	c = tdb_freelist_class(tdb, rec->rec_len);
+	if (tdb_lock(tdb, TDB_FREELIST_LIST(c), F_WRLCK) != 0) {
+		goto fail;
+	}
+
+	/* our callers still need the hash of the record */
+	full_hash = rec->full_hash;
 
-	/* Now, prepend to free list */
 	rec->magic = TDB_FREE_MAGIC;
+	if (TDB_FREELIST_CLASSES_ON(tdb)) {
+		rec->full_hash = c;
+	}
 
-	if (tdb_ofs_read(tdb, FREELIST_TOP, &rec->next) == -1 ||
+	ret = 0;
+	if (tdb_ofs_read(tdb, TDB_FREELIST_HEAD(c), &rec->next) == -1 ||
 	    tdb_rec_write(tdb, offset, rec) == -1 ||
-	    tdb_ofs_write(tdb, FREELIST_TOP, &offset) == -1) {
+	    tdb_ofs_write(tdb, TDB_FREELIST_HEAD(c), &offset) == -1) {
 		TDB_LOG((tdb, TDB_DEBUG_FATAL, "tdb_free record write failed at offset=%d\n", offset));
+		ret = -1;
+	}
+	rec->full_hash = full_hash;
+	tdb_unlock(tdb, TDB_FREELIST_LIST(c), F_WRLCK);
+	if (ret == -1) {
 		goto fail;
 	}
 
+ done:
 	/* And we're done. */
-	tdb_unlock(tdb, -1, F_WRLCK);
+	if (!TDB_FREELIST_CLASSES_ON(tdb)) {
+		tdb_unlock(tdb, -1, F_WRLCK);
+	}
 	return 0;
 
  fail:
-	tdb_unlock(tdb, -1, F_WRLCK);
+	if (!TDB_FREELIST_CLASSES_ON(tdb)) {
+		tdb_unlock(tdb, -1, F_WRLCK);
+	}
 	return -1;
 }
 
 
 
+/*
+  move a free record from freelist c to the one of its size class,
+  last_ptr points to it. We already hold the lock of freelist c, so
+  don't wait for a second one: if it's busy the record just stays
+  where it is. Returns 1 if the record was moved (and written), 0 if
+  not and -1 on error.
+ */
+static int tdb_freelist_move(struct tdb_context *tdb, tdb_off_t rec_ptr,
+			     struct tdb_record *rec, tdb_off_t last_ptr,
+			     unsigned int c)
+{
+	unsigned int newc = tdb_freelist_class(tdb, rec->rec_len);
+	enum TDB_ERROR ecode = tdb->ecode;
+	tdb_off_t next = rec->next;
+
+	if (newc == c) {
+		return 0;
+	}
+
+	if (tdb_lock_nonblock(tdb, TDB_FREELIST_LIST(newc), F_WRLCK) == -1) {
+		tdb->ecode = ecode;
+		return 0;
+	}
+
+	rec->full_hash = newc;
+	if (tdb_ofs_read(tdb, TDB_FREELIST_HEAD(newc), &rec->next) == -1 ||
+	    tdb_ofs_write(tdb, last_ptr, &next) == -1 ||
+	    tdb_rec_write(tdb, rec_ptr, rec) == -1 ||
+	    tdb_ofs_write(tdb, TDB_FREELIST_HEAD(newc), &rec_ptr) == -1) {
+		tdb_unlock(tdb, TDB_FREELIST_LIST(newc), F_WRLCK);
+		return -1;
+	}
+
+	tdb_unlock(tdb, TDB_FREELIST_LIST(newc), F_WRLCK);
+	return 1;
+}
+
 /* 
    the core of tdb_allocate - called when we have decided which
    free list entry to use
@@ -220,9 +334,11 @@ update:
  */
 static tdb_off_t tdb_allocate_ofs(struct tdb_context *tdb, 
 				  tdb_len_t length, tdb_off_t rec_ptr,
-				  struct tdb_record *rec, tdb_off_t last_ptr)
+				  struct tdb_record *rec, tdb_off_t last_ptr,
+				  unsigned int c)
 {
 #define MIN_REC_SIZE (sizeof(struct tdb_record) + sizeof(tdb_off_t) + 8)
+	int ret;
 
 	if (rec->rec_len < length + MIN_REC_SIZE) {
 		/* we have to grab the whole record */
@@ -242,10 +358,16 @@ static tdb_off_t tdb_allocate_ofs(struct tdb_context *tdb,
 
 	/* we're going to just shorten the existing record */
 	rec->rec_len -= (length + sizeof(*rec));
-	if (tdb_rec_write(tdb, rec_ptr, rec) == -1) {
+	if (update_tailer(tdb, rec_ptr, rec) == -1) {
 		return 0;
 	}
-	if (update_tailer(tdb, rec_ptr, rec) == -1) {
+
+	/* move what's left to the list of its new size class */
+	ret = tdb_freelist_move(tdb, rec_ptr, rec, last_ptr, c);
+	if (ret == -1) {
+		return 0;
+	}
+	if (ret == 0 && tdb_rec_write(tdb, rec_ptr, rec) == -1) {
 		return 0;
 	}
 
@@ -267,36 +389,29 @@ static tdb_off_t tdb_allocate_ofs(struct tdb_context *tdb,
 	return rec_ptr;
 }
 
-/* allocate some space from the free list. The offset returned points
-   to a unconnected tdb_record within the database with room for at
-   least length bytes of total data
-
-   0 is returned if the space could not be allocated
+/*
+  best fit search in freelist c, returns -1 on error, 0 if no record
+  is big enough and 1 with the new record in *newrec_ptr. If limit is
+  non-zero only free records starting below limit are considered.
  */
-tdb_off_t tdb_allocate(struct tdb_context *tdb, tdb_len_t length, struct tdb_record *rec)
+static int tdb_allocate_class(struct tdb_context *tdb, unsigned int c,
+			      tdb_len_t length, struct tdb_record *rec,
+			      tdb_off_t limit, tdb_off_t *newrec_ptr)
 {
-	tdb_off_t rec_ptr, last_ptr, newrec_ptr;
+	tdb_off_t rec_ptr, last_ptr;
 	struct {
 		tdb_off_t rec_ptr, last_ptr;
 		tdb_len_t rec_len;
 	} bestfit;
 	float multiplier = 1.0;
 
-	if (tdb_lock(tdb, -1, F_WRLCK) == -1)
-		return 0;
-
-	/* over-allocate to reduce fragmentation */
-	length *= 1.25;
-
-	/* Extra bytes required for tailer */
-	length += sizeof(tdb_off_t);
-	length = TDB_ALIGN(length, TDB_ALIGNMENT);
+	if (tdb_lock(tdb, TDB_FREELIST_LIST(c), F_WRLCK) == -1)
+		return -1;
 
- again:
-	last_ptr = FREELIST_TOP;
+	last_ptr = TDB_FREELIST_HEAD(c);
 
 	/* read in the freelist top */
-	if (tdb_ofs_read(tdb, FREELIST_TOP, &rec_ptr) == -1)
+	if (tdb_ofs_read(tdb, last_ptr, &rec_ptr) == -1)
 		goto fail;
 
 	bestfit.rec_ptr = 0;
@@ -313,7 +428,23 @@ tdb_off_t tdb_allocate(struct tdb_context *tdb, tdb_len_t length, struct tdb_rec
 			goto fail;
 		}
 
-		if (rec->rec_len >= length) {
+		/* left merges let records grow out of their class,
+		   pass them on to the class they belong to now */
+		if (c > 0 && rec->rec_len >= TDB_FREELIST_CLASS_LIMIT(c)) {
+			tdb_off_t next = rec->next;
+			int ret = tdb_freelist_move(tdb, rec_ptr, rec,
+						    last_ptr, c);
+			if (ret == -1) {
+				goto fail;
+			}
+			if (ret == 1) {
+				rec_ptr = next;
+				continue;
+			}
+		}
+
+		if (rec->rec_len >= length &&
+		    (limit == 0 || rec_ptr < limit)) {
 			if (bestfit.rec_ptr == 0 ||
 			    rec->rec_len < bestfit.rec_len) {
 				bestfit.rec_len = rec->rec_len;
@@ -342,24 +473,93 @@ tdb_off_t tdb_allocate(struct tdb_context *tdb, tdb_len_t length, struct tdb_rec
 		multiplier *= 1.05;
 	}
 
-	if (bestfit.rec_ptr != 0) {
-		if (tdb_rec_free_read(tdb, bestfit.rec_ptr, rec) == -1) {
-			goto fail;
-		}
+	if (bestfit.rec_ptr == 0) {
+		tdb_unlock(tdb, TDB_FREELIST_LIST(c), F_WRLCK);
+		return 0;
+	}
 
-		newrec_ptr = tdb_allocate_ofs(tdb, length, bestfit.rec_ptr, 
-					      rec, bestfit.last_ptr);
-		tdb_unlock(tdb, -1, F_WRLCK);
-		return newrec_ptr;
+	if (tdb_rec_free_read(tdb, bestfit.rec_ptr, rec) == -1) {
+		goto fail;
+	}
+
+	*newrec_ptr = tdb_allocate_ofs(tdb, length, bestfit.rec_ptr,
+				       rec, bestfit.last_ptr, c);
+	tdb_unlock(tdb, TDB_FREELIST_LIST(c), F_WRLCK);
+	return (*newrec_ptr != 0) ? 1 : -1;
+
+ fail:
+	tdb_unlock(tdb, TDB_FREELIST_LIST(c), F_WRLCK);
+	return -1;
+}
+
+/* allocate some space from the free list. The offset returned points
+   to a unconnected tdb_record within the database with room for at
+   least length bytes of total data
+
+   0 is returned if the space could not be allocated
+
+   With size classes we start with the class of the wanted length
+   and go on with the classes of bigger records, holding only one
+   freelist lock at a time.
+ */
+static tdb_off_t tdb_allocate_limit(struct tdb_context *tdb, tdb_len_t length,
+				    struct tdb_record *rec, tdb_off_t limit)
+{
+	tdb_off_t newrec_ptr = 0;
+	unsigned int first;
+	int c, ret;
+
+	if (!TDB_FREELIST_CLASSES_ON(tdb) && tdb_lock(tdb, -1, F_WRLCK) == -1)
+		return 0;
+
+	/* over-allocate to reduce fragmentation */
+	length *= 1.25;
+
+	/* Extra bytes required for tailer */
+	length += sizeof(tdb_off_t);
+	length = TDB_ALIGN(length, TDB_ALIGNMENT);
+
+	first = tdb_freelist_class(tdb, length);
+
+ again:
+	for (c = first; c >= 0; c--) {
+		ret = tdb_allocate_class(tdb, c, length, rec, limit,
+					 &newrec_ptr);
+		if (ret == -1) {
+			newrec_ptr = 0;
+			goto done;
+		}
+		if (ret == 1) {
+			goto done;
+		}
 	}
 
 	/* we didn't find enough space. See if we can expand the
 	   database and if we can then try again */
-	if (tdb_expand(tdb, length + sizeof(*rec)) == 0)
+	if (limit == 0 && tdb_expand(tdb, length + sizeof(*rec)) == 0)
 		goto again;
- fail:
-	tdb_unlock(tdb, -1, F_WRLCK);
-	return 0;
+
+ done:
+	if (!TDB_FREELIST_CLASSES_ON(tdb)) {
+		tdb_unlock(tdb, -1, F_WRLCK);
+	}
+	return newrec_ptr;
+}
+
+tdb_off_t tdb_allocate(struct tdb_context *tdb, tdb_len_t length, struct tdb_record *rec)
+{
+	return tdb_allocate_limit(tdb, length, rec, 0);
+}
+
+/*
+  allocate space for a record that has to start below limit, used to
+  move records towards the start of the file. The file is never
+  expanded, 0 is returned if no free record below limit is big enough
+*/
+tdb_off_t tdb_allocate_below(struct tdb_context *tdb, tdb_len_t length,
+			     struct tdb_record *rec, tdb_off_t limit)
+{
+	return tdb_allocate_limit(tdb, length, rec, limit);
 }
 
 
@@ -371,16 +571,161 @@ _PUBLIC_ int tdb_freelist_size(struct tdb_context *tdb)
 {
 	tdb_off_t ptr;
 	int count=0;
+	unsigned int c;
+
+	for (c = 0; c < TDB_FREELISTS(tdb); c++) {
+		if (tdb_lock(tdb, TDB_FREELIST_LIST(c), F_RDLCK) == -1) {
+			return -1;
+		}
+
+		ptr = TDB_FREELIST_HEAD(c);
+		while (tdb_ofs_read(tdb, ptr, &ptr) == 0 && ptr != 0) {
+			count++;
+		}
+
+		tdb_unlock(tdb, TDB_FREELIST_LIST(c), F_RDLCK);
+	}
+	return count;
+}
+
+/* unlink the free record at rec_ptr from freelist c */
+static int tdb_freelist_unlink(struct tdb_context *tdb, unsigned int c,
+			       tdb_off_t rec_ptr, struct tdb_record *rec)
+{
+	struct tdb_record lastrec;
+	tdb_off_t last_ptr, i;
 
-	if (tdb_lock(tdb, -1, F_RDLCK) == -1) {
+	last_ptr = TDB_FREELIST_HEAD(c);
+	if (tdb_ofs_read(tdb, last_ptr, &i) == -1) {
 		return -1;
 	}
+	while (i != rec_ptr) {
+		if (i == 0) {
+			tdb->ecode = TDB_ERR_CORRUPT;
+			TDB_LOG((tdb, TDB_DEBUG_FATAL, "tdb_freelist_unlink: "
+				 "free record %u not on freelist %u\n",
+				 rec_ptr, c));
+			return -1;
+		}
+		if (tdb_rec_free_read(tdb, i, &lastrec) == -1) {
+			return -1;
+		}
+		last_ptr = i;
+		i = lastrec.next;
+	}
+	return tdb_ofs_write(tdb, last_ptr, &rec->next);
+}
+
+/*
+  hand the free records at the end of the file back to the filesystem,
+  starting with rec_ptr and working left for at most max records.
+  Returns the number of records released or -1 on error
+*/
+int tdb_free_tail(struct tdb_context *tdb, tdb_off_t rec_ptr,
+		  unsigned int max)
+{
+	struct tdb_record rec;
+	tdb_off_t old_size, new_size;
+	int released = 0;
 
-	ptr = FREELIST_TOP;
-	while (tdb_ofs_read(tdb, ptr, &ptr) == 0 && ptr != 0) {
-		count++;
+	/* any chain lock keeps out check, wipe_all and transactions,
+	   list -1 keeps out tdb_expand() */
+	if (tdb_lock(tdb, 0, F_WRLCK) == -1) {
+		return -1;
+	}
+	if (tdb_lock(tdb, -1, F_WRLCK) == -1) {
+		tdb_unlock(tdb, 0, F_WRLCK);
+		return -1;
 	}
 
-	tdb_unlock(tdb, -1, F_RDLCK);
-	return count;
+	tdb->methods->tdb_oob(tdb, tdb->map_size + 1, 1);
+	old_size = new_size = tdb->map_size;
+
+	while (rec_ptr != 0 && released < max) {
+		unsigned int c;
+		int ret;
+
+		if (tdb->methods->tdb_read(tdb, rec_ptr, &rec, sizeof(rec),
+					   DOCONV()) == -1) {
+			goto fail;
+		}
+		if (rec.magic != TDB_FREE_MAGIC ||
+		    rec_ptr + sizeof(rec) + rec.rec_len != new_size) {
+			/* someone got there first */
+			break;
+		}
+
+		c = tdb_free_rec_class(tdb, &rec);
+		if (c >= TDB_FREELISTS(tdb)) {
+			tdb->ecode = TDB_ERR_CORRUPT;
+			TDB_LOG((tdb, TDB_DEBUG_FATAL, "tdb_free_tail: bad "
+				 "class %u at offset %u\n", c, rec_ptr));
+			goto fail;
+		}
+		if (c != 0 &&
+		    tdb_lock(tdb, TDB_FREELIST_LIST(c), F_WRLCK) == -1) {
+			goto fail;
+		}
+
+		/* it could have been allocated or moved to another list
+		   before we got that lock */
+		ret = tdb->methods->tdb_read(tdb, rec_ptr, &rec, sizeof(rec),
+					     DOCONV());
+		if (ret == 0 &&
+		    rec.magic == TDB_FREE_MAGIC &&
+		    tdb_free_rec_class(tdb, &rec) == c &&
+		    rec_ptr + sizeof(rec) + rec.rec_len == new_size) {
+			ret = tdb_freelist_unlink(tdb, c, rec_ptr, &rec);
+			if (ret == 0) {
+				new_size = rec_ptr;
+				released++;
+			}
+		} else if (ret == 0) {
+			rec_ptr = 0;
+		}
+
+		if (c != 0) {
+			tdb_unlock(tdb, TDB_FREELIST_LIST(c), F_WRLCK);
+		}
+		if (ret == -1) {
+			goto fail;
+		}
+		if (rec_ptr != 0) {
+			rec_ptr = tdb_free_left(tdb, new_size, &rec);
+		}
+	}
+
+	if (released == 0) {
+		goto unlock;
+	}
+
+	if (tdb_munmap(tdb) == -1) {
+		tdb->ecode = TDB_ERR_IO;
+		goto fail;
+	}
+	if (ftruncate(tdb->fd, new_size) == -1) {
+		tdb->ecode = TDB_ERR_IO;
+		TDB_LOG((tdb, TDB_DEBUG_ERROR, "tdb_free_tail: ftruncate to "
+			 "%u failed (%s)\n", new_size, strerror(errno)));
+		tdb_mmap(tdb);
+		goto fail;
+	}
+	tdb->map_size = new_size;
+	tdb_mmap(tdb);
+
+ unlock:
+	tdb_unlock(tdb, -1, F_WRLCK);
+	tdb_unlock(tdb, 0, F_WRLCK);
+	return released;
+
+ fail:
+	if (new_size != old_size) {
+		/* give the records we unlinked back as a single one */
+		memset(&rec, 0, sizeof(rec));
+		rec.rec_len = old_size - new_size - sizeof(rec);
+		tdb_free(tdb, new_size, &rec);
+	}
+	tdb_unlock(tdb, -1, F_WRLCK);
+	tdb_unlock(tdb, 0, F_WRLCK);
+	return -1;
 }
@@ -294,6 +294,37 @@ static int tdb_expand_file(struct tdb_context *tdb, tdb_off_t size, tdb_off_t ad
 }
 
 
+/*
+  tdb_repack_step() can truncate free space off the end of the file.
+  Code that works from map_size itself rather than from record offsets
+  has to notice that, tdb_oob() only ever grows the map.
+*/
+int tdb_remap_shrunk(struct tdb_context *tdb)
+{
+	struct stat st;
+
+	if (tdb->flags & TDB_INTERNAL) {
+		return 0;
+	}
+
+	if (fstat(tdb->fd, &st) == -1) {
+		tdb->ecode = TDB_ERR_IO;
+		return -1;
+	}
+
+	if (st.st_size >= tdb->map_size) {
+		return 0;
+	}
+
+	if (tdb_munmap(tdb) == -1) {
+		tdb->ecode = TDB_ERR_IO;
+		return -1;
+	}
+	tdb->map_size = st.st_size;
+	tdb_mmap(tdb);
+	return 0;
+}
+
 /* expand the database at least size bytes by expanding the underlying
    file and doing the mmap again if necessary */
 int tdb_expand(struct tdb_context *tdb, tdb_off_t size)
@@ -306,7 +337,11 @@ int tdb_expand(struct tdb_context *tdb, tdb_off_t size)
 		return -1;
 	}
 
-	/* must know about any previous expansions by another process */
+	/* must know about any previous expansions or truncations by
+	 * another process, inside a transaction map_size is its own */
+	if (tdb->transaction == NULL) {
+		tdb_remap_shrunk(tdb);
+	}
 	tdb->methods->tdb_oob(tdb, tdb->map_size + 1, 1);
 
 	/* limit size in order to avoid using up huge amounts of memory for
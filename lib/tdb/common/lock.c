@@ -36,6 +36,11 @@ static int fcntl_lock(struct tdb_context *tdb,
 		      int rw, off_t off, off_t len, bool waitflag)
 {
 	struct flock fl;
+	int ret;
+
+	if (tdb_mutex_lock(tdb, rw, off, len, waitflag, &ret)) {
+		return ret;
+	}
 
 	fl.l_type = rw;
 	fl.l_whence = SEEK_SET;
@@ -52,6 +57,11 @@ static int fcntl_lock(struct tdb_context *tdb,
 static int fcntl_unlock(struct tdb_context *tdb, int rw, off_t off, off_t len)
 {
 	struct flock fl;
+	int ret;
+
+	if (tdb_mutex_unlock(tdb, rw, off, len, &ret)) {
+		return ret;
+	}
 #if 0 /* Check they matched up locks and unlocks correctly. */
 	char line[80];
 	FILE *locks;
@@ -119,7 +129,8 @@ static int fcntl_unlock(struct tdb_context *tdb, int rw, off_t off, off_t len)
 	return fcntl(tdb->fd, F_SETLKW, &fl);
 }
 
-/* list -1 is the alloc list, otherwise a hash chain. */
+/* list -1 is the alloc list, -2 and below the freelists of
+   TDB_FEATURE_FLAG_FREELIST_CLASSES, otherwise a hash chain. */
 static tdb_off_t lock_offset(int list)
 {
 	return FREELIST_TOP + 4*list;
@@ -220,6 +231,25 @@ int tdb_allrecord_upgrade(struct tdb_context *tdb)
 		return -1;
 	}
 
+	if (tdb->mutexes) {
+		int ret;
+
+		if (tdb_mutex_allrecord_upgrade(tdb) == -1) {
+			TDB_LOG((tdb, TDB_DEBUG_TRACE,"tdb_allrecord_upgrade failed\n"));
+			return -1;
+		}
+		ret = tdb_brlock(tdb, F_WRLCK, lock_offset(tdb->header.hash_size),
+				 0, TDB_LOCK_WAIT);
+		tdb_mutex_allrecord_upgraded(tdb);
+		if (ret == -1) {
+			TDB_LOG((tdb, TDB_DEBUG_TRACE,"tdb_allrecord_upgrade failed\n"));
+			return -1;
+		}
+		tdb->allrecord_lock.ltype = F_WRLCK;
+		tdb->allrecord_lock.off = 0;
+		return 0;
+	}
+
 	while (count--) {
 		struct timeval tv;
 		if (tdb_brlock(tdb, F_WRLCK, FREELIST_TOP, 0,
@@ -301,24 +331,49 @@ int tdb_nest_lock(struct tdb_context *tdb, uint32_t offset, int ltype,
 	return 0;
 }
 
+/* drop the locks taken by tdb_allrecord_lock() */
+static int tdb_allrecord_release(struct tdb_context *tdb, int ltype)
+{
+	int ret;
+
+	if (!tdb->mutexes) {
+		return tdb_brunlock(tdb, ltype, FREELIST_TOP, 0);
+	}
+
+	ret = tdb_brunlock(tdb, ltype, lock_offset(tdb->header.hash_size), 0);
+	if (tdb_mutex_allrecord_unlock(tdb) == -1) {
+		ret = -1;
+	}
+	return ret;
+}
+
 static int tdb_lock_and_recover(struct tdb_context *tdb)
 {
 	int ret;
 
 	/* We need to match locking order in transaction commit. */
-	if (tdb_brlock(tdb, F_WRLCK, FREELIST_TOP, 0, TDB_LOCK_WAIT)) {
+	if (tdb->mutexes) {
+		if (tdb_mutex_allrecord_lock(tdb, F_WRLCK, TDB_LOCK_WAIT)) {
+			return -1;
+		}
+		if (tdb_brlock(tdb, F_WRLCK, lock_offset(tdb->header.hash_size),
+			       0, TDB_LOCK_WAIT)) {
+			tdb_mutex_allrecord_unlock(tdb);
+			return -1;
+		}
+	} else if (tdb_brlock(tdb, F_WRLCK, FREELIST_TOP, 0, TDB_LOCK_WAIT)) {
 		return -1;
 	}
 
 	if (tdb_brlock(tdb, F_WRLCK, OPEN_LOCK, 1, TDB_LOCK_WAIT)) {
-		tdb_brunlock(tdb, F_WRLCK, FREELIST_TOP, 0);
+		tdb_allrecord_release(tdb, F_WRLCK);
 		return -1;
 	}
 
 	ret = tdb_transaction_recover(tdb);
 
 	tdb_brunlock(tdb, F_WRLCK, OPEN_LOCK, 1);
-	tdb_brunlock(tdb, F_WRLCK, FREELIST_TOP, 0);
+	tdb_allrecord_release(tdb, F_WRLCK);
 
 	return ret;
 }
@@ -328,7 +383,7 @@ static bool have_data_locks(const struct tdb_context *tdb)
 	unsigned int i;
 
 	for (i = 0; i < tdb->num_lockrecs; i++) {
-		if (tdb->lockrecs[i].off >= lock_offset(-1))
+		if (tdb->lockrecs[i].off >= lock_offset(-TDB_NUM_FREELISTS))
 			return true;
 	}
 	return false;
@@ -566,17 +621,25 @@ int tdb_allrecord_lock(struct tdb_context *tdb, int ltype,
 	 *    chain locks.
 	 *
 	 * It is (1) which cause the starvation problem, so we're only
-	 * gradual for that. */
-	if (tdb_chainlock_gradual(tdb, ltype, flags, FREELIST_TOP,
-				  tdb->header.hash_size * 4) == -1) {
+	 * gradual for that. With mutexes there is no starvation. */
+	if (tdb->mutexes) {
+		if (tdb_mutex_allrecord_lock(tdb, ltype, flags) == -1) {
+			return -1;
+		}
+	} else if (tdb_chainlock_gradual(tdb, ltype, flags, FREELIST_TOP,
+					 tdb->header.hash_size * 4) == -1) {
 		return -1;
 	}
 
 	/* Grab individual record locks. */
 	if (tdb_brlock(tdb, ltype, lock_offset(tdb->header.hash_size), 0,
 		       flags) == -1) {
-		tdb_brunlock(tdb, ltype, FREELIST_TOP,
-			     tdb->header.hash_size * 4);
+		if (tdb->mutexes) {
+			tdb_mutex_allrecord_unlock(tdb);
+		} else {
+			tdb_brunlock(tdb, ltype, FREELIST_TOP,
+				     tdb->header.hash_size * 4);
+		}
 		return -1;
 	}
 
@@ -601,6 +664,14 @@ int tdb_allrecord_lock(struct tdb_context *tdb, int ltype,
 		return tdb_allrecord_lock(tdb, ltype, flags, upgradable);
 	}
 
+	/* the file might have been shrunk by tdb_repack_step() since
+	 * we last looked, check, wipe_all and transactions walk up to
+	 * map_size. A starting transaction has not hooked its io
+	 * methods yet, so this is still the real map */
+	if (!(flags & TDB_LOCK_MARK_ONLY)) {
+		tdb_remap_shrunk(tdb);
+	}
+
 	return 0;
 }
 
@@ -632,7 +703,7 @@ int tdb_allrecord_unlock(struct tdb_context *tdb, int ltype, bool mark_lock)
 		return 0;
 	}
 
-	if (!mark_lock && tdb_brunlock(tdb, ltype, FREELIST_TOP, 0)) {
+	if (!mark_lock && tdb_allrecord_release(tdb, ltype)) {
 		TDB_LOG((tdb, TDB_DEBUG_ERROR, "tdb_unlockall failed (%s)\n", strerror(errno)));
 		return -1;
 	}
@@ -840,7 +911,7 @@ void tdb_release_transaction_locks(struct tdb_context *tdb)
 	unsigned int i, active = 0;
 
 	if (tdb->allrecord_lock.count != 0) {
-		tdb_brunlock(tdb, tdb->allrecord_lock.ltype, FREELIST_TOP, 0);
+		tdb_allrecord_release(tdb, tdb->allrecord_lock.ltype);
 		tdb->allrecord_lock.count = 0;
 	}
 
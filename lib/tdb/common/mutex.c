@@ -0,0 +1,539 @@
+ /*
+   Unix SMB/CIFS implementation.
+
+   trivial database library - process shared robust mutexes for the
+   freelist and the hash chains
+
+     ** NOTE! The following LGPL license applies to the tdb
+     ** library. This does NOT imply that all of Samba is released
+     ** under the LGPL
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "tdb_private.h"
+
+/*
+  With TDB_MUTEX_LOCKING the freelist and hash chain locks are not done
+  with fcntl() byte range locks, but with PTHREAD_PROCESS_SHARED robust
+  mutexes that live in the database file, directly behind the hash
+  table. The mutex area takes whole pages and is mapped separately
+  from the rest of the file, so that its address never changes while
+  we hold one of the mutexes.
+
+  All other locks (open, active, transaction, record and the record
+  part of the allrecord lock) are still fcntl() locks.
+
+  Mutexes don't distinguish between read and write locks, so every
+  chain lock is exclusive.
+
+  The allrecord lock is done with an additional mutex: the locker takes
+  the allrecord mutex, announces itself in allrecord_lock and then
+  takes and releases every chain mutex to wait for the current chain
+  lock holders. A chain locker that sees allrecord_lock set after it
+  got its chain mutex drops it again and waits on the allrecord mutex,
+  unless it already holds another chain (typically while it takes the
+  freelist): the allrecord locker waits for that one anyway.
+
+  A transaction only marks its allrecord lock until it commits, so the
+  allrecord mutex is taken when the lock is upgraded, together with a
+  write lock on the record locks. A traverse holds a record lock while it waits for
+  the next chain, so it must not wait for an upgrading allrecord lock
+  holder: it fails with EDEADLK instead, like fcntl() would.
+*/
+
+#ifdef USE_TDB_MUTEX_LOCKING
+
+struct tdb_mutexes {
+	/* tdb_mutex_size() of the creator, to detect a different ABI */
+	uint32_t size;
+	pthread_mutex_t allrecord_mutex;
+	/* F_UNLCK, F_RDLCK or F_WRLCK, protected by allrecord_mutex */
+	int allrecord_lock;
+	/* the allrecord lock holder waits for the record locks */
+	int allrecord_upgrading;
+	/* the TDB_NUM_FREELISTS freelist mutexes, highest class
+	 * first, followed by one mutex per hash chain */
+	pthread_mutex_t chains[1];
+};
+
+/*
+  size of the mutex area for a given hash size
+*/
+tdb_len_t tdb_mutex_size(uint32_t hash_size)
+{
+	size_t size = offsetof(struct tdb_mutexes, chains);
+
+	size += (hash_size + TDB_NUM_FREELISTS) * sizeof(pthread_mutex_t);
+
+	return TDB_ALIGN(size, TDB_ALIGNMENT);
+}
+
+/*
+  lock a mutex, taking over the lock of a process that died holding it.
+  Like with fcntl locks the caller has to cope with the state the dead
+  process left behind. Returns 0 or an errno value.
+
+  If deadlock is given, waiting fails with EDEADLK once it is set.
+*/
+static int tdb_mutex_take(struct tdb_context *tdb, pthread_mutex_t *m,
+			  bool waitflag, const int *deadlock,
+			  bool *owner_died)
+{
+	int ret;
+
+	if (owner_died != NULL) {
+		*owner_died = false;
+	}
+
+	if (!waitflag) {
+		ret = pthread_mutex_trylock(m);
+		if (ret == EBUSY) {
+			ret = EAGAIN;
+		}
+	} else if (tdb->interrupt_sig_ptr == NULL && deadlock == NULL) {
+		ret = pthread_mutex_lock(m);
+	} else {
+		/*
+		 * mutexes can't be interrupted by a signal, so we poll
+		 * the flag tdb_setalarm_sigptr() gave us
+		 */
+		do {
+			struct timespec ts;
+
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_nsec += 10 * 1000 * 1000;
+			if (ts.tv_nsec >= 1000 * 1000 * 1000) {
+				ts.tv_nsec -= 1000 * 1000 * 1000;
+				ts.tv_sec += 1;
+			}
+			ret = pthread_mutex_timedlock(m, &ts);
+			if (ret != ETIMEDOUT) {
+				break;
+			}
+			if (tdb->interrupt_sig_ptr && *tdb->interrupt_sig_ptr) {
+				ret = EINTR;
+			}
+			if (deadlock && *deadlock) {
+				ret = EDEADLK;
+			}
+		} while (ret == ETIMEDOUT);
+	}
+
+	if (ret == EOWNERDEAD) {
+		TDB_LOG((tdb, TDB_DEBUG_TRACE, "tdb_mutex_take: previous "
+			 "owner of a mutex in %s died\n", tdb->name));
+		if (owner_died != NULL) {
+			*owner_died = true;
+		}
+		ret = pthread_mutex_consistent(m);
+	}
+
+	return ret;
+}
+
+/*
+  map a byte range lock to a hash chain mutex, NULL if it is not one
+*/
+static pthread_mutex_t *tdb_chain_mutex(struct tdb_context *tdb,
+					off_t off, off_t len)
+{
+	off_t idx;
+
+	if (tdb->mutexes == NULL || len != 1) {
+		return NULL;
+	}
+	/* the freelist locks are below FREELIST_TOP, see lock_offset() */
+	if (off < FREELIST_TOP - TDB_NUM_FREELISTS * sizeof(tdb_off_t)) {
+		return NULL;
+	}
+	idx = (off - (FREELIST_TOP - TDB_NUM_FREELISTS * sizeof(tdb_off_t)))
+		/ sizeof(tdb_off_t);
+	if (idx >= tdb->header.hash_size + TDB_NUM_FREELISTS) {
+		/* the record locks */
+		return NULL;
+	}
+	return &tdb->mutexes->chains[idx];
+}
+
+/*
+  do we hold a chain or the freelist already?
+*/
+static bool tdb_have_chain_mutex(struct tdb_context *tdb)
+{
+	int i;
+
+	for (i=0; i<tdb->num_lockrecs; i++) {
+		if (tdb_chain_mutex(tdb, tdb->lockrecs[i].off, 1) != NULL) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+  called by tdb_brlock() for every lock. Returns true if the lock is
+  done with a mutex, the result is in *pret, errno set on failure.
+*/
+bool tdb_mutex_lock(struct tdb_context *tdb, int rw, off_t off, off_t len,
+		    bool waitflag, int *pret)
+{
+	struct tdb_mutexes *m = tdb->mutexes;
+	pthread_mutex_t *chain;
+	const int *deadlock = NULL;
+	int ret;
+
+	chain = tdb_chain_mutex(tdb, off, len);
+	if (chain == NULL) {
+		return false;
+	}
+
+	if (tdb->travlocks.off != 0 || tdb->travlocks.next != NULL) {
+		/* we might hold record locks */
+		deadlock = &m->allrecord_upgrading;
+	}
+
+	while (true) {
+		bool owner_died;
+
+		ret = tdb_mutex_take(tdb, chain, waitflag, NULL, NULL);
+		if (ret != 0) {
+			break;
+		}
+
+		if (m->allrecord_lock == F_UNLCK) {
+			break;
+		}
+		if (tdb_have_chain_mutex(tdb)) {
+			break;
+		}
+
+		/* someone holds or is getting the allrecord lock */
+		pthread_mutex_unlock(chain);
+
+		if (!waitflag) {
+			ret = EAGAIN;
+			break;
+		}
+
+		if (deadlock && *deadlock) {
+			ret = EDEADLK;
+			break;
+		}
+
+		ret = tdb_mutex_take(tdb, &m->allrecord_mutex, true,
+				     deadlock, &owner_died);
+		if (ret != 0) {
+			break;
+		}
+		if (owner_died) {
+			m->allrecord_lock = F_UNLCK;
+			m->allrecord_upgrading = 0;
+		}
+		pthread_mutex_unlock(&m->allrecord_mutex);
+	}
+
+	if (ret != 0) {
+		errno = ret;
+		*pret = -1;
+	} else {
+		*pret = 0;
+	}
+	return true;
+}
+
+/*
+  called by tdb_brunlock() for every unlock, see tdb_mutex_lock()
+*/
+bool tdb_mutex_unlock(struct tdb_context *tdb, int rw, off_t off, off_t len,
+		      int *pret)
+{
+	pthread_mutex_t *chain;
+	int ret;
+
+	chain = tdb_chain_mutex(tdb, off, len);
+	if (chain == NULL) {
+		return false;
+	}
+
+	ret = pthread_mutex_unlock(chain);
+	if (ret != 0) {
+		errno = ret;
+		*pret = -1;
+	} else {
+		*pret = 0;
+	}
+	return true;
+}
+
+/*
+  the hash chain part of the allrecord lock
+*/
+int tdb_mutex_allrecord_lock(struct tdb_context *tdb, int ltype,
+			     enum tdb_lock_flags flags)
+{
+	struct tdb_mutexes *m = tdb->mutexes;
+	bool waitflag = (flags & TDB_LOCK_WAIT);
+	uint32_t i;
+	int ret;
+
+	if (flags & TDB_LOCK_MARK_ONLY) {
+		return 0;
+	}
+
+	ret = tdb_mutex_take(tdb, &m->allrecord_mutex, waitflag, NULL, NULL);
+	if (ret != 0) {
+		tdb->ecode = TDB_ERR_LOCK;
+		errno = ret;
+		return -1;
+	}
+
+	m->allrecord_upgrading = 0;
+	m->allrecord_lock = ltype;
+	tdb->mutex_allrecord = true;
+
+	/* wait for everybody who got a chain before we announced us */
+	for (i=0; i<tdb->header.hash_size + TDB_NUM_FREELISTS; i++) {
+		ret = tdb_mutex_take(tdb, &m->chains[i], waitflag, NULL, NULL);
+		if (ret != 0) {
+			m->allrecord_lock = F_UNLCK;
+			tdb->mutex_allrecord = false;
+			pthread_mutex_unlock(&m->allrecord_mutex);
+			tdb->ecode = TDB_ERR_LOCK;
+			errno = ret;
+			return -1;
+		}
+		pthread_mutex_unlock(&m->chains[i]);
+	}
+
+	return 0;
+}
+
+/*
+  the hash chain part of tdb_allrecord_upgrade(). The caller waits for
+  the record locks next, so tell traversing chain lockers not to wait
+  for us, see tdb_mutex_lock()
+*/
+int tdb_mutex_allrecord_upgrade(struct tdb_context *tdb)
+{
+	if (!tdb->mutex_allrecord &&
+	    tdb_mutex_allrecord_lock(tdb, F_WRLCK, TDB_LOCK_WAIT) == -1) {
+		return -1;
+	}
+	tdb->mutexes->allrecord_lock = F_WRLCK;
+	tdb->mutexes->allrecord_upgrading = 1;
+	return 0;
+}
+
+void tdb_mutex_allrecord_upgraded(struct tdb_context *tdb)
+{
+	tdb->mutexes->allrecord_upgrading = 0;
+}
+
+int tdb_mutex_allrecord_unlock(struct tdb_context *tdb)
+{
+	struct tdb_mutexes *m = tdb->mutexes;
+	int ret;
+
+	if (!tdb->mutex_allrecord) {
+		/* only marked */
+		return 0;
+	}
+	tdb->mutex_allrecord = false;
+
+	m->allrecord_upgrading = 0;
+	m->allrecord_lock = F_UNLCK;
+
+	ret = pthread_mutex_unlock(&m->allrecord_mutex);
+	if (ret != 0) {
+		errno = ret;
+		return -1;
+	}
+	return 0;
+}
+
+/*
+  map the mutex area described in the header
+*/
+int tdb_mutex_mmap(struct tdb_context *tdb)
+{
+	off_t page_ofs;
+	size_t delta;
+	void *ptr;
+
+	page_ofs = tdb->header.mutex_offset & ~((off_t)tdb->page_size - 1);
+	delta = tdb->header.mutex_offset - page_ofs;
+
+	ptr = mmap(NULL, tdb->header.mutex_size + delta,
+		   PROT_READ|PROT_WRITE, MAP_SHARED|MAP_FILE,
+		   tdb->fd, page_ofs);
+	if (ptr == MAP_FAILED) {
+		TDB_LOG((tdb, TDB_DEBUG_ERROR, "tdb_mutex_mmap: mmap of %u "
+			 "bytes failed (%s)\n",
+			 tdb->header.mutex_size, strerror(errno)));
+		return -1;
+	}
+
+	tdb->mutex_map = ptr;
+	tdb->mutex_map_size = tdb->header.mutex_size + delta;
+	tdb->mutexes = (struct tdb_mutexes *)((char *)ptr + delta);
+
+	if (tdb->mutexes->size != 0 &&
+	    tdb->mutexes->size != tdb_mutex_size(tdb->header.hash_size)) {
+		TDB_LOG((tdb, TDB_DEBUG_ERROR, "tdb_mutex_mmap: %s was "
+			 "created with incompatible mutexes\n", tdb->name));
+		tdb_mutex_munmap(tdb);
+		errno = EINVAL;
+		return -1;
+	}
+	return 0;
+}
+
+int tdb_mutex_munmap(struct tdb_context *tdb)
+{
+	int ret;
+
+	if (tdb->mutex_map == NULL) {
+		return 0;
+	}
+
+	ret = munmap(tdb->mutex_map, tdb->mutex_map_size);
+	tdb->mutex_map = NULL;
+	tdb->mutex_map_size = 0;
+	tdb->mutexes = NULL;
+	tdb->mutex_allrecord = false;
+	return ret;
+}
+
+/*
+  initialise the mutexes of a new database, called with the open lock
+  held, so nobody else can use them yet
+*/
+int tdb_mutex_init(struct tdb_context *tdb)
+{
+	pthread_mutexattr_t ma;
+	uint32_t i;
+	int ret;
+
+	if (tdb_mutex_mmap(tdb) == -1) {
+		return -1;
+	}
+
+	ret = pthread_mutexattr_init(&ma);
+	if (ret != 0) {
+		goto fail;
+	}
+	ret = pthread_mutexattr_settype(&ma, PTHREAD_MUTEX_ERRORCHECK);
+	if (ret != 0) {
+		goto fail_attr;
+	}
+	ret = pthread_mutexattr_setpshared(&ma, PTHREAD_PROCESS_SHARED);
+	if (ret != 0) {
+		goto fail_attr;
+	}
+	ret = pthread_mutexattr_setrobust(&ma, PTHREAD_MUTEX_ROBUST);
+	if (ret != 0) {
+		goto fail_attr;
+	}
+
+	ret = pthread_mutex_init(&tdb->mutexes->allrecord_mutex, &ma);
+	if (ret != 0) {
+		goto fail_attr;
+	}
+	tdb->mutexes->size = tdb_mutex_size(tdb->header.hash_size);
+	tdb->mutexes->allrecord_lock = F_UNLCK;
+	tdb->mutexes->allrecord_upgrading = 0;
+
+	for (i=0; i<tdb->header.hash_size + TDB_NUM_FREELISTS; i++) {
+		ret = pthread_mutex_init(&tdb->mutexes->chains[i], &ma);
+		if (ret != 0) {
+			goto fail_attr;
+		}
+	}
+
+	pthread_mutexattr_destroy(&ma);
+	return 0;
+
+fail_attr:
+	pthread_mutexattr_destroy(&ma);
+fail:
+	TDB_LOG((tdb, TDB_DEBUG_ERROR, "tdb_mutex_init: failed to "
+		 "initialise mutexes (%s)\n", strerror(ret)));
+	tdb_mutex_munmap(tdb);
+	errno = ret;
+	return -1;
+}
+
+#else /* USE_TDB_MUTEX_LOCKING */
+
+tdb_len_t tdb_mutex_size(uint32_t hash_size)
+{
+	return 0;
+}
+
+bool tdb_mutex_lock(struct tdb_context *tdb, int rw, off_t off, off_t len,
+		    bool waitflag, int *pret)
+{
+	return false;
+}
+
+bool tdb_mutex_unlock(struct tdb_context *tdb, int rw, off_t off, off_t len,
+		      int *pret)
+{
+	return false;
+}
+
+int tdb_mutex_allrecord_lock(struct tdb_context *tdb, int ltype,
+			     enum tdb_lock_flags flags)
+{
+	tdb->ecode = TDB_ERR_LOCK;
+	errno = ENOSYS;
+	return -1;
+}
+
+int tdb_mutex_allrecord_upgrade(struct tdb_context *tdb)
+{
+	tdb->ecode = TDB_ERR_LOCK;
+	errno = ENOSYS;
+	return -1;
+}
+
+void tdb_mutex_allrecord_upgraded(struct tdb_context *tdb)
+{
+}
+
+int tdb_mutex_allrecord_unlock(struct tdb_context *tdb)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+int tdb_mutex_mmap(struct tdb_context *tdb)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+int tdb_mutex_munmap(struct tdb_context *tdb)
+{
+	return 0;
+}
+
+int tdb_mutex_init(struct tdb_context *tdb)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+#endif /* USE_TDB_MUTEX_LOCKING */
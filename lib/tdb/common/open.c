@@ -72,9 +72,37 @@ static int tdb_new_database(struct tdb_context *tdb, int hash_size)
 
 	/* Make sure older tdbs (which don't check the magic hash fields)
 	 * will refuse to open this TDB. */
-	if (tdb->flags & TDB_INCOMPATIBLE_HASH)
+	if (tdb->flags & (TDB_INCOMPATIBLE_HASH|TDB_CRC32C_HASH))
 		newdb->rwlocks = TDB_HASH_RWLOCK_MAGIC;
 
+	/* The mutexes are native structures, they don't work for
+	 * internal or byte swapped databases. */
+	if ((tdb->flags & TDB_MUTEX_LOCKING) &&
+	    !(tdb->flags & (TDB_INTERNAL|TDB_CONVERT))) {
+		if (tdb_mutex_size(hash_size) == 0) {
+			TDB_LOG((tdb, TDB_DEBUG_WARNING, "tdb_new_database: "
+				 "mutexes not supported, using fcntl locks "
+				 "for %s\n", tdb->name));
+			tdb->flags &= ~TDB_MUTEX_LOCKING;
+		} else {
+			/* older tdbs refuse to open this one as well */
+			newdb->rwlocks = TDB_FEATURE_FLAG_MAGIC;
+			newdb->feature_flags = TDB_FEATURE_FLAG_MUTEX;
+			newdb->mutex_offset = TDB_ALIGN(size, tdb->page_size);
+			/* transactions write whole pages, don't
+			 * share one with the mutexes */
+			newdb->mutex_size = TDB_ALIGN(tdb_mutex_size(hash_size),
+						      tdb->page_size);
+		}
+	} else {
+		tdb->flags &= ~TDB_MUTEX_LOCKING;
+	}
+
+	if (tdb->flags & TDB_FREELIST_CLASSES) {
+		newdb->rwlocks = TDB_FEATURE_FLAG_MAGIC;
+		newdb->feature_flags |= TDB_FEATURE_FLAG_FREELIST_CLASSES;
+	}
+
 	if (tdb->flags & TDB_INTERNAL) {
 		tdb->map_size = size;
 		tdb->map_ptr = (char *)newdb;
@@ -95,8 +123,18 @@ static int tdb_new_database(struct tdb_context *tdb, int hash_size)
 	/* Don't endian-convert the magic food! */
 	memcpy(newdb->magic_food, TDB_MAGIC_FOOD, strlen(TDB_MAGIC_FOOD)+1);
 	/* we still have "ret == -1" here */
-	if (tdb_write_all(tdb->fd, newdb, size))
-		ret = 0;
+	if (!tdb_write_all(tdb->fd, newdb, size))
+		goto fail;
+
+	if (tdb->header.mutex_size != 0) {
+		/* the mutex area is zero filled up to its page */
+		if (ftruncate(tdb->fd, tdb->header.mutex_offset +
+			      tdb->header.mutex_size) == -1)
+			goto fail;
+		if (tdb_mutex_init(tdb) == -1)
+			goto fail;
+	}
+	ret = 0;
 
   fail:
 	SAFE_FREE(newdb);
@@ -144,6 +182,12 @@ static void null_log_fn(struct tdb_context *tdb, enum tdb_debug_level level, con
 static bool check_header_hash(struct tdb_context *tdb,
 			      bool default_hash, uint32_t *m1, uint32_t *m2)
 {
+	tdb_hash_func inbuilt[] = {
+		tdb_old_hash, tdb_jenkins_hash, tdb_crc32c_hash
+	};
+	tdb_hash_func tried = tdb->hash_fn;
+	size_t i;
+
 	tdb_header_hash(tdb, m1, m2);
 	if (tdb->header.magic1_hash == *m1 &&
 	    tdb->header.magic2_hash == *m2) {
@@ -154,12 +198,17 @@ static bool check_header_hash(struct tdb_context *tdb,
 	if (!default_hash)
 		return false;
 
-	/* Otherwise, try the other inbuilt hash. */
-	if (tdb->hash_fn == tdb_old_hash)
-		tdb->hash_fn = tdb_jenkins_hash;
-	else
-		tdb->hash_fn = tdb_old_hash;
-	return check_header_hash(tdb, false, m1, m2);
+	/* Otherwise, try the other inbuilt hashes. */
+	for (i = 0; i < ARRAY_SIZE(inbuilt); i++) {
+		if (inbuilt[i] == tried) {
+			continue;
+		}
+		tdb->hash_fn = inbuilt[i];
+		if (check_header_hash(tdb, false, m1, m2)) {
+			return true;
+		}
+	}
+	return false;
 }
 
 _PUBLIC_ struct tdb_context *tdb_open_ex(const char *name, int hash_size, int tdb_flags,
@@ -228,7 +277,9 @@ _PUBLIC_ struct tdb_context *tdb_open_ex(const char *name, int hash_size, int td
 		hash_alg = "the user defined";
 	} else {
 		/* This controls what we use when creating a tdb. */
-		if (tdb->flags & TDB_INCOMPATIBLE_HASH) {
+		if (tdb->flags & TDB_CRC32C_HASH) {
+			tdb->hash_fn = tdb_crc32c_hash;
+		} else if (tdb->flags & TDB_INCOMPATIBLE_HASH) {
 			tdb->hash_fn = tdb_jenkins_hash;
 		} else {
 			tdb->hash_fn = tdb_old_hash;
@@ -352,11 +403,48 @@ _PUBLIC_ struct tdb_context *tdb_open_ex(const char *name, int hash_size, int td
 		goto fail;
 
 	if (tdb->header.rwlocks != 0 &&
-	    tdb->header.rwlocks != TDB_HASH_RWLOCK_MAGIC) {
+	    tdb->header.rwlocks != TDB_HASH_RWLOCK_MAGIC &&
+	    tdb->header.rwlocks != TDB_FEATURE_FLAG_MAGIC) {
 		TDB_LOG((tdb, TDB_DEBUG_ERROR, "tdb_open_ex: spinlocks no longer supported\n"));
 		goto fail;
 	}
 
+	if (tdb->header.rwlocks != TDB_FEATURE_FLAG_MAGIC) {
+		tdb->header.feature_flags = 0;
+	}
+	if (tdb->header.feature_flags & ~TDB_SUPPORTED_FEATURE_FLAGS) {
+		TDB_LOG((tdb, TDB_DEBUG_ERROR, "tdb_open_ex: "
+			 "unsupported feature flags 0x%08x in %s\n",
+			 tdb->header.feature_flags, name));
+		errno = EINVAL;
+		goto fail;
+	}
+	if (tdb->header.feature_flags & TDB_FEATURE_FLAG_FREELIST_CLASSES) {
+		tdb->flags |= TDB_FREELIST_CLASSES;
+	} else {
+		tdb->flags &= ~TDB_FREELIST_CLASSES;
+	}
+	if (!(tdb->header.feature_flags & TDB_FEATURE_FLAG_MUTEX)) {
+		tdb->header.mutex_offset = 0;
+		tdb->header.mutex_size = 0;
+		tdb->flags &= ~TDB_MUTEX_LOCKING;
+	} else if (rev ||
+		   tdb->header.mutex_size < tdb_mutex_size(tdb->header.hash_size) ||
+		   tdb->header.mutex_offset + tdb->header.mutex_size > st.st_size) {
+		/* a different platform, or a build without mutexes */
+		TDB_LOG((tdb, TDB_DEBUG_ERROR, "tdb_open_ex: "
+			 "can't use the mutexes of %s\n", name));
+		errno = EINVAL;
+		goto fail;
+	} else if (tdb->flags & TDB_NOLOCK) {
+		tdb->flags &= ~TDB_MUTEX_LOCKING;
+	} else {
+		if (tdb->mutexes == NULL && tdb_mutex_mmap(tdb) == -1) {
+			goto fail;
+		}
+		tdb->flags |= TDB_MUTEX_LOCKING;
+	}
+
 	if ((tdb->header.magic1_hash == 0) && (tdb->header.magic2_hash == 0)) {
 		/* older TDB without magic hash references */
 		tdb->hash_fn = tdb_old_hash;
@@ -457,6 +545,7 @@ _PUBLIC_ struct tdb_context *tdb_open_ex(const char *name, int hash_size, int td
 		else
 			tdb_munmap(tdb);
 	}
+	tdb_mutex_munmap(tdb);
 	if (tdb->fd != -1)
 		if (close(tdb->fd) != 0)
 			TDB_LOG((tdb, TDB_DEBUG_ERROR, "tdb_open_ex: failed to close tdb->fd on error!\n"));
@@ -498,6 +587,7 @@ _PUBLIC_ int tdb_close(struct tdb_context *tdb)
 		else
 			tdb_munmap(tdb);
 	}
+	tdb_mutex_munmap(tdb);
 	SAFE_FREE(tdb->name);
 	if (tdb->fd != -1) {
 		ret = close(tdb->fd);
@@ -33,6 +33,9 @@
 	"Smallest/average/largest uncoalesced runs: %zu/%zu/%zu\n" \
 	"Percentage keys/data/padding/free/dead/rechdrs&tailers/hashes: %.0f/%.0f/%.0f/%.0f/%.0f/%.0f/%.0f\n"
 
+#define SUMMARY_CLASS_FORMAT \
+	"Number/size of free records in class %u (%s %u bytes): %zu/%zu\n"
+
 /* We don't use tally module, to keep upstream happy. */
 struct tally {
 	size_t min, max, total;
@@ -88,10 +91,12 @@ _PUBLIC_ char *tdb_summary(struct tdb_context *tdb)
 {
 	tdb_off_t off, rec_off;
 	struct tally freet, keys, data, dead, extra, hash, uncoal;
+	struct tally classes[TDB_NUM_FREELISTS];
 	struct tdb_record rec;
 	char *ret = NULL;
 	bool locked;
 	size_t len, unc = 0;
+	unsigned int c;
 	struct tdb_record recovery;
 
 	/* Read-only databases use no locking at all: it's best-effort.
@@ -115,8 +120,11 @@ _PUBLIC_ char *tdb_summary(struct tdb_context *tdb)
 	tally_init(&extra);
 	tally_init(&hash);
 	tally_init(&uncoal);
+	for (c = 0; c < TDB_NUM_FREELISTS; c++) {
+		tally_init(&classes[c]);
+	}
 
-	for (off = TDB_DATA_START(tdb->header.hash_size);
+	for (off = TDB_DATA_START(tdb, tdb->header.hash_size);
 	     off < tdb->map_size - 1;
 	     off += sizeof(rec) + rec.rec_len) {
 		if (tdb->methods->tdb_read(tdb, off, &rec, sizeof(rec),
@@ -134,6 +142,11 @@ _PUBLIC_ char *tdb_summary(struct tdb_context *tdb)
 			break;
 		case TDB_FREE_MAGIC:
 			tally_add(&freet, rec.rec_len);
+			/* free records note their freelist in full_hash */
+			if (TDB_FREELIST_CLASSES_ON(tdb) &&
+			    rec.full_hash < TDB_NUM_FREELISTS) {
+				tally_add(&classes[rec.full_hash], rec.rec_len);
+			}
 			unc++;
 			break;
 		/* If we crash after ftruncate, we can get zeroes or fill. */
@@ -164,6 +177,9 @@ _PUBLIC_ char *tdb_summary(struct tdb_context *tdb)
 
 	/* 20 is max length of a %zu. */
 	len = strlen(SUMMARY_FORMAT) + 35*20 + 1;
+	if (TDB_FREELIST_CLASSES_ON(tdb)) {
+		len += TDB_NUM_FREELISTS * (strlen(SUMMARY_CLASS_FORMAT) + 4*20);
+	}
 	ret = (char *)malloc(len);
 	if (!ret)
 		goto unlock;
@@ -193,6 +209,18 @@ _PUBLIC_ char *tdb_summary(struct tdb_context *tdb)
 		 tdb->header.hash_size * sizeof(tdb_off_t)
 		 * 100.0 / tdb->map_size);
 
+	if (TDB_FREELIST_CLASSES_ON(tdb)) {
+		/* the classes of the smallest records first */
+		for (c = TDB_NUM_FREELISTS; c-- > 0;) {
+			size_t used = strlen(ret);
+
+			snprintf(ret + used, len - used, SUMMARY_CLASS_FORMAT,
+				 c, c == 0 ? ">=" : "<",
+				 TDB_FREELIST_CLASS_LIMIT(c == 0 ? 1 : c),
+				 classes[c].num, classes[c].total);
+		}
+	}
+
 unlock:
 	if (locked) {
 		tdb_unlockall_read(tdb);
@@ -347,7 +347,8 @@ static int tdb_purge_dead(struct tdb_context *tdb, uint32_t hash)
 	struct tdb_record rec;
 	tdb_off_t rec_ptr;
 
-	if (tdb_lock(tdb, -1, F_WRLCK) == -1) {
+	/* with size classes tdb_free() locks the freelists itself */
+	if (!TDB_FREELIST_CLASSES_ON(tdb) && tdb_lock(tdb, -1, F_WRLCK) == -1) {
 		return -1;
 	}
 
@@ -372,7 +373,9 @@ static int tdb_purge_dead(struct tdb_context *tdb, uint32_t hash)
 	}
 	res = 0;
  fail:
-	tdb_unlock(tdb, -1, F_WRLCK);
+	if (!TDB_FREELIST_CLASSES_ON(tdb)) {
+		tdb_unlock(tdb, -1, F_WRLCK);
+	}
 	return res;
 }
 
@@ -544,23 +547,28 @@ static int _tdb_store(struct tdb_context *tdb, TDB_DATA key,
 	/*
 	 * We have to allocate some space from the freelist, so this means we
 	 * have to lock it. Use the chance to purge all the DEAD records from
-	 * the hash chain under the freelist lock.
+	 * the hash chain under the freelist lock. With size classes there
+	 * is no single freelist lock, tdb_allocate() takes the ones it needs.
 	 */
 
-	if (tdb_lock(tdb, -1, F_WRLCK) == -1) {
+	if (!TDB_FREELIST_CLASSES_ON(tdb) && tdb_lock(tdb, -1, F_WRLCK) == -1) {
 		goto fail;
 	}
 
 	if ((tdb->max_dead_records != 0)
 	    && (tdb_purge_dead(tdb, hash) == -1)) {
-		tdb_unlock(tdb, -1, F_WRLCK);
+		if (!TDB_FREELIST_CLASSES_ON(tdb)) {
+			tdb_unlock(tdb, -1, F_WRLCK);
+		}
 		goto fail;
 	}
 
 	/* we have to allocate some space */
 	rec_ptr = tdb_allocate(tdb, key.dsize + dbuf.dsize, &rec);
 
-	tdb_unlock(tdb, -1, F_WRLCK);
+	if (!TDB_FREELIST_CLASSES_ON(tdb)) {
+		tdb_unlock(tdb, -1, F_WRLCK);
+	}
 
 	if (rec_ptr == 0) {
 		goto fail;
@@ -852,18 +860,20 @@ _PUBLIC_ int tdb_wipe_all(struct tdb_context *tdb)
 		}
 	}
 
-	/* wipe the freelist */
-	if (tdb_ofs_write(tdb, FREELIST_TOP, &offset) == -1) {
-		TDB_LOG((tdb, TDB_DEBUG_FATAL,"tdb_wipe_all: failed to write freelist\n"));
-		goto failed;
+	/* wipe the freelists */
+	for (i=0;i<TDB_FREELISTS(tdb);i++) {
+		if (tdb_ofs_write(tdb, TDB_FREELIST_HEAD(i), &offset) == -1) {
+			TDB_LOG((tdb, TDB_DEBUG_FATAL,"tdb_wipe_all: failed to write freelist %d\n", i));
+			goto failed;
+		}
 	}
 
 	/* add all the rest of the file to the freelist, possibly leaving a gap 
 	   for the recovery area */
 	if (recovery_size == 0) {
 		/* the simple case - the whole file can be used as a freelist */
-		data_len = (tdb->map_size - TDB_DATA_START(tdb->header.hash_size));
-		if (tdb_free_region(tdb, TDB_DATA_START(tdb->header.hash_size), data_len) != 0) {
+		data_len = (tdb->map_size - TDB_DATA_START(tdb, tdb->header.hash_size));
+		if (tdb_free_region(tdb, TDB_DATA_START(tdb, tdb->header.hash_size), data_len) != 0) {
 			goto failed;
 		}
 	} else {
@@ -875,8 +885,8 @@ _PUBLIC_ int tdb_wipe_all(struct tdb_context *tdb)
 		   move the recovery area or we risk subtle data
 		   corruption
 		*/
-		data_len = (recovery_head - TDB_DATA_START(tdb->header.hash_size));
-		if (tdb_free_region(tdb, TDB_DATA_START(tdb->header.hash_size), data_len) != 0) {
+		data_len = (recovery_head - TDB_DATA_START(tdb, tdb->header.hash_size));
+		if (tdb_free_region(tdb, TDB_DATA_START(tdb, tdb->header.hash_size), data_len) != 0) {
 			goto failed;
 		}
 		/* and the 2nd free list entry after the recovery area - if any */
@@ -991,6 +1001,206 @@ _PUBLIC_ int tdb_repack(struct tdb_context *tdb)
 	return 0;
 }
 
+/*
+  find the last record in the file through its tailer. Returns 0 if
+  the end of the file doesn't hold a record we can work with.
+*/
+static tdb_off_t tdb_repack_last(struct tdb_context *tdb,
+				 struct tdb_record *rec)
+{
+	tdb_off_t end, tailer, rec_ptr;
+
+	/* pick up expansions and truncations by other processes */
+	tdb_remap_shrunk(tdb);
+	tdb->methods->tdb_oob(tdb, tdb->map_size + 1, 1);
+
+	end = tdb->map_size;
+	if (end < TDB_DATA_START(tdb, tdb->header.hash_size)
+	    + sizeof(*rec) + sizeof(tailer)) {
+		return 0;
+	}
+	if (tdb_ofs_read(tdb, end - sizeof(tailer), &tailer) == -1) {
+		return 0;
+	}
+	if (tailer < sizeof(*rec) + sizeof(tailer) ||
+	    tailer > end - TDB_DATA_START(tdb, tdb->header.hash_size)) {
+		return 0;
+	}
+	rec_ptr = end - tailer;
+	if (tdb->methods->tdb_read(tdb, rec_ptr, rec, sizeof(*rec),
+				   DOCONV()) == -1) {
+		return 0;
+	}
+	if (rec_ptr + sizeof(*rec) + rec->rec_len != end) {
+		return 0;
+	}
+	return rec_ptr;
+}
+
+/*
+  move the record at rec_ptr into free space further down the file,
+  dead records are simply purged. Returns 1 if rec_ptr no longer holds
+  the record, 0 if it has to stay where it is and -1 on error.
+*/
+static int tdb_repack_move(struct tdb_context *tdb, tdb_off_t rec_ptr,
+			   struct tdb_record *rec)
+{
+	uint32_t hash = rec->full_hash;
+	struct tdb_record newrec, lastrec;
+	tdb_off_t new_ptr, last_ptr, i;
+	tdb_len_t len;
+	unsigned char *buf;
+	int ret = -1;
+
+	if (tdb_lock(tdb, BUCKET(hash), F_WRLCK) == -1) {
+		return -1;
+	}
+
+	/* it may have changed before we got the chain lock */
+	if (tdb->methods->tdb_read(tdb, rec_ptr, rec, sizeof(*rec),
+				   DOCONV()) == -1) {
+		goto out;
+	}
+	if ((rec->magic != TDB_MAGIC && !TDB_DEAD(rec)) ||
+	    rec->full_hash != hash) {
+		ret = 1;
+		goto out;
+	}
+
+	/* leave records alone that a traverse sits on */
+	if (tdb_write_lock_record(tdb, rec_ptr) == -1) {
+		ret = 0;
+		goto out;
+	}
+	if (tdb_write_unlock_record(tdb, rec_ptr) != 0) {
+		goto out;
+	}
+
+	if (TDB_DEAD(rec)) {
+		ret = (tdb_do_delete(tdb, rec_ptr, rec) == 0) ? 1 : -1;
+		goto out;
+	}
+
+	len = rec->key_len + rec->data_len;
+	new_ptr = tdb_allocate_below(tdb, len, &newrec, rec_ptr);
+	if (new_ptr == 0) {
+		/* no room further down */
+		ret = 0;
+		goto out;
+	}
+
+	buf = tdb_alloc_read(tdb, rec_ptr + sizeof(*rec), len);
+	if (buf == NULL) {
+		goto free_new;
+	}
+	if (tdb->methods->tdb_write(tdb, new_ptr + sizeof(*rec),
+				    buf, len) == -1) {
+		SAFE_FREE(buf);
+		goto free_new;
+	}
+	SAFE_FREE(buf);
+
+	newrec.next = rec->next;
+	newrec.key_len = rec->key_len;
+	newrec.data_len = rec->data_len;
+	newrec.full_hash = rec->full_hash;
+	newrec.magic = TDB_MAGIC;
+	if (tdb_rec_write(tdb, new_ptr, &newrec) == -1) {
+		goto free_new;
+	}
+
+	/* find previous record in hash chain */
+	if (tdb_ofs_read(tdb, TDB_HASH_TOP(hash), &i) == -1) {
+		goto free_new;
+	}
+	for (last_ptr = 0; i != rec_ptr; last_ptr = i, i = lastrec.next) {
+		if (i == 0) {
+			/* not on its chain, leave it to tdb_check */
+			ret = 0;
+			goto free_new;
+		}
+		if (tdb_rec_read(tdb, i, &lastrec) == -1) {
+			goto free_new;
+		}
+	}
+
+	/* point it at the copy: next ptr is at start of record */
+	if (last_ptr == 0) {
+		last_ptr = TDB_HASH_TOP(hash);
+	}
+	if (tdb_ofs_write(tdb, last_ptr, &new_ptr) == -1) {
+		goto free_new;
+	}
+
+	ret = (tdb_free(tdb, rec_ptr, rec) == 0) ? 1 : -1;
+	goto out;
+
+ free_new:
+	tdb_free(tdb, new_ptr, &newrec);
+ out:
+	tdb_unlock(tdb, BUCKET(hash), F_WRLCK);
+	return ret;
+}
+
+/*
+  incremental, online version of tdb_repack(): move up to max_records
+  records from the end of the file into free space further down and
+  truncate the free space this leaves at the end
+*/
+_PUBLIC_ int tdb_repack_step(struct tdb_context *tdb,
+			     unsigned int max_records)
+{
+	unsigned int done = 0;
+
+	tdb_trace(tdb, "tdb_repack_step");
+
+	if (tdb->read_only || tdb->traverse_read) {
+		tdb->ecode = TDB_ERR_RDONLY;
+		return -1;
+	}
+
+	if (tdb->transaction != NULL) {
+		tdb->ecode = TDB_ERR_EINVAL;
+		TDB_LOG((tdb, TDB_DEBUG_ERROR,
+			 "tdb_repack_step: not inside a transaction\n"));
+		return -1;
+	}
+
+	if (tdb->flags & TDB_INTERNAL) {
+		return 0;
+	}
+
+	while (done < max_records) {
+		struct tdb_record rec;
+		tdb_off_t rec_ptr;
+		int ret;
+
+		rec_ptr = tdb_repack_last(tdb, &rec);
+		if (rec_ptr == 0) {
+			break;
+		}
+
+		if (rec.magic == TDB_FREE_MAGIC) {
+			ret = tdb_free_tail(tdb, rec_ptr, max_records - done);
+		} else if (rec.magic == TDB_MAGIC || TDB_DEAD(&rec)) {
+			ret = tdb_repack_move(tdb, rec_ptr, &rec);
+		} else {
+			/* the transaction recovery area stays */
+			break;
+		}
+
+		if (ret == -1) {
+			return -1;
+		}
+		if (ret == 0) {
+			break;
+		}
+		done += ret;
+	}
+
+	return done;
+}
+
 /* Even on files, we can get partial writes due to signals. */
 bool tdb_write_all(int fd, const void *buf, size_t count)
 {
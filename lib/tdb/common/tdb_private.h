@@ -31,6 +31,10 @@
 #include "system/wait.h"
 #include "tdb.h"
 
+#ifdef USE_TDB_MUTEX_LOCKING
+#include <pthread.h>
+#endif
+
 /* #define TDB_TRACE 1 */
 #ifndef HAVE_GETPAGESIZE
 #define getpagesize() 0x2000
@@ -51,6 +55,11 @@ typedef uint32_t tdb_off_t;
 #define TDB_RECOVERY_MAGIC (0xf53bc0e7U)
 #define TDB_RECOVERY_INVALID_MAGIC (0x0)
 #define TDB_HASH_RWLOCK_MAGIC (0xbad1a51U)
+#define TDB_FEATURE_FLAG_MAGIC (0xbad1a52U)
+#define TDB_FEATURE_FLAG_MUTEX 0x00000001
+#define TDB_FEATURE_FLAG_FREELIST_CLASSES 0x00000002
+#define TDB_SUPPORTED_FEATURE_FLAGS \
+	(TDB_FEATURE_FLAG_MUTEX|TDB_FEATURE_FLAG_FREELIST_CLASSES)
 #define TDB_ALIGNMENT 4
 #define DEFAULT_HASH_SIZE 131
 #define FREELIST_TOP (sizeof(struct tdb_header))
@@ -60,8 +69,21 @@ typedef uint32_t tdb_off_t;
 #define TDB_BAD_MAGIC(r) ((r)->magic != TDB_MAGIC && !TDB_DEAD(r))
 #define TDB_HASH_TOP(hash) (FREELIST_TOP + (BUCKET(hash)+1)*sizeof(tdb_off_t))
 #define TDB_HASHTABLE_SIZE(tdb) ((tdb->header.hash_size+1)*sizeof(tdb_off_t))
-#define TDB_DATA_START(hash_size) (TDB_HASH_TOP(hash_size-1) + sizeof(tdb_off_t))
+#define TDB_HASH_END(hash_size) (TDB_HASH_TOP(hash_size-1) + sizeof(tdb_off_t))
+#define TDB_DATA_START(tdb, hash_size) ((tdb)->header.mutex_size ? \
+	(tdb)->header.mutex_offset + (tdb)->header.mutex_size : \
+	TDB_HASH_END(hash_size))
 #define TDB_RECOVERY_HEAD offsetof(struct tdb_header, recovery_start)
+#define TDB_NUM_FREELISTS 8
+#define TDB_FREELIST_CLASSES_ON(tdb) \
+	((tdb)->header.feature_flags & TDB_FEATURE_FLAG_FREELIST_CLASSES)
+#define TDB_FREELISTS(tdb) (TDB_FREELIST_CLASSES_ON(tdb) ? TDB_NUM_FREELISTS : 1)
+#define TDB_FREELIST_HEAD(c) ((c) == 0 ? FREELIST_TOP : \
+	offsetof(struct tdb_header, freelist_heads) + ((c)-1)*sizeof(tdb_off_t))
+#define TDB_FREELIST_LIST(c) (-1 - (int)(c))
+/* freelist c > 0 holds records shorter than this, and at least as long
+ * as the limit of c+1. Freelist 0 holds the rest. */
+#define TDB_FREELIST_CLASS_LIMIT(c) (64U << (TDB_NUM_FREELISTS - 1 - (c)))
 #define TDB_SEQNUM_OFS    offsetof(struct tdb_header, sequence_number)
 #define TDB_PAD_BYTE 0x42
 #define TDB_PAD_U32  0x42424242
@@ -145,12 +167,18 @@ struct tdb_header {
 	char magic_food[32]; /* for /etc/magic */
 	uint32_t version; /* version of the code */
 	uint32_t hash_size; /* number of hash entries */
-	tdb_off_t rwlocks; /* obsolete - kept to detect old formats */
+	tdb_off_t rwlocks; /* obsolete - kept to detect old formats and feature flags */
 	tdb_off_t recovery_start; /* offset of transaction recovery region */
 	tdb_off_t sequence_number; /* used when TDB_SEQNUM is set */
 	uint32_t magic1_hash; /* hash of TDB_MAGIC_FOOD. */
 	uint32_t magic2_hash; /* hash of TDB_MAGIC. */
-	tdb_off_t reserved[27];
+	uint32_t feature_flags; /* TDB_FEATURE_FLAG_*, if rwlocks is TDB_FEATURE_FLAG_MAGIC */
+	tdb_off_t mutex_offset; /* page aligned start of the mutex area */
+	tdb_len_t mutex_size; /* whole pages, data follows the mutex area */
+	tdb_off_t reserved[24 - (TDB_NUM_FREELISTS - 1)];
+	/* size classes 1.. of TDB_FEATURE_FLAG_FREELIST_CLASSES, class 0
+	 * is the classic freelist at FREELIST_TOP */
+	tdb_off_t freelist_heads[TDB_NUM_FREELISTS - 1];
 };
 
 struct tdb_lock_type {
@@ -213,6 +241,10 @@ struct tdb_context {
 	int tracefd;
 #endif
 	volatile sig_atomic_t *interrupt_sig_ptr;
+	struct tdb_mutexes *mutexes; /* chain mutexes with TDB_MUTEX_LOCKING */
+	void *mutex_map;
+	size_t mutex_map_size;
+	bool mutex_allrecord; /* we hold the allrecord mutex */
 };
 
 
@@ -253,6 +285,10 @@ int tdb_ofs_write(struct tdb_context *tdb, tdb_off_t offset, tdb_off_t *d);
 void *tdb_convert(void *buf, uint32_t size);
 int tdb_free(struct tdb_context *tdb, tdb_off_t offset, struct tdb_record *rec);
 tdb_off_t tdb_allocate(struct tdb_context *tdb, tdb_len_t length, struct tdb_record *rec);
+tdb_off_t tdb_allocate_below(struct tdb_context *tdb, tdb_len_t length,
+			     struct tdb_record *rec, tdb_off_t limit);
+int tdb_free_tail(struct tdb_context *tdb, tdb_off_t rec_ptr,
+		  unsigned int max);
 int tdb_ofs_read(struct tdb_context *tdb, tdb_off_t offset, tdb_off_t *d);
 int tdb_ofs_write(struct tdb_context *tdb, tdb_off_t offset, tdb_off_t *d);
 int tdb_lock_record(struct tdb_context *tdb, tdb_off_t off);
@@ -271,6 +307,7 @@ tdb_off_t tdb_find_lock_hash(struct tdb_context *tdb, TDB_DATA key, uint32_t has
 			   struct tdb_record *rec);
 void tdb_io_init(struct tdb_context *tdb);
 int tdb_expand(struct tdb_context *tdb, tdb_off_t size);
+int tdb_remap_shrunk(struct tdb_context *tdb);
 int tdb_rec_free_read(struct tdb_context *tdb, tdb_off_t off,
 		      struct tdb_record *rec);
 bool tdb_write_all(int fd, const void *buf, size_t count);
@@ -279,3 +316,16 @@ void tdb_header_hash(struct tdb_context *tdb,
 		     uint32_t *magic1_hash, uint32_t *magic2_hash);
 unsigned int tdb_old_hash(TDB_DATA *key);
 size_t tdb_dead_space(struct tdb_context *tdb, tdb_off_t off);
+tdb_len_t tdb_mutex_size(uint32_t hash_size);
+bool tdb_mutex_lock(struct tdb_context *tdb, int rw, off_t off, off_t len,
+		    bool waitflag, int *pret);
+bool tdb_mutex_unlock(struct tdb_context *tdb, int rw, off_t off, off_t len,
+		      int *pret);
+int tdb_mutex_allrecord_lock(struct tdb_context *tdb, int ltype,
+			     enum tdb_lock_flags flags);
+int tdb_mutex_allrecord_upgrade(struct tdb_context *tdb);
+void tdb_mutex_allrecord_upgraded(struct tdb_context *tdb);
+int tdb_mutex_allrecord_unlock(struct tdb_context *tdb);
+int tdb_mutex_mmap(struct tdb_context *tdb);
+int tdb_mutex_munmap(struct tdb_context *tdb);
+int tdb_mutex_init(struct tdb_context *tdb);
@@ -80,6 +80,9 @@ extern "C" {
 #define TDB_ALLOW_NESTING 512 /** Allow transactions to nest */
 #define TDB_DISALLOW_NESTING 1024 /** Disallow transactions to nest */
 #define TDB_INCOMPATIBLE_HASH 2048 /** Better hashing: can't be opened by tdb < 1.2.6. */
+#define TDB_MUTEX_LOCKING 4096 /** Use robust mutexes for the chain locks: can't be opened by tdb < 1.2.10. */
+#define TDB_FREELIST_CLASSES 8192 /** Separate freelists per record size: can't be opened by tdb < 1.2.10. */
+#define TDB_CRC32C_HASH 16384 /** Faster hashing with CRC32C: can't be opened by tdb < 1.2.10. */
 
 /** The tdb error codes */
 enum TDB_ERROR {TDB_SUCCESS=0, TDB_ERR_CORRUPT, TDB_ERR_IO, TDB_ERR_LOCK, 
@@ -143,6 +146,15 @@ struct tdb_logging_context {
  *                                        default 5.\n
  *                         TDB_ALLOW_NESTING - Allow transactions to nest.\n
  *                         TDB_DISALLOW_NESTING - Disallow transactions to nest.\n
+ *                         TDB_MUTEX_LOCKING - Use process shared robust
+ *                                             mutexes for the hash chain
+ *                                             locks if supported.\n
+ *                         TDB_FREELIST_CLASSES - Create the database with
+ *                                                one freelist and lock per
+ *                                                record size class.\n
+ *                         TDB_CRC32C_HASH - Create the database with the
+ *                                           CRC32C based hash, using
+ *                                           SSE4.2 where available.\n
  *
  * @param[in]  open_flags Flags for the open(2) function.
  *
@@ -179,6 +191,15 @@ struct tdb_context *tdb_open(const char *name, int hash_size, int tdb_flags,
  *                                        default 5.\n
  *                         TDB_ALLOW_NESTING - Allow transactions to nest.\n
  *                         TDB_DISALLOW_NESTING - Disallow transactions to nest.\n
+ *                         TDB_MUTEX_LOCKING - Use process shared robust
+ *                                             mutexes for the hash chain
+ *                                             locks if supported.\n
+ *                         TDB_FREELIST_CLASSES - Create the database with
+ *                                                one freelist and lock per
+ *                                                record size class.\n
+ *                         TDB_CRC32C_HASH - Create the database with the
+ *                                           CRC32C based hash, using
+ *                                           SSE4.2 where available.\n
  *
  * @param[in]  open_flags Flags for the open(2) function.
  *
@@ -789,6 +810,19 @@ void tdb_increment_seqnum_nonblock(struct tdb_context *tdb);
  */
 unsigned int tdb_jenkins_hash(TDB_DATA *key);
 
+/**
+ * @brief Create a hash of the key with CRC32C.
+ *
+ * This is the hash used for databases created with TDB_CRC32C_HASH. It
+ * uses the SSE4.2 crc32 instruction where available and gives the same
+ * results everywhere.
+ *
+ * @param[in]  key      The key to hash
+ *
+ * @return              The hash.
+ */
+unsigned int tdb_crc32c_hash(TDB_DATA *key);
+
 /**
  * @brief Check the consistency of the database.
  *
@@ -830,6 +864,11 @@ void tdb_setalarm_sigptr(struct tdb_context *tdb, volatile sig_atomic_t *sigptr)
 /* wipe and repack */
 int tdb_wipe_all(struct tdb_context *tdb);
 int tdb_repack(struct tdb_context *tdb);
+/* move up to max_records records from the end of the file into free
+   space below and truncate the file. Only takes chain and freelist
+   locks, returns the number of records moved or truncated, 0 when
+   nothing is left to do and -1 on error */
+int tdb_repack_step(struct tdb_context *tdb, unsigned int max_records);
 
 /* Debug functions. Not used in production. */
 void tdb_dump_all(struct tdb_context *tdb);
@@ -590,6 +590,7 @@ void inittdb(void)
 	PyModule_AddObject(m, "ALLOW_NESTING", PyInt_FromLong(TDB_ALLOW_NESTING));
 	PyModule_AddObject(m, "DISALLOW_NESTING", PyInt_FromLong(TDB_DISALLOW_NESTING));
 	PyModule_AddObject(m, "INCOMPATIBLE_HASH", PyInt_FromLong(TDB_INCOMPATIBLE_HASH));
+	PyModule_AddObject(m, "CRC32C_HASH", PyInt_FromLong(TDB_CRC32C_HASH));
 
 	PyModule_AddObject(m, "__docformat__", PyString_FromString("restructuredText"));
 
@@ -0,0 +1,127 @@
+/* this tests the CRC32C hash against known values. The hash decides
+   where records live on disk, so it must never change. It also checks
+   that the SSE4.2 and table driven CRC32C give the same results.
+*/
+
+#include "../common/hash.c"
+
+struct crc32c_vector {
+	const char *name;
+	uint8_t data[32];
+	size_t len;
+	uint32_t crc;
+};
+
+/* RFC 3720, B.4, and the usual check value */
+static struct crc32c_vector crc32c_vectors[] = {
+	{ "empty", { 0 }, 0, 0x00000000 },
+	{ "123456789", { '1', '2', '3', '4', '5', '6', '7', '8', '9' },
+	  9, 0xe3069283 },
+	{ "32 zeros", { 0 }, 32, 0x8a9136aa },
+	{ "32 0xff", { 0 }, 32, 0x62a8ab43 },
+	{ "32 incrementing", { 0 }, 32, 0x46dd794e },
+	{ "32 decrementing", { 0 }, 32, 0x113fdb5c },
+};
+
+static int failures;
+
+static void check(bool ok, const char *what, const char *name,
+		  size_t len, uint32_t got, uint32_t expected)
+{
+	if (!ok) {
+		printf("%s failed for %s (len %u): got 0x%08x, "
+		       "expected 0x%08x\n", what, name, (unsigned)len,
+		       got, expected);
+		failures++;
+	}
+}
+
+static void test_vectors(void)
+{
+	unsigned i, j;
+
+	memset(crc32c_vectors[3].data, 0xff, 32);
+	for (j = 0; j < 32; j++) {
+		crc32c_vectors[4].data[j] = j;
+		crc32c_vectors[5].data[j] = 31 - j;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(crc32c_vectors); i++) {
+		const struct crc32c_vector *v = &crc32c_vectors[i];
+		uint32_t crc;
+
+		crc = ~crc32c_sw(~0U, v->data, v->len);
+		check(crc == v->crc, "table crc32c", v->name, v->len,
+		      crc, v->crc);
+#ifdef HAVE_TDB_CRC32C_SSE42
+		if (crc32c_have_sse42()) {
+			crc = ~crc32c_sse42(~0U, v->data, v->len);
+			check(crc == v->crc, "sse4.2 crc32c", v->name, v->len,
+			      crc, v->crc);
+		}
+#endif
+	}
+}
+
+/* the CRC of "123456789" through the murmur3 avalanche step */
+static void test_crc32c_hash(void)
+{
+	TDB_DATA key = {
+		.dptr = discard_const_p(uint8_t, "123456789"),
+		.dsize = 9
+	};
+	uint32_t h;
+
+	h = tdb_crc32c_hash(&key);
+	check(h == 0xac7081cc, "tdb_crc32c_hash", "123456789", key.dsize,
+	      h, 0xac7081cc);
+}
+
+/*
+  compare both CRC32C implementations on every length and alignment the
+  8 and 4 byte steps of the SSE4.2 version can hit
+ */
+static void test_sse42_matches_table(void)
+{
+#ifdef HAVE_TDB_CRC32C_SSE42
+	uint8_t buf[256 + 8];
+	size_t ofs, len;
+	unsigned i;
+
+	if (!crc32c_have_sse42()) {
+		printf("no SSE4.2, only the table driven crc32c tested\n");
+		return;
+	}
+
+	srandom(time(NULL));
+	for (i = 0; i < sizeof(buf); i++) {
+		buf[i] = random();
+	}
+
+	for (ofs = 0; ofs < 8; ofs++) {
+		for (len = 0; len <= 256; len++) {
+			uint32_t sw = crc32c_sw(~0U, &buf[ofs], len);
+			uint32_t hw = crc32c_sse42(~0U, &buf[ofs], len);
+
+			check(sw == hw, "sse4.2 vs table crc32c", "random",
+			      len, hw, sw);
+		}
+	}
+#else
+	printf("built without SSE4.2, only the table driven crc32c tested\n");
+#endif
+}
+
+int main(int argc, const char *argv[])
+{
+	test_vectors();
+	test_crc32c_hash();
+	test_sse42_matches_table();
+
+	if (failures != 0) {
+		printf("%d failures\n", failures);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+}
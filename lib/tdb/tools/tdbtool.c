@@ -57,6 +57,9 @@ enum commands {
 	CMD_INFO,
 	CMD_MMAP,
 	CMD_SPEED,
+	CMD_FRAGSPEED,
+	CMD_COMPACT,
+	CMD_HASHSPEED,
 	CMD_FIRST,
 	CMD_NEXT,
 	CMD_SYSTEM,
@@ -89,6 +92,9 @@ COMMAND_TABLE cmd_table[] = {
 	{"free",	CMD_LIST_FREE},
 	{"info",	CMD_INFO},
 	{"speed",	CMD_SPEED},
+	{"fragspeed",	CMD_FRAGSPEED},
+	{"compact",	CMD_COMPACT},
+	{"hashspeed",	CMD_HASHSPEED},
 	{"mmap",	CMD_MMAP},
 	{"first",	CMD_FIRST},
 	{"1",		CMD_FIRST},
@@ -185,7 +191,8 @@ static void help(void)
 {
 	printf("\n"
 "tdbtool: \n"
-"  create    dbname     : create a database\n"
+"  create    dbname [classes,crc32c] : create a database, with size class\n"
+"                       freelists and/or the CRC32C hash\n"
 "  open      dbname     : open an existing database\n"
 "  transaction_start    : start a transaction\n"
 "  transaction_commit   : commit a transaction\n"
@@ -204,6 +211,9 @@ static void help(void)
 "  free                 : print the database freelist\n"
 "  check                : check the integrity of an opened database\n"
 "  speed                : perform speed tests on the database\n"
+"  fragspeed [records]  : time stores after fragmenting the freelist\n"
+"  compact   [records]  : repack and shrink online, records per step\n"
+"  hashspeed [keys]     : compare the hash functions on typical keys\n"
 "  ! command            : execute system command\n"
 "  1 | first            : print the first record\n"
 "  n | next             : print the next record\n"
@@ -217,13 +227,21 @@ static void terror(const char *why)
 	printf("%s\n", why);
 }
 
-static void create_tdb(const char *tdbname)
+static void create_tdb(const char *tdbname, const char *options)
 {
 	struct tdb_logging_context log_ctx;
+	int tdb_flags = TDB_CLEAR_IF_FIRST | (disable_mmap?TDB_NOMMAP:0);
 	log_ctx.log_fn = tdb_log;
 
+	if (options && strstr(options, "classes") != NULL) {
+		tdb_flags |= TDB_FREELIST_CLASSES;
+	}
+	if (options && strstr(options, "crc32c") != NULL) {
+		tdb_flags |= TDB_CRC32C_HASH;
+	}
+
 	if (tdb) tdb_close(tdb);
-	tdb = tdb_open_ex(tdbname, 0, TDB_CLEAR_IF_FIRST | (disable_mmap?TDB_NOMMAP:0),
+	tdb = tdb_open_ex(tdbname, 0, tdb_flags,
 			  O_RDWR | O_CREAT | O_TRUNC, 0600, &log_ctx, NULL);
 	if (!tdb) {
 		printf("Could not create %s: %s\n", tdbname, strerror(errno));
@@ -488,6 +506,240 @@ static void speed_tdb(const char *tlimit)
 	printf("%10.3f ops/sec\n", ops/t);
 }
 
+/*
+  store records of mixed sizes and delete every other one, so that the
+  freelist is full of small holes between live records, then time the
+  stores that have to allocate from it
+*/
+static void fragspeed_tdb(const char *nrecords)
+{
+	unsigned num = nrecords?atoi(nrecords):0;
+	char keystr[32];
+	unsigned char data[1024];
+	TDB_DATA key, dbuf;
+	double t, total = 0, worst = 0;
+	unsigned i;
+
+	if (num == 0) num = 20000;
+	memset(data, 'x', sizeof(data));
+	key.dptr = (unsigned char *)keystr;
+	dbuf.dptr = data;
+
+	printf("Fragmenting the database with %u records\n", num);
+	for (i = 0; i < 2*num; i++) {
+		key.dsize = snprintf(keystr, sizeof(keystr), "frag%u", i);
+		dbuf.dsize = 16 + random() % (sizeof(data) - 16);
+		if (tdb_store(tdb, key, dbuf, TDB_REPLACE) != 0) {
+			printf("store failed: %s\n", tdb_errorstr(tdb));
+			return;
+		}
+	}
+	for (i = 0; i < 2*num; i += 2) {
+		key.dsize = snprintf(keystr, sizeof(keystr), "frag%u", i);
+		tdb_delete(tdb, key);
+	}
+	printf("%d free records\n", tdb_freelist_size(tdb));
+
+	printf("Testing store speed of %u records\n", num);
+	for (i = 0; i < num; i++) {
+		key.dsize = snprintf(keystr, sizeof(keystr), "fragnew%u", i);
+		dbuf.dsize = 16 + random() % (sizeof(data) - 16);
+		_start_timer();
+		tdb_store(tdb, key, dbuf, TDB_REPLACE);
+		t = _end_timer();
+		total += t;
+		if (t > worst) {
+			worst = t;
+		}
+	}
+	printf("%10.3f ops/sec, %.1f/%.1f usec average/worst latency\n",
+	       num/total, total*1.0e6/num, worst*1.0e6);
+
+	for (i = 0; i < 2*num; i++) {
+		key.dsize = snprintf(keystr, sizeof(keystr), "frag%u", i);
+		tdb_delete(tdb, key);
+		if (i < num) {
+			key.dsize = snprintf(keystr, sizeof(keystr), "fragnew%u", i);
+			tdb_delete(tdb, key);
+		}
+	}
+}
+
+/*
+  shrink the database with tdb_repack_step(), which only holds chain
+  and freelist locks for a few records at a time
+*/
+static void compact_tdb(const char *nrecords)
+{
+	unsigned num = nrecords?atoi(nrecords):0;
+	struct stat st;
+	off_t before;
+	unsigned steps = 0, records = 0;
+	double t, worst = 0;
+	int ret;
+
+	if (num == 0) num = 100;
+
+	if (fstat(tdb_fd(tdb), &st) != 0) {
+		terror("fstat failed");
+		return;
+	}
+	before = st.st_size;
+
+	_start_timer();
+	while ((ret = tdb_repack_step(tdb, num)) > 0) {
+		t = _end_timer();
+		if (t > worst) {
+			worst = t;
+		}
+		steps++;
+		records += ret;
+		_start_timer();
+	}
+	if (ret == -1) {
+		printf("repack step failed: %s\n", tdb_errorstr(tdb));
+	}
+
+	if (fstat(tdb_fd(tdb), &st) != 0) {
+		terror("fstat failed");
+		return;
+	}
+	printf("%u steps, %u records moved or truncated, "
+	       "%.1f usec worst step\n", steps, records, worst*1.0e6);
+	printf("size %lld -> %lld bytes\n",
+	       (long long)before, (long long)st.st_size);
+}
+
+/*
+  fill keys[] with num keys of one kind, the way smbd builds them
+*/
+static void hashspeed_keys(int kind, TDB_DATA *keys, unsigned num)
+{
+	unsigned i;
+
+	for (i = 0; i < num; i++) {
+		char buf[128];
+		size_t len;
+
+		switch (kind) {
+		case 0: {
+			/* struct file_id from locking_key() */
+			uint64_t file_id[3];
+			file_id[0] = 0x801;
+			file_id[1] = 1000000 + i;
+			file_id[2] = 0;
+			len = sizeof(file_id);
+			memcpy(buf, file_id, len);
+			break;
+		}
+		case 1:
+			/* SIDs in the string form */
+			len = snprintf(buf, sizeof(buf),
+				       "S-1-5-21-3623811015-3361044348-30300820-%u",
+				       1000 + i);
+			break;
+		default:
+			/* gencache entries */
+			len = snprintf(buf, sizeof(buf),
+				       "IDMAP/SID2XID/S-1-5-21-3623811015-"
+				       "3361044348-30300820-%u", 1000 + i);
+			break;
+		}
+		keys[i].dptr = (unsigned char *)malloc(len);
+		memcpy(keys[i].dptr, buf, len);
+		keys[i].dsize = len;
+	}
+}
+
+/*
+  time the raw hash functions, and fetches from an internal database
+  created with each of the inbuilt hashes
+*/
+static void hashspeed_tdb(const char *nkeys)
+{
+	static const char *kinds[] = { "file_id", "SID", "gencache" };
+	static const struct {
+		const char *name;
+		int flags;
+	} hashes[] = {
+		{ "old", 0 },
+		{ "jenkins", TDB_INCOMPATIBLE_HASH },
+		{ "crc32c", TDB_CRC32C_HASH },
+	};
+	unsigned num = nkeys?atoi(nkeys):0;
+	TDB_DATA *keys;
+	unsigned k, h, i, rounds;
+	volatile unsigned int sink = 0;
+	double t;
+
+	if (num == 0) num = 100000;
+	keys = (TDB_DATA *)calloc(num, sizeof(TDB_DATA));
+	if (keys == NULL) {
+		terror("out of memory");
+		return;
+	}
+	rounds = 10000000 / num + 1;
+
+	printf("%-10s %-8s %12s %12s\n", "keys", "hash", "nsec/hash", "fetches/sec");
+	for (k = 0; k < ARRAY_SIZE(kinds); k++) {
+		hashspeed_keys(k, keys, num);
+
+		for (h = 0; h < ARRAY_SIZE(hashes); h++) {
+			struct tdb_context *db;
+			double nsec = 0;
+			unsigned r;
+
+			if (hashes[h].flags != 0) {
+				_start_timer();
+				for (r = 0; r < rounds; r++) {
+					for (i = 0; i < num; i++) {
+						sink += hashes[h].flags == TDB_CRC32C_HASH ?
+							tdb_crc32c_hash(&keys[i]) :
+							tdb_jenkins_hash(&keys[i]);
+					}
+				}
+				nsec = _end_timer() * 1.0e9 / ((double)rounds * num);
+			}
+
+			db = tdb_open("hashspeed", 10007,
+				      TDB_INTERNAL|hashes[h].flags,
+				      O_RDWR|O_CREAT, 0);
+			if (db == NULL) {
+				terror("can't create internal database");
+				break;
+			}
+			for (i = 0; i < num; i++) {
+				tdb_store(db, keys[i], keys[i], TDB_INSERT);
+			}
+			r = 0;
+			_start_timer();
+			do {
+				for (i = 0; i < num; i++) {
+					TDB_DATA d = tdb_fetch(db, keys[i]);
+					free(d.dptr);
+				}
+				r++;
+				t = _end_timer();
+			} while (t < 0.5);
+			tdb_close(db);
+
+			if (hashes[h].flags != 0) {
+				printf("%-10s %-8s %12.1f %12.0f\n", kinds[k],
+				       hashes[h].name, nsec, r*num/t);
+			} else {
+				/* tdb_old_hash() is not exported */
+				printf("%-10s %-8s %12s %12.0f\n", kinds[k],
+				       hashes[h].name, "-", r*num/t);
+			}
+		}
+
+		for (i = 0; i < num; i++) {
+			free(keys[i].dptr);
+		}
+	}
+	free(keys);
+}
+
 static void toggle_mmap(void)
 {
 	disable_mmap = !disable_mmap;
@@ -580,7 +832,7 @@ static int do_command(void)
 	switch (mycmd) {
 	case CMD_CREATE_TDB:
 		bIterate = 0;
-		create_tdb(arg1);
+		create_tdb(arg1, arg2);
 		return 0;
 	case CMD_OPEN_TDB:
 		bIterate = 0;
@@ -594,6 +846,9 @@ static int do_command(void)
 		return 0;
 	case CMD_QUIT:
 		return 1;
+	case CMD_HASHSPEED:
+		hashspeed_tdb(arg1);
+		return 0;
 	default:
 		/* all the rest require a open database */
 		if (!tdb) {
@@ -661,6 +916,12 @@ static int do_command(void)
 		case CMD_SPEED:
 			speed_tdb(arg1);
 			return 0;
+		case CMD_FRAGSPEED:
+			fragspeed_tdb(arg1);
+			return 0;
+		case CMD_COMPACT:
+			compact_tdb(arg1);
+			return 0;
 		case CMD_MMAP:
 			toggle_mmap();
 			return 0;
@@ -682,6 +943,7 @@ static int do_command(void)
 		case CMD_OPEN_TDB:
 		case CMD_SYSTEM:
 		case CMD_QUIT:
+		case CMD_HASHSPEED:
 			/*
 			 * unhandled commands.  cases included here to avoid compiler
 			 * warnings.
@@ -22,6 +22,7 @@
 #define LOCKSTORE_PROB 5
 #define TRAVERSE_PROB 20
 #define TRAVERSE_READ_PROB 20
+#define REPACK_STEP_PROB 50
 #define CULL_PROB 100
 #define KEYLEN 3
 #define DATALEN 100
@@ -31,6 +32,7 @@ static int in_transaction;
 static int error_count;
 static int always_transaction = 0;
 static int hash_size = 2;
+static int tdb_flags = TDB_DEFAULT;
 static int loopnum;
 static int count_pipe;
 static struct tdb_logging_context log_ctx;
@@ -199,6 +201,15 @@ static void addrec_db(void)
 	}
 #endif
 
+#if REPACK_STEP_PROB
+	if (in_transaction == 0 && random() % REPACK_STEP_PROB == 0) {
+		if (tdb_repack_step(db, 10) == -1) {
+			fatal("tdb_repack_step failed");
+		}
+		goto next;
+	}
+#endif
+
 	data = tdb_fetch(db, key);
 	if (data.dptr) free(data.dptr);
 
@@ -216,7 +227,7 @@ static int traverse_fn(struct tdb_context *tdb, TDB_DATA key, TDB_DATA dbuf,
 
 static void usage(void)
 {
-	printf("Usage: tdbtorture [-t] [-k] [-n NUM_PROCS] [-l NUM_LOOPS] [-s SEED] [-H HASH_SIZE]\n");
+	printf("Usage: tdbtorture [-t] [-k] [-m] [-c] [-n NUM_PROCS] [-l NUM_LOOPS] [-s SEED] [-H HASH_SIZE]\n");
 	exit(0);
 }
 
@@ -230,7 +241,7 @@ static void send_count_and_suicide(int sig)
 
 static int run_child(const char *filename, int i, int seed, unsigned num_loops, unsigned start)
 {
-	db = tdb_open_ex(filename, hash_size, TDB_DEFAULT,
+	db = tdb_open_ex(filename, hash_size, tdb_flags,
 			 O_RDWR | O_CREAT, 0600, &log_ctx, NULL);
 	if (!db) {
 		fatal("db open failed");
@@ -302,7 +313,7 @@ int main(int argc, char * const *argv)
 
 	log_ctx.log_fn = tdb_log;
 
-	while ((c = getopt(argc, argv, "n:l:s:H:thk")) != -1) {
+	while ((c = getopt(argc, argv, "n:l:s:H:thkmc")) != -1) {
 		switch (c) {
 		case 'n':
 			num_procs = strtol(optarg, NULL, 0);
@@ -322,6 +333,12 @@ int main(int argc, char * const *argv)
 		case 'k':
 			kill_random = 1;
 			break;
+		case 'm':
+			tdb_flags |= TDB_MUTEX_LOCKING;
+			break;
+		case 'c':
+			tdb_flags |= TDB_FREELIST_CLASSES;
+			break;
 		default:
 			usage();
 		}
@@ -354,8 +371,11 @@ int main(int argc, char * const *argv)
 		if ((pids[i]=fork()) == 0) {
 			close(pfds[0]);
 			if (i == 0) {
-				printf("Testing with %d processes, %d loops, %d hash_size, seed=%d%s\n",
-				       num_procs, num_loops, hash_size, seed, always_transaction ? " (all within transactions)" : "");
+				printf("Testing with %d processes, %d loops, %d hash_size, seed=%d%s%s%s\n",
+				       num_procs, num_loops, hash_size, seed,
+				       always_transaction ? " (all within transactions)" : "",
+				       (tdb_flags & TDB_MUTEX_LOCKING) ? " (mutex locking)" : "",
+				       (tdb_flags & TDB_FREELIST_CLASSES) ? " (freelist classes)" : "");
 			}
 			exit(run_child(test_tdb, i, seed, num_loops, 0));
 		}
@@ -435,7 +455,7 @@ int main(int argc, char * const *argv)
 
 done:
 	if (error_count == 0) {
-		db = tdb_open_ex(test_tdb, hash_size, TDB_DEFAULT,
+		db = tdb_open_ex(test_tdb, hash_size, tdb_flags,
 				 O_RDWR, 0, &log_ctx, NULL);
 		if (!db) {
 			fatal("db open failed");
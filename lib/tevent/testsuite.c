@@ -146,6 +146,220 @@ static bool test_event_context(struct torture_context *test,
 	return true;
 }
 
+struct fde_free_state {
+	struct tevent_fd *fde[2];
+	int fd[2][2];
+	int called;
+};
+
+static void fde_free_handler(struct tevent_context *ev_ctx, struct tevent_fd *f,
+			     uint16_t flags, void *private_data)
+{
+	struct fde_free_state *state = (struct fde_free_state *)private_data;
+	int i;
+
+	state->called++;
+
+	/* free the other fd event, its event may already be pending */
+	for (i=0; i<2; i++) {
+		if (state->fde[i] != f) {
+			TALLOC_FREE(state->fde[i]);
+		}
+	}
+}
+
+/*
+  make two fds readable at the same time, the handler of the first one
+  frees the event of the second one, which must not be called anymore
+*/
+static bool test_event_fd_free(struct torture_context *test,
+			       const void *test_data)
+{
+	struct tevent_context *ev_ctx;
+	const char *backend = (const char *)test_data;
+	struct fde_free_state state;
+	char c = 0;
+	int i;
+
+	ev_ctx = event_context_init_byname(test, backend);
+	if (ev_ctx == NULL) {
+		torture_comment(test, "event backend '%s' not supported\n", backend);
+		return true;
+	}
+
+	ZERO_STRUCT(state);
+
+	for (i=0; i<2; i++) {
+		torture_assert(test, pipe(state.fd[i]) == 0, "pipe failed");
+		state.fde[i] = tevent_add_fd(ev_ctx, ev_ctx, state.fd[i][0],
+					     TEVENT_FD_READ,
+					     fde_free_handler, &state);
+		torture_assert(test, state.fde[i] != NULL, "tevent_add_fd failed");
+		write(state.fd[i][1], &c, 1);
+	}
+
+	torture_assert(test, tevent_loop_once(ev_ctx) == 0, "tevent_loop_once failed");
+	torture_assert_int_equal(test, state.called, 1, "handler of freed fde called");
+
+	for (i=0; i<2; i++) {
+		close(state.fd[i][0]);
+		close(state.fd[i][1]);
+	}
+	talloc_free(ev_ctx);
+
+	return true;
+}
+
+static void fde_oneshot_handler(struct tevent_context *ev_ctx, struct tevent_fd *f,
+				uint16_t flags, void *private_data)
+{
+	int *called = (int *)private_data;
+
+	(*called)++;
+}
+
+/*
+  a TEVENT_FD_ONESHOT event must not fire again before it is rearmed
+*/
+static bool test_event_fd_oneshot(struct torture_context *test,
+				  const void *test_data)
+{
+	struct tevent_context *ev_ctx;
+	const char *backend = (const char *)test_data;
+	struct tevent_fd *fde;
+	int fd[2];
+	int called = 0;
+	int finished = 0;
+	char c = 0;
+
+	ev_ctx = event_context_init_byname(test, backend);
+	if (ev_ctx == NULL) {
+		torture_comment(test, "event backend '%s' not supported\n", backend);
+		return true;
+	}
+
+	torture_assert(test, pipe(fd) == 0, "pipe failed");
+	fde = tevent_add_fd(ev_ctx, ev_ctx, fd[0],
+			    TEVENT_FD_READ|TEVENT_FD_ONESHOT,
+			    fde_oneshot_handler, &called);
+	torture_assert(test, fde != NULL, "tevent_add_fd failed");
+
+	/* the data is never read, so a level triggered fd would fire forever */
+	write(fd[1], &c, 1);
+
+	tevent_add_timer(ev_ctx, ev_ctx, timeval_current_ofs(0, 100000),
+			 finished_handler, &finished);
+	while (!finished) {
+		torture_assert(test, tevent_loop_once(ev_ctx) == 0,
+			       "tevent_loop_once failed");
+	}
+	torture_assert_int_equal(test, called, 1, "oneshot event fired again");
+	torture_assert_int_equal(test, tevent_fd_get_flags(fde), TEVENT_FD_ONESHOT,
+				 "oneshot event not disarmed");
+
+	TEVENT_FD_READABLE(fde);
+	torture_assert(test, tevent_loop_once(ev_ctx) == 0, "tevent_loop_once failed");
+	torture_assert_int_equal(test, called, 2, "rearmed oneshot event not fired");
+
+	close(fd[0]);
+	close(fd[1]);
+	talloc_free(ev_ctx);
+
+	return true;
+}
+
+struct timer_order_state {
+	struct timeval last;
+	int last_id;
+	int fired;
+	bool ok;
+};
+
+struct timer_order_entry {
+	struct timer_order_state *state;
+	int id;
+};
+
+static void timer_order_handler(struct tevent_context *ev_ctx,
+				struct tevent_timer *te,
+				struct timeval tval, void *private_data)
+{
+	struct timer_order_entry *e = (struct timer_order_entry *)private_data;
+	struct timer_order_state *state = e->state;
+	struct timeval t = tevent_timeval_set(e->id % 97, 0);
+	int cmp = tevent_timeval_compare(&state->last, &t);
+
+	/* deadlines must not go backwards, equal ones fire in creation order */
+	if (cmp > 0 || (cmp == 0 && state->last_id > e->id)) {
+		state->ok = false;
+	}
+	state->last = t;
+	state->last_id = e->id;
+	state->fired++;
+}
+
+/*
+  add many timers with clashing deadlines, free every third one and
+  check the firing order. This also reports the add/fire rate, which
+  was quadratic in the number of timers with the sorted list.
+*/
+static bool test_event_timer_order(struct torture_context *test)
+{
+	struct tevent_context *ev_ctx;
+	struct timer_order_state state;
+	struct timer_order_entry *entries;
+	struct tevent_timer **timers;
+	const int num_timers = 50000;
+	int expected = 0;
+	struct timeval t;
+	int i;
+
+	ev_ctx = tevent_context_init(test);
+	torture_assert(test, ev_ctx != NULL, "tevent_context_init failed");
+
+	entries = talloc_array(ev_ctx, struct timer_order_entry, num_timers);
+	timers = talloc_array(ev_ctx, struct tevent_timer *, num_timers);
+	torture_assert(test, entries != NULL && timers != NULL, "no memory");
+
+	ZERO_STRUCT(state);
+	state.ok = true;
+
+	t = timeval_current();
+	for (i=0; i<num_timers; i++) {
+		entries[i].state = &state;
+		entries[i].id = i;
+		/* all of these lie in the past, so they fire at once */
+		timers[i] = tevent_add_timer(ev_ctx, ev_ctx,
+					     tevent_timeval_set(i % 97, 0),
+					     timer_order_handler, &entries[i]);
+		torture_assert(test, timers[i] != NULL, "tevent_add_timer failed");
+	}
+	torture_comment(test, "Added %d timers in %.3f sec\n",
+			num_timers, timeval_elapsed(&t));
+
+	for (i=0; i<num_timers; i++) {
+		if (i % 3 == 0) {
+			TALLOC_FREE(timers[i]);
+		} else {
+			expected++;
+		}
+	}
+
+	t = timeval_current();
+	while (state.fired < expected) {
+		torture_assert(test, tevent_loop_once(ev_ctx) == 0,
+			       "tevent_loop_once failed");
+	}
+	torture_comment(test, "Fired %d timers in %.3f sec\n",
+			expected, timeval_elapsed(&t));
+
+	torture_assert(test, state.ok, "timers fired out of order");
+
+	talloc_free(ev_ctx);
+
+	return true;
+}
+
 struct torture_suite *torture_local_event(TALLOC_CTX *mem_ctx)
 {
 	struct torture_suite *suite = torture_suite_create(mem_ctx, "event");
@@ -156,7 +370,17 @@ struct torture_suite *torture_local_event(TALLOC_CTX *mem_ctx)
 		torture_suite_add_simple_tcase_const(suite, list[i],
 					       test_event_context,
 					       (const void *)list[i]);
+		torture_suite_add_simple_tcase_const(suite,
+					       talloc_asprintf(suite, "%s-fd-free", list[i]),
+					       test_event_fd_free,
+					       (const void *)list[i]);
+		torture_suite_add_simple_tcase_const(suite,
+					       talloc_asprintf(suite, "%s-fd-oneshot", list[i]),
+					       test_event_fd_oneshot,
+					       (const void *)list[i]);
 	}
 
+	torture_suite_add_simple_test(suite, "timer-order", test_event_timer_order);
+
 	return suite;
 }
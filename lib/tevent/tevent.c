@@ -142,7 +142,7 @@ const char **tevent_backend_list(TALLOC_CTX *mem_ctx)
 int tevent_common_context_destructor(struct tevent_context *ev)
 {
 	struct tevent_fd *fd, *fn;
-	struct tevent_timer *te, *tn;
+	struct tevent_timer *te;
 	struct tevent_immediate *ie, *in;
 	struct tevent_signal *se, *sn;
 
@@ -159,10 +159,10 @@ int tevent_common_context_destructor(struct tevent_context *ev)
 		DLIST_REMOVE(ev->fd_events, fd);
 	}
 
-	for (te = ev->timer_events; te; te = tn) {
-		tn = te->next;
+	while (ev->num_timers > 0) {
+		te = ev->timer_heap[--ev->num_timers];
 		te->event_ctx = NULL;
-		DLIST_REMOVE(ev->timer_events, te);
+		te->heap_idx = TEVENT_TIMER_NOT_QUEUED;
 	}
 
 	for (ie = ev->immediate_events; ie; ie = in) {
@@ -599,7 +599,7 @@ int tevent_common_loop_wait(struct tevent_context *ev,
 	 * loop as long as we have events pending
 	 */
 	while (ev->fd_events ||
-	       ev->timer_events ||
+	       ev->num_timers ||
 	       ev->immediate_events ||
 	       ev->signal_events) {
 		int ret;
@@ -424,6 +424,19 @@ void tevent_set_abort_fn(void (*abort_fn)(const char *reason));
  * Monitor a file descriptor for data to be read
  */
 #define TEVENT_FD_WRITE 2
+/**
+ * Ask for edge triggered notification (EPOLLET) on backends that
+ * support it. The handler has to read or write until the fd would
+ * block, other backends keep on reporting level triggered events.
+ * Available since tevent 0.9.15.
+ */
+#define TEVENT_FD_EDGE_TRIGGERED 4
+/**
+ * Disable the event before its handler is called (EPOLLONESHOT with
+ * epoll), the handler has to set #TEVENT_FD_READ or #TEVENT_FD_WRITE
+ * again to get further events. Available since tevent 0.9.15.
+ */
+#define TEVENT_FD_ONESHOT 8
 
 /**
  * Convenience function for declaring a tevent_fd writable
@@ -39,8 +39,25 @@ struct epoll_event_context {
 	int epoll_fd;
 
 	pid_t pid;
+
+	/* the innermost epoll_event_loop() that is dispatching events */
+	struct epoll_dispatch_state *dispatch;
+};
+
+/*
+  the events returned by a single epoll_wait() call, while their
+  handlers are being called. Entries for fd events freed by a handler
+  are reset, so that we never dispatch to a stale tevent_fd.
+*/
+struct epoll_dispatch_state {
+	struct epoll_dispatch_state *prev;
+	struct epoll_event *events;
+	int num_events;
+	bool ctx_freed;
 };
 
+#define EPOLL_MAXEVENTS 64
+
 /*
   called when a epoll call fails
 */
@@ -59,6 +76,9 @@ static uint32_t epoll_map_flags(uint16_t flags)
 	uint32_t ret = 0;
 	if (flags & TEVENT_FD_READ) ret |= (EPOLLIN | EPOLLERR | EPOLLHUP);
 	if (flags & TEVENT_FD_WRITE) ret |= (EPOLLOUT | EPOLLERR | EPOLLHUP);
+	if (ret == 0) return ret;
+	if (flags & TEVENT_FD_EDGE_TRIGGERED) ret |= EPOLLET;
+	if (flags & TEVENT_FD_ONESHOT) ret |= EPOLLONESHOT;
 	return ret;
 }
 
@@ -67,6 +87,12 @@ static uint32_t epoll_map_flags(uint16_t flags)
 */
 static int epoll_ctx_destructor(struct epoll_event_context *epoll_ev)
 {
+	struct epoll_dispatch_state *state;
+
+	for (state = epoll_ev->dispatch; state; state = state->prev) {
+		state->ctx_freed = true;
+		state->num_events = 0;
+	}
 	close(epoll_ev->epoll_fd);
 	epoll_ev->epoll_fd = -1;
 	return 0;
@@ -242,14 +268,58 @@ static void epoll_change_event(struct epoll_event_context *epoll_ev, struct teve
 	}
 }
 
+/*
+  forget about the not yet dispatched events of a fd event that goes away
+*/
+static void epoll_forget_pending(struct epoll_event_context *epoll_ev,
+				 struct tevent_fd *fde)
+{
+	struct epoll_dispatch_state *state;
+	int i;
+
+	for (state = epoll_ev->dispatch; state; state = state->prev) {
+		for (i=0; i<state->num_events; i++) {
+			if (state->events[i].data.ptr == fde) {
+				state->events[i].data.ptr = NULL;
+			}
+		}
+	}
+}
+
+/*
+  a handler called into the event loop again, the outer loops must
+  not dispatch their remaining events, as the nested loop may already
+  have consumed the data. Level triggered events will be reported again,
+  edge triggered and oneshot ones need to be rearmed.
+*/
+static void epoll_drop_pending(struct epoll_event_context *epoll_ev)
+{
+	struct epoll_dispatch_state *state;
+	int i;
+
+	for (state = epoll_ev->dispatch; state; state = state->prev) {
+		for (i=0; i<state->num_events; i++) {
+			struct tevent_fd *fde = (struct tevent_fd *)state->events[i].data.ptr;
+
+			state->events[i].data.ptr = NULL;
+
+			if (fde == NULL) continue;
+			if (!(fde->flags & (TEVENT_FD_EDGE_TRIGGERED|TEVENT_FD_ONESHOT))) continue;
+			if (!(fde->additional_flags & EPOLL_ADDITIONAL_FD_FLAG_HAS_EVENT)) continue;
+			epoll_mod_event(epoll_ev, fde);
+		}
+		state->num_events = 0;
+	}
+}
+
 /*
   event loop handling using epoll
 */
 static int epoll_event_loop(struct epoll_event_context *epoll_ev, struct timeval *tvalp)
 {
 	int ret, i;
-#define MAXEVENTS 1
-	struct epoll_event events[MAXEVENTS];
+	struct epoll_event events[EPOLL_MAXEVENTS];
+	struct epoll_dispatch_state state;
 	int timeout = -1;
 
 	if (epoll_ev->epoll_fd == -1) return -1;
@@ -264,7 +334,11 @@ static int epoll_event_loop(struct epoll_event_context *epoll_ev, struct timeval
 		return 0;
 	}
 
-	ret = epoll_wait(epoll_ev->epoll_fd, events, MAXEVENTS, timeout);
+	if (epoll_ev->dispatch != NULL) {
+		epoll_drop_pending(epoll_ev);
+	}
+
+	ret = epoll_wait(epoll_ev->epoll_fd, events, EPOLL_MAXEVENTS, timeout);
 
 	if (ret == -1 && errno == EINTR && epoll_ev->ev->signal_events) {
 		if (tevent_common_check_signal(epoll_ev->ev)) {
@@ -283,12 +357,34 @@ static int epoll_event_loop(struct epoll_event_context *epoll_ev, struct timeval
 		return 0;
 	}
 
-	for (i=0;i<ret;i++) {
-		struct tevent_fd *fde = talloc_get_type(events[i].data.ptr, 
-						       struct tevent_fd);
+	if (ret <= 0) {
+		return 0;
+	}
+
+	state.prev = epoll_ev->dispatch;
+	state.events = events;
+	state.num_events = ret;
+	state.ctx_freed = false;
+	epoll_ev->dispatch = &state;
+
+	/*
+	 * call the handlers of all returned events, a handler may free
+	 * or change any other fd event, which epoll_forget_pending()
+	 * and the checks against fde->flags take care of
+	 */
+	for (i=0;i<state.num_events;i++) {
+		struct tevent_fd *fde;
 		uint16_t flags = 0;
 
+		if (events[i].data.ptr == NULL) {
+			/* freed by an earlier handler */
+			continue;
+		}
+
+		fde = talloc_get_type(events[i].data.ptr, struct tevent_fd);
+		events[i].data.ptr = NULL;
 		if (fde == NULL) {
+			epoll_ev->dispatch = state.prev;
 			epoll_panic(epoll_ev, "epoll_wait() gave bad data");
 			return -1;
 		}
@@ -308,12 +404,31 @@ static int epoll_event_loop(struct epoll_event_context *epoll_ev, struct timeval
 		}
 		if (events[i].events & EPOLLIN) flags |= TEVENT_FD_READ;
 		if (events[i].events & EPOLLOUT) flags |= TEVENT_FD_WRITE;
-		if (flags) {
-			fde->handler(epoll_ev->ev, fde, flags, fde->private_data);
-			break;
+
+		/* an earlier handler may have changed what we wait for */
+		flags &= fde->flags;
+		if (flags == 0) {
+			continue;
+		}
+
+		if (fde->flags & TEVENT_FD_ONESHOT) {
+			/*
+			 * the kernel disabled the fd, the handler
+			 * has to rearm it with tevent_fd_set_flags()
+			 */
+			fde->flags &= ~(TEVENT_FD_READ|TEVENT_FD_WRITE);
+			fde->additional_flags &= ~EPOLL_ADDITIONAL_FD_FLAG_REPORT_ERROR;
+		}
+
+		fde->handler(epoll_ev->ev, fde, flags, fde->private_data);
+		if (state.ctx_freed) {
+			/* the handler freed the whole event context */
+			return 0;
 		}
 	}
 
+	epoll_ev->dispatch = state.prev;
+
 	return 0;
 }
 
@@ -354,6 +469,7 @@ static int epoll_event_fd_destructor(struct tevent_fd *fde)
 
 		epoll_check_reopen(epoll_ev);
 
+		epoll_forget_pending(epoll_ev, fde);
 		epoll_del_event(epoll_ev, fde);
 	}
 
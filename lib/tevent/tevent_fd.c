@@ -88,6 +88,17 @@ void tevent_common_fd_set_flags(struct tevent_fd *fde, uint16_t flags)
 	fde->flags = flags;
 }
 
+/*
+  emulate EPOLLONESHOT for backends without kernel support,
+  called just before the handler of the fd event
+*/
+void tevent_common_fd_disarm_oneshot(struct tevent_fd *fde)
+{
+	if (!(fde->flags & TEVENT_FD_ONESHOT)) return;
+
+	tevent_fd_set_flags(fde, fde->flags & ~(TEVENT_FD_READ|TEVENT_FD_WRITE));
+}
+
 void tevent_common_fd_set_close_fn(struct tevent_fd *fde,
 				   tevent_fd_close_fn_t close_fn)
 {
@@ -173,8 +173,11 @@ struct tevent_fd {
 };
 
 struct tevent_timer {
-	struct tevent_timer *prev, *next;
 	struct tevent_context *event_ctx;
+	/* position in event_ctx->timer_heap, TEVENT_TIMER_NOT_QUEUED if none */
+	size_t heap_idx;
+	/* orders timers with the same next_event by creation */
+	uint64_t seqnum;
 	struct timeval next_event;
 	tevent_timer_handler_t handler;
 	/* this is private for the specific handler */
@@ -232,8 +235,16 @@ struct tevent_context {
 	/* list of fd events - used by common code */
 	struct tevent_fd *fd_events;
 
-	/* list of timed events - used by common code */
-	struct tevent_timer *timer_events;
+	/*
+	 * timed events - used by common code
+	 *
+	 * this is a binary min-heap ordered by next_event and seqnum,
+	 * timer_heap[0] is the next timer to fire
+	 */
+	struct tevent_timer **timer_heap;
+	size_t num_timers;
+	size_t timer_heap_size;
+	uint64_t timer_seqnum;
 
 	/* list of immediate events - used by common code */
 	struct tevent_immediate *immediate_events;
@@ -278,6 +289,7 @@ void tevent_common_fd_set_close_fn(struct tevent_fd *fde,
 				   tevent_fd_close_fn_t close_fn);
 uint16_t tevent_common_fd_get_flags(struct tevent_fd *fde);
 void tevent_common_fd_set_flags(struct tevent_fd *fde, uint16_t flags);
+void tevent_common_fd_disarm_oneshot(struct tevent_fd *fde);
 
 struct tevent_timer *tevent_common_add_timer(struct tevent_context *ev,
 					     TALLOC_CTX *mem_ctx,
@@ -287,6 +299,8 @@ struct tevent_timer *tevent_common_add_timer(struct tevent_context *ev,
 					     const char *handler_name,
 					     const char *location);
 struct timeval tevent_common_loop_timer_delay(struct tevent_context *);
+#define TEVENT_TIMER_NOT_QUEUED ((size_t)-1)
+void tevent_common_timer_remove(struct tevent_timer *te);
 
 void tevent_common_schedule_immediate(struct tevent_immediate *im,
 				      struct tevent_context *ev,
@@ -259,6 +259,7 @@ static int poll_event_loop_poll(struct tevent_context *ev,
 			flags |= TEVENT_FD_WRITE;
 		}
 		if (flags != 0) {
+			tevent_common_fd_disarm_oneshot(fde);
 			fde->handler(ev, fde, flags, fde->private_data);
 			break;
 		}
@@ -203,6 +203,7 @@ static int select_event_loop_select(struct select_event_context *select_ev, stru
 			if (FD_ISSET(fde->fd, &r_fds)) flags |= TEVENT_FD_READ;
 			if (FD_ISSET(fde->fd, &w_fds)) flags |= TEVENT_FD_WRITE;
 			if (flags) {
+				tevent_common_fd_disarm_oneshot(fde);
 				fde->handler(select_ev->ev, fde, flags, fde->private_data);
 				break;
 			}
@@ -53,10 +53,28 @@ struct std_event_context {
 
 	/* our pid at the time the epoll_fd was created */
 	pid_t pid;
+
+	/* the innermost epoll_event_loop() that is dispatching events */
+	struct std_epoll_dispatch_state *dispatch;
+};
+
+/*
+  the events returned by a single epoll_wait() call, while their
+  handlers are being called. Entries for fd events freed by a handler
+  are reset, so that we never dispatch to a stale tevent_fd.
+*/
+struct std_epoll_dispatch_state {
+	struct std_epoll_dispatch_state *prev;
+	struct epoll_event *events;
+	int num_events;
+	bool ctx_freed;
 };
 
 /* use epoll if it is available */
 #if HAVE_EPOLL
+
+#define EPOLL_MAXEVENTS 64
+
 /*
   called when a epoll call fails, and we should fallback
   to using select
@@ -68,7 +86,6 @@ static void epoll_fallback_to_select(struct std_event_context *std_ev, const cha
 		     reason, strerror(errno));
 	close(std_ev->epoll_fd);
 	std_ev->epoll_fd = -1;
-	talloc_set_destructor(std_ev, NULL);
 }
 
 /*
@@ -79,6 +96,9 @@ static uint32_t epoll_map_flags(uint16_t flags)
 	uint32_t ret = 0;
 	if (flags & TEVENT_FD_READ) ret |= (EPOLLIN | EPOLLERR | EPOLLHUP);
 	if (flags & TEVENT_FD_WRITE) ret |= (EPOLLOUT | EPOLLERR | EPOLLHUP);
+	if (ret == 0) return ret;
+	if (flags & TEVENT_FD_EDGE_TRIGGERED) ret |= EPOLLET;
+	if (flags & TEVENT_FD_ONESHOT) ret |= EPOLLONESHOT;
 	return ret;
 }
 
@@ -87,6 +107,12 @@ static uint32_t epoll_map_flags(uint16_t flags)
 */
 static int epoll_ctx_destructor(struct std_event_context *std_ev)
 {
+	struct std_epoll_dispatch_state *state;
+
+	for (state = std_ev->dispatch; state; state = state->prev) {
+		state->ctx_freed = true;
+		state->num_events = 0;
+	}
 	if (std_ev->epoll_fd != -1) {
 		close(std_ev->epoll_fd);
 	}
@@ -256,14 +282,58 @@ static void epoll_change_event(struct std_event_context *std_ev, struct tevent_f
 	}
 }
 
+/*
+  forget about the not yet dispatched events of a fd event that goes away
+*/
+static void epoll_forget_pending(struct std_event_context *std_ev,
+				 struct tevent_fd *fde)
+{
+	struct std_epoll_dispatch_state *state;
+	int i;
+
+	for (state = std_ev->dispatch; state; state = state->prev) {
+		for (i=0; i<state->num_events; i++) {
+			if (state->events[i].data.ptr == fde) {
+				state->events[i].data.ptr = NULL;
+			}
+		}
+	}
+}
+
+/*
+  a handler called into the event loop again, the outer loops must
+  not dispatch their remaining events, as the nested loop may already
+  have consumed the data. Level triggered events will be reported again,
+  edge triggered and oneshot ones need to be rearmed.
+*/
+static void epoll_drop_pending(struct std_event_context *std_ev)
+{
+	struct std_epoll_dispatch_state *state;
+	int i;
+
+	for (state = std_ev->dispatch; state; state = state->prev) {
+		for (i=0; i<state->num_events; i++) {
+			struct tevent_fd *fde = (struct tevent_fd *)state->events[i].data.ptr;
+
+			state->events[i].data.ptr = NULL;
+
+			if (fde == NULL) continue;
+			if (!(fde->flags & (TEVENT_FD_EDGE_TRIGGERED|TEVENT_FD_ONESHOT))) continue;
+			if (!(fde->additional_flags & EPOLL_ADDITIONAL_FD_FLAG_HAS_EVENT)) continue;
+			epoll_mod_event(std_ev, fde);
+		}
+		state->num_events = 0;
+	}
+}
+
 /*
   event loop handling using epoll
 */
 static int epoll_event_loop(struct std_event_context *std_ev, struct timeval *tvalp)
 {
 	int ret, i;
-#define MAXEVENTS 1
-	struct epoll_event events[MAXEVENTS];
+	struct epoll_event events[EPOLL_MAXEVENTS];
+	struct std_epoll_dispatch_state state;
 	int timeout = -1;
 
 	if (std_ev->epoll_fd == -1) return -1;
@@ -278,7 +348,11 @@ static int epoll_event_loop(struct std_event_context *std_ev, struct timeval *tv
 		return 0;
 	}
 
-	ret = epoll_wait(std_ev->epoll_fd, events, MAXEVENTS, timeout);
+	if (std_ev->dispatch != NULL) {
+		epoll_drop_pending(std_ev);
+	}
+
+	ret = epoll_wait(std_ev->epoll_fd, events, EPOLL_MAXEVENTS, timeout);
 
 	if (ret == -1 && errno == EINTR && std_ev->ev->signal_events) {
 		if (tevent_common_check_signal(std_ev->ev)) {
@@ -297,12 +371,34 @@ static int epoll_event_loop(struct std_event_context *std_ev, struct timeval *tv
 		return 0;
 	}
 
-	for (i=0;i<ret;i++) {
-		struct tevent_fd *fde = talloc_get_type(events[i].data.ptr, 
-						       struct tevent_fd);
+	if (ret <= 0) {
+		return 0;
+	}
+
+	state.prev = std_ev->dispatch;
+	state.events = events;
+	state.num_events = ret;
+	state.ctx_freed = false;
+	std_ev->dispatch = &state;
+
+	/*
+	 * call the handlers of all returned events, a handler may free
+	 * or change any other fd event, which epoll_forget_pending()
+	 * and the checks against fde->flags take care of
+	 */
+	for (i=0;i<state.num_events;i++) {
+		struct tevent_fd *fde;
 		uint16_t flags = 0;
 
+		if (events[i].data.ptr == NULL) {
+			/* freed by an earlier handler */
+			continue;
+		}
+
+		fde = talloc_get_type(events[i].data.ptr, struct tevent_fd);
+		events[i].data.ptr = NULL;
 		if (fde == NULL) {
+			std_ev->dispatch = state.prev;
 			epoll_fallback_to_select(std_ev, "epoll_wait() gave bad data");
 			return -1;
 		}
@@ -322,12 +418,31 @@ static int epoll_event_loop(struct std_event_context *std_ev, struct timeval *tv
 		}
 		if (events[i].events & EPOLLIN) flags |= TEVENT_FD_READ;
 		if (events[i].events & EPOLLOUT) flags |= TEVENT_FD_WRITE;
-		if (flags) {
-			fde->handler(std_ev->ev, fde, flags, fde->private_data);
-			break;
+
+		/* an earlier handler may have changed what we wait for */
+		flags &= fde->flags;
+		if (flags == 0) {
+			continue;
+		}
+
+		if (fde->flags & TEVENT_FD_ONESHOT) {
+			/*
+			 * the kernel disabled the fd, the handler
+			 * has to rearm it with tevent_fd_set_flags()
+			 */
+			fde->flags &= ~(TEVENT_FD_READ|TEVENT_FD_WRITE);
+			fde->additional_flags &= ~EPOLL_ADDITIONAL_FD_FLAG_REPORT_ERROR;
+		}
+
+		fde->handler(std_ev->ev, fde, flags, fde->private_data);
+		if (state.ctx_freed) {
+			/* the handler freed the whole event context */
+			return 0;
 		}
 	}
 
+	std_ev->dispatch = state.prev;
+
 	return 0;
 }
 #else
@@ -336,6 +451,7 @@ static int epoll_event_loop(struct std_event_context *std_ev, struct timeval *tv
 #define epoll_del_event(std_ev,fde)
 #define epoll_change_event(std_ev,fde)
 #define epoll_event_loop(std_ev,tvalp) (-1)
+#define epoll_forget_pending(std_ev,fde)
 #define epoll_check_reopen(std_ev)
 #endif
 
@@ -396,6 +512,7 @@ static int std_event_fd_destructor(struct tevent_fd *fde)
 			std_ev->maxfd = EVENT_INVALID_MAXFD;
 		}
 
+		epoll_forget_pending(std_ev, fde);
 		epoll_del_event(std_ev, fde);
 	}
 
@@ -527,6 +644,7 @@ static int std_event_loop_select(struct std_event_context *std_ev, struct timeva
 			if (FD_ISSET(fde->fd, &r_fds)) flags |= TEVENT_FD_READ;
 			if (FD_ISSET(fde->fd, &w_fds)) flags |= TEVENT_FD_WRITE;
 			if (flags & fde->flags) {
+				tevent_common_fd_disarm_oneshot(fde);
 				fde->handler(std_ev->ev, fde, flags, fde->private_data);
 				break;
 			}
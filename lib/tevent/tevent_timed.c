@@ -128,6 +128,107 @@ struct timeval tevent_timeval_current_ofs(uint32_t secs, uint32_t usecs)
 	return tevent_timeval_add(&tv, secs, usecs);
 }
 
+/*
+  does timer a fire before timer b?
+*/
+static bool tevent_timer_before(const struct tevent_timer *a,
+				const struct tevent_timer *b)
+{
+	int cmp = tevent_timeval_compare(&a->next_event, &b->next_event);
+
+	if (cmp != 0) {
+		return (cmp < 0);
+	}
+
+	/* keep the order in which timers with the same time were added */
+	return (a->seqnum < b->seqnum);
+}
+
+static void tevent_timer_heap_set(struct tevent_context *ev, size_t idx,
+				  struct tevent_timer *te)
+{
+	ev->timer_heap[idx] = te;
+	te->heap_idx = idx;
+}
+
+/*
+  move the timer at idx towards the root until the heap is ordered
+*/
+static void tevent_timer_heap_up(struct tevent_context *ev, size_t idx)
+{
+	struct tevent_timer *te = ev->timer_heap[idx];
+
+	while (idx > 0) {
+		size_t parent = (idx - 1) / 2;
+
+		if (!tevent_timer_before(te, ev->timer_heap[parent])) {
+			break;
+		}
+		tevent_timer_heap_set(ev, idx, ev->timer_heap[parent]);
+		idx = parent;
+	}
+	tevent_timer_heap_set(ev, idx, te);
+}
+
+/*
+  move the timer at idx towards the leaves until the heap is ordered
+*/
+static void tevent_timer_heap_down(struct tevent_context *ev, size_t idx)
+{
+	struct tevent_timer *te = ev->timer_heap[idx];
+
+	while (true) {
+		size_t child = idx * 2 + 1;
+
+		if (child >= ev->num_timers) {
+			break;
+		}
+		if (child + 1 < ev->num_timers &&
+		    tevent_timer_before(ev->timer_heap[child + 1],
+					ev->timer_heap[child])) {
+			child += 1;
+		}
+		if (!tevent_timer_before(ev->timer_heap[child], te)) {
+			break;
+		}
+		tevent_timer_heap_set(ev, idx, ev->timer_heap[child]);
+		idx = child;
+	}
+	tevent_timer_heap_set(ev, idx, te);
+}
+
+/*
+  remove a timed event from the heap of its event context
+*/
+void tevent_common_timer_remove(struct tevent_timer *te)
+{
+	struct tevent_context *ev = te->event_ctx;
+	size_t idx = te->heap_idx;
+	struct tevent_timer *last;
+
+	if (ev == NULL || idx == TEVENT_TIMER_NOT_QUEUED) {
+		return;
+	}
+
+	te->heap_idx = TEVENT_TIMER_NOT_QUEUED;
+
+	ev->num_timers -= 1;
+	last = ev->timer_heap[ev->num_timers];
+	ev->timer_heap[ev->num_timers] = NULL;
+
+	if (last == te) {
+		return;
+	}
+
+	/* fill the hole with the last timer and restore the heap order */
+	tevent_timer_heap_set(ev, idx, last);
+	if (idx > 0 && tevent_timer_before(last, ev->timer_heap[(idx - 1) / 2])) {
+		tevent_timer_heap_up(ev, idx);
+	} else {
+		tevent_timer_heap_down(ev, idx);
+	}
+}
+
 /*
   destroy a timed event
 */
@@ -137,9 +238,7 @@ static int tevent_common_timed_destructor(struct tevent_timer *te)
 		     "Destroying timer event %p \"%s\"\n",
 		     te, te->handler_name);
 
-	if (te->event_ctx) {
-		DLIST_REMOVE(te->event_ctx->timer_events, te);
-	}
+	tevent_common_timer_remove(te);
 
 	return 0;
 }
@@ -160,12 +259,28 @@ struct tevent_timer *tevent_common_add_timer(struct tevent_context *ev, TALLOC_C
 					     const char *handler_name,
 					     const char *location)
 {
-	struct tevent_timer *te, *last_te, *cur_te;
+	struct tevent_timer *te;
+
+	if (ev->num_timers == ev->timer_heap_size) {
+		struct tevent_timer **heap;
+		size_t size = ev->timer_heap_size * 2;
+
+		if (size == 0) {
+			size = 16;
+		}
+		heap = talloc_realloc(ev, ev->timer_heap,
+				      struct tevent_timer *, size);
+		if (heap == NULL) return NULL;
+
+		ev->timer_heap = heap;
+		ev->timer_heap_size = size;
+	}
 
 	te = talloc(mem_ctx?mem_ctx:ev, struct tevent_timer);
 	if (te == NULL) return NULL;
 
 	te->event_ctx		= ev;
+	te->seqnum		= ev->timer_seqnum++;
 	te->next_event		= next_event;
 	te->handler		= handler;
 	te->private_data	= private_data;
@@ -173,18 +288,9 @@ struct tevent_timer *tevent_common_add_timer(struct tevent_context *ev, TALLOC_C
 	te->location		= location;
 	te->additional_data	= NULL;
 
-	/* keep the list ordered */
-	last_te = NULL;
-	for (cur_te = ev->timer_events; cur_te; cur_te = cur_te->next) {
-		/* if the new event comes before the current one break */
-		if (tevent_timeval_compare(&te->next_event, &cur_te->next_event) < 0) {
-			break;
-		}
-
-		last_te = cur_te;
-	}
-
-	DLIST_ADD_AFTER(ev->timer_events, te, last_te);
+	ev->num_timers += 1;
+	tevent_timer_heap_set(ev, ev->num_timers - 1, te);
+	tevent_timer_heap_up(ev, te->heap_idx);
 
 	talloc_set_destructor(te, tevent_common_timed_destructor);
 
@@ -203,14 +309,15 @@ struct tevent_timer *tevent_common_add_timer(struct tevent_context *ev, TALLOC_C
 struct timeval tevent_common_loop_timer_delay(struct tevent_context *ev)
 {
 	struct timeval current_time = tevent_timeval_zero();
-	struct tevent_timer *te = ev->timer_events;
+	struct tevent_timer *te;
 
-	if (!te) {
+	if (ev->num_timers == 0) {
 		/* have a default tick time of 30 seconds. This guarantees
 		   that code that uses its own timeout checking will be
 		   able to proceed eventually */
 		return tevent_timeval_set(30, 0);
 	}
+	te = ev->timer_heap[0];
 
 	/*
 	 * work out the right timeout for the next timed event
@@ -242,7 +349,7 @@ struct timeval tevent_common_loop_timer_delay(struct tevent_context *ev)
 	/* We need to remove the timer from the list before calling the
 	 * handler because in a semi-async inner event loop called from the
 	 * handler we don't want to come across this event again -- vl */
-	DLIST_REMOVE(ev->timer_events, te);
+	tevent_common_timer_remove(te);
 
 	/*
 	 * If the timed event was registered for a zero current_time,
@@ -254,7 +361,7 @@ struct timeval tevent_common_loop_timer_delay(struct tevent_context *ev)
 	te->handler(ev, te, current_time, te->private_data);
 
 	/* The destructor isn't necessary anymore, we've already removed the
-	 * event from the list. */
+	 * event from the heap. */
 	talloc_set_destructor(te, NULL);
 
 	tevent_debug(te->event_ctx, TEVENT_DEBUG_TRACE,
@@ -226,6 +226,10 @@ size_t smb_iconv(smb_iconv_t cd,
 		 char **outbuf, size_t *outbytesleft);
 smb_iconv_t smb_iconv_open_ex(TALLOC_CTX *mem_ctx, const char *tocode, 
 			      const char *fromcode, bool use_builtin_handlers);
+size_t smb_ascii_run_len(const uint8_t *s, size_t n, bool stop_at_nul);
+size_t smb_ascii_to_utf16le(const uint8_t *src, size_t n,
+			    uint8_t *dst, bool stop_at_nul);
+size_t smb_utf16le_to_ascii(const uint8_t *src, size_t n, uint8_t *dst);
 
 void load_case_tables(void);
 void load_case_tables_library(void);
@@ -139,6 +139,17 @@ bool convert_string_error_handle(struct smb_iconv_handle *ic,
 		unsigned char lastp = '\0';
 		size_t retval = 0;
 
+		if (slen != (size_t)-1) {
+			/* copy the leading ascii in bulk */
+			size_t n = smb_ascii_run_len(p, MIN(slen, dlen), true);
+			memcpy(q, p, n);
+			p += n;
+			q += n;
+			slen -= n;
+			dlen -= n;
+			retval += n;
+		}
+
 		/* If all characters are ascii, fast path here. */
 		while (slen && dlen) {
 			if ((lastp = *p) <= 0x7f) {
@@ -193,6 +204,13 @@ bool convert_string_error_handle(struct smb_iconv_handle *ic,
 			}
 			if (lastp != 0) goto slow_path;
 		} else {
+			size_t n = smb_utf16le_to_ascii(p, MIN(slen/2, dlen), q);
+			p += 2*n;
+			q += n;
+			slen -= 2*n;
+			dlen -= n;
+			retval += n;
+
 			while (slen >= 2 && dlen &&
 			       (*p <= 0x7f) && (p[1] == 0)) {
 				*q++ = *p;
@@ -236,6 +254,16 @@ bool convert_string_error_handle(struct smb_iconv_handle *ic,
 		size_t dlen = destlen;
 		unsigned char lastp = '\0';
 
+		if (slen != (size_t)-1) {
+			/* widen the leading ascii in bulk */
+			size_t n = smb_ascii_to_utf16le(p, MIN(slen, dlen/2), q, true);
+			p += n;
+			q += 2*n;
+			slen -= n;
+			dlen -= 2*n;
+			retval += 2*n;
+		}
+
 		/* If all characters are ascii, fast path here. */
 		while (slen && (dlen >= 1)) {
 			if (dlen >=2 && (lastp = *p) <= 0x7F) {
@@ -24,6 +24,10 @@
 #include "system/filesys.h"
 #include "charset_proto.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #ifdef strcasecmp
 #undef strcasecmp
 #endif
@@ -318,6 +322,143 @@ _PUBLIC_ int smb_iconv_close(smb_iconv_t cd)
 	return 0;
 }
 
+/**********************************************************************
+ the following functions convert runs of ASCII characters, which make
+ up most of the names and strings we see, 16 at a time where the
+ platform allows. Each returns the number of characters converted,
+ stopping before the first one that needs the general code
+***********************************************************************/
+
+#define ASCII_HIGH_BITS 0x8080808080808080ULL
+#define ASCII_LOW_BITS 0x0101010101010101ULL
+
+/*
+  the number of leading ASCII bytes of s, or of leading non-nul ASCII
+  bytes if stop_at_nul is set
+*/
+_PUBLIC_ size_t smb_ascii_run_len(const uint8_t *s, size_t n, bool stop_at_nul)
+{
+	size_t i = 0;
+
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128();
+
+	for (; i + 16 <= n; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+		int mask = _mm_movemask_epi8(v);
+
+		if (stop_at_nul) {
+			mask |= _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero));
+		}
+		if (mask != 0) {
+			break;
+		}
+	}
+#else
+	for (; i + 8 <= n; i += 8) {
+		uint64_t v;
+
+		memcpy(&v, s + i, sizeof(v));
+		if (v & ASCII_HIGH_BITS) {
+			break;
+		}
+		/* with no high bits set this finds exactly the nul bytes */
+		if (stop_at_nul && ((v - ASCII_LOW_BITS) & ASCII_HIGH_BITS)) {
+			break;
+		}
+	}
+#endif
+
+	for (; i < n; i++) {
+		if (s[i] > 0x7f || (stop_at_nul && s[i] == 0)) {
+			break;
+		}
+	}
+
+	return i;
+}
+
+/*
+  widen up to n leading ASCII bytes of src into UTF-16LE at dst
+*/
+_PUBLIC_ size_t smb_ascii_to_utf16le(const uint8_t *src, size_t n,
+				     uint8_t *dst, bool stop_at_nul)
+{
+	size_t i = 0;
+
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128();
+
+	for (; i + 16 <= n; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+		int mask = _mm_movemask_epi8(v);
+
+		if (stop_at_nul) {
+			mask |= _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero));
+		}
+		if (mask != 0) {
+			break;
+		}
+		_mm_storeu_si128((__m128i *)(dst + 2*i),
+				 _mm_unpacklo_epi8(v, zero));
+		_mm_storeu_si128((__m128i *)(dst + 2*i + 16),
+				 _mm_unpackhi_epi8(v, zero));
+	}
+#else
+	size_t len = smb_ascii_run_len(src, n, stop_at_nul);
+
+	for (; i < len; i++) {
+		dst[2*i] = src[i];
+		dst[2*i+1] = 0;
+	}
+#endif
+
+	for (; i < n; i++) {
+		if (src[i] > 0x7f || (stop_at_nul && src[i] == 0)) {
+			break;
+		}
+		dst[2*i] = src[i];
+		dst[2*i+1] = 0;
+	}
+
+	return i;
+}
+
+/*
+  narrow up to n leading UTF-16LE characters of src that are ASCII
+  into bytes at dst
+*/
+_PUBLIC_ size_t smb_utf16le_to_ascii(const uint8_t *src, size_t n,
+				     uint8_t *dst)
+{
+	size_t i = 0;
+
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i non_ascii = _mm_set1_epi16((short)0xFF80);
+
+	for (; i + 16 <= n; i += 16) {
+		__m128i lo = _mm_loadu_si128((const __m128i *)(src + 2*i));
+		__m128i hi = _mm_loadu_si128((const __m128i *)(src + 2*i + 16));
+		__m128i bad = _mm_and_si128(_mm_or_si128(lo, hi), non_ascii);
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi16(bad, zero)) != 0xFFFF) {
+			break;
+		}
+		_mm_storeu_si128((__m128i *)(dst + i),
+				 _mm_packus_epi16(lo, hi));
+	}
+#endif
+
+	for (; i < n; i++) {
+		if (src[2*i] > 0x7f || src[2*i+1] != 0) {
+			break;
+		}
+		dst[i] = src[2*i];
+	}
+
+	return i;
+}
 
 /**********************************************************************
  the following functions implement the builtin character sets in Samba
@@ -606,12 +747,12 @@ static size_t utf8_pull(void *cd, const char **inbuf, size_t *inbytesleft,
 
 	while (in_left >= 1 && out_left >= 2) {
 		if ((c[0] & 0x80) == 0) {
-			uc[0] = c[0];
-			uc[1] = 0;
-			c  += 1;
-			in_left  -= 1;
-			out_left -= 2;
-			uc += 2;
+			size_t n = smb_ascii_to_utf16le(c, MIN(in_left, out_left/2),
+							uc, false);
+			c  += n;
+			in_left  -= n;
+			out_left -= 2*n;
+			uc += 2*n;
 			continue;
 		}
 
@@ -730,11 +871,12 @@ static size_t utf8_push(void *cd, const char **inbuf, size_t *inbytesleft,
 
 		if (uc[1] == 0 && !(uc[0] & 0x80)) {
 			/* simplest case */
-			c[0] = uc[0];
-			in_left  -= 2;
-			out_left -= 1;
-			uc += 2;
-			c  += 1;
+			size_t n = smb_utf16le_to_ascii(uc, MIN(in_left/2, out_left),
+							c);
+			in_left  -= 2*n;
+			out_left -= n;
+			uc += 2*n;
+			c  += n;
 			continue;
 		}
 
@@ -1695,6 +1695,62 @@ static bool test_plato_case(struct torture_context *tctx)
 	return true;
 }
 
+/*
+  report how fast directory listing sized batches of file names
+  convert between the unix charset and UTF-16LE
+*/
+static bool test_names_speed_handle(struct torture_context *tctx)
+{
+	struct smb_iconv_handle *iconv_handle;
+	const int num_names = 10000;
+	const char **names;
+	uint8_t wide[1024], narrow[512];
+	size_t total = 0, len, wlen;
+	struct timeval tv;
+	double secs;
+	int i, round;
+
+	iconv_handle = get_iconv_testing_handle(tctx, "ASCII", "UTF8",
+						lpcfg_parm_bool(tctx->lp_ctx, NULL, "iconv", "use_builtin_handlers", true));
+	torture_assert(tctx, iconv_handle, "getting iconv handle");
+
+	names = talloc_array(tctx, const char *, num_names);
+	torture_assert(tctx, names, "allocating names");
+	for (i = 0; i < num_names; i++) {
+		/* one name in ten has a non-ASCII character */
+		names[i] = talloc_asprintf(names, "%s quarterly report %05d.docx",
+					   (i % 10) ? "Department" : "G\xc3\xbcnther",
+					   i);
+		total += strlen(names[i]);
+	}
+
+	tv = timeval_current();
+	for (round = 0; round < 20; round++) {
+		for (i = 0; i < num_names; i++) {
+			torture_assert(tctx, convert_string_error_handle(iconv_handle,
+							CH_UNIX, CH_UTF16LE,
+							names[i], strlen(names[i]),
+							wide, sizeof(wide), &wlen),
+				       "conversion to UTF-16LE");
+			torture_assert(tctx, convert_string_error_handle(iconv_handle,
+							CH_UTF16LE, CH_UNIX,
+							wide, wlen,
+							narrow, sizeof(narrow), &len),
+				       "conversion from UTF-16LE");
+			torture_assert_int_equal(tctx, len, strlen(names[i]),
+						 "round trip length");
+		}
+	}
+	secs = timeval_elapsed(&tv);
+
+	torture_comment(tctx, "%.0f names/sec, %.2f MB/sec each way\n",
+			20 * num_names / secs,
+			20 * total / (secs * 1024 * 1024));
+
+	talloc_free(names);
+	return true;
+}
+
 struct torture_suite *torture_local_convert_string_handle(TALLOC_CTX *mem_ctx)
 {
 	struct torture_suite *suite = torture_suite_create(mem_ctx, "convert_string_handle");
@@ -1707,6 +1763,7 @@ struct torture_suite *torture_local_convert_string_handle(TALLOC_CTX *mem_ctx)
 	torture_suite_add_simple_test(suite, "plato_cp850_utf8", test_plato_cp850_utf8_handle);
 	torture_suite_add_simple_test(suite, "plato_minus_1", test_plato_minus_1_handle);
 	torture_suite_add_simple_test(suite, "plato_latin_cp850_utf8", test_plato_latin_cp850_utf8_handle);
+	torture_suite_add_simple_test(suite, "names_speed", test_names_speed_handle);
 	return suite;
 }
 
@@ -409,6 +409,104 @@ static bool test_random_5m(struct torture_context *tctx)
 	return true;
 }
 
+/*
+  check the ASCII run helpers against a plain loop, for every length up
+  to a few vectors, every alignment and a stopping byte at every position
+*/
+static bool test_ascii_runs(struct torture_context *tctx)
+{
+	const uint8_t stoppers[] = { 0x00, 0x80, 0xc3, 0xff };
+	uint8_t src[100], wide[200], out[200], expect[200];
+	size_t ofs, len, pos, s, i, n, n_expect;
+
+	for (ofs = 0; ofs < 4; ofs++) {
+	for (len = 0; len <= 70; len++) {
+	for (pos = 0; pos <= len; pos++) {
+	for (s = 0; s < ARRAY_SIZE(stoppers); s++) {
+		uint8_t *in = src + ofs;
+
+		for (i = 0; i < len; i++) {
+			in[i] = 1 + random() % 0x7f;
+		}
+		if (pos < len) {
+			in[pos] = stoppers[s];
+		}
+
+		/* a nul only stops the helpers when asked to */
+		n_expect = (pos < len && stoppers[s] != 0) ? pos : len;
+		n = smb_ascii_run_len(in, len, false);
+		torture_assert_int_equal(tctx, n, n_expect, "run_len");
+		n = smb_ascii_run_len(in, len, true);
+		torture_assert_int_equal(tctx, n, MIN(pos, len), "run_len nul");
+
+		for (i = 0; i < len; i++) {
+			expect[2*i] = in[i];
+			expect[2*i+1] = 0;
+		}
+
+		n = smb_ascii_to_utf16le(in, len, out, false);
+		torture_assert_int_equal(tctx, n, n_expect, "to_utf16le");
+		torture_assert_mem_equal(tctx, out, expect, 2*n,
+					 "to_utf16le data");
+		n = smb_ascii_to_utf16le(in, len, out, true);
+		torture_assert_int_equal(tctx, n, MIN(pos, len),
+					 "to_utf16le nul");
+
+		/* the same string in UTF-16LE, with a non-ASCII char at pos */
+		memcpy(wide + ofs, expect, 2*len);
+		if (pos < len && stoppers[s] != 0) {
+			wide[ofs + 2*pos + 1] = stoppers[s];
+		}
+		n = smb_utf16le_to_ascii(wide + ofs, len, out);
+		torture_assert_int_equal(tctx, n, n_expect, "to_ascii");
+		torture_assert_mem_equal(tctx, out, in, n, "to_ascii data");
+	}
+	}
+	}
+	}
+	return true;
+}
+
+/*
+  compare the builtin UTF-8 handlers with the system iconv on strings
+  made of ASCII runs of all lengths broken by other characters
+*/
+static bool test_ascii_runs_utf8(struct torture_context *tctx)
+{
+	unsigned char inbuf[600];
+	unsigned int i;
+
+	if (iconv_untestable(tctx))
+		return true;
+
+	for (i=0;i<100000;i++) {
+		size_t size = 0;
+		size_t max = 2 * (1 + random() % 300);
+
+		while (size < max) {
+			size_t run = random() % 40;
+			uint16_t c;
+
+			for (; run > 0 && size < max; run--, size += 2) {
+				SSVAL(inbuf, size, random() % 0x80);
+			}
+			if (size >= max) {
+				break;
+			}
+			do {
+				c = random() % 0x10000;
+			} while (c >= 0xd800 && c < 0xe000);
+			SSVAL(inbuf, size, c);
+			size += 2;
+		}
+
+		if (!test_buffer(tctx, inbuf, size, "UTF-8")) {
+			printf("i=%d failed UTF-8\n", i);
+			return false;
+		}
+	}
+	return true;
+}
 
 static bool test_string2key(struct torture_context *tctx)
 {
@@ -475,6 +573,12 @@ struct torture_suite *torture_local_iconv(TALLOC_CTX *mem_ctx)
 	torture_suite_add_simple_test(suite, "5M random UTF-16LE sequences",
 				      test_random_5m);
 
+	torture_suite_add_simple_test(suite, "ascii runs",
+				      test_ascii_runs);
+
+	torture_suite_add_simple_test(suite, "ascii runs UTF-8",
+				      test_ascii_runs_utf8);
+
 	torture_suite_add_simple_test(suite, "string2key",
 				      test_string2key);
 	return suite;
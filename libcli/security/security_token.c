@@ -103,9 +103,104 @@ bool security_token_is_anonymous(const struct security_token *token)
 	return security_token_is_sid(token, &global_sid_Anonymous);
 }
 
+/*
+  an open addressing hash table of the SIDs in a token, so access
+  checks need not compare every ACE trustee with every SID. It
+  remembers the array it was built from and is not used once the
+  token's SIDs have been replaced or extended.
+*/
+struct security_token_sid_index {
+	const struct dom_sid *sids;
+	uint32_t num_sids;
+	uint32_t mask;
+	uint32_t *slots; /* 1 + the index into sids, 0 for an empty slot */
+};
+
+/* below this a linear search is just as quick */
+#define SECURITY_TOKEN_INDEX_MIN_SIDS 16
+
+static uint32_t security_token_sid_hash(const struct dom_sid *sid)
+{
+	int num_auths = MAX(MIN(sid->num_auths, ARRAY_SIZE(sid->sub_auths)), 0);
+	uint32_t h = sid->sid_rev_num;
+	int i;
+
+	for (i = 0; i < 6; i++) {
+		h = h * 31 + sid->id_auth[i];
+	}
+	for (i = 0; i < num_auths; i++) {
+		h = (h ^ sid->sub_auths[i]) * 0x01000193;
+	}
+	return h ^ (h >> 16);
+}
+
+/*
+  build the SID index of a token. This should be called again whenever
+  the SIDs of the token change
+*/
+NTSTATUS security_token_index_sids(struct security_token *token)
+{
+	struct security_token_sid_index *idx;
+	uint32_t size, i;
+
+	TALLOC_FREE(token->sid_index);
+
+	if (token->num_sids < SECURITY_TOKEN_INDEX_MIN_SIDS) {
+		return NT_STATUS_OK;
+	}
+
+	/* keep the table at most half full */
+	for (size = 1; size < token->num_sids * 2; size <<= 1);
+
+	idx = talloc(token, struct security_token_sid_index);
+	NT_STATUS_HAVE_NO_MEMORY(idx);
+
+	idx->slots = talloc_zero_array(idx, uint32_t, size);
+	if (idx->slots == NULL) {
+		talloc_free(idx);
+		return NT_STATUS_NO_MEMORY;
+	}
+	idx->sids = token->sids;
+	idx->num_sids = token->num_sids;
+	idx->mask = size - 1;
+
+	for (i = 0; i < token->num_sids; i++) {
+		uint32_t h = security_token_sid_hash(&token->sids[i]) & idx->mask;
+
+		while (idx->slots[h] != 0) {
+			h = (h + 1) & idx->mask;
+		}
+		idx->slots[h] = i + 1;
+	}
+
+	token->sid_index = idx;
+	return NT_STATUS_OK;
+}
+
 bool security_token_has_sid(const struct security_token *token, const struct dom_sid *sid)
 {
+	const struct security_token_sid_index *idx = token->sid_index;
 	uint32_t i;
+
+	if (idx != NULL &&
+	    idx->sids == token->sids &&
+	    idx->num_sids == token->num_sids) {
+		uint32_t h;
+
+		if (sid == NULL) {
+			return false;
+		}
+
+		h = security_token_sid_hash(sid) & idx->mask;
+		while ((i = idx->slots[h]) != 0) {
+			if (dom_sid_equal(&token->sids[i - 1], sid)) {
+				return true;
+			}
+			h = (h + 1) & idx->mask;
+		}
+		return false;
+	}
+
 	for (i = 0; i < token->num_sids; i++) {
 		if (dom_sid_equal(&token->sids[i], sid)) {
 			return true;
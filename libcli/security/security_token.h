@@ -47,6 +47,8 @@ bool security_token_is_system(const struct security_token *token);
 
 bool security_token_is_anonymous(const struct security_token *token);
 
+NTSTATUS security_token_index_sids(struct security_token *token);
+
 bool security_token_has_sid(const struct security_token *token, const struct dom_sid *sid);
 
 bool security_token_has_sid_string(const struct security_token *token, const char *sid_string);
@@ -23,15 +23,15 @@
 #include "../libcli/smb/smb_common.h"
 #include "../lib/crypto/crypto.h"
 
-NTSTATUS smb2_signing_sign_pdu(DATA_BLOB session_key,
-			       struct iovec *vector,
-			       int count)
+NTSTATUS smb2_signing_prepare_pdu(DATA_BLOB session_key,
+				  struct iovec *vector,
+				  int count,
+				  bool *sign)
 {
 	uint8_t *hdr;
 	uint64_t session_id;
-	struct HMACSHA256Context m;
-	uint8_t res[SHA256_DIGEST_LENGTH];
-	int i;
+
+	*sign = false;
 
 	if (count < 2) {
 		return NT_STATUS_INVALID_PARAMETER;
@@ -62,6 +62,22 @@ NTSTATUS smb2_signing_sign_pdu(DATA_BLOB session_key,
 
 	SIVAL(hdr, SMB2_HDR_FLAGS, IVAL(hdr, SMB2_HDR_FLAGS) | SMB2_HDR_FLAG_SIGNED);
 
+	*sign = true;
+	return NT_STATUS_OK;
+}
+
+/*
+ * Only hashes, no logging: this may run in a helper thread.
+ */
+void smb2_signing_calc_signature(DATA_BLOB session_key,
+				 const struct iovec *vector,
+				 int count,
+				 uint8_t signature[16])
+{
+	struct HMACSHA256Context m;
+	uint8_t res[SHA256_DIGEST_LENGTH];
+	int i;
+
 	ZERO_STRUCT(m);
 	hmac_sha256_init(session_key.data, MIN(session_key.length, 16), &m);
 	for (i=0; i < count; i++) {
@@ -69,9 +85,28 @@ NTSTATUS smb2_signing_sign_pdu(DATA_BLOB session_key,
 				   vector[i].iov_len, &m);
 	}
 	hmac_sha256_final(res, &m);
-	DEBUG(5,("signed SMB2 message\n"));
 
-	memcpy(hdr + SMB2_HDR_SIGNATURE, res, 16);
+	memcpy(signature, res, 16);
+}
+
+NTSTATUS smb2_signing_sign_pdu(DATA_BLOB session_key,
+			       struct iovec *vector,
+			       int count)
+{
+	uint8_t *hdr;
+	bool sign;
+	NTSTATUS status;
+
+	status = smb2_signing_prepare_pdu(session_key, vector, count, &sign);
+	if (!NT_STATUS_IS_OK(status) || !sign) {
+		return status;
+	}
+
+	hdr = (uint8_t *)vector[0].iov_base;
+
+	smb2_signing_calc_signature(session_key, vector, count,
+				    hdr + SMB2_HDR_SIGNATURE);
+	DEBUG(5,("signed SMB2 message\n"));
 
 	return NT_STATUS_OK;
 }
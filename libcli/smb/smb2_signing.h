@@ -23,6 +23,22 @@
 
 struct iovec;
 
+/*
+ * smb2_signing_sign_pdu() in two steps, for callers that compute the
+ * signature away from the main event loop: prepare checks the PDU and
+ * clears the signature field, *sign is false if the PDU is not to be
+ * signed. calc does nothing but hashing and may run in another thread.
+ */
+NTSTATUS smb2_signing_prepare_pdu(DATA_BLOB session_key,
+				  struct iovec *vector,
+				  int count,
+				  bool *sign);
+
+void smb2_signing_calc_signature(DATA_BLOB session_key,
+				 const struct iovec *vector,
+				 int count,
+				 uint8_t signature[16]);
+
 NTSTATUS smb2_signing_sign_pdu(DATA_BLOB session_key,
 			       struct iovec *vector,
 			       int count);
@@ -423,6 +423,10 @@ enum ndr_err_code ndr_push_dom_sid0(struct ndr_push *ndr, int ndr_flags, const s
 enum ndr_err_code ndr_pull_dom_sid0(struct ndr_pull *ndr, int ndr_flags, struct dom_sid *sid);
 void ndr_print_dom_sid0(struct ndr_print *ndr, const char *name, const struct dom_sid *sid);
 size_t ndr_size_dom_sid0(const struct dom_sid *sid, int flags);
+struct security_token_sid_index;
+enum ndr_err_code ndr_push_security_token_sid_index(struct ndr_push *ndr, int ndr_flags, const struct security_token_sid_index *v);
+enum ndr_err_code ndr_pull_security_token_sid_index(struct ndr_pull *ndr, int ndr_flags, struct security_token_sid_index *v);
+void ndr_print_security_token_sid_index(struct ndr_print *ndr, const char *name, const struct security_token_sid_index *v);
 void ndr_print_GUID(struct ndr_print *ndr, const char *name, const struct GUID *guid);
 void ndr_print_sockaddr_storage(struct ndr_print *ndr, const char *name, const struct sockaddr_storage *ss);
 bool ndr_syntax_id_equal(const struct ndr_syntax_id *i1, const struct ndr_syntax_id *i2); 
@@ -341,3 +341,22 @@ _PUBLIC_ enum ndr_err_code ndr_pull_dom_sid(struct ndr_pull *ndr, int ndr_flags,
 	}
 	return NDR_ERR_SUCCESS;
 }
+
+/*
+  the SID index of a security_token is local to the process that built
+  it, it has no network representation
+*/
+_PUBLIC_ enum ndr_err_code ndr_push_security_token_sid_index(struct ndr_push *ndr, int ndr_flags, const struct security_token_sid_index *v)
+{
+	return NDR_ERR_SUCCESS;
+}
+
+_PUBLIC_ enum ndr_err_code ndr_pull_security_token_sid_index(struct ndr_pull *ndr, int ndr_flags, struct security_token_sid_index *v)
+{
+	return NDR_ERR_SUCCESS;
+}
+
+_PUBLIC_ void ndr_print_security_token_sid_index(struct ndr_print *ndr, const char *name, const struct security_token_sid_index *v)
+{
+	ndr->print(ndr, "%-25s: NULL", name);
+}
@@ -0,0 +1,165 @@
+/*
+   Unix SMB/CIFS implementation.
+
+   policy handle lookup table shared by the rpc servers
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "includes.h"
+#include "librpc/ndr/libndr.h"
+#include "librpc/rpc/rpc_handle_table.h"
+
+struct rpc_handle_table_entry {
+	struct rpc_handle_table_entry *next;
+	uint32_t hash;
+	struct GUID uuid;
+	void *handle;
+};
+
+struct rpc_handle_table {
+	struct rpc_handle_table_entry **buckets;
+	uint32_t num_buckets;
+	size_t count;
+};
+
+#define RPC_HANDLE_TABLE_MIN_BUCKETS 64
+
+/*
+ * The s4 server uses random uuids, the s3 one a counter in time_low
+ * and the pid in the node. Mix all of it.
+ */
+static uint32_t rpc_handle_table_hash(const struct GUID *uuid)
+{
+	uint32_t h = uuid->time_low;
+	unsigned int i;
+
+	h = h * 31 + uuid->time_mid;
+	h = h * 31 + uuid->time_hi_and_version;
+	for (i = 0; i < ARRAY_SIZE(uuid->clock_seq); i++) {
+		h = h * 31 + uuid->clock_seq[i];
+	}
+	for (i = 0; i < ARRAY_SIZE(uuid->node); i++) {
+		h = h * 31 + uuid->node[i];
+	}
+	return h ^ (h >> 16);
+}
+
+struct rpc_handle_table *rpc_handle_table_init(TALLOC_CTX *mem_ctx)
+{
+	struct rpc_handle_table *table;
+
+	table = talloc_zero(mem_ctx, struct rpc_handle_table);
+	if (table == NULL) {
+		return NULL;
+	}
+	table->num_buckets = RPC_HANDLE_TABLE_MIN_BUCKETS;
+	table->buckets = talloc_zero_array(table,
+					   struct rpc_handle_table_entry *,
+					   table->num_buckets);
+	if (table->buckets == NULL) {
+		talloc_free(table);
+		return NULL;
+	}
+	return table;
+}
+
+static void rpc_handle_table_grow(struct rpc_handle_table *table)
+{
+	struct rpc_handle_table_entry **buckets;
+	uint32_t num_buckets = table->num_buckets * 2;
+	uint32_t i;
+
+	buckets = talloc_zero_array(table, struct rpc_handle_table_entry *,
+				    num_buckets);
+	if (buckets == NULL) {
+		/* longer chains, but still correct */
+		return;
+	}
+
+	for (i = 0; i < table->num_buckets; i++) {
+		struct rpc_handle_table_entry *e, *next;
+
+		for (e = table->buckets[i]; e != NULL; e = next) {
+			uint32_t b = e->hash % num_buckets;
+
+			next = e->next;
+			e->next = buckets[b];
+			buckets[b] = e;
+		}
+	}
+
+	talloc_free(table->buckets);
+	table->buckets = buckets;
+	table->num_buckets = num_buckets;
+}
+
+bool rpc_handle_table_add(struct rpc_handle_table *table,
+			  const struct GUID *uuid, void *handle)
+{
+	struct rpc_handle_table_entry *e;
+	uint32_t b;
+
+	e = talloc(table, struct rpc_handle_table_entry);
+	if (e == NULL) {
+		return false;
+	}
+	e->hash = rpc_handle_table_hash(uuid);
+	e->uuid = *uuid;
+	e->handle = handle;
+
+	b = e->hash % table->num_buckets;
+	e->next = table->buckets[b];
+	table->buckets[b] = e;
+	table->count += 1;
+
+	if (table->count > table->num_buckets * 2) {
+		rpc_handle_table_grow(table);
+	}
+	return true;
+}
+
+void *rpc_handle_table_find(struct rpc_handle_table *table,
+			    const struct GUID *uuid)
+{
+	struct rpc_handle_table_entry *e;
+	uint32_t hash = rpc_handle_table_hash(uuid);
+
+	for (e = table->buckets[hash % table->num_buckets]; e != NULL;
+	     e = e->next) {
+		if (e->hash == hash && GUID_equal(&e->uuid, uuid)) {
+			return e->handle;
+		}
+	}
+	return NULL;
+}
+
+void rpc_handle_table_remove(struct rpc_handle_table *table,
+			     const struct GUID *uuid, void *handle)
+{
+	struct rpc_handle_table_entry **pe;
+	uint32_t hash = rpc_handle_table_hash(uuid);
+
+	for (pe = &table->buckets[hash % table->num_buckets]; *pe != NULL;
+	     pe = &(*pe)->next) {
+		struct rpc_handle_table_entry *e = *pe;
+
+		if (e->handle == handle) {
+			*pe = e->next;
+			table->count -= 1;
+			talloc_free(e);
+			return;
+		}
+	}
+}
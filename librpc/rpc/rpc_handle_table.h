@@ -0,0 +1,39 @@
+/*
+   Unix SMB/CIFS implementation.
+
+   policy handle lookup table shared by the rpc servers
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIBRPC_RPC_HANDLE_TABLE_H__
+#define __LIBRPC_RPC_HANDLE_TABLE_H__
+
+/*
+ * Maps the uuid of a policy handle to the server's handle structure.
+ * The table does not own the handles, the servers remove them before
+ * freeing them. Checking the rest of the wire handle is left to the
+ * caller.
+ */
+struct rpc_handle_table;
+
+struct rpc_handle_table *rpc_handle_table_init(TALLOC_CTX *mem_ctx);
+bool rpc_handle_table_add(struct rpc_handle_table *table,
+			  const struct GUID *uuid, void *handle);
+void *rpc_handle_table_find(struct rpc_handle_table *table,
+			    const struct GUID *uuid);
+void rpc_handle_table_remove(struct rpc_handle_table *table,
+			     const struct GUID *uuid, void *handle);
+
+#endif /* __LIBRPC_RPC_HANDLE_TABLE_H__ */
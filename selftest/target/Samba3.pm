@@ -965,6 +965,10 @@ sub provision($$$$$$$)
 [hideunwrite]
 	copy = tmp
 	hide unwriteable files = yes
+[signedsendfile]
+	copy = tmp
+	use sendfile = yes
+	smbd:signed sendfile = yes
 [print1]
 	copy = tmp
 	printable = yes
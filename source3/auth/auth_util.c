@@ -1080,6 +1080,15 @@ struct auth_session_info *copy_session_info(TALLOC_CTX *mem_ctx,
 		return NULL;
 	}
 
+	/* the SID index is not marshalled */
+	if (dst->security_token != NULL &&
+	    !NT_STATUS_IS_OK(security_token_index_sids(dst->security_token))) {
+		DEBUG(0, ("copy_session_info(): security_token_index_sids "
+			  "failed\n"));
+		TALLOC_FREE(dst);
+		return NULL;
+	}
+
 	return dst;
 }
 
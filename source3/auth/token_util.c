@@ -512,7 +512,7 @@ static NTSTATUS finalize_local_nt_token(struct security_token *result,
 	get_privileges_for_sids(&result->privilege_mask, result->sids,
 				result->num_sids);
 
-	return NT_STATUS_OK;
+	return security_token_index_sids(result);
 }
 
 /****************************************************************************
@@ -43,6 +43,8 @@ enum memcache_number {
 	GETPWNAM_CACHE,		/* talloc */
 	MANGLE_HASH2_CACHE,
 	PDB_GETPWSID_CACHE,	/* talloc */
+	SECDESC_CACHE,		/* talloc */
+	DIR_NAME_INDEX_CACHE,	/* talloc */
 	SINGLETON_CACHE_TALLOC,	/* talloc */
 	SINGLETON_CACHE
 };
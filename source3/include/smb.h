@@ -236,6 +236,7 @@ struct print_file_data {
 
 typedef struct files_struct {
 	struct files_struct *next, *prev;
+	struct files_struct *fi_next, *fi_prev; /* file_id hash chain */
 	int fnum;
 	struct connection_struct *conn;
 	struct fd_handle *fh;
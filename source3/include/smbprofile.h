@@ -26,7 +26,7 @@
 
 #define PROF_SHMEM_KEY ((key_t)0x07021999)
 #define PROF_SHM_MAGIC 0x6349985
-#define PROF_SHM_VERSION 12
+#define PROF_SHM_VERSION 14
 
 /* time values in the following structure are in microseconds */
 
@@ -868,6 +868,16 @@ struct profile_stats {
 	unsigned statcache_misses;
 	unsigned statcache_hits;
 
+/* security descriptor cache counters */
+	unsigned sdcache_lookups;
+	unsigned sdcache_misses;
+	unsigned sdcache_hits;
+
+/* directory name index counters */
+	unsigned dirindex_lookups;
+	unsigned dirindex_misses;
+	unsigned dirindex_hits;
+
 /* write cache counters */
 	unsigned writecache_read_hits;
 	unsigned writecache_abutted_writes;
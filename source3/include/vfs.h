@@ -136,6 +136,10 @@
 /* Leave at 28 - not yet released. Rename open function to open_fn. - gd */
 /* Leave at 28 - not yet released. Make getwd function always return malloced memory. JRA. */
 /* Bump to version 29 - Samba 3.6.0 will ship with interface version 28. */
+/* Leave at 29 - not yet released. Add pread_send/recv, pwrite_send/recv
+		and fsync_send/recv for async I/O without POSIX aio. */
+/* Leave at 29 - not yet released. Add a file_id hash chain to files_struct,
+		fsp->file_id must now be changed with fsp_set_file_id(). */
 #define SMB_VFS_INTERFACE_VERSION 29
 
 /*
@@ -156,6 +160,8 @@ struct ea_list;
 struct smb_file_time;
 struct blocking_lock_record;
 struct smb_filename;
+struct tevent_context;
+struct tevent_req;
 
 #define VFS_FIND(__fn__) while (handle->fns->__fn__==NULL) { \
 				handle = handle->next; \
@@ -231,8 +237,22 @@ struct vfs_fn_pointers {
 	int (*close_fn)(struct vfs_handle_struct *handle, struct files_struct *fsp);
 	ssize_t (*vfs_read)(struct vfs_handle_struct *handle, struct files_struct *fsp, void *data, size_t n);
 	ssize_t (*pread)(struct vfs_handle_struct *handle, struct files_struct *fsp, void *data, size_t n, SMB_OFF_T offset);
+	struct tevent_req *(*pread_send)(struct vfs_handle_struct *handle,
+					 TALLOC_CTX *mem_ctx,
+					 struct tevent_context *ev,
+					 struct files_struct *fsp,
+					 void *data,
+					 size_t n, SMB_OFF_T offset);
+	ssize_t (*pread_recv)(struct tevent_req *req, int *perrno);
 	ssize_t (*write)(struct vfs_handle_struct *handle, struct files_struct *fsp, const void *data, size_t n);
 	ssize_t (*pwrite)(struct vfs_handle_struct *handle, struct files_struct *fsp, const void *data, size_t n, SMB_OFF_T offset);
+	struct tevent_req *(*pwrite_send)(struct vfs_handle_struct *handle,
+					  TALLOC_CTX *mem_ctx,
+					  struct tevent_context *ev,
+					  struct files_struct *fsp,
+					  const void *data,
+					  size_t n, SMB_OFF_T offset);
+	ssize_t (*pwrite_recv)(struct tevent_req *req, int *perrno);
 	SMB_OFF_T (*lseek)(struct vfs_handle_struct *handle, struct files_struct *fsp, SMB_OFF_T offset, int whence);
 	ssize_t (*sendfile)(struct vfs_handle_struct *handle, int tofd, files_struct *fromfsp, const DATA_BLOB *header, SMB_OFF_T offset, size_t count);
 	ssize_t (*recvfile)(struct vfs_handle_struct *handle, int fromfd, files_struct *tofsp, SMB_OFF_T offset, size_t count);
@@ -240,6 +260,11 @@ struct vfs_fn_pointers {
 		      const struct smb_filename *smb_fname_src,
 		      const struct smb_filename *smb_fname_dst);
 	int (*fsync)(struct vfs_handle_struct *handle, struct files_struct *fsp);
+	struct tevent_req *(*fsync_send)(struct vfs_handle_struct *handle,
+					 TALLOC_CTX *mem_ctx,
+					 struct tevent_context *ev,
+					 struct files_struct *fsp);
+	int (*fsync_recv)(struct tevent_req *req, int *perrno);
 	int (*stat)(struct vfs_handle_struct *handle, struct smb_filename *smb_fname);
 	int (*fstat)(struct vfs_handle_struct *handle, struct files_struct *fsp, SMB_STRUCT_STAT *sbuf);
 	int (*lstat)(struct vfs_handle_struct *handle, struct smb_filename *smb_filename);
@@ -573,12 +598,26 @@ ssize_t smb_vfs_call_vfs_read(struct vfs_handle_struct *handle,
 ssize_t smb_vfs_call_pread(struct vfs_handle_struct *handle,
 			   struct files_struct *fsp, void *data, size_t n,
 			   SMB_OFF_T offset);
+struct tevent_req *smb_vfs_call_pread_send(struct vfs_handle_struct *handle,
+					   TALLOC_CTX *mem_ctx,
+					   struct tevent_context *ev,
+					   struct files_struct *fsp,
+					   void *data,
+					   size_t n, SMB_OFF_T offset);
+ssize_t smb_vfs_call_pread_recv(struct tevent_req *req, int *perrno);
 ssize_t smb_vfs_call_write(struct vfs_handle_struct *handle,
 			   struct files_struct *fsp, const void *data,
 			   size_t n);
 ssize_t smb_vfs_call_pwrite(struct vfs_handle_struct *handle,
 			    struct files_struct *fsp, const void *data,
 			    size_t n, SMB_OFF_T offset);
+struct tevent_req *smb_vfs_call_pwrite_send(struct vfs_handle_struct *handle,
+					    TALLOC_CTX *mem_ctx,
+					    struct tevent_context *ev,
+					    struct files_struct *fsp,
+					    const void *data,
+					    size_t n, SMB_OFF_T offset);
+ssize_t smb_vfs_call_pwrite_recv(struct tevent_req *req, int *perrno);
 SMB_OFF_T smb_vfs_call_lseek(struct vfs_handle_struct *handle,
 			     struct files_struct *fsp, SMB_OFF_T offset,
 			     int whence);
@@ -593,6 +632,11 @@ int smb_vfs_call_rename(struct vfs_handle_struct *handle,
 			const struct smb_filename *smb_fname_dst);
 int smb_vfs_call_fsync(struct vfs_handle_struct *handle,
 		       struct files_struct *fsp);
+struct tevent_req *smb_vfs_call_fsync_send(struct vfs_handle_struct *handle,
+					   TALLOC_CTX *mem_ctx,
+					   struct tevent_context *ev,
+					   struct files_struct *fsp);
+int smb_vfs_call_fsync_recv(struct tevent_req *req, int *perrno);
 int smb_vfs_call_stat(struct vfs_handle_struct *handle,
 		      struct smb_filename *smb_fname);
 int smb_vfs_call_fstat(struct vfs_handle_struct *handle,
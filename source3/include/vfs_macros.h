@@ -149,6 +149,17 @@
 #define SMB_VFS_NEXT_PREAD(handle, fsp, data, n, off) \
 	smb_vfs_call_pread((handle)->next, (fsp), (data), (n), (off))
 
+#define SMB_VFS_PREAD_SEND(mem_ctx, ev, fsp, data, n, off) \
+	smb_vfs_call_pread_send((fsp)->conn->vfs_handles, (mem_ctx), (ev), \
+				(fsp), (data), (n), (off))
+#define SMB_VFS_PREAD_RECV(req, perrno) \
+	smb_vfs_call_pread_recv((req), (perrno))
+#define SMB_VFS_NEXT_PREAD_SEND(handle, mem_ctx, ev, fsp, data, n, off) \
+	smb_vfs_call_pread_send((handle)->next, (mem_ctx), (ev), (fsp), \
+				(data), (n), (off))
+#define SMB_VFS_NEXT_PREAD_RECV(req, perrno) \
+	smb_vfs_call_pread_recv((req), (perrno))
+
 #define SMB_VFS_WRITE(fsp, data, n) \
 	smb_vfs_call_write((fsp)->conn->vfs_handles, (fsp), (data), (n))
 #define SMB_VFS_NEXT_WRITE(handle, fsp, data, n) \
@@ -159,6 +170,17 @@
 #define SMB_VFS_NEXT_PWRITE(handle, fsp, data, n, off) \
 	smb_vfs_call_pwrite((handle)->next, (fsp), (data), (n), (off))
 
+#define SMB_VFS_PWRITE_SEND(mem_ctx, ev, fsp, data, n, off) \
+	smb_vfs_call_pwrite_send((fsp)->conn->vfs_handles, (mem_ctx), (ev), \
+				 (fsp), (data), (n), (off))
+#define SMB_VFS_PWRITE_RECV(req, perrno) \
+	smb_vfs_call_pwrite_recv((req), (perrno))
+#define SMB_VFS_NEXT_PWRITE_SEND(handle, mem_ctx, ev, fsp, data, n, off) \
+	smb_vfs_call_pwrite_send((handle)->next, (mem_ctx), (ev), (fsp), \
+				 (data), (n), (off))
+#define SMB_VFS_NEXT_PWRITE_RECV(req, perrno) \
+	smb_vfs_call_pwrite_recv((req), (perrno))
+
 #define SMB_VFS_LSEEK(fsp, offset, whence) \
 	smb_vfs_call_lseek((fsp)->conn->vfs_handles, (fsp), (offset), (whence))
 #define SMB_VFS_NEXT_LSEEK(handle, fsp, offset, whence) \
@@ -184,6 +206,16 @@
 #define SMB_VFS_NEXT_FSYNC(handle, fsp) \
 	smb_vfs_call_fsync((handle)->next, (fsp))
 
+#define SMB_VFS_FSYNC_SEND(mem_ctx, ev, fsp) \
+	smb_vfs_call_fsync_send((fsp)->conn->vfs_handles, (mem_ctx), (ev), \
+				(fsp))
+#define SMB_VFS_FSYNC_RECV(req, perrno) \
+	smb_vfs_call_fsync_recv((req), (perrno))
+#define SMB_VFS_NEXT_FSYNC_SEND(handle, mem_ctx, ev, fsp) \
+	smb_vfs_call_fsync_send((handle)->next, (mem_ctx), (ev), (fsp))
+#define SMB_VFS_NEXT_FSYNC_RECV(req, perrno) \
+	smb_vfs_call_fsync_recv((req), (perrno))
+
 #define SMB_VFS_STAT(conn, smb_fname) \
 	smb_vfs_call_stat((conn)->vfs_handles, (smb_fname))
 #define SMB_VFS_NEXT_STAT(handle, smb_fname) \
@@ -165,13 +165,13 @@ bool event_add_to_poll_args(struct tevent_context *ev, TALLOC_CTX *mem_ctx,
 		*ptimeout = 0;
 		return true;
 	}
-	if (ev->timer_events == NULL) {
+	if (ev->num_timers == 0) {
 		*ptimeout = MIN(*ptimeout, INT_MAX);
 		return true;
 	}
 
 	now = timeval_current();
-	diff = timeval_until(&now, &ev->timer_events->next_event);
+	diff = timeval_until(&now, &ev->timer_heap[0]->next_event);
 	timeout = timeval_to_msec(diff);
 
 	if (timeout < *ptimeout) {
@@ -201,8 +201,8 @@ bool run_events_poll(struct tevent_context *ev, int pollrtn,
 
 	GetTimeOfDay(&now);
 
-	if ((ev->timer_events != NULL)
-	    && (timeval_compare(&now, &ev->timer_events->next_event) >= 0)) {
+	if ((ev->num_timers != 0)
+	    && (timeval_compare(&now, &ev->timer_heap[0]->next_event) >= 0)) {
 		/* this older events system did not auto-free timed
 		   events on running them, and had a race condition
 		   where the event could be called twice if the
@@ -214,13 +214,13 @@ bool run_events_poll(struct tevent_context *ev, int pollrtn,
 		   remove the te from the timed event list before we
 		   call the handler, to ensure we can't loop */
 
-		struct tevent_timer *te = ev->timer_events;
+		struct tevent_timer *te = ev->timer_heap[0];
 		TALLOC_CTX *tmp_ctx = talloc_new(ev);
 
 		DEBUG(10, ("Running timed event \"%s\" %p\n",
-			   ev->timer_events->handler_name, ev->timer_events));
+			   te->handler_name, te));
 
-		DLIST_REMOVE(ev->timer_events, te);
+		tevent_common_timer_remove(te);
 		talloc_steal(tmp_ctx, te);
 
 		te->handler(ev, te, now, te->private_data);
@@ -296,7 +296,7 @@ struct timeval *get_timed_events_timeout(struct tevent_context *ev,
 {
 	struct timeval now;
 
-	if ((ev->timer_events == NULL) && (ev->immediate_events == NULL)) {
+	if ((ev->num_timers == 0) && (ev->immediate_events == NULL)) {
 		return NULL;
 	}
 	if (ev->immediate_events != NULL) {
@@ -305,7 +305,7 @@ struct timeval *get_timed_events_timeout(struct tevent_context *ev,
 	}
 
 	now = timeval_current();
-	*to_ret = timeval_until(&now, &ev->timer_events->next_event);
+	*to_ret = timeval_until(&now, &ev->timer_heap[0]->next_event);
 
 	DEBUG(10, ("timed_events_timeout: %d/%d\n", (int)to_ret->tv_sec,
 		(int)to_ret->tv_usec));
@@ -360,6 +360,7 @@ void dump_event_list(struct tevent_context *ev)
 	struct tevent_timer *te;
 	struct tevent_fd *fe;
 	struct timeval evt, now;
+	size_t i;
 
 	if (!ev) {
 		return;
@@ -369,8 +370,9 @@ void dump_event_list(struct tevent_context *ev)
 
 	DEBUG(10,("dump_event_list:\n"));
 
-	for (te = ev->timer_events; te; te = te->next) {
+	for (i = 0; i < ev->num_timers; i++) {
 
+		te = ev->timer_heap[i];
 		evt = timeval_until(&now, &te->next_event);
 
 		DEBUGADD(10,("Timed Event \"%s\" %p handled in %d seconds (at %s)\n",
@@ -27,13 +27,17 @@
 #include "../lib/util/select.h"
 #include "system/select.h"
 #include "messages.h"
+#include "../lib/util/tevent_ntstatus.h"
 
 static NTSTATUS g_lock_force_unlock(struct g_lock_ctx *ctx, const char *name,
 				    struct server_id pid);
 
+struct g_lock_lock_state;
+
 struct g_lock_ctx {
 	struct db_context *db;
 	struct messaging_context *msg;
+	struct g_lock_lock_state *waiters;
 };
 
 /*
@@ -57,6 +61,7 @@ struct g_lock_ctx *g_lock_ctx_init(TALLOC_CTX *mem_ctx,
 		return NULL;
 	}
 	result->msg = msg;
+	result->waiters = NULL;
 
 	result->db = db_open(result, lock_path("g_lock.tdb"), 0,
 			     TDB_CLEAR_IF_FIRST|TDB_INCOMPATIBLE_HASH,
@@ -297,9 +302,247 @@ done:
 		return STATUS_PENDING;
 	}
 
-	return NT_STATUS_OK;
+	return status;
+}
+
+struct g_lock_lock_state {
+	struct g_lock_lock_state *prev, *next;
+	struct tevent_req *req;
+	struct tevent_context *ev;
+	struct g_lock_ctx *ctx;
+	const char *name;
+	enum g_lock_type type;
+	struct tevent_timer *retry_timer;
+	struct tevent_immediate *retry_im;
+	bool listed;
+	bool registered;
+	bool pending;
+	bool locked;
+};
+
+static int g_lock_lock_state_destructor(struct g_lock_lock_state *state);
+static void g_lock_lock_retry_msg(struct messaging_context *msg,
+				  void *private_data,
+				  uint32_t msg_type,
+				  struct server_id server_id,
+				  DATA_BLOB *data);
+static void g_lock_lock_retry_im(struct tevent_context *ev,
+				 struct tevent_immediate *im,
+				 void *private_data);
+static bool g_lock_lock_try(struct tevent_req *req);
+
+/*
+ * Wait for a lock without blocking the event loop: retry whenever a
+ * MSG_DBWRAP_G_LOCK_RETRY comes in. ev must be the event context the
+ * messaging context was set up with, the retry messages arrive
+ * there. Use tevent_req_set_endtime() for a timeout, freeing the
+ * request before it finished removes our waiter entry again.
+ *
+ * g_lock.tdb has one entry per process and name, so only one request
+ * per process can wait for a name. A second one fails with
+ * NT_STATUS_POSSIBLE_DEADLOCK. Asking for a lock this process already
+ * holds fails as well, and leaves the lock alone.
+ */
+struct tevent_req *g_lock_lock_send(TALLOC_CTX *mem_ctx,
+				    struct tevent_context *ev,
+				    struct g_lock_ctx *ctx,
+				    const char *name,
+				    enum g_lock_type type)
+{
+	struct tevent_req *req;
+	struct g_lock_lock_state *state, *w;
+	NTSTATUS status;
+
+	req = tevent_req_create(mem_ctx, &state, struct g_lock_lock_state);
+	if (req == NULL) {
+		return NULL;
+	}
+	state->req = req;
+	state->ev = ev;
+	state->ctx = ctx;
+	state->type = type;
+
+	DEBUG(10, ("Trying to acquire lock %d for %s\n", (int)type, name));
+
+	if (type & ~1) {
+		DEBUG(1, ("Got invalid lock type %d for %s\n",
+			  (int)type, name));
+		tevent_req_nterror(req, NT_STATUS_INVALID_PARAMETER);
+		return tevent_req_post(req, ev);
+	}
+
+	state->name = talloc_strdup(state, name);
+	if (tevent_req_nomem(state->name, req)) {
+		return tevent_req_post(req, ev);
+	}
+
+	state->retry_im = tevent_create_immediate(state);
+	if (tevent_req_nomem(state->retry_im, req)) {
+		return tevent_req_post(req, ev);
+	}
+
+	for (w = ctx->waiters; w != NULL; w = w->next) {
+		if (strcmp(w->name, name) == 0) {
+			DEBUG(1, ("Already waiting for lock %s\n", name));
+			tevent_req_nterror(req, NT_STATUS_POSSIBLE_DEADLOCK);
+			return tevent_req_post(req, ev);
+		}
+	}
+	DLIST_ADD(ctx->waiters, state);
+	state->listed = true;
+	talloc_set_destructor(state, g_lock_lock_state_destructor);
+
+#ifdef CLUSTER_SUPPORT
+	if (lp_clustering()) {
+		status = ctdb_watch_us(messaging_ctdbd_connection());
+		if (!NT_STATUS_IS_OK(status)) {
+			DEBUG(10, ("could not register retry with ctdb: %s\n",
+				   nt_errstr(status)));
+			tevent_req_nterror(req, status);
+			return tevent_req_post(req, ev);
+		}
+	}
+#endif
+
+	/*
+	 * Requests for different names can wait at the same time,
+	 * each registers with its own private pointer.
+	 */
+	status = messaging_register(ctx->msg, state, MSG_DBWRAP_G_LOCK_RETRY,
+				    g_lock_lock_retry_msg);
+	if (!NT_STATUS_IS_OK(status)) {
+		DEBUG(10, ("messaging_register failed: %s\n",
+			   nt_errstr(status)));
+		tevent_req_nterror(req, status);
+		return tevent_req_post(req, ev);
+	}
+	state->registered = true;
+
+	if (!g_lock_lock_try(req)) {
+		return tevent_req_post(req, ev);
+	}
+	return req;
+}
+
+static int g_lock_lock_state_destructor(struct g_lock_lock_state *state)
+{
+	if (state->listed) {
+		DLIST_REMOVE(state->ctx->waiters, state);
+	}
+	if (state->registered) {
+		messaging_deregister(state->ctx->msg, MSG_DBWRAP_G_LOCK_RETRY,
+				     state);
+	}
+	if (state->pending && !state->locked) {
+		/*
+		 * Timed out, failed or given up: don't leave the
+		 * pending entry behind we added.
+		 */
+		g_lock_unlock(state->ctx, state->name);
+	}
+	return 0;
+}
+
+static void g_lock_lock_retry_timer(struct tevent_context *ev,
+				    struct tevent_timer *te,
+				    struct timeval current_time,
+				    void *private_data)
+{
+	struct g_lock_lock_state *state = talloc_get_type_abort(
+		private_data, struct g_lock_lock_state);
+
+	state->retry_timer = NULL;
+	g_lock_lock_try(state->req);
+}
+
+static void g_lock_lock_retry_msg(struct messaging_context *msg,
+				  void *private_data,
+				  uint32_t msg_type,
+				  struct server_id server_id,
+				  DATA_BLOB *data)
+{
+	struct g_lock_lock_state *state = talloc_get_type_abort(
+		private_data, struct g_lock_lock_state);
+
+	DEBUG(10, ("Got retry message from pid %s\n",
+		   server_id_str(talloc_tos(), &server_id)));
+
+	/*
+	 * Don't finish the request from within
+	 * messaging_dispatch_rec(): the callback might free
+	 * another waiter, and with it the messaging callback the
+	 * dispatch loop looks at next.
+	 */
+	tevent_schedule_immediate(state->retry_im, state->ev,
+				  g_lock_lock_retry_im, state);
+}
+
+static void g_lock_lock_retry_im(struct tevent_context *ev,
+				 struct tevent_immediate *im,
+				 void *private_data)
+{
+	struct g_lock_lock_state *state = talloc_get_type_abort(
+		private_data, struct g_lock_lock_state);
+
+	g_lock_lock_try(state->req);
+}
+
+/*
+ * Returns false if the request is finished
+ */
+static bool g_lock_lock_try(struct tevent_req *req)
+{
+	struct g_lock_lock_state *state = tevent_req_data(
+		req, struct g_lock_lock_state);
+	NTSTATUS status;
+
+	TALLOC_FREE(state->retry_timer);
+
+	if (!tevent_req_is_in_progress(req)) {
+		/* timed out, the caller just did not free us yet */
+		return false;
+	}
+
+	status = g_lock_trylock(state->ctx, state->name, state->type);
+	if (NT_STATUS_IS_OK(status)) {
+		DEBUG(10, ("Got lock %s\n", state->name));
+		state->locked = true;
+		tevent_req_done(req);
+		return false;
+	}
+	if (!NT_STATUS_EQUAL(status, STATUS_PENDING)) {
+		DEBUG(10, ("g_lock_trylock failed: %s\n",
+			   nt_errstr(status)));
+		tevent_req_nterror(req, status);
+		return false;
+	}
+	state->pending = true;
+
+	DEBUG(10, ("g_lock_trylock: Did not get lock, waiting...\n"));
+
+	/*
+	 * g_lock_force_unlock only wakes up a few waiters, look
+	 * again once a minute in case we were not among them.
+	 */
+	state->retry_timer = tevent_add_timer(
+		state->ev, state, timeval_current_ofs(60, 0),
+		g_lock_lock_retry_timer, state);
+	if (tevent_req_nomem(state->retry_timer, req)) {
+		return false;
+	}
+	return true;
 }
 
+NTSTATUS g_lock_lock_recv(struct tevent_req *req)
+{
+	return tevent_req_simple_recv_ntstatus(req);
+}
+
+/*
+ * The blocking variant. It can't run the event loop because it is
+ * called from inside it, so it waits in poll and retries more often
+ * than needed. Whoever can should use g_lock_lock_send().
+ */
 NTSTATUS g_lock_lock(struct g_lock_ctx *ctx, const char *name,
 		     enum g_lock_type lock_type, struct timeval timeout)
 {
@@ -774,6 +1017,7 @@ NTSTATUS g_lock_do(const char *name, enum g_lock_type lock_type,
 	struct tevent_context *ev = NULL;
 	struct messaging_context *msg = NULL;
 	struct g_lock_ctx *g_ctx = NULL;
+	struct tevent_req *req = NULL;
 	NTSTATUS status;
 
 	if (!g_lock_init_all(talloc_tos(), &ev, &msg, self, &g_ctx)) {
@@ -781,7 +1025,30 @@ NTSTATUS g_lock_do(const char *name, enum g_lock_type lock_type,
 		goto done;
 	}
 
-	status = g_lock_lock(g_ctx, name, lock_type, timeout);
+	/*
+	 * We own ev and msg, so we can simply run the loop until
+	 * the lock is ours
+	 */
+	req = g_lock_lock_send(talloc_tos(), ev, g_ctx, name, lock_type);
+	if (req == NULL) {
+		status = NT_STATUS_NO_MEMORY;
+		goto done;
+	}
+	if (!tevent_req_set_endtime(req, ev,
+				    timeval_current_ofs(timeout.tv_sec,
+							timeout.tv_usec))) {
+		status = NT_STATUS_NO_MEMORY;
+		goto done;
+	}
+	if (!tevent_req_poll_ntstatus(req, ev, &status)) {
+		goto done;
+	}
+	status = g_lock_lock_recv(req);
+	if (NT_STATUS_EQUAL(status, NT_STATUS_IO_TIMEOUT)) {
+		DEBUG(10, ("g_lock_do timed out\n"));
+		status = NT_STATUS_LOCK_NOT_GRANTED;
+	}
+	TALLOC_FREE(req);
 	if (!NT_STATUS_IS_OK(status)) {
 		goto done;
 	}
@@ -789,6 +1056,7 @@ NTSTATUS g_lock_do(const char *name, enum g_lock_type lock_type,
 	g_lock_unlock(g_ctx, name);
 
 done:
+	TALLOC_FREE(req);
 	TALLOC_FREE(g_ctx);
 	TALLOC_FREE(msg);
 	TALLOC_FREE(ev);
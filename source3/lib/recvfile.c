@@ -138,6 +138,8 @@ static ssize_t default_sys_recvfile(int fromfd,
  * failed. Else we return the number of bytes
  * actually written. We always read count bytes
  * from the network in the case of return != -1.
+ * splice() needs an explicit offset, so positionless
+ * writes use the userspace implementation.
  */
 
 
@@ -147,9 +149,11 @@ ssize_t sys_recvfile(int fromfd,
 			size_t count)
 {
 	static int pipefd[2] = { -1, -1 };
-	static bool try_splice_call = false;
+	static bool try_splice_call = true;
 	size_t total_written = 0;
 	loff_t splice_offset = offset;
+	ssize_t to_write = 0;
+	int saved_errno;
 
 	DEBUG(10,("sys_recvfile: from = %d, to = %d, "
 		"offset=%.0f, count = %lu\n",
@@ -167,7 +171,7 @@ ssize_t sys_recvfile(int fromfd,
 	 * implementation if recvfile splice fails. JRA.
 	 */
 
-	if (!try_splice_call) {
+	if (!try_splice_call || tofd == -1 || offset == (SMB_OFF_T)-1) {
 		return default_sys_recvfile(fromfd,
 				tofd,
 				offset,
@@ -180,7 +184,7 @@ ssize_t sys_recvfile(int fromfd,
 	}
 
 	while (count > 0) {
-		int nread, to_write;
+		ssize_t nread;
 
 		nread = splice(fromfd, NULL, pipefd[1], NULL,
 			       MIN(count, 16384), SPLICE_F_MOVE);
@@ -194,36 +198,88 @@ ssize_t sys_recvfile(int fromfd,
 				return default_sys_recvfile(fromfd, tofd,
 							    offset, count);
 			}
-			break;
+			/* socket is dead. */
+			return -1;
+		}
+		if (nread == 0) {
+			/* EOF on the socket. */
+			errno = EPIPE;
+			return -1;
 		}
+		count -= nread;
 
 		to_write = nread;
 		while (to_write > 0) {
-			int thistime;
+			ssize_t thistime;
 			thistime = splice(pipefd[0], NULL, tofd,
 					  &splice_offset, to_write,
 					  SPLICE_F_MOVE);
 			if (thistime == -1) {
-				goto done;
+				if (errno == EINTR) {
+					continue;
+				}
+				goto write_failed;
 			}
+			total_written += thistime;
 			to_write -= thistime;
 		}
-
-		total_written += nread;
-		count -= nread;
 	}
 
- done:
-	if (total_written < count) {
-		int saved_errno = errno;
-		if (drain_socket(fromfd, count-total_written) !=
-				count-total_written) {
-			/* socket is dead. */
-			return -1;
+	return total_written;
+
+ write_failed:
+	saved_errno = errno;
+
+	if (total_written == 0 &&
+	    (saved_errno == EINVAL || saved_errno == ENOSYS)) {
+		/*
+		 * This file system can't splice, others might. Write
+		 * what is already in the pipe by hand and do the rest
+		 * of this call in userspace.
+		 */
+		char buf[16384];
+		ssize_t got = 0;
+		ssize_t ret;
+
+		while (got < to_write) {
+			ret = sys_read(pipefd[0], buf + got, to_write - got);
+			if (ret <= 0) {
+				saved_errno = (ret == -1) ? errno : EIO;
+				break;
+			}
+			got += ret;
+		}
+
+		if (got == to_write) {
+			ret = sys_pwrite(tofd, buf, got, offset);
+			if (ret == got) {
+				ret = default_sys_recvfile(fromfd, tofd,
+							   offset + got,
+							   count);
+				if (ret == -1) {
+					return -1;
+				}
+				return got + ret;
+			}
+			saved_errno = (ret == -1) ? errno : ENOSPC;
 		}
-		errno = saved_errno;
 	}
 
+	/*
+	 * Throw away what is left in the pipe by starting
+	 * with a fresh one next time, and drain the rest of
+	 * the payload from the socket. The caller sees a
+	 * short write.
+	 */
+	close(pipefd[0]);
+	close(pipefd[1]);
+	pipefd[0] = pipefd[1] = -1;
+
+	if (drain_socket(fromfd, count) != count) {
+		/* socket is dead. */
+		return -1;
+	}
+	errno = saved_errno;
 	return total_written;
 }
 #else
@@ -60,6 +60,12 @@ struct security_token *dup_nt_token(TALLOC_CTX *mem_ctx, const struct security_t
 	token->privilege_mask = ptoken->privilege_mask;
 	token->rights_mask = ptoken->rights_mask;
 
+	if (!NT_STATUS_IS_OK(security_token_index_sids(token))) {
+		DEBUG(0, ("security_token_index_sids failed\n"));
+		TALLOC_FREE(token);
+		return NULL;
+	}
+
 	return token;
 }
 
@@ -122,12 +128,5 @@ NTSTATUS merge_nt_token(TALLOC_CTX *mem_ctx,
 
 bool token_sid_in_ace(const struct security_token *token, const struct security_ace *ace)
 {
-	size_t i;
-
-	for (i = 0; i < token->num_sids; i++) {
-		if (dom_sid_equal(&ace->trustee, &token->sids[i]))
-			return true;
-	}
-
-	return false;
+	return security_token_has_sid(token, &ace->trustee);
 }
@@ -24,6 +24,8 @@
 #include "../libcli/security/security.h"
 #include "../librpc/gen_ndr/ndr_security.h"
 #include "../lib/util/bitmap.h"
+#include "memcache.h"
+#include "smbprofile.h"
 
 static NTSTATUS create_acl_blob(const struct security_descriptor *psd,
 			DATA_BLOB *pblob,
@@ -40,6 +42,9 @@ static NTSTATUS store_acl_blob_fsp(vfs_handle_struct *handle,
 			files_struct *fsp,
 			DATA_BLOB *pblob);
 
+static bool acl_sd_cache_generation(vfs_handle_struct *handle,
+			int *generation);
+
 #define HASH_SECURITY_INFO (SECINFO_OWNER | \
 				SECINFO_GROUP | \
 				SECINFO_DACL | \
@@ -241,6 +246,127 @@ static void add_directory_inheritable_components(vfs_handle_struct *handle,
 	psd->dacl->num_aces += 3;
 }
 
+/*******************************************************************
+ Per-process cache of the full security descriptors we hand out.
+ Entries are keyed by file_id and share, and are only valid while
+ the ctime of the file and the module's generation number are
+ unchanged. Changes made through this process invalidate the entry
+ explicitly, changes made elsewhere are caught by the ctime check,
+ or by the generation where storing a blob does not touch the file.
+*******************************************************************/
+
+struct acl_common_sd_cache_key {
+	struct file_id id;
+	int snum;
+};
+
+struct acl_common_sd_cache_entry {
+	struct timespec ctime;
+	int generation;
+	struct security_descriptor *psd;
+};
+
+static bool acl_common_sd_cache_enabled(vfs_handle_struct *handle)
+{
+	return lp_parm_bool(SNUM(handle->conn),
+			ACL_MODULE_NAME,
+			"cache security descriptors",
+			true);
+}
+
+static DATA_BLOB acl_common_sd_cache_key(vfs_handle_struct *handle,
+				const struct file_id *id,
+				struct acl_common_sd_cache_key *key)
+{
+	ZERO_STRUCTP(key);
+	key->id = *id;
+	key->snum = SNUM(handle->conn);
+	return data_blob_const(key, sizeof(*key));
+}
+
+static struct security_descriptor *acl_common_sd_cache_lookup(
+				TALLOC_CTX *mem_ctx,
+				vfs_handle_struct *handle,
+				const SMB_STRUCT_STAT *psbuf,
+				int generation)
+{
+	struct acl_common_sd_cache_key key;
+	struct acl_common_sd_cache_entry *entry;
+	struct file_id id = vfs_file_id_from_sbuf(handle->conn, psbuf);
+
+	DO_PROFILE_INC(sdcache_lookups);
+
+	entry = (struct acl_common_sd_cache_entry *)memcache_lookup_talloc(
+		smbd_memcache(), SECDESC_CACHE,
+		acl_common_sd_cache_key(handle, &id, &key));
+	if (entry == NULL ||
+	    timespec_compare(&entry->ctime, &psbuf->st_ex_ctime) != 0 ||
+	    entry->generation != generation) {
+		DO_PROFILE_INC(sdcache_misses);
+		return NULL;
+	}
+
+	DO_PROFILE_INC(sdcache_hits);
+	return security_descriptor_copy(mem_ctx, entry->psd);
+}
+
+static void acl_common_sd_cache_store(vfs_handle_struct *handle,
+				const SMB_STRUCT_STAT *psbuf,
+				int generation,
+				const struct security_descriptor *psd)
+{
+	struct acl_common_sd_cache_key key;
+	struct acl_common_sd_cache_entry *entry;
+	struct file_id id;
+
+	/*
+	 * A change made by another process within the same ctime
+	 * tick would go unnoticed, so only cache descriptors of
+	 * files that have not changed in the last second.
+	 */
+	if (psbuf->st_ex_ctime.tv_sec >= time(NULL) - 1) {
+		return;
+	}
+
+	entry = talloc(talloc_tos(), struct acl_common_sd_cache_entry);
+	if (entry == NULL) {
+		return;
+	}
+	entry->ctime = psbuf->st_ex_ctime;
+	entry->generation = generation;
+	entry->psd = security_descriptor_copy(entry, psd);
+	if (entry->psd == NULL) {
+		TALLOC_FREE(entry);
+		return;
+	}
+
+	id = vfs_file_id_from_sbuf(handle->conn, psbuf);
+	memcache_add_talloc(smbd_memcache(), SECDESC_CACHE,
+			acl_common_sd_cache_key(handle, &id, &key), &entry);
+}
+
+static void acl_common_sd_cache_delete(vfs_handle_struct *handle,
+				const struct file_id *id)
+{
+	struct acl_common_sd_cache_key key;
+
+	memcache_delete(smbd_memcache(), SECDESC_CACHE,
+			acl_common_sd_cache_key(handle, id, &key));
+}
+
+static void acl_common_sd_cache_delete_path(vfs_handle_struct *handle,
+				const char *path)
+{
+	SMB_STRUCT_STAT sbuf;
+	struct file_id id;
+
+	if (vfs_stat_smb_fname(handle->conn, path, &sbuf) == -1) {
+		return;
+	}
+	id = vfs_file_id_from_sbuf(handle->conn, &sbuf);
+	acl_common_sd_cache_delete(handle, &id);
+}
+
 /*******************************************************************
  Pull a DATA_BLOB from an xattr given a pathname.
  If the hash doesn't match, or doesn't exist - return the underlying
@@ -260,6 +386,10 @@ static NTSTATUS get_nt_acl_internal(vfs_handle_struct *handle,
 	uint8_t hash_tmp[XATTR_SD_HASH_SIZE];
 	struct security_descriptor *psd = NULL;
 	struct security_descriptor *pdesc_next = NULL;
+	SMB_STRUCT_STAT sbuf;
+	SMB_STRUCT_STAT *psbuf = NULL;
+	int generation = 0;
+	bool cacheable = false;
 	bool ignore_file_system_acl = lp_parm_bool(SNUM(handle->conn),
 						ACL_MODULE_NAME,
 						"ignore system acls",
@@ -271,6 +401,32 @@ static NTSTATUS get_nt_acl_internal(vfs_handle_struct *handle,
 
 	DEBUG(10, ("get_nt_acl_internal: name=%s\n", name));
 
+	/*
+	 * The generation is read before the blob, so that a blob
+	 * stored in between makes the cached descriptor stale.
+	 */
+	if (acl_common_sd_cache_enabled(handle) &&
+	    acl_sd_cache_generation(handle, &generation)) {
+		if (fsp) {
+			status = vfs_stat_fsp(fsp);
+			if (NT_STATUS_IS_OK(status)) {
+				psbuf = &fsp->fsp_name->st;
+			}
+		} else if (vfs_stat_smb_fname(handle->conn, name,
+					      &sbuf) == 0) {
+			psbuf = &sbuf;
+		}
+		if (psbuf != NULL) {
+			cacheable = true;
+			psd = acl_common_sd_cache_lookup(talloc_tos(),
+							 handle, psbuf,
+							 generation);
+			if (psd != NULL) {
+				goto done;
+			}
+		}
+	}
+
 	/* Get the full underlying sd for the hash
 	   or to return as backup. */
 	if (fsp) {
@@ -357,29 +513,28 @@ static NTSTATUS get_nt_acl_internal(vfs_handle_struct *handle,
  		 * away the filesystem SD. */
 		TALLOC_FREE(pdesc_next);
 	} else {
-		SMB_STRUCT_STAT sbuf;
-		SMB_STRUCT_STAT *psbuf = &sbuf;
 		bool is_directory = false;
 		/*
 		 * We're returning the underlying ACL from the
 		 * filesystem. If it's a directory, and has no
 		 * inheritable ACE entries we have to fake them.
 		 */
-		if (fsp) {
+		if (psbuf == NULL && fsp) {
 			status = vfs_stat_fsp(fsp);
 			if (!NT_STATUS_IS_OK(status)) {
 				return status;
 			}
 			psbuf = &fsp->fsp_name->st;
-		} else {
+		} else if (psbuf == NULL) {
 			int ret = vfs_stat_smb_fname(handle->conn,
 						name,
 						&sbuf);
 			if (ret == -1) {
 				return map_nt_error_from_unix(errno);
 			}
+			psbuf = &sbuf;
 		}
-		is_directory = S_ISDIR(sbuf.st_ex_mode);
+		is_directory = S_ISDIR(psbuf->st_ex_mode);
 
 		if (ignore_file_system_acl) {
 			TALLOC_FREE(pdesc_next);
@@ -407,6 +562,12 @@ static NTSTATUS get_nt_acl_internal(vfs_handle_struct *handle,
 		}
 	}
 
+	if (cacheable) {
+		acl_common_sd_cache_store(handle, psbuf, generation, psd);
+	}
+
+  done:
+
 	if (!(security_info & SECINFO_OWNER)) {
 		psd->owner_sid = NULL;
 	}
@@ -803,6 +964,7 @@ static NTSTATUS fset_nt_acl_common(vfs_handle_struct *handle, files_struct *fsp,
 	}
 	create_acl_blob(psd, &blob, XATTR_SD_HASH_TYPE_SHA256, hash);
 	store_acl_blob_fsp(handle, fsp, &blob);
+	acl_common_sd_cache_delete(handle, &fsp->file_id);
 
 	return NT_STATUS_OK;
 }
@@ -1071,6 +1233,7 @@ static int chmod_acl_module_common(struct vfs_handle_struct *handle,
 {
 	if (lp_posix_pathnames()) {
 		/* Only allow this on POSIX pathnames. */
+		acl_common_sd_cache_delete_path(handle, path);
 		return SMB_VFS_NEXT_CHMOD(handle, path, mode);
 	}
 	return 0;
@@ -1081,6 +1244,7 @@ static int fchmod_acl_module_common(struct vfs_handle_struct *handle,
 {
 	if (fsp->posix_open) {
 		/* Only allow this on POSIX opens. */
+		acl_common_sd_cache_delete(handle, &fsp->file_id);
 		return SMB_VFS_NEXT_FCHMOD(handle, fsp, mode);
 	}
 	return 0;
@@ -1091,6 +1255,7 @@ static int chmod_acl_acl_module_common(struct vfs_handle_struct *handle,
 {
 	if (lp_posix_pathnames()) {
 		/* Only allow this on POSIX pathnames. */
+		acl_common_sd_cache_delete_path(handle, name);
 		return SMB_VFS_NEXT_CHMOD_ACL(handle, name, mode);
 	}
 	return 0;
@@ -1101,7 +1266,29 @@ static int fchmod_acl_acl_module_common(struct vfs_handle_struct *handle,
 {
 	if (fsp->posix_open) {
 		/* Only allow this on POSIX opens. */
+		acl_common_sd_cache_delete(handle, &fsp->file_id);
 		return SMB_VFS_NEXT_FCHMOD_ACL(handle, fsp, mode);
 	}
 	return 0;
 }
+
+static int chown_acl_common(struct vfs_handle_struct *handle,
+			const char *path, uid_t uid, gid_t gid)
+{
+	acl_common_sd_cache_delete_path(handle, path);
+	return SMB_VFS_NEXT_CHOWN(handle, path, uid, gid);
+}
+
+static int fchown_acl_common(struct vfs_handle_struct *handle,
+			struct files_struct *fsp, uid_t uid, gid_t gid)
+{
+	acl_common_sd_cache_delete(handle, &fsp->file_id);
+	return SMB_VFS_NEXT_FCHOWN(handle, fsp, uid, gid);
+}
+
+static int lchown_acl_common(struct vfs_handle_struct *handle,
+			const char *path, uid_t uid, gid_t gid)
+{
+	acl_common_sd_cache_delete_path(handle, path);
+	return SMB_VFS_NEXT_LCHOWN(handle, path, uid, gid);
+}
@@ -59,7 +59,8 @@ static bool acl_tdb_init(void)
 	}
 
 	become_root();
-	acl_db = db_open(NULL, dbname, 0, TDB_DEFAULT, O_RDWR|O_CREAT, 0600);
+	acl_db = db_open(NULL, dbname, 0, TDB_DEFAULT|TDB_SEQNUM,
+			 O_RDWR|O_CREAT, 0600);
 	unbecome_root();
 
 	if (acl_db == NULL) {
@@ -231,6 +232,23 @@ static NTSTATUS store_acl_blob_fsp(vfs_handle_struct *handle,
 	return rec->store(rec, data, 0);
 }
 
+/*******************************************************************
+ Storing a blob in the tdb leaves the file's ctime alone, so the
+ security descriptor cache also compares the tdb sequence number.
+ With clustering a store on another node does not change the local
+ one, so don't cache there.
+*******************************************************************/
+
+static bool acl_sd_cache_generation(vfs_handle_struct *handle,
+				int *generation)
+{
+	if (lp_clustering()) {
+		return false;
+	}
+	*generation = acl_db->get_seqnum(acl_db);
+	return true;
+}
+
 /*********************************************************************
  On unlink we need to delete the tdb record (if using tdb).
 *********************************************************************/
@@ -343,6 +361,7 @@ static int sys_acl_set_file_tdb(vfs_handle_struct *handle,
                               SMB_ACL_T theacl)
 {
 	SMB_STRUCT_STAT sbuf;
+	struct file_id id;
 	struct db_context *db = acl_db;
 	int ret = -1;
 
@@ -365,6 +384,8 @@ static int sys_acl_set_file_tdb(vfs_handle_struct *handle,
 	}
 
 	acl_tdb_delete(handle, db, &sbuf);
+	id = vfs_file_id_from_sbuf(handle->conn, &sbuf);
+	acl_common_sd_cache_delete(handle, &id);
 	return 0;
 }
 
@@ -393,6 +414,7 @@ static int sys_acl_set_fd_tdb(vfs_handle_struct *handle,
 	}
 
 	acl_tdb_delete(handle, db, &fsp->fsp_name->st);
+	acl_common_sd_cache_delete(handle, &fsp->file_id);
 	return 0;
 }
 
@@ -407,6 +429,9 @@ static struct vfs_fn_pointers vfs_acl_tdb_fns = {
 	.unlink = unlink_acl_tdb,
 	.chmod = chmod_acl_module_common,
 	.fchmod = fchmod_acl_module_common,
+	.chown = chown_acl_common,
+	.fchown = fchown_acl_common,
+	.lchown = lchown_acl_common,
 	.fget_nt_acl = fget_nt_acl_common,
 	.get_nt_acl = get_nt_acl_common,
 	.fset_nt_acl = fset_nt_acl_common,
@@ -129,6 +129,18 @@ static NTSTATUS store_acl_blob_fsp(vfs_handle_struct *handle,
 	return NT_STATUS_OK;
 }
 
+/*******************************************************************
+ Setting the xattr changes the file's ctime, that is all the
+ security descriptor cache needs to notice.
+*******************************************************************/
+
+static bool acl_sd_cache_generation(vfs_handle_struct *handle,
+				int *generation)
+{
+	*generation = 0;
+	return true;
+}
+
 /*********************************************************************
  Remove a Windows ACL - we're setting the underlying POSIX ACL.
 *********************************************************************/
@@ -149,6 +161,7 @@ static int sys_acl_set_file_xattr(vfs_handle_struct *handle,
 	become_root();
 	SMB_VFS_REMOVEXATTR(handle->conn, name, XATTR_NTACL_NAME);
 	unbecome_root();
+	acl_common_sd_cache_delete_path(handle, name);
 
 	return ret;
 }
@@ -171,6 +184,7 @@ static int sys_acl_set_fd_xattr(vfs_handle_struct *handle,
 	become_root();
 	SMB_VFS_FREMOVEXATTR(fsp, XATTR_NTACL_NAME);
 	unbecome_root();
+	acl_common_sd_cache_delete(handle, &fsp->file_id);
 
 	return ret;
 }
@@ -209,6 +223,9 @@ static struct vfs_fn_pointers vfs_acl_xattr_fns = {
 	.unlink = unlink_acl_common,
 	.chmod = chmod_acl_module_common,
 	.fchmod = fchmod_acl_module_common,
+	.chown = chown_acl_common,
+	.fchown = fchown_acl_common,
+	.lchown = lchown_acl_common,
 	.fget_nt_acl = fget_nt_acl_common,
 	.get_nt_acl = get_nt_acl_common,
 	.fset_nt_acl = fset_nt_acl_common,
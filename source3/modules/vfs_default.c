@@ -24,6 +24,7 @@
 #include "smbd/smbd.h"
 #include "ntioctl.h"
 #include "smbprofile.h"
+#include "../lib/util/tevent_unix.h"
 
 #undef DBGC_CLASS
 #define DBGC_CLASS DBGC_VFS
@@ -533,6 +534,303 @@ static int vfswrap_fsync(vfs_handle_struct *handle, files_struct *fsp)
 #endif
 }
 
+/*
+ * Asynchronous pread/pwrite/fsync. The syscalls run in a helper thread
+ * out of a per-process fncall_context, the completion is signalled to
+ * the main event loop through the pthreadpool signal fd. Without
+ * pthreadpool support fncall_send() runs the job inline.
+ *
+ * Jobs work on a dup() of the file descriptor: a close of the fsp while
+ * a job is still queued or running must not redirect the syscall to a
+ * descriptor that got reused in the meantime. There is one dup() per
+ * fsp, kept in an fsp extension and shared by all its jobs. It is
+ * closed once the fsp is gone and the last job is done.
+ *
+ * If a job can't be set up, vfswrap_asys_send() returns NULL so that
+ * the caller falls back to synchronous I/O instead of failing the
+ * client request.
+ */
+
+static struct fncall_context *vfswrap_fncall_ctx;
+
+static struct fncall_context *vfswrap_get_fncall_ctx(void)
+{
+	if (vfswrap_fncall_ctx == NULL) {
+		int max_threads = lp_parm_int(-1, "smbd", "aio max threads",
+					      100);
+
+		vfswrap_fncall_ctx = fncall_context_init(NULL, max_threads);
+	}
+	return vfswrap_fncall_ctx;
+}
+
+struct vfswrap_asys_fd {
+	int fsp_fd;
+	int fd;
+	unsigned num_jobs;
+	bool detached;
+};
+
+static void vfswrap_asys_fd_unref(struct vfswrap_asys_fd *afd)
+{
+	if (!afd->detached || (afd->num_jobs != 0)) {
+		return;
+	}
+	close(afd->fd);
+	TALLOC_FREE(afd);
+}
+
+static void vfswrap_asys_fd_ext_destroy(void *p_data)
+{
+	struct vfswrap_asys_fd **pafd = (struct vfswrap_asys_fd **)p_data;
+
+	if (*pafd == NULL) {
+		return;
+	}
+	(*pafd)->detached = true;
+	vfswrap_asys_fd_unref(*pafd);
+	*pafd = NULL;
+}
+
+/*
+ * Get the shared dup() of fsp's descriptor, making a new one if the fsp
+ * has none yet or its descriptor changed.
+ */
+static struct vfswrap_asys_fd *vfswrap_asys_get_fd(
+	struct vfs_handle_struct *handle, struct fncall_context *ctx,
+	struct files_struct *fsp)
+{
+	struct vfswrap_asys_fd **pafd, *afd;
+
+	if (fsp->fh->fd == -1) {
+		return NULL;
+	}
+
+	pafd = (struct vfswrap_asys_fd **)VFS_FETCH_FSP_EXTENSION(handle,
+								  fsp);
+	if (pafd == NULL) {
+		pafd = (struct vfswrap_asys_fd **)VFS_ADD_FSP_EXTENSION(
+			handle, fsp, struct vfswrap_asys_fd *,
+			vfswrap_asys_fd_ext_destroy);
+		if (pafd == NULL) {
+			return NULL;
+		}
+	}
+
+	if ((*pafd != NULL) && ((*pafd)->fsp_fd == fsp->fh->fd)) {
+		return *pafd;
+	}
+	vfswrap_asys_fd_ext_destroy(pafd);
+
+	afd = talloc(ctx, struct vfswrap_asys_fd);
+	if (afd == NULL) {
+		return NULL;
+	}
+	afd->fd = dup(fsp->fh->fd);
+	if (afd->fd == -1) {
+		DEBUG(3, ("vfswrap_asys_get_fd: dup failed: %s\n",
+			  strerror(errno)));
+		TALLOC_FREE(afd);
+		return NULL;
+	}
+	afd->fsp_fd = fsp->fh->fd;
+	afd->num_jobs = 0;
+	afd->detached = false;
+
+	*pafd = afd;
+	return afd;
+}
+
+struct vfswrap_asys_job {
+	struct vfswrap_asys_fd *afd;
+	int fd;
+	void *buf;
+	size_t n;
+	SMB_OFF_T offset;
+	ssize_t ret;
+	int err;
+};
+
+static int vfswrap_asys_job_destructor(struct vfswrap_asys_job *job)
+{
+	if (job->afd != NULL) {
+		job->afd->num_jobs -= 1;
+		vfswrap_asys_fd_unref(job->afd);
+		job->afd = NULL;
+	}
+	return 0;
+}
+
+struct vfswrap_asys_state {
+	struct vfswrap_asys_job *job;
+	ssize_t ret;
+	int err;
+};
+
+static void vfswrap_asys_done(struct tevent_req *subreq);
+
+static struct tevent_req *vfswrap_asys_send(struct vfs_handle_struct *handle,
+					    TALLOC_CTX *mem_ctx,
+					    struct tevent_context *ev,
+					    struct files_struct *fsp,
+					    void (*fn)(void *private_data),
+					    void *buf, size_t n,
+					    SMB_OFF_T offset)
+{
+	struct tevent_req *req, *subreq;
+	struct vfswrap_asys_state *state;
+	struct vfswrap_asys_job *job;
+	struct vfswrap_asys_fd *afd;
+	struct fncall_context *ctx;
+
+	ctx = vfswrap_get_fncall_ctx();
+	if (ctx == NULL) {
+		return NULL;
+	}
+
+	afd = vfswrap_asys_get_fd(handle, ctx, fsp);
+	if (afd == NULL) {
+		return NULL;
+	}
+
+	req = tevent_req_create(mem_ctx, &state, struct vfswrap_asys_state);
+	if (req == NULL) {
+		return NULL;
+	}
+
+	job = talloc_zero(state, struct vfswrap_asys_job);
+	if (job == NULL) {
+		TALLOC_FREE(req);
+		return NULL;
+	}
+	job->afd = afd;
+	afd->num_jobs += 1;
+	talloc_set_destructor(job, vfswrap_asys_job_destructor);
+	state->job = job;
+
+	job->fd = afd->fd;
+	job->buf = buf;
+	job->n = n;
+	job->offset = offset;
+
+	subreq = fncall_send(state, ev, ctx, fn, job);
+	if (subreq == NULL) {
+		TALLOC_FREE(req);
+		return NULL;
+	}
+	tevent_req_set_callback(subreq, vfswrap_asys_done, req);
+	return req;
+}
+
+static void vfswrap_asys_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct vfswrap_asys_state *state = tevent_req_data(
+		req, struct vfswrap_asys_state);
+	int ret, err;
+
+	ret = fncall_recv(subreq, &err);
+	TALLOC_FREE(subreq);
+	if (ret == -1) {
+		tevent_req_error(req, err);
+		return;
+	}
+	state->ret = state->job->ret;
+	state->err = state->job->err;
+	TALLOC_FREE(state->job);
+	tevent_req_done(req);
+}
+
+static ssize_t vfswrap_asys_recv(struct tevent_req *req, int *perrno)
+{
+	struct vfswrap_asys_state *state = tevent_req_data(
+		req, struct vfswrap_asys_state);
+
+	if (tevent_req_is_unix_error(req, perrno)) {
+		return -1;
+	}
+	if (state->ret == -1) {
+		*perrno = state->err;
+	}
+	return state->ret;
+}
+
+static void vfswrap_pread_do(void *private_data)
+{
+	struct vfswrap_asys_job *job = talloc_get_type_abort(
+		private_data, struct vfswrap_asys_job);
+
+	job->ret = sys_pread(job->fd, job->buf, job->n, job->offset);
+	if ((job->ret == -1) && (errno == ESPIPE)) {
+		/* Maintain the fiction that pipes can be seeked on. */
+		job->ret = sys_read(job->fd, job->buf, job->n);
+	}
+	job->err = errno;
+}
+
+static struct tevent_req *vfswrap_pread_send(struct vfs_handle_struct *handle,
+					     TALLOC_CTX *mem_ctx,
+					     struct tevent_context *ev,
+					     struct files_struct *fsp,
+					     void *data,
+					     size_t n, SMB_OFF_T offset)
+{
+	return vfswrap_asys_send(handle, mem_ctx, ev, fsp, vfswrap_pread_do,
+				 data, n, offset);
+}
+
+static void vfswrap_pwrite_do(void *private_data)
+{
+	struct vfswrap_asys_job *job = talloc_get_type_abort(
+		private_data, struct vfswrap_asys_job);
+
+	job->ret = sys_pwrite(job->fd, job->buf, job->n, job->offset);
+	if ((job->ret == -1) && (errno == ESPIPE)) {
+		/* Maintain the fiction that pipes can be sought on. */
+		job->ret = sys_write(job->fd, job->buf, job->n);
+	}
+	job->err = errno;
+}
+
+static struct tevent_req *vfswrap_pwrite_send(struct vfs_handle_struct *handle,
+					      TALLOC_CTX *mem_ctx,
+					      struct tevent_context *ev,
+					      struct files_struct *fsp,
+					      const void *data,
+					      size_t n, SMB_OFF_T offset)
+{
+	return vfswrap_asys_send(handle, mem_ctx, ev, fsp, vfswrap_pwrite_do,
+				 discard_const_p(void, data), n, offset);
+}
+
+static void vfswrap_fsync_do(void *private_data)
+{
+	struct vfswrap_asys_job *job = talloc_get_type_abort(
+		private_data, struct vfswrap_asys_job);
+
+#ifdef HAVE_FSYNC
+	job->ret = fsync(job->fd);
+#else
+	job->ret = 0;
+#endif
+	job->err = errno;
+}
+
+static struct tevent_req *vfswrap_fsync_send(struct vfs_handle_struct *handle,
+					     TALLOC_CTX *mem_ctx,
+					     struct tevent_context *ev,
+					     struct files_struct *fsp)
+{
+	return vfswrap_asys_send(handle, mem_ctx, ev, fsp, vfswrap_fsync_do,
+				 NULL, 0, 0);
+}
+
+static int vfswrap_fsync_recv(struct tevent_req *req, int *perrno)
+{
+	return vfswrap_asys_recv(req, perrno);
+}
+
 static int vfswrap_stat(vfs_handle_struct *handle,
 			struct smb_filename *smb_fname)
 {
@@ -1689,13 +1987,19 @@ static struct vfs_fn_pointers vfs_default_fns = {
 	.close_fn = vfswrap_close,
 	.vfs_read = vfswrap_read,
 	.pread = vfswrap_pread,
+	.pread_send = vfswrap_pread_send,
+	.pread_recv = vfswrap_asys_recv,
 	.write = vfswrap_write,
 	.pwrite = vfswrap_pwrite,
+	.pwrite_send = vfswrap_pwrite_send,
+	.pwrite_recv = vfswrap_asys_recv,
 	.lseek = vfswrap_lseek,
 	.sendfile = vfswrap_sendfile,
 	.recvfile = vfswrap_recvfile,
 	.rename = vfswrap_rename,
 	.fsync = vfswrap_fsync,
+	.fsync_send = vfswrap_fsync_send,
+	.fsync_recv = vfswrap_fsync_recv,
 	.stat = vfswrap_stat,
 	.fstat = vfswrap_fstat,
 	.lstat = vfswrap_lstat,
@@ -111,13 +111,16 @@ typedef enum _vfs_op_type {
 	SMB_VFS_OP_CLOSE,
 	SMB_VFS_OP_READ,
 	SMB_VFS_OP_PREAD,
+	SMB_VFS_OP_PREAD_SEND,
 	SMB_VFS_OP_WRITE,
 	SMB_VFS_OP_PWRITE,
+	SMB_VFS_OP_PWRITE_SEND,
 	SMB_VFS_OP_LSEEK,
 	SMB_VFS_OP_SENDFILE,
 	SMB_VFS_OP_RECVFILE,
 	SMB_VFS_OP_RENAME,
 	SMB_VFS_OP_FSYNC,
+	SMB_VFS_OP_FSYNC_SEND,
 	SMB_VFS_OP_STAT,
 	SMB_VFS_OP_FSTAT,
 	SMB_VFS_OP_LSTAT,
@@ -251,13 +254,16 @@ static struct {
 	{ SMB_VFS_OP_CLOSE,	"close" },
 	{ SMB_VFS_OP_READ,	"read" },
 	{ SMB_VFS_OP_PREAD,	"pread" },
+	{ SMB_VFS_OP_PREAD_SEND,	"pread_send" },
 	{ SMB_VFS_OP_WRITE,	"write" },
 	{ SMB_VFS_OP_PWRITE,	"pwrite" },
+	{ SMB_VFS_OP_PWRITE_SEND,	"pwrite_send" },
 	{ SMB_VFS_OP_LSEEK,	"lseek" },
 	{ SMB_VFS_OP_SENDFILE,	"sendfile" },
 	{ SMB_VFS_OP_RECVFILE,  "recvfile" },
 	{ SMB_VFS_OP_RENAME,	"rename" },
 	{ SMB_VFS_OP_FSYNC,	"fsync" },
+	{ SMB_VFS_OP_FSYNC_SEND,	"fsync_send" },
 	{ SMB_VFS_OP_STAT,	"stat" },
 	{ SMB_VFS_OP_FSTAT,	"fstat" },
 	{ SMB_VFS_OP_LSTAT,	"lstat" },
@@ -972,6 +978,32 @@ static ssize_t smb_full_audit_pread(vfs_handle_struct *handle, files_struct *fsp
 	return result;
 }
 
+/*
+ * The async calls are logged when they are submitted. The fsp might
+ * be gone by the time the request completes.
+ */
+
+static struct tevent_req *smb_full_audit_pread_send(
+	struct vfs_handle_struct *handle, TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev, struct files_struct *fsp,
+	void *data, size_t n, SMB_OFF_T offset)
+{
+	struct tevent_req *req;
+
+	req = SMB_VFS_NEXT_PREAD_SEND(handle, mem_ctx, ev, fsp, data, n,
+				      offset);
+
+	do_log(SMB_VFS_OP_PREAD_SEND, (req != NULL), handle, "%s",
+	       fsp_str_do_log(fsp));
+
+	return req;
+}
+
+static ssize_t smb_full_audit_pread_recv(struct tevent_req *req, int *perrno)
+{
+	return SMB_VFS_NEXT_PREAD_RECV(req, perrno);
+}
+
 static ssize_t smb_full_audit_write(vfs_handle_struct *handle, files_struct *fsp,
 			   const void *data, size_t n)
 {
@@ -999,6 +1031,27 @@ static ssize_t smb_full_audit_pwrite(vfs_handle_struct *handle, files_struct *fs
 	return result;
 }
 
+static struct tevent_req *smb_full_audit_pwrite_send(
+	struct vfs_handle_struct *handle, TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev, struct files_struct *fsp,
+	const void *data, size_t n, SMB_OFF_T offset)
+{
+	struct tevent_req *req;
+
+	req = SMB_VFS_NEXT_PWRITE_SEND(handle, mem_ctx, ev, fsp, data, n,
+				       offset);
+
+	do_log(SMB_VFS_OP_PWRITE_SEND, (req != NULL), handle, "%s",
+	       fsp_str_do_log(fsp));
+
+	return req;
+}
+
+static ssize_t smb_full_audit_pwrite_recv(struct tevent_req *req, int *perrno)
+{
+	return SMB_VFS_NEXT_PWRITE_RECV(req, perrno);
+}
+
 static SMB_OFF_T smb_full_audit_lseek(vfs_handle_struct *handle, files_struct *fsp,
 			     SMB_OFF_T offset, int whence)
 {
@@ -1069,6 +1122,25 @@ static int smb_full_audit_fsync(vfs_handle_struct *handle, files_struct *fsp)
 	return result;    
 }
 
+static struct tevent_req *smb_full_audit_fsync_send(
+	struct vfs_handle_struct *handle, TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev, struct files_struct *fsp)
+{
+	struct tevent_req *req;
+
+	req = SMB_VFS_NEXT_FSYNC_SEND(handle, mem_ctx, ev, fsp);
+
+	do_log(SMB_VFS_OP_FSYNC_SEND, (req != NULL), handle, "%s",
+	       fsp_str_do_log(fsp));
+
+	return req;
+}
+
+static int smb_full_audit_fsync_recv(struct tevent_req *req, int *perrno)
+{
+	return SMB_VFS_NEXT_FSYNC_RECV(req, perrno);
+}
+
 static int smb_full_audit_stat(vfs_handle_struct *handle,
 			       struct smb_filename *smb_fname)
 {
@@ -2263,13 +2335,19 @@ static struct vfs_fn_pointers vfs_full_audit_fns = {
 	.close_fn = smb_full_audit_close,
 	.vfs_read = smb_full_audit_read,
 	.pread = smb_full_audit_pread,
+	.pread_send = smb_full_audit_pread_send,
+	.pread_recv = smb_full_audit_pread_recv,
 	.write = smb_full_audit_write,
 	.pwrite = smb_full_audit_pwrite,
+	.pwrite_send = smb_full_audit_pwrite_send,
+	.pwrite_recv = smb_full_audit_pwrite_recv,
 	.lseek = smb_full_audit_lseek,
 	.sendfile = smb_full_audit_sendfile,
 	.recvfile = smb_full_audit_recvfile,
 	.rename = smb_full_audit_rename,
 	.fsync = smb_full_audit_fsync,
+	.fsync_send = smb_full_audit_fsync_send,
+	.fsync_recv = smb_full_audit_fsync_recv,
 	.stat = smb_full_audit_stat,
 	.fstat = smb_full_audit_fstat,
 	.lstat = smb_full_audit_lstat,
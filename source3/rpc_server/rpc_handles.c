@@ -26,6 +26,7 @@
 #include "rpc_server/rpc_pipes.h"
 #include "../libcli/security/security.h"
 #include "lib/tsocket/tsocket.h"
+#include "../librpc/rpc/rpc_handle_table.h"
 
 #undef DBGC_CLASS
 #define DBGC_CLASS DBGC_RPC_SRV
@@ -127,14 +128,13 @@ int close_internal_rpc_pipe_hnd(struct pipes_struct *p)
  */
 
 struct dcesrv_handle {
-	struct dcesrv_handle *prev, *next;
 	struct policy_handle wire_handle;
 	uint32_t access_granted;
 	void *data;
 };
 
 struct handle_list {
-	struct dcesrv_handle *handles;	/* List of pipe handles. */
+	struct rpc_handle_table *table;	/* Pipe handles by uuid. */
 	size_t count;			/* Current number of handles. */
 	size_t pipe_ref_count;		/* Number of pipe handles referring
 					 * to this tree. */
@@ -214,6 +214,11 @@ bool init_pipe_handles(struct pipes_struct *p, const struct ndr_syntax_id *synta
 		if (hl == NULL) {
 			return false;
 		}
+		hl->table = rpc_handle_table_init(hl);
+		if (hl->table == NULL) {
+			TALLOC_FREE(hl);
+			return false;
+		}
 
 		DEBUG(10,("init_pipe_handle_list: created handle list for "
 			  "pipe %s\n",
@@ -293,7 +298,12 @@ static struct dcesrv_handle *create_rpc_handle_internal(struct pipes_struct *p,
 	/* something more random */
 	SIVAL(rpc_hnd->wire_handle.uuid.node, 2, sys_getpid());
 
-	DLIST_ADD(p->pipe_handles->handles, rpc_hnd);
+	if (!rpc_handle_table_add(p->pipe_handles->table,
+				  &rpc_hnd->wire_handle.uuid, rpc_hnd)) {
+		DEBUG(0,("create_policy_hnd: ERROR: out of memory!\n"));
+		TALLOC_FREE(rpc_hnd);
+		return NULL;
+	}
 	p->pipe_handles->count++;
 
 	*hnd = rpc_hnd->wire_handle;
@@ -324,23 +334,20 @@ static struct dcesrv_handle *find_policy_by_hnd_internal(struct pipes_struct *p,
 				const struct policy_handle *hnd, void **data_p)
 {
 	struct dcesrv_handle *h;
-	unsigned int count;
 
 	if (data_p) {
 		*data_p = NULL;
 	}
 
-	count = 0;
-	for (h = p->pipe_handles->handles; h != NULL; h = h->next) {
-		if (memcmp(&h->wire_handle, hnd, sizeof(*hnd)) == 0) {
-			DEBUG(4,("Found policy hnd[%u] ", count));
-			dump_data(4, (const uint8 *)hnd, sizeof(*hnd));
-			if (data_p) {
-				*data_p = h->data;
-			}
-			return h;
+	h = (struct dcesrv_handle *)rpc_handle_table_find(
+		p->pipe_handles->table, &hnd->uuid);
+	if (h != NULL && memcmp(&h->wire_handle, hnd, sizeof(*hnd)) == 0) {
+		DEBUG(4,("Found policy hnd "));
+		dump_data(4, (const uint8 *)hnd, sizeof(*hnd));
+		if (data_p) {
+			*data_p = h->data;
 		}
-		count++;
+		return h;
 	}
 
 	DEBUG(4,("Policy not found: "));
@@ -386,7 +393,8 @@ bool close_policy_hnd(struct pipes_struct *p, struct policy_handle *hnd)
 
 	p->pipe_handles->count--;
 
-	DLIST_REMOVE(p->pipe_handles->handles, rpc_hnd);
+	rpc_handle_table_remove(p->pipe_handles->table,
+				&rpc_hnd->wire_handle.uuid, rpc_hnd);
 	TALLOC_FREE(rpc_hnd);
 
 	return true;
@@ -23,20 +23,6 @@
 #include "smbd/globals.h"
 #include "../lib/util/tevent_ntstatus.h"
 
-#if defined(WITH_AIO)
-
-/* The signal we'll use to signify aio done. */
-#ifndef RT_SIGNAL_AIO
-#define RT_SIGNAL_AIO	(SIGRTMIN+3)
-#endif
-
-#ifndef HAVE_STRUCT_SIGEVENT_SIGEV_VALUE_SIVAL_PTR
-#ifdef HAVE_STRUCT_SIGEVENT_SIGEV_VALUE_SIGVAL_PTR
-#define sival_int	sigval_int
-#define sival_ptr	sigval_ptr
-#endif
-#endif
-
 /****************************************************************************
  The buffer we keep around whilst an aio request is in process.
 *****************************************************************************/
@@ -50,8 +36,88 @@ struct aio_extra {
 	struct lock_struct lock;
 	bool write_through;
 	int (*handle_completion)(struct aio_extra *ex, int errcode);
+
+	/*
+	 * For requests handed to the SMB_VFS_PREAD_SEND and friends,
+	 * req is the pending VFS request. acb is unused then.
+	 */
+	struct tevent_req *req;
+	SMB_OFF_T offset;
+	size_t nbyte;
 };
 
+static int aio_extra_destructor(struct aio_extra *aio_ex)
+{
+	DLIST_REMOVE(aio_list_head, aio_ex);
+	return 0;
+}
+
+/****************************************************************************
+ Create the extended aio struct we must keep around for the lifetime
+ of the aio call.
+*****************************************************************************/
+
+static struct aio_extra *create_aio_extra(TALLOC_CTX *mem_ctx,
+					files_struct *fsp,
+					size_t buflen)
+{
+	struct aio_extra *aio_ex = talloc_zero(mem_ctx, struct aio_extra);
+
+	if (!aio_ex) {
+		return NULL;
+	}
+
+	/* The output buffer stored in the aio_ex is the start of
+	   the smb return buffer. The buffer used in the acb
+	   is the start of the reply data portion of that buffer. */
+
+	if (buflen) {
+		aio_ex->outbuf = data_blob_talloc(aio_ex, NULL, buflen);
+		if (!aio_ex->outbuf.data) {
+			TALLOC_FREE(aio_ex);
+			return NULL;
+		}
+	}
+	DLIST_ADD(aio_list_head, aio_ex);
+	talloc_set_destructor(aio_ex, aio_extra_destructor);
+	aio_ex->fsp = fsp;
+	return aio_ex;
+}
+
+/****************************************************************************
+ Detach the VFS async requests pending on an fsp that is about to be
+ closed. The helper threads work on their own file descriptor, so the
+ requests are left to finish; their completion only reports
+ NT_STATUS_FILE_CLOSED to the client.
+*****************************************************************************/
+
+static void detach_vfs_aio_by_fsp(files_struct *fsp)
+{
+	struct aio_extra *aio_ex;
+
+	for (aio_ex = aio_list_head; aio_ex; aio_ex = aio_ex->next) {
+		if ((aio_ex->req == NULL) || (aio_ex->fsp != fsp)) {
+			continue;
+		}
+		SMB_VFS_STRICT_UNLOCK(fsp->conn, fsp, &aio_ex->lock);
+		aio_ex->fsp = NULL;
+	}
+}
+
+#if defined(WITH_AIO)
+
+/* The signal we'll use to signify aio done. */
+#ifndef RT_SIGNAL_AIO
+#define RT_SIGNAL_AIO	(SIGRTMIN+3)
+#endif
+
+#ifndef HAVE_STRUCT_SIGEVENT_SIGEV_VALUE_SIVAL_PTR
+#ifdef HAVE_STRUCT_SIGEVENT_SIGEV_VALUE_SIGVAL_PTR
+#define sival_int	sigval_int
+#define sival_ptr	sigval_ptr
+#endif
+#endif
+
 /****************************************************************************
  Initialize the signal handler for aio read/write.
 *****************************************************************************/
@@ -98,46 +164,6 @@ static bool initialize_async_io_handler(void)
 
 static int handle_aio_read_complete(struct aio_extra *aio_ex, int errcode);
 static int handle_aio_write_complete(struct aio_extra *aio_ex, int errcode);
-static int handle_aio_smb2_read_complete(struct aio_extra *aio_ex, int errcode);
-static int handle_aio_smb2_write_complete(struct aio_extra *aio_ex, int errcode);
-
-static int aio_extra_destructor(struct aio_extra *aio_ex)
-{
-	DLIST_REMOVE(aio_list_head, aio_ex);
-	return 0;
-}
-
-/****************************************************************************
- Create the extended aio struct we must keep around for the lifetime
- of the aio call.
-*****************************************************************************/
-
-static struct aio_extra *create_aio_extra(TALLOC_CTX *mem_ctx,
-					files_struct *fsp,
-					size_t buflen)
-{
-	struct aio_extra *aio_ex = talloc_zero(mem_ctx, struct aio_extra);
-
-	if (!aio_ex) {
-		return NULL;
-	}
-
-	/* The output buffer stored in the aio_ex is the start of
-	   the smb return buffer. The buffer used in the acb
-	   is the start of the reply data portion of that buffer. */
-
-	if (buflen) {
-		aio_ex->outbuf = data_blob_talloc(aio_ex, NULL, buflen);
-		if (!aio_ex->outbuf.data) {
-			TALLOC_FREE(aio_ex);
-			return NULL;
-		}
-	}
-	DLIST_ADD(aio_list_head, aio_ex);
-	talloc_set_destructor(aio_ex, aio_extra_destructor);
-	aio_ex->fsp = fsp;
-	return aio_ex;
-}
 
 /****************************************************************************
  Set up an aio request from a SMBreadX call.
@@ -381,288 +407,69 @@ NTSTATUS schedule_aio_write_and_X(connection_struct *conn,
 }
 
 /****************************************************************************
- Set up an aio request from a SMB2 read call.
+ Complete the read and return the data or error back to the client.
+ Returns errno or zero if all ok.
 *****************************************************************************/
 
-NTSTATUS schedule_smb2_aio_read(connection_struct *conn,
-				struct smb_request *smbreq,
-				files_struct *fsp,
-				TALLOC_CTX *ctx,
-				DATA_BLOB *preadbuf,
-				SMB_OFF_T startpos,
-				size_t smb_maxcnt)
+static int handle_aio_read_complete(struct aio_extra *aio_ex, int errcode)
 {
-	struct aio_extra *aio_ex;
-	SMB_STRUCT_AIOCB *a;
-	size_t min_aio_read_size = lp_aio_read_size(SNUM(conn));
-	int ret;
-
-	/* Ensure aio is initialized. */
-	if (!initialize_async_io_handler()) {
-		return NT_STATUS_RETRY;
-	}
-
-	if (fsp->base_fsp != NULL) {
-		/* No AIO on streams yet */
-		DEBUG(10, ("AIO on streams not yet supported\n"));
-		return NT_STATUS_RETRY;
-	}
-
-	if ((!min_aio_read_size || (smb_maxcnt < min_aio_read_size))
-	    && !SMB_VFS_AIO_FORCE(fsp)) {
-		/* Too small a read for aio request. */
-		DEBUG(10,("smb2: read size (%u) too small "
-			"for minimum aio_read of %u\n",
-			(unsigned int)smb_maxcnt,
-			(unsigned int)min_aio_read_size ));
-		return NT_STATUS_RETRY;
-	}
+	int outsize;
+	char *outbuf = (char *)aio_ex->outbuf.data;
+	char *data = smb_buf(outbuf);
+	ssize_t nread = SMB_VFS_AIO_RETURN(aio_ex->fsp,&aio_ex->acb);
 
-	/* Only do this on reads not using the write cache. */
-	if (lp_write_cache_size(SNUM(conn)) != 0) {
-		return NT_STATUS_RETRY;
-	}
+	if (nread < 0) {
+		/* We're relying here on the fact that if the fd is
+		   closed then the aio will complete and aio_return
+		   will return an error. Hopefully this is
+		   true.... JRA. */
 
-	if (outstanding_aio_calls >= aio_pending_size) {
-		DEBUG(10,("smb2: Already have %d aio "
-			"activities outstanding.\n",
-			outstanding_aio_calls ));
-		return NT_STATUS_RETRY;
-	}
+		DEBUG( 3,( "handle_aio_read_complete: file %s nread == %d. "
+			   "Error = %s\n",
+			   fsp_str_dbg(aio_ex->fsp), (int)nread, strerror(errcode)));
 
-	/* Create the out buffer. */
-	*preadbuf = data_blob_talloc(ctx, NULL, smb_maxcnt);
-	if (preadbuf->data == NULL) {
-		return NT_STATUS_NO_MEMORY;
-	}
+		ERROR_NT(map_nt_error_from_unix(errcode));
+		outsize = srv_set_message(outbuf,0,0,true);
+	} else {
+		outsize = srv_set_message(outbuf,12,nread,False);
+		SSVAL(outbuf,smb_vwv2,0xFFFF); /* Remaining - must be * -1. */
+		SSVAL(outbuf,smb_vwv5,nread);
+		SSVAL(outbuf,smb_vwv6,smb_offset(data,outbuf));
+		SSVAL(outbuf,smb_vwv7,((nread >> 16) & 1));
+		SSVAL(smb_buf(outbuf),-2,nread);
 
-	if (!(aio_ex = create_aio_extra(smbreq->smb2req, fsp, 0))) {
-		return NT_STATUS_NO_MEMORY;
-	}
-	aio_ex->handle_completion = handle_aio_smb2_read_complete;
+		aio_ex->fsp->fh->pos = aio_ex->acb.aio_offset + nread;
+		aio_ex->fsp->fh->position_information = aio_ex->fsp->fh->pos;
 
-	init_strict_lock_struct(fsp, (uint64_t)smbreq->smbpid,
-		(uint64_t)startpos, (uint64_t)smb_maxcnt, READ_LOCK,
-		&aio_ex->lock);
+		DEBUG( 3, ( "handle_aio_read_complete file %s max=%d "
+			    "nread=%d\n",
+			    fsp_str_dbg(aio_ex->fsp),
+			    (int)aio_ex->acb.aio_nbytes, (int)nread ) );
 
-	/* Take the lock until the AIO completes. */
-	if (!SMB_VFS_STRICT_LOCK(conn, fsp, &aio_ex->lock)) {
-		TALLOC_FREE(aio_ex);
-		return NT_STATUS_FILE_LOCK_CONFLICT;
 	}
-
-	a = &aio_ex->acb;
-
-	/* Now set up the aio record for the read call. */
-
-	a->aio_fildes = fsp->fh->fd;
-	a->aio_buf = preadbuf->data;
-	a->aio_nbytes = smb_maxcnt;
-	a->aio_offset = startpos;
-	a->aio_sigevent.sigev_notify = SIGEV_SIGNAL;
-	a->aio_sigevent.sigev_signo  = RT_SIGNAL_AIO;
-	a->aio_sigevent.sigev_value.sival_ptr = aio_ex;
-
-	ret = SMB_VFS_AIO_READ(fsp, a);
-	if (ret == -1) {
-		DEBUG(0,("smb2: aio_read failed. "
-			"Error %s\n", strerror(errno) ));
-		SMB_VFS_STRICT_UNLOCK(conn, fsp, &aio_ex->lock);
-		TALLOC_FREE(aio_ex);
-		return NT_STATUS_RETRY;
+	smb_setlen(outbuf,outsize - 4);
+	show_msg(outbuf);
+	if (!srv_send_smb(aio_ex->smbreq->sconn, outbuf,
+			true, aio_ex->smbreq->seqnum+1,
+			IS_CONN_ENCRYPTED(aio_ex->fsp->conn), NULL)) {
+		exit_server_cleanly("handle_aio_read_complete: srv_send_smb "
+				    "failed.");
 	}
 
-	outstanding_aio_calls++;
-	/* We don't need talloc_move here as both aio_ex and
-	 * smbreq are children of smbreq->smb2req. */
-	aio_ex->smbreq = smbreq;
-
-	DEBUG(10,("smb2: scheduled aio_read for file %s, "
-		"offset %.0f, len = %u (mid = %u)\n",
-		fsp_str_dbg(fsp), (double)startpos, (unsigned int)smb_maxcnt,
-		(unsigned int)aio_ex->smbreq->mid ));
+	DEBUG(10,("handle_aio_read_complete: scheduled aio_read completed "
+		  "for file %s, offset %.0f, len = %u\n",
+		  fsp_str_dbg(aio_ex->fsp), (double)aio_ex->acb.aio_offset,
+		  (unsigned int)nread ));
 
-	return NT_STATUS_OK;
+	return errcode;
 }
 
 /****************************************************************************
- Set up an aio request from a SMB2write call.
+ Complete the write and return the data or error back to the client.
+ Returns error code or zero if all ok.
 *****************************************************************************/
 
-NTSTATUS schedule_aio_smb2_write(connection_struct *conn,
-				struct smb_request *smbreq,
-				files_struct *fsp,
-				uint64_t in_offset,
-				DATA_BLOB in_data,
-				bool write_through)
-{
-	struct aio_extra *aio_ex = NULL;
-	SMB_STRUCT_AIOCB *a = NULL;
-	size_t min_aio_write_size = lp_aio_write_size(SNUM(conn));
-	int ret;
-
-	/* Ensure aio is initialized. */
-	if (!initialize_async_io_handler()) {
-		return NT_STATUS_RETRY;
-	}
-
-	if (fsp->base_fsp != NULL) {
-		/* No AIO on streams yet */
-		DEBUG(10, ("AIO on streams not yet supported\n"));
-		return NT_STATUS_RETRY;
-	}
-
-	if ((!min_aio_write_size || (in_data.length < min_aio_write_size))
-	    && !SMB_VFS_AIO_FORCE(fsp)) {
-		/* Too small a write for aio request. */
-		DEBUG(10,("smb2: write size (%u) too "
-			"small for minimum aio_write of %u\n",
-			(unsigned int)in_data.length,
-			(unsigned int)min_aio_write_size ));
-		return NT_STATUS_RETRY;
-	}
-
-	/* Only do this on writes not using the write cache. */
-	if (lp_write_cache_size(SNUM(conn)) != 0) {
-		return NT_STATUS_RETRY;
-	}
-
-	if (outstanding_aio_calls >= aio_pending_size) {
-		DEBUG(3,("smb2: Already have %d aio "
-			"activities outstanding.\n",
-			outstanding_aio_calls ));
-		return NT_STATUS_RETRY;
-	}
-
-	if (!(aio_ex = create_aio_extra(smbreq->smb2req, fsp, 0))) {
-		return NT_STATUS_NO_MEMORY;
-	}
-
-	aio_ex->handle_completion = handle_aio_smb2_write_complete;
-	aio_ex->write_through = write_through;
-
-	init_strict_lock_struct(fsp, (uint64_t)smbreq->smbpid,
-		in_offset, (uint64_t)in_data.length, WRITE_LOCK,
-		&aio_ex->lock);
-
-	/* Take the lock until the AIO completes. */
-	if (!SMB_VFS_STRICT_LOCK(conn, fsp, &aio_ex->lock)) {
-		TALLOC_FREE(aio_ex);
-		return NT_STATUS_FILE_LOCK_CONFLICT;
-	}
-
-	a = &aio_ex->acb;
-
-	/* Now set up the aio record for the write call. */
-
-	a->aio_fildes = fsp->fh->fd;
-	a->aio_buf = in_data.data;
-	a->aio_nbytes = in_data.length;
-	a->aio_offset = in_offset;
-	a->aio_sigevent.sigev_notify = SIGEV_SIGNAL;
-	a->aio_sigevent.sigev_signo  = RT_SIGNAL_AIO;
-	a->aio_sigevent.sigev_value.sival_ptr = aio_ex;
-
-	ret = SMB_VFS_AIO_WRITE(fsp, a);
-	if (ret == -1) {
-		DEBUG(3,("smb2: aio_write failed. "
-			"Error %s\n", strerror(errno) ));
-		SMB_VFS_STRICT_UNLOCK(conn, fsp, &aio_ex->lock);
-		TALLOC_FREE(aio_ex);
-		return NT_STATUS_RETRY;
-	}
-
-	outstanding_aio_calls++;
-	/* We don't need talloc_move here as both aio_ex and
-	* smbreq are children of smbreq->smb2req. */
-	aio_ex->smbreq = smbreq;
-
-	/* This should actually be improved to span the write. */
-	contend_level2_oplocks_begin(fsp, LEVEL2_CONTEND_WRITE);
-	contend_level2_oplocks_end(fsp, LEVEL2_CONTEND_WRITE);
-
-	/*
-	 * We don't want to do write behind due to ownership
-	 * issues of the request structs. Maybe add it if I
-	 * figure those out. JRA.
-	 */
-
-	DEBUG(10,("smb2: scheduled aio_write for file "
-		"%s, offset %.0f, len = %u (mid = %u) "
-		"outstanding_aio_calls = %d\n",
-		fsp_str_dbg(fsp),
-		(double)in_offset,
-		(unsigned int)in_data.length,
-		(unsigned int)aio_ex->smbreq->mid,
-		outstanding_aio_calls ));
-
-	return NT_STATUS_OK;
-}
-
-/****************************************************************************
- Complete the read and return the data or error back to the client.
- Returns errno or zero if all ok.
-*****************************************************************************/
-
-static int handle_aio_read_complete(struct aio_extra *aio_ex, int errcode)
-{
-	int outsize;
-	char *outbuf = (char *)aio_ex->outbuf.data;
-	char *data = smb_buf(outbuf);
-	ssize_t nread = SMB_VFS_AIO_RETURN(aio_ex->fsp,&aio_ex->acb);
-
-	if (nread < 0) {
-		/* We're relying here on the fact that if the fd is
-		   closed then the aio will complete and aio_return
-		   will return an error. Hopefully this is
-		   true.... JRA. */
-
-		DEBUG( 3,( "handle_aio_read_complete: file %s nread == %d. "
-			   "Error = %s\n",
-			   fsp_str_dbg(aio_ex->fsp), (int)nread, strerror(errcode)));
-
-		ERROR_NT(map_nt_error_from_unix(errcode));
-		outsize = srv_set_message(outbuf,0,0,true);
-	} else {
-		outsize = srv_set_message(outbuf,12,nread,False);
-		SSVAL(outbuf,smb_vwv2,0xFFFF); /* Remaining - must be * -1. */
-		SSVAL(outbuf,smb_vwv5,nread);
-		SSVAL(outbuf,smb_vwv6,smb_offset(data,outbuf));
-		SSVAL(outbuf,smb_vwv7,((nread >> 16) & 1));
-		SSVAL(smb_buf(outbuf),-2,nread);
-
-		aio_ex->fsp->fh->pos = aio_ex->acb.aio_offset + nread;
-		aio_ex->fsp->fh->position_information = aio_ex->fsp->fh->pos;
-
-		DEBUG( 3, ( "handle_aio_read_complete file %s max=%d "
-			    "nread=%d\n",
-			    fsp_str_dbg(aio_ex->fsp),
-			    (int)aio_ex->acb.aio_nbytes, (int)nread ) );
-
-	}
-	smb_setlen(outbuf,outsize - 4);
-	show_msg(outbuf);
-	if (!srv_send_smb(aio_ex->smbreq->sconn, outbuf,
-			true, aio_ex->smbreq->seqnum+1,
-			IS_CONN_ENCRYPTED(aio_ex->fsp->conn), NULL)) {
-		exit_server_cleanly("handle_aio_read_complete: srv_send_smb "
-				    "failed.");
-	}
-
-	DEBUG(10,("handle_aio_read_complete: scheduled aio_read completed "
-		  "for file %s, offset %.0f, len = %u\n",
-		  fsp_str_dbg(aio_ex->fsp), (double)aio_ex->acb.aio_offset,
-		  (unsigned int)nread ));
-
-	return errcode;
-}
-
-/****************************************************************************
- Complete the write and return the data or error back to the client.
- Returns error code or zero if all ok.
-*****************************************************************************/
-
-static int handle_aio_write_complete(struct aio_extra *aio_ex, int errcode)
+static int handle_aio_write_complete(struct aio_extra *aio_ex, int errcode)
 {
 	files_struct *fsp = aio_ex->fsp;
 	char *outbuf = (char *)aio_ex->outbuf.data;
@@ -747,79 +554,6 @@ static int handle_aio_write_complete(struct aio_extra *aio_ex, int errcode)
 	return errcode;
 }
 
-/****************************************************************************
- Complete the read and return the data or error back to the client.
- Returns errno or zero if all ok.
-*****************************************************************************/
-
-static int handle_aio_smb2_read_complete(struct aio_extra *aio_ex, int errcode)
-{
-	NTSTATUS status;
-	struct tevent_req *subreq = aio_ex->smbreq->smb2req->subreq;
-	ssize_t nread = SMB_VFS_AIO_RETURN(aio_ex->fsp,&aio_ex->acb);
-
-	/* Common error or success code processing for async or sync
-	   read returns. */
-
-	status = smb2_read_complete(subreq, nread, errcode);
-
-	if (nread > 0) {
-		aio_ex->fsp->fh->pos = aio_ex->acb.aio_offset + nread;
-		aio_ex->fsp->fh->position_information = aio_ex->fsp->fh->pos;
-	}
-
-	DEBUG(10,("smb2: scheduled aio_read completed "
-		"for file %s, offset %.0f, len = %u "
-		"(errcode = %d, NTSTATUS = %s)\n",
-		fsp_str_dbg(aio_ex->fsp),
-		(double)aio_ex->acb.aio_offset,
-		(unsigned int)nread,
-		errcode,
-		nt_errstr(status) ));
-
-	if (!NT_STATUS_IS_OK(status)) {
-		tevent_req_nterror(subreq, status);
-		return errcode;
-	}
-
-	tevent_req_done(subreq);
-	return errcode;
-}
-
-/****************************************************************************
- Complete the SMB2 write and return the data or error back to the client.
- Returns error code or zero if all ok.
-*****************************************************************************/
-
-static int handle_aio_smb2_write_complete(struct aio_extra *aio_ex, int errcode)
-{
-	files_struct *fsp = aio_ex->fsp;
-	ssize_t numtowrite = aio_ex->acb.aio_nbytes;
-	ssize_t nwritten = SMB_VFS_AIO_RETURN(fsp,&aio_ex->acb);
-	struct tevent_req *subreq = aio_ex->smbreq->smb2req->subreq;
-	NTSTATUS status;
-
-	status = smb2_write_complete(subreq, nwritten, errcode);
-
-	DEBUG(10,("smb2: scheduled aio_write completed "
-		"for file %s, offset %.0f, requested %u, "
-		"written = %u (errcode = %d, NTSTATUS = %s)\n",
-		fsp_str_dbg(fsp),
-		(double)aio_ex->acb.aio_offset,
-		(unsigned int)numtowrite,
-		(unsigned int)nwritten,
-		errcode,
-		nt_errstr(status) ));
-
-	if (!NT_STATUS_IS_OK(status)) {
-		tevent_req_nterror(subreq, status);
-		return errcode;
-	}
-
-	tevent_req_done(subreq);
-	return errcode;
-}
-
 /****************************************************************************
  Handle any aio completion. Returns True if finished (and sets *perr if err
  was non-zero), False if not.
@@ -914,6 +648,8 @@ int wait_for_aio_completion(files_struct *fsp)
 	time_t start_time = time_mono(NULL);
 	int seconds_left;
 
+	detach_vfs_aio_by_fsp(fsp);
+
 	for (seconds_left = SMB_TIME_FOR_AIO_COMPLETE_WAIT;
 	     seconds_left >= 0;) {
 		int err = 0;
@@ -1006,6 +742,8 @@ void cancel_aio_by_fsp(files_struct *fsp)
 {
 	struct aio_extra *aio_ex;
 
+	detach_vfs_aio_by_fsp(fsp);
+
 	for( aio_ex = aio_list_head; aio_ex; aio_ex = aio_ex->next) {
 		if (aio_ex->fsp == fsp) {
 			/* Unlock now we're done. */
@@ -1039,17 +777,189 @@ NTSTATUS schedule_aio_write_and_X(connection_struct *conn,
 	return NT_STATUS_RETRY;
 }
 
+void cancel_aio_by_fsp(files_struct *fsp)
+{
+	detach_vfs_aio_by_fsp(fsp);
+}
+
+int wait_for_aio_completion(files_struct *fsp)
+{
+	detach_vfs_aio_by_fsp(fsp);
+	return 0;
+}
+
+void smbd_aio_complete_mid(uint64_t mid);
+
+#endif
+
+/****************************************************************************
+ Upper bound for the SMB2 reads and writes handed to the VFS async
+ calls at any one time. Beyond that we fall back to synchronous I/O.
+*****************************************************************************/
+
+static int smb2_aio_pending_max(void)
+{
+	return lp_parm_int(-1, "smbd", "aio max pending", 1000);
+}
+
+static void aio_pread_smb2_done(struct tevent_req *req);
+
+/****************************************************************************
+ Set up an aio request from a SMB2 read call.
+*****************************************************************************/
+
 NTSTATUS schedule_smb2_aio_read(connection_struct *conn,
-                                struct smb_request *smbreq,
-                                files_struct *fsp,
+				struct smb_request *smbreq,
+				files_struct *fsp,
 				TALLOC_CTX *ctx,
 				DATA_BLOB *preadbuf,
-                                SMB_OFF_T startpos,
-                                size_t smb_maxcnt)
+				SMB_OFF_T startpos,
+				size_t smb_maxcnt)
 {
-	return NT_STATUS_RETRY;
+	struct aio_extra *aio_ex;
+	size_t min_aio_read_size = lp_aio_read_size(SNUM(conn));
+
+	if (fsp->base_fsp != NULL) {
+		/* No AIO on streams yet */
+		DEBUG(10, ("AIO on streams not yet supported\n"));
+		return NT_STATUS_RETRY;
+	}
+
+	if ((!min_aio_read_size || (smb_maxcnt < min_aio_read_size))
+	    && !SMB_VFS_AIO_FORCE(fsp)) {
+		/* Too small a read for aio request. */
+		DEBUG(10,("smb2: read size (%u) too small "
+			"for minimum aio_read of %u\n",
+			(unsigned int)smb_maxcnt,
+			(unsigned int)min_aio_read_size ));
+		return NT_STATUS_RETRY;
+	}
+
+	/* Only do this on reads not using the write cache. */
+	if (lp_write_cache_size(SNUM(conn)) != 0) {
+		return NT_STATUS_RETRY;
+	}
+
+	if (outstanding_aio_calls >= smb2_aio_pending_max()) {
+		DEBUG(10,("smb2: Already have %d aio "
+			"activities outstanding.\n",
+			outstanding_aio_calls ));
+		return NT_STATUS_RETRY;
+	}
+
+	/* Create the out buffer. */
+	*preadbuf = data_blob_talloc(ctx, NULL, smb_maxcnt);
+	if (preadbuf->data == NULL) {
+		return NT_STATUS_NO_MEMORY;
+	}
+
+	if (!(aio_ex = create_aio_extra(smbreq->smb2req, fsp, 0))) {
+		return NT_STATUS_NO_MEMORY;
+	}
+	aio_ex->offset = startpos;
+	aio_ex->nbyte = smb_maxcnt;
+
+	init_strict_lock_struct(fsp, (uint64_t)smbreq->smbpid,
+		(uint64_t)startpos, (uint64_t)smb_maxcnt, READ_LOCK,
+		&aio_ex->lock);
+
+	/* Take the lock until the AIO completes. */
+	if (!SMB_VFS_STRICT_LOCK(conn, fsp, &aio_ex->lock)) {
+		TALLOC_FREE(aio_ex);
+		return NT_STATUS_FILE_LOCK_CONFLICT;
+	}
+
+	aio_ex->req = SMB_VFS_PREAD_SEND(aio_ex, server_event_context(), fsp,
+					 preadbuf->data, smb_maxcnt, startpos);
+	if (aio_ex->req == NULL) {
+		DEBUG(3,("smb2: SMB_VFS_PREAD_SEND failed. "
+			"Error %s\n", strerror(errno) ));
+		SMB_VFS_STRICT_UNLOCK(conn, fsp, &aio_ex->lock);
+		TALLOC_FREE(aio_ex);
+		return NT_STATUS_RETRY;
+	}
+	tevent_req_set_callback(aio_ex->req, aio_pread_smb2_done, aio_ex);
+
+	outstanding_aio_calls++;
+	/* We don't need talloc_move here as both aio_ex and
+	 * smbreq are children of smbreq->smb2req. */
+	aio_ex->smbreq = smbreq;
+
+	DEBUG(10,("smb2: scheduled aio_read for file %s, "
+		"offset %.0f, len = %u (mid = %u)\n",
+		fsp_str_dbg(fsp), (double)startpos, (unsigned int)smb_maxcnt,
+		(unsigned int)aio_ex->smbreq->mid ));
+
+	return NT_STATUS_OK;
+}
+
+/****************************************************************************
+ Complete the SMB2 read and return the data or error back to the client.
+*****************************************************************************/
+
+static void aio_pread_smb2_done(struct tevent_req *req)
+{
+	struct aio_extra *aio_ex = tevent_req_callback_data(
+		req, struct aio_extra);
+	struct tevent_req *subreq = aio_ex->smbreq->smb2req->subreq;
+	files_struct *fsp = aio_ex->fsp;
+	NTSTATUS status;
+	ssize_t nread;
+	int err = 0;
+
+	nread = SMB_VFS_PREAD_RECV(req, &err);
+	TALLOC_FREE(req);
+	aio_ex->req = NULL;
+
+	outstanding_aio_calls--;
+
+	if (fsp == NULL) {
+		/* file was closed whilst I/O was outstanding. */
+		DEBUG(3, ("smb2: file closed whilst aio read outstanding "
+			  "(mid[%llu])\n",
+			  (unsigned long long)aio_ex->smbreq->mid));
+		TALLOC_FREE(aio_ex);
+		tevent_req_nterror(subreq, NT_STATUS_FILE_CLOSED);
+		return;
+	}
+
+	/* Unlock now we're done. */
+	SMB_VFS_STRICT_UNLOCK(fsp->conn, fsp, &aio_ex->lock);
+
+	/* Common error or success code processing for async or sync
+	   read returns. */
+
+	status = smb2_read_complete(subreq, nread, err);
+
+	if (nread > 0) {
+		fsp->fh->pos = aio_ex->offset + nread;
+		fsp->fh->position_information = fsp->fh->pos;
+	}
+
+	DEBUG(10,("smb2: scheduled aio_read completed "
+		"for file %s, offset %.0f, len = %u "
+		"(errcode = %d, NTSTATUS = %s)\n",
+		fsp_str_dbg(fsp),
+		(double)aio_ex->offset,
+		(unsigned int)nread,
+		err,
+		nt_errstr(status) ));
+
+	TALLOC_FREE(aio_ex);
+
+	if (!NT_STATUS_IS_OK(status)) {
+		tevent_req_nterror(subreq, status);
+		return;
+	}
+	tevent_req_done(subreq);
 }
 
+static void aio_pwrite_smb2_done(struct tevent_req *req);
+
+/****************************************************************************
+ Set up an aio request from a SMB2write call.
+*****************************************************************************/
+
 NTSTATUS schedule_aio_smb2_write(connection_struct *conn,
 				struct smb_request *smbreq,
 				files_struct *fsp,
@@ -1057,18 +967,144 @@ NTSTATUS schedule_aio_smb2_write(connection_struct *conn,
 				DATA_BLOB in_data,
 				bool write_through)
 {
-	return NT_STATUS_RETRY;
-}
+	struct aio_extra *aio_ex = NULL;
+	size_t min_aio_write_size = lp_aio_write_size(SNUM(conn));
 
-void cancel_aio_by_fsp(files_struct *fsp)
-{
+	if (fsp->base_fsp != NULL) {
+		/* No AIO on streams yet */
+		DEBUG(10, ("AIO on streams not yet supported\n"));
+		return NT_STATUS_RETRY;
+	}
+
+	if ((!min_aio_write_size || (in_data.length < min_aio_write_size))
+	    && !SMB_VFS_AIO_FORCE(fsp)) {
+		/* Too small a write for aio request. */
+		DEBUG(10,("smb2: write size (%u) too "
+			"small for minimum aio_write of %u\n",
+			(unsigned int)in_data.length,
+			(unsigned int)min_aio_write_size ));
+		return NT_STATUS_RETRY;
+	}
+
+	/* Only do this on writes not using the write cache. */
+	if (lp_write_cache_size(SNUM(conn)) != 0) {
+		return NT_STATUS_RETRY;
+	}
+
+	if (outstanding_aio_calls >= smb2_aio_pending_max()) {
+		DEBUG(3,("smb2: Already have %d aio "
+			"activities outstanding.\n",
+			outstanding_aio_calls ));
+		return NT_STATUS_RETRY;
+	}
+
+	if (!(aio_ex = create_aio_extra(smbreq->smb2req, fsp, 0))) {
+		return NT_STATUS_NO_MEMORY;
+	}
+
+	aio_ex->write_through = write_through;
+	aio_ex->offset = in_offset;
+	aio_ex->nbyte = in_data.length;
+
+	init_strict_lock_struct(fsp, (uint64_t)smbreq->smbpid,
+		in_offset, (uint64_t)in_data.length, WRITE_LOCK,
+		&aio_ex->lock);
+
+	/* Take the lock until the AIO completes. */
+	if (!SMB_VFS_STRICT_LOCK(conn, fsp, &aio_ex->lock)) {
+		TALLOC_FREE(aio_ex);
+		return NT_STATUS_FILE_LOCK_CONFLICT;
+	}
+
+	aio_ex->req = SMB_VFS_PWRITE_SEND(aio_ex, server_event_context(), fsp,
+					  in_data.data, in_data.length,
+					  in_offset);
+	if (aio_ex->req == NULL) {
+		DEBUG(3,("smb2: SMB_VFS_PWRITE_SEND failed. "
+			"Error %s\n", strerror(errno) ));
+		SMB_VFS_STRICT_UNLOCK(conn, fsp, &aio_ex->lock);
+		TALLOC_FREE(aio_ex);
+		return NT_STATUS_RETRY;
+	}
+	tevent_req_set_callback(aio_ex->req, aio_pwrite_smb2_done, aio_ex);
+
+	outstanding_aio_calls++;
+	/* We don't need talloc_move here as both aio_ex and
+	* smbreq are children of smbreq->smb2req. */
+	aio_ex->smbreq = smbreq;
+
+	/* This should actually be improved to span the write. */
+	contend_level2_oplocks_begin(fsp, LEVEL2_CONTEND_WRITE);
+	contend_level2_oplocks_end(fsp, LEVEL2_CONTEND_WRITE);
+
+	/*
+	 * We don't want to do write behind due to ownership
+	 * issues of the request structs. Maybe add it if I
+	 * figure those out. JRA.
+	 */
+
+	DEBUG(10,("smb2: scheduled aio_write for file "
+		"%s, offset %.0f, len = %u (mid = %u) "
+		"outstanding_aio_calls = %d\n",
+		fsp_str_dbg(fsp),
+		(double)in_offset,
+		(unsigned int)in_data.length,
+		(unsigned int)aio_ex->smbreq->mid,
+		outstanding_aio_calls ));
+
+	return NT_STATUS_OK;
 }
 
-int wait_for_aio_completion(files_struct *fsp)
+/****************************************************************************
+ Complete the SMB2 write and return the data or error back to the client.
+*****************************************************************************/
+
+static void aio_pwrite_smb2_done(struct tevent_req *req)
 {
-	return 0;
-}
+	struct aio_extra *aio_ex = tevent_req_callback_data(
+		req, struct aio_extra);
+	struct tevent_req *subreq = aio_ex->smbreq->smb2req->subreq;
+	files_struct *fsp = aio_ex->fsp;
+	NTSTATUS status;
+	ssize_t nwritten;
+	int err = 0;
 
-void smbd_aio_complete_mid(uint64_t mid);
+	nwritten = SMB_VFS_PWRITE_RECV(req, &err);
+	TALLOC_FREE(req);
+	aio_ex->req = NULL;
 
-#endif
+	outstanding_aio_calls--;
+
+	if (fsp == NULL) {
+		/* file was closed whilst I/O was outstanding. */
+		DEBUG(3, ("smb2: file closed whilst aio write outstanding "
+			  "(mid[%llu])\n",
+			  (unsigned long long)aio_ex->smbreq->mid));
+		TALLOC_FREE(aio_ex);
+		tevent_req_nterror(subreq, NT_STATUS_FILE_CLOSED);
+		return;
+	}
+
+	/* Unlock now we're done. */
+	SMB_VFS_STRICT_UNLOCK(fsp->conn, fsp, &aio_ex->lock);
+
+	status = smb2_write_complete(subreq, nwritten, err);
+
+	DEBUG(10,("smb2: scheduled aio_write completed "
+		"for file %s, offset %.0f, requested %u, "
+		"written = %u (errcode = %d, NTSTATUS = %s)\n",
+		fsp_str_dbg(fsp),
+		(double)aio_ex->offset,
+		(unsigned int)aio_ex->nbyte,
+		(unsigned int)nwritten,
+		err,
+		nt_errstr(status) ));
+
+	TALLOC_FREE(aio_ex);
+
+	if (!NT_STATUS_IS_OK(status)) {
+		tevent_req_nterror(subreq, status);
+		return;
+	}
+	tevent_req_done(subreq);
+}
@@ -1077,6 +1077,20 @@ static int get_real_filename_full_scan(connection_struct *conn,
 		}
 	}
 
+	/*
+	 * Unmangled names can be looked up in the directory's name
+	 * index, which saves the scan below in large directories.
+	 */
+	if (!mangled &&
+	    dir_name_index_lookup(conn, path, name, mem_ctx, found_name)) {
+		TALLOC_FREE(unmangled_name);
+		if (*found_name == NULL) {
+			errno = ENOENT;
+			return -1;
+		}
+		return 0;
+	}
+
 	/* open the directory */
 	if (!(cur_dir = OpenDir(talloc_tos(), conn, path, NULL, 0))) {
 		DEBUG(3,("scan dir didn't open dir [%s]\n",path));
@@ -42,6 +42,49 @@ static unsigned long get_gen_count(struct smbd_server_connection *sconn)
 	return sconn->file_gen_counter;
 }
 
+/****************************************************************************
+ Maintain the chains of fsps hashed by file_id.
+****************************************************************************/
+
+static struct files_struct **file_id_hash_bucket(
+	struct smbd_server_connection *sconn, const struct file_id *id)
+{
+	uint32_t h = hash(id, 1, 0);
+
+	return &sconn->file_id_hash[h & (sconn->file_id_hash_size - 1)];
+}
+
+static void file_id_hash_add(struct smbd_server_connection *sconn,
+			     files_struct *fsp)
+{
+	struct files_struct **bucket = file_id_hash_bucket(sconn,
+							   &fsp->file_id);
+
+	fsp->fi_prev = NULL;
+	fsp->fi_next = *bucket;
+	if (fsp->fi_next != NULL) {
+		fsp->fi_next->fi_prev = fsp;
+	}
+	*bucket = fsp;
+}
+
+static void file_id_hash_remove(struct smbd_server_connection *sconn,
+				files_struct *fsp)
+{
+	if (fsp->fi_prev != NULL) {
+		fsp->fi_prev->fi_next = fsp->fi_next;
+	} else {
+		struct files_struct **bucket = file_id_hash_bucket(
+			sconn, &fsp->file_id);
+		SMB_ASSERT(*bucket == fsp);
+		*bucket = fsp->fi_next;
+	}
+	if (fsp->fi_next != NULL) {
+		fsp->fi_next->fi_prev = fsp->fi_prev;
+	}
+	fsp->fi_next = fsp->fi_prev = NULL;
+}
+
 /****************************************************************************
  Find first available file slot.
 ****************************************************************************/
@@ -64,8 +107,6 @@ NTSTATUS file_new(struct smb_request *req, connection_struct *conn,
 		sconn->first_file %= sconn->real_max_open_files;
 	}
 
-	/* TODO: Port the id-tree implementation from Samba4 */
-
 	i = bitmap_find(sconn->file_bmap, sconn->first_file);
 	if (i == -1) {
 		DEBUG(0,("ERROR! Out of file structures\n"));
@@ -118,11 +159,16 @@ NTSTATUS file_new(struct smb_request *req, connection_struct *conn,
 	status = create_synthetic_smb_fname(fsp, "", NULL, NULL,
 					    &fsp->fsp_name);
 	if (!NT_STATUS_IS_OK(status)) {
-		TALLOC_FREE(fsp);
+		bitmap_clear(sconn->file_bmap, i);
+		sconn->files_used -= 1;
 		TALLOC_FREE(fsp->fh);
+		TALLOC_FREE(fsp);
+		return status;
 	}
 
 	DLIST_ADD(sconn->files, fsp);
+	sconn->fnum_table[i] = fsp;
+	file_id_hash_add(sconn, fsp);
 
 	DEBUG(5,("allocated file structure %d, fnum = %d (%d used)\n",
 		 i, fsp->fnum, sconn->files_used));
@@ -131,13 +177,6 @@ NTSTATUS file_new(struct smb_request *req, connection_struct *conn,
 		req->chain_fsp = fsp;
 	}
 
-	/* A new fsp invalidates the positive and
-	  negative fsp_fi_cache as the new fsp is pushed
-	  at the start of the list and we search from
-	  a cache hit to the *end* of the list. */
-
-	ZERO_STRUCT(sconn->fsp_fi_cache);
-
 	conn->num_files_open++;
 
 	*result = fsp;
@@ -213,6 +252,23 @@ bool file_init(struct smbd_server_connection *sconn)
 	if (!sconn->file_bmap) {
 		return false;
 	}
+
+	sconn->fnum_table = talloc_zero_array(sconn, struct files_struct *,
+					      sconn->real_max_open_files);
+	if (sconn->fnum_table == NULL) {
+		return false;
+	}
+
+	/* Power of two buckets, about one per possible open file */
+	sconn->file_id_hash_size = 1;
+	while (sconn->file_id_hash_size < sconn->real_max_open_files) {
+		sconn->file_id_hash_size <<= 1;
+	}
+	sconn->file_id_hash = talloc_zero_array(sconn, struct files_struct *,
+						sconn->file_id_hash_size);
+	if (sconn->file_id_hash == NULL) {
+		return false;
+	}
 	return true;
 }
 
@@ -283,16 +339,12 @@ files_struct *file_find_fd(struct smbd_server_connection *sconn, int fd)
 files_struct *file_find_dif(struct smbd_server_connection *sconn,
 			    struct file_id id, unsigned long gen_id)
 {
-	int count=0;
 	files_struct *fsp;
 
-	for (fsp=sconn->files; fsp; fsp=fsp->next,count++) {
+	for (fsp = *file_id_hash_bucket(sconn, &id); fsp; fsp = fsp->fi_next) {
 		/* We can have a fsp->fh->fd == -1 here as it could be a stat open. */
 		if (file_id_equal(&fsp->file_id, &id) &&
 		    fsp->fh->gen_id == gen_id ) {
-			if (count > 10) {
-				DLIST_PROMOTE(sconn->files, fsp);
-			}
 			/* Paranoia check. */
 			if ((fsp->fh->fd == -1) &&
 			    (fsp->oplock_type != NO_OPLOCK) &&
@@ -315,8 +367,6 @@ files_struct *file_find_dif(struct smbd_server_connection *sconn,
 
 /****************************************************************************
  Find the first fsp given a device and inode.
- We use a singleton cache here to speed up searching from getfilepathinfo
- calls.
 ****************************************************************************/
 
 files_struct *file_find_di_first(struct smbd_server_connection *sconn,
@@ -324,23 +374,12 @@ files_struct *file_find_di_first(struct smbd_server_connection *sconn,
 {
 	files_struct *fsp;
 
-	if (file_id_equal(&sconn->fsp_fi_cache.id, &id)) {
-		/* Positive or negative cache hit. */
-		return sconn->fsp_fi_cache.fsp;
-	}
-
-	sconn->fsp_fi_cache.id = id;
-
-	for (fsp=sconn->files;fsp;fsp=fsp->next) {
+	for (fsp = *file_id_hash_bucket(sconn, &id); fsp; fsp = fsp->fi_next) {
 		if (file_id_equal(&fsp->file_id, &id)) {
-			/* Setup positive cache. */
-			sconn->fsp_fi_cache.fsp = fsp;
 			return fsp;
 		}
 	}
 
-	/* Setup negative cache. */
-	sconn->fsp_fi_cache.fsp = NULL;
 	return NULL;
 }
 
@@ -352,7 +391,7 @@ files_struct *file_find_di_next(files_struct *start_fsp)
 {
 	files_struct *fsp;
 
-	for (fsp = start_fsp->next;fsp;fsp=fsp->next) {
+	for (fsp = start_fsp->fi_next; fsp; fsp = fsp->fi_next) {
 		if (file_id_equal(&fsp->file_id, &start_fsp->file_id)) {
 			return fsp;
 		}
@@ -361,6 +400,20 @@ files_struct *file_find_di_next(files_struct *start_fsp)
 	return NULL;
 }
 
+/****************************************************************************
+ Set the file_id of an fsp. This must be used instead of assigning
+ fsp->file_id so that the fsp can be found by file_find_di_first().
+****************************************************************************/
+
+void fsp_set_file_id(struct files_struct *fsp, struct file_id id)
+{
+	struct smbd_server_connection *sconn = fsp->conn->sconn;
+
+	file_id_hash_remove(sconn, fsp);
+	fsp->file_id = id;
+	file_id_hash_add(sconn, fsp);
+}
+
 /****************************************************************************
  Find any fsp open with a pathname below that of an already open path.
 ****************************************************************************/
@@ -435,6 +488,8 @@ void file_free(struct smb_request *req, files_struct *fsp)
 	struct smbd_server_connection *sconn = fsp->conn->sconn;
 
 	DLIST_REMOVE(sconn->files, fsp);
+	sconn->fnum_table[fsp->fnum - FILE_HANDLE_OFFSET] = NULL;
+	file_id_hash_remove(sconn, fsp);
 
 	TALLOC_FREE(fsp->fake_file_handle);
 
@@ -479,11 +534,6 @@ void file_free(struct smb_request *req, files_struct *fsp)
 		remove_smb2_chained_fsp(fsp);
 	}
 
-	/* Closing a file can invalidate the positive cache. */
-	if (fsp == sconn->fsp_fi_cache.fsp) {
-		ZERO_STRUCT(sconn->fsp_fi_cache);
-	}
-
 	/* Drop all remaining extensions. */
 	while (fsp->vfs_extension) {
 		vfs_remove_fsp_extension(fsp->vfs_extension->owner, fsp);
@@ -504,18 +554,12 @@ void file_free(struct smb_request *req, files_struct *fsp)
 static struct files_struct *file_fnum(struct smbd_server_connection *sconn,
 				      uint16 fnum)
 {
-	files_struct *fsp;
-	int count=0;
+	int i = (int)fnum - FILE_HANDLE_OFFSET;
 
-	for (fsp=sconn->files; fsp; fsp=fsp->next, count++) {
-		if (fsp->fnum == fnum) {
-			if (count > 10) {
-				DLIST_PROMOTE(sconn->files, fsp);
-			}
-			return fsp;
-		}
+	if ((i < 0) || (i >= sconn->real_max_open_files)) {
+		return NULL;
 	}
-	return NULL;
+	return sconn->fnum_table[i];
 }
 
 /****************************************************************************
@@ -563,7 +607,7 @@ NTSTATUS dup_file_fsp(struct smb_request *req, files_struct *from,
 	to->fh = from->fh;
 	to->fh->ref_count++;
 
-	to->file_id = from->file_id;
+	fsp_set_file_id(to, from->file_id);
 	to->initial_allocation_size = from->initial_allocation_size;
 	to->mode = from->mode;
 	to->file_pid = from->file_pid;
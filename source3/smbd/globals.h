@@ -38,12 +38,6 @@ extern bool dfree_broken;
 /* how many write cache buffers have been allocated */
 extern unsigned int allocated_write_caches;
 
-/* A singleton cache to speed up searching by dev/inode. */
-struct fsp_singleton_cache {
-	files_struct *fsp;
-	struct file_id id;
-};
-
 extern const struct mangle_fns *mangle_fns;
 
 extern unsigned char *chartest;
@@ -282,6 +276,7 @@ NTSTATUS smbd_smb2_request_process_close(struct smbd_smb2_request *req);
 NTSTATUS smbd_smb2_request_process_flush(struct smbd_smb2_request *req);
 NTSTATUS smbd_smb2_request_process_read(struct smbd_smb2_request *req);
 NTSTATUS smb2_read_complete(struct tevent_req *req, ssize_t nread, int err);
+NTSTATUS smb2_read_sign_sendfile_pdu(struct smbd_smb2_request *req, int idx);
 NTSTATUS smbd_smb2_request_process_write(struct smbd_smb2_request *req);
 NTSTATUS smb2_write_complete(struct tevent_req *req, ssize_t nwritten, int err);
 NTSTATUS smbd_smb2_request_process_lock(struct smbd_smb2_request *req);
@@ -409,6 +404,13 @@ struct smbd_smb2_request {
 		 */
 		struct iovec *vector;
 		int vector_count;
+		/*
+		 * The dynamic part of a signed READ reply points
+		 * at a mapping of the file data. It is only used
+		 * for the signature and then sent with sendfile,
+		 * by the destructor of this read state.
+		 */
+		struct smbd_smb2_read_state *sendfile_signed;
 	} out;
 };
 
@@ -470,7 +472,11 @@ struct smbd_server_connection {
 	struct bitmap *file_bmap;
 	int real_max_open_files;
 	int files_used;
-	struct fsp_singleton_cache fsp_fi_cache;
+	/* indexed by fnum - FILE_HANDLE_OFFSET */
+	struct files_struct **fnum_table;
+	/* chains of fsps hashed by file_id, see fsp_set_file_id() */
+	struct files_struct **file_id_hash;
+	unsigned file_id_hash_size;
 	unsigned long file_gen_counter;
 	int first_file;
 
@@ -612,6 +618,11 @@ struct smbd_server_connection {
 		uint32_t max_credits;
 		struct bitmap *credits_bitmap;
 		bool compound_related_in_progress;
+		/*
+		 * WRITE payload left on the socket for
+		 * SMB_VFS_RECVFILE() to consume.
+		 */
+		size_t unread_bytes;
 	} smb2;
 };
 
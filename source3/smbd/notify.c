@@ -358,6 +358,8 @@ void notify_fname(connection_struct *conn, uint32 action, uint32 filter,
 	if (parent_dirname(talloc_tos(), path, &parent, &name)) {
 		struct smb_filename smb_fname_parent;
 
+		dir_name_index_notify(conn, parent, action);
+
 		ZERO_STRUCT(smb_fname_parent);
 		smb_fname_parent.base_name = parent;
 
@@ -374,6 +374,7 @@ files_struct *file_find_dif(struct smbd_server_connection *sconn,
 files_struct *file_find_di_first(struct smbd_server_connection *sconn,
 				 struct file_id id);
 files_struct *file_find_di_next(files_struct *start_fsp);
+void fsp_set_file_id(struct files_struct *fsp, struct file_id id);
 bool file_find_subpath(files_struct *dir_fsp);
 void file_sync_all(connection_struct *conn);
 void file_free(struct smb_request *req, files_struct *fsp);
@@ -1057,6 +1058,11 @@ struct TDB_DATA;
 unsigned int fast_string_hash(struct TDB_DATA *key);
 #endif
 bool reset_stat_cache( void );
+bool dir_name_index_lookup(connection_struct *conn, const char *path,
+			   const char *name, TALLOC_CTX *mem_ctx,
+			   char **found_name);
+void dir_name_index_notify(connection_struct *conn, const char *path,
+			   uint32 action);
 
 /* The following definitions come from smbd/statvfs.c  */
 
@@ -113,6 +113,8 @@ struct smbd_smb2_flush_state {
 	struct smbd_smb2_request *smb2req;
 };
 
+static void smbd_smb2_flush_done(struct tevent_req *subreq);
+
 static struct tevent_req *smbd_smb2_flush_send(TALLOC_CTX *mem_ctx,
 					       struct tevent_context *ev,
 					       struct smbd_smb2_request *smb2req,
@@ -121,8 +123,10 @@ static struct tevent_req *smbd_smb2_flush_send(TALLOC_CTX *mem_ctx,
 	struct tevent_req *req;
 	struct smbd_smb2_flush_state *state;
 	NTSTATUS status;
+	struct tevent_req *subreq;
 	struct smb_request *smbreq;
 	files_struct *fsp;
+	int ret;
 
 	req = tevent_req_create(mem_ctx, &state,
 				struct smbd_smb2_flush_state);
@@ -163,16 +167,68 @@ static struct tevent_req *smbd_smb2_flush_send(TALLOC_CTX *mem_ctx,
 		return tevent_req_post(req, ev);
 	}
 
-	status = sync_file(smbreq->conn, fsp, true);
-	if (!NT_STATUS_IS_OK(status)) {
-		DEBUG(5,("smbd_smb2_flush: sync_file for %s returned %s\n",
+	if (fsp->fh->fd == -1) {
+		tevent_req_nterror(req, NT_STATUS_INVALID_HANDLE);
+		return tevent_req_post(req, ev);
+	}
+
+	if (!lp_strict_sync(SNUM(smbreq->conn))) {
+		/*
+		 * No strict sync - we can ignore this flush request.
+		 */
+		tevent_req_done(req);
+		return tevent_req_post(req, ev);
+	}
+
+	ret = flush_write_cache(fsp, SYNC_FLUSH);
+	if (ret == -1) {
+		status = map_nt_error_from_unix(errno);
+		DEBUG(5,("smbd_smb2_flush: flush_write_cache for %s "
+			 "returned %s\n",
 			 fsp_str_dbg(fsp), nt_errstr(status)));
 		tevent_req_nterror(req, status);
 		return tevent_req_post(req, ev);
 	}
 
+	/*
+	 * The fsync runs asynchronously, so a slow flush does not
+	 * hold up the other requests on this connection.
+	 */
+	subreq = SMB_VFS_FSYNC_SEND(state, ev, fsp);
+	if (subreq == NULL) {
+		/* Could not go async, do it here */
+		ret = SMB_VFS_FSYNC(fsp);
+		if (ret == -1) {
+			status = map_nt_error_from_unix(errno);
+			DEBUG(5,("smbd_smb2_flush: fsync for %s returned %s\n",
+				 fsp_str_dbg(fsp), nt_errstr(status)));
+			tevent_req_nterror(req, status);
+			return tevent_req_post(req, ev);
+		}
+		tevent_req_done(req);
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(subreq, smbd_smb2_flush_done, req);
+	return req;
+}
+
+static void smbd_smb2_flush_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	int ret, err;
+
+	ret = SMB_VFS_FSYNC_RECV(subreq, &err);
+	TALLOC_FREE(subreq);
+	if (ret == -1) {
+		NTSTATUS status = map_nt_error_from_unix(err);
+
+		DEBUG(5,("smbd_smb2_flush: fsync returned %s\n",
+			 nt_errstr(status)));
+		tevent_req_nterror(req, status);
+		return;
+	}
 	tevent_req_done(req);
-	return tevent_req_post(req, ev);
 }
 
 static NTSTATUS smbd_smb2_flush_recv(struct tevent_req *req)
@@ -20,6 +20,8 @@
 
 #include "includes.h"
 #include "system/filesys.h"
+#include "system/shmem.h"
+#include <setjmp.h>
 #include "smbd/smbd.h"
 #include "smbd/globals.h"
 #include "../libcli/smb/smb_common.h"
@@ -39,7 +41,8 @@ static struct tevent_req *smbd_smb2_read_send(TALLOC_CTX *mem_ctx,
 static NTSTATUS smbd_smb2_read_recv(struct tevent_req *req,
 				    TALLOC_CTX *mem_ctx,
 				    DATA_BLOB *out_data,
-				    uint32_t *out_remaining);
+				    uint32_t *out_remaining,
+				    struct smbd_smb2_read_state **out_sendfile);
 
 static void smbd_smb2_request_read_done(struct tevent_req *subreq);
 NTSTATUS smbd_smb2_request_process_read(struct smbd_smb2_request *req)
@@ -114,13 +117,15 @@ static void smbd_smb2_request_read_done(struct tevent_req *subreq)
 	uint8_t out_data_offset;
 	DATA_BLOB out_data_buffer = data_blob_null;
 	uint32_t out_data_remaining = 0;
+	struct smbd_smb2_read_state *out_sendfile = NULL;
 	NTSTATUS status;
 	NTSTATUS error; /* transport error */
 
 	status = smbd_smb2_read_recv(subreq,
 				     req,
 				     &out_data_buffer,
-				     &out_data_remaining);
+				     &out_data_remaining,
+				     &out_sendfile);
 	TALLOC_FREE(subreq);
 	if (!NT_STATUS_IS_OK(status)) {
 		error = smbd_smb2_request_error(req, status);
@@ -158,6 +163,7 @@ static void smbd_smb2_request_read_done(struct tevent_req *subreq)
 	SIVAL(outbody.data, 0x0C, 0);		/* reserved */
 
 	outdyn = out_data_buffer;
+	req->out.sendfile_signed = out_sendfile;
 
 	error = smbd_smb2_request_done(req, outbody, &outdyn);
 	if (!NT_STATUS_IS_OK(error)) {
@@ -176,12 +182,37 @@ struct smbd_smb2_read_state {
 	uint32_t in_minimum;
 	DATA_BLOB out_data;
 	uint32_t out_remaining;
+	/* signed sendfile: the file data mapped for the signature */
+	void *map_base;
+	size_t map_len;
+	/* the copy whose destructor does the sendfile */
+	struct smbd_smb2_read_state *sendfile_state;
 };
 
+/* Release what a scheduled sendfile read holds. */
+static void smb2_sendfile_release(struct smbd_smb2_read_state *state)
+{
+	struct lock_struct lock;
+	files_struct *fsp = state->fsp;
+
+	init_strict_lock_struct(fsp,
+				state->in_file_id_volatile,
+				state->in_offset,
+				state->in_length,
+				READ_LOCK,
+				&lock);
+
+	SMB_VFS_STRICT_UNLOCK(fsp->conn, fsp, &lock);
+
+	if (state->map_base != NULL) {
+		munmap(state->map_base, state->map_len);
+		state->map_base = NULL;
+	}
+}
+
 /* struct smbd_smb2_read_state destructor. Send the SMB2_READ data. */
 static int smb2_sendfile_send_data(struct smbd_smb2_read_state *state)
 {
-	struct lock_struct lock;
 	uint32_t in_length = state->in_length;
 	uint64_t in_offset = state->in_offset;
 	files_struct *fsp = state->fsp;
@@ -251,17 +282,89 @@ static int smb2_sendfile_send_data(struct smbd_smb2_read_state *state)
 		sendfile_short_send(fsp, nread, 0, in_length);
 	}
 
-	init_strict_lock_struct(fsp,
-				state->in_file_id_volatile,
-				in_offset,
-				in_length,
-				READ_LOCK,
-				&lock);
-
-	SMB_VFS_STRICT_UNLOCK(fsp->conn, fsp, &lock);
+	smb2_sendfile_release(state);
 	return 0;
 }
 
+/*
+ * A signed sendfile read signs the reply over a mapping of the
+ * file data. If the file is truncated under the mapping, touching
+ * it raises SIGBUS; catch that rather than taking smbd down. The
+ * sendfile is then cancelled and the caller answers the read with
+ * NT_STATUS_FILE_INVALID.
+ */
+
+static sigjmp_buf *smb2_read_sigbus_env;
+
+static void smb2_read_sigbus(int sig)
+{
+	siglongjmp(*smb2_read_sigbus_env, 1);
+}
+
+NTSTATUS smb2_read_sign_sendfile_pdu(struct smbd_smb2_request *req, int idx)
+{
+	sigjmp_buf env;
+	void (*old_handler)(int);
+	NTSTATUS status;
+
+	smb2_read_sigbus_env = &env;
+	old_handler = CatchSignal(SIGBUS, smb2_read_sigbus);
+
+	if (sigsetjmp(env, 1) != 0) {
+		struct smbd_smb2_read_state *state = req->out.sendfile_signed;
+
+		CatchSignal(SIGBUS, old_handler);
+		smb2_read_sigbus_env = NULL;
+		DEBUG(1, ("smb2_read_sign_sendfile_pdu: file truncated "
+			  "while signing a sendfile read\n"));
+
+		req->out.sendfile_signed = NULL;
+		talloc_set_destructor(state, NULL);
+		smb2_sendfile_release(state);
+		TALLOC_FREE(state);
+		return NT_STATUS_FILE_INVALID;
+	}
+
+	status = smb2_signing_sign_pdu(req->session->session_key,
+				       &req->out.vector[idx], 3);
+
+	CatchSignal(SIGBUS, old_handler);
+	smb2_read_sigbus_env = NULL;
+	return status;
+}
+
+/*
+ * Map the data of a signed sendfile read, so the signature can be
+ * computed without reading it into a buffer first.
+ */
+static bool smb2_sendfile_map_data(struct smbd_smb2_read_state *state)
+{
+	files_struct *fsp = state->fsp;
+	SMB_OFF_T page_size = getpagesize();
+	SMB_OFF_T map_offset = state->in_offset & ~(page_size - 1);
+	size_t delta = state->in_offset - map_offset;
+	int flags = MAP_SHARED;
+	void *base;
+
+#ifdef MAP_POPULATE
+	/* we read all of it straight away */
+	flags |= MAP_POPULATE;
+#endif
+
+	base = mmap(NULL, delta + state->in_length, PROT_READ, flags,
+		    fsp->fh->fd, map_offset);
+	if (base == MAP_FAILED) {
+		DEBUG(10,("smb2_sendfile_map_data: mmap failed for %s: %s\n",
+			  fsp_str_dbg(fsp), strerror(errno)));
+		return false;
+	}
+
+	state->map_base = base;
+	state->map_len = delta + state->in_length;
+	state->out_data.data = (uint8_t *)base + delta;
+	return true;
+}
+
 static NTSTATUS schedule_smb2_sendfile_read(struct smbd_smb2_request *smb2req,
 					struct smbd_smb2_read_state *state)
 {
@@ -271,7 +374,7 @@ static NTSTATUS schedule_smb2_sendfile_read(struct smbd_smb2_request *smb2req,
 	/*
 	 * We cannot use sendfile if...
 	 * We were not configured to do so OR
-	 * Signing is active OR
+	 * Signing is active and we may not sign a mapping OR
 	 * This is a compound SMB2 operation OR
 	 * fsp is a STREAM file OR
 	 * We're using a write cache OR
@@ -283,7 +386,9 @@ static NTSTATUS schedule_smb2_sendfile_read(struct smbd_smb2_request *smb2req,
 	*/
 
 	if (!lp__use_sendfile(SNUM(fsp->conn)) ||
-			smb2req->do_signing ||
+			(smb2req->do_signing &&
+			 !lp_parm_bool(SNUM(fsp->conn), "smbd",
+				       "signed sendfile", false)) ||
 			smb2req->in.vector_count != 4 ||
 			(fsp->base_fsp != NULL) ||
 			(fsp->wcp != NULL) ||
@@ -294,20 +399,36 @@ static NTSTATUS schedule_smb2_sendfile_read(struct smbd_smb2_request *smb2req,
 		return NT_STATUS_RETRY;
 	}
 
+	if (smb2req->do_signing) {
+		if (state->in_length == 0 || !smb2_sendfile_map_data(state)) {
+			return NT_STATUS_RETRY;
+		}
+	}
+
 	/* We've already checked there's this amount of data
 	   to read. */
 	state->out_data.length = state->in_length;
 	state->out_remaining = 0;
 
+	/* Keep the file position in step with read_file(). */
+	fsp->fh->pos = state->in_offset + state->in_length;
+	fsp->fh->position_information = fsp->fh->pos;
+
 	/* Make a copy of state attached to the smb2req. Attach
 	   the destructor here as this will trigger the sendfile
 	   call when the request is destroyed. */
 	state_copy = talloc(smb2req, struct smbd_smb2_read_state);
 	if (!state_copy) {
+		if (state->map_base != NULL) {
+			munmap(state->map_base, state->map_len);
+		}
 		return NT_STATUS_NO_MEMORY;
 	}
 	*state_copy = *state;
 	talloc_set_destructor(state_copy, smb2_sendfile_send_data);
+	if (state->map_base != NULL) {
+		state->sendfile_state = state_copy;
+	}
 	return NT_STATUS_OK;
 }
 
@@ -580,7 +701,8 @@ static void smbd_smb2_read_pipe_done(struct tevent_req *subreq)
 static NTSTATUS smbd_smb2_read_recv(struct tevent_req *req,
 				    TALLOC_CTX *mem_ctx,
 				    DATA_BLOB *out_data,
-				    uint32_t *out_remaining)
+				    uint32_t *out_remaining,
+				    struct smbd_smb2_read_state **out_sendfile)
 {
 	NTSTATUS status;
 	struct smbd_smb2_read_state *state = tevent_req_data(req,
@@ -592,7 +714,11 @@ static NTSTATUS smbd_smb2_read_recv(struct tevent_req *req,
 	}
 
 	*out_data = state->out_data;
-	talloc_steal(mem_ctx, out_data->data);
+	/* a mapping is owned by the sendfile state */
+	*out_sendfile = state->sendfile_state;
+	if (*out_sendfile == NULL) {
+		talloc_steal(mem_ctx, out_data->data);
+	}
 	*out_remaining = state->out_remaining;
 
 	tevent_req_received(req);
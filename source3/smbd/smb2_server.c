@@ -20,6 +20,7 @@
 */
 
 #include "includes.h"
+#include "system/filesys.h"
 #include "smbd/smbd.h"
 #include "smbd/globals.h"
 #include "../libcli/smb/smb_common.h"
@@ -1287,6 +1288,12 @@ NTSTATUS smbd_smb2_request_verify_sizes(struct smbd_smb2_request *req,
 	case SMB2_OP_GETINFO:
 		min_dyn_size = 0;
 		break;
+	case SMB2_OP_WRITE:
+		if (req->sconn->smb2.unread_bytes) {
+			/* the payload is still on the socket */
+			min_dyn_size = 0;
+		}
+		break;
 	}
 
 	/*
@@ -1828,9 +1835,191 @@ NTSTATUS smbd_smb2_request_dispatch(struct smbd_smb2_request *req)
 	return return_value;
 }
 
-static NTSTATUS smbd_smb2_request_reply(struct smbd_smb2_request *req)
+static NTSTATUS smbd_smb2_request_send(struct smbd_smb2_request *req)
 {
 	struct tevent_req *subreq;
+
+	if (DEBUGLEVEL >= 10) {
+		dbgtext("smbd_smb2_request_reply: sending...\n");
+		print_req_vectors(req);
+	}
+
+	/* I am a sick, sick man... :-). Sendfile hack ... JRA. */
+	if (req->out.vector_count == 4 &&
+			(req->out.vector[3].iov_base == NULL ||
+			 req->out.sendfile_signed != NULL) &&
+			req->out.vector[3].iov_len != 0) {
+		/* Dynamic part is NULL or only there for the
+		   signature. Chop it off,
+		   We're going to send it via sendfile. */
+		req->out.vector_count -= 1;
+	}
+
+	subreq = tstream_writev_queue_send(req,
+					   req->sconn->smb2.event_ctx,
+					   req->sconn->smb2.stream,
+					   req->sconn->smb2.send_queue,
+					   req->out.vector,
+					   req->out.vector_count);
+	if (subreq == NULL) {
+		return NT_STATUS_NO_MEMORY;
+	}
+	tevent_req_set_callback(subreq, smbd_smb2_request_writev_done, req);
+	/*
+	 * We're done with this request -
+	 * move it off the "being processed" queue.
+	 */
+	DLIST_REMOVE(req->sconn->smb2.requests, req);
+
+	return NT_STATUS_OK;
+}
+
+/*
+ * Signing a large reply can take longer than the request itself.
+ * With "smbd:async signing size" set, single (non-compound) replies
+ * with at least that many bytes of payload are signed in a helper
+ * thread, and the main loop goes on with other requests meanwhile.
+ * The reply is queued for sending once its signature is in place.
+ *
+ * The job hashes the reply buffers owned by the request. The request
+ * stays on sconn->smb2.requests without a subreq until the signature
+ * is done, so neither a cancel nor a reply to another request frees
+ * it underneath the thread.
+ */
+
+static struct fncall_context *smbd_smb2_sign_fncall_ctx;
+
+static struct fncall_context *smbd_smb2_get_sign_fncall_ctx(void)
+{
+	if (smbd_smb2_sign_fncall_ctx == NULL) {
+		int max_threads = lp_parm_int(-1, "smbd",
+					      "async signing threads", 4);
+
+		smbd_smb2_sign_fncall_ctx = fncall_context_init(NULL,
+								max_threads);
+	}
+	return smbd_smb2_sign_fncall_ctx;
+}
+
+static bool smbd_smb2_want_async_signing(struct smbd_smb2_request *req,
+					 int i)
+{
+	int min_size;
+
+	if (req->out.vector_count != 4 || req->out.sendfile_signed != NULL) {
+		return false;
+	}
+
+	min_size = lp_parm_int(-1, "smbd", "async signing size", 0);
+	if (min_size <= 0) {
+		return false;
+	}
+
+	return req->out.vector[i+2].iov_len >= (size_t)min_size;
+}
+
+struct smbd_smb2_sign_job {
+	struct smbd_smb2_request *req;
+	DATA_BLOB session_key;
+	struct iovec vector[3];
+	uint8_t signature[16];
+};
+
+static void smbd_smb2_sign_job_fn(void *private_data)
+{
+	struct smbd_smb2_sign_job *job =
+		(struct smbd_smb2_sign_job *)private_data;
+
+	smb2_signing_calc_signature(job->session_key, job->vector,
+				    ARRAY_SIZE(job->vector), job->signature);
+}
+
+static void smbd_smb2_request_signed(struct tevent_req *subreq);
+
+static NTSTATUS smbd_smb2_request_sign_async(struct smbd_smb2_request *req,
+					     int i)
+{
+	struct fncall_context *ctx;
+	struct smbd_smb2_sign_job *job;
+	struct tevent_req *subreq;
+	NTSTATUS status;
+	bool sign;
+
+	ctx = smbd_smb2_get_sign_fncall_ctx();
+	if (ctx == NULL) {
+		status = smb2_signing_sign_pdu(req->session->session_key,
+					       &req->out.vector[i], 3);
+		if (!NT_STATUS_IS_OK(status)) {
+			return status;
+		}
+		return smbd_smb2_request_send(req);
+	}
+
+	status = smb2_signing_prepare_pdu(req->session->session_key,
+					  &req->out.vector[i], 3, &sign);
+	if (!NT_STATUS_IS_OK(status)) {
+		return status;
+	}
+	if (!sign) {
+		return smbd_smb2_request_send(req);
+	}
+
+	job = talloc_zero(req, struct smbd_smb2_sign_job);
+	if (job == NULL) {
+		return NT_STATUS_NO_MEMORY;
+	}
+	job->req = req;
+	job->session_key = data_blob_talloc(job,
+					    req->session->session_key.data,
+					    req->session->session_key.length);
+	if (job->session_key.data == NULL) {
+		TALLOC_FREE(job);
+		return NT_STATUS_NO_MEMORY;
+	}
+	memcpy(job->vector, &req->out.vector[i], sizeof(job->vector));
+
+	subreq = fncall_send(req, req->sconn->smb2.event_ctx, ctx,
+			     smbd_smb2_sign_job_fn, job);
+	if (subreq == NULL) {
+		TALLOC_FREE(job);
+		return NT_STATUS_NO_MEMORY;
+	}
+	tevent_req_set_callback(subreq, smbd_smb2_request_signed, job);
+	return NT_STATUS_OK;
+}
+
+static void smbd_smb2_request_signed(struct tevent_req *subreq)
+{
+	struct smbd_smb2_sign_job *job = tevent_req_callback_data(subreq,
+					struct smbd_smb2_sign_job);
+	struct smbd_smb2_request *req = job->req;
+	struct smbd_server_connection *sconn = req->sconn;
+	uint8_t *outhdr;
+	NTSTATUS status;
+	int ret, err;
+
+	ret = fncall_recv(subreq, &err);
+	TALLOC_FREE(subreq);
+	if (ret == -1) {
+		status = map_nt_error_from_unix(err);
+		smbd_server_connection_terminate(sconn, nt_errstr(status));
+		return;
+	}
+
+	outhdr = (uint8_t *)job->vector[0].iov_base;
+	memcpy(outhdr + SMB2_HDR_SIGNATURE, job->signature, 16);
+	TALLOC_FREE(job);
+	DEBUG(5,("signed SMB2 message\n"));
+
+	status = smbd_smb2_request_send(req);
+	if (!NT_STATUS_IS_OK(status)) {
+		smbd_server_connection_terminate(sconn, nt_errstr(status));
+		return;
+	}
+}
+
+static NTSTATUS smbd_smb2_request_reply(struct smbd_smb2_request *req)
+{
 	int i = req->current_idx;
 
 	req->subreq = NULL;
@@ -1869,7 +2058,29 @@ static NTSTATUS smbd_smb2_request_reply(struct smbd_smb2_request *req)
 			&req->in.vector[i],
 			&req->out.vector[i]);
 
-	if (req->do_signing) {
+	if (req->do_signing && req->out.sendfile_signed != NULL) {
+		NTSTATUS status;
+		status = smb2_read_sign_sendfile_pdu(req, i);
+		if (NT_STATUS_EQUAL(status, NT_STATUS_FILE_INVALID)) {
+			/*
+			 * The file was truncated under the mapping and
+			 * the sendfile is cancelled. Answer this read
+			 * with an error instead, the error reply grants
+			 * the credits again.
+			 */
+			uint8_t *outhdr = (uint8_t *)req->out.vector[i].iov_base;
+
+			req->sconn->smb2.credits_granted -=
+				SVAL(outhdr, SMB2_HDR_CREDIT);
+			req->current_idx = i;
+			return smbd_smb2_request_error(req, status);
+		}
+		if (!NT_STATUS_IS_OK(status)) {
+			return status;
+		}
+	} else if (req->do_signing && smbd_smb2_want_async_signing(req, i)) {
+		return smbd_smb2_request_sign_async(req, i);
+	} else if (req->do_signing) {
 		NTSTATUS status;
 		status = smb2_signing_sign_pdu(req->session->session_key,
 					       &req->out.vector[i], 3);
@@ -1878,37 +2089,7 @@ static NTSTATUS smbd_smb2_request_reply(struct smbd_smb2_request *req)
 		}
 	}
 
-	if (DEBUGLEVEL >= 10) {
-		dbgtext("smbd_smb2_request_reply: sending...\n");
-		print_req_vectors(req);
-	}
-
-	/* I am a sick, sick man... :-). Sendfile hack ... JRA. */
-	if (req->out.vector_count == 4 &&
-			req->out.vector[3].iov_base == NULL &&
-			req->out.vector[3].iov_len != 0) {
-		/* Dynamic part is NULL. Chop it off,
-		   We're going to send it via sendfile. */
-		req->out.vector_count -= 1;
-	}
-
-	subreq = tstream_writev_queue_send(req,
-					   req->sconn->smb2.event_ctx,
-					   req->sconn->smb2.stream,
-					   req->sconn->smb2.send_queue,
-					   req->out.vector,
-					   req->out.vector_count);
-	if (subreq == NULL) {
-		return NT_STATUS_NO_MEMORY;
-	}
-	tevent_req_set_callback(subreq, smbd_smb2_request_writev_done, req);
-	/*
-	 * We're done with this request -
-	 * move it off the "being processed" queue.
-	 */
-	DLIST_REMOVE(req->sconn->smb2.requests, req);
-
-	return NT_STATUS_OK;
+	return smbd_smb2_request_send(req);
 }
 
 static NTSTATUS smbd_smb2_request_next_incoming(struct smbd_server_connection *sconn);
@@ -2251,6 +2432,65 @@ static struct tevent_req *smbd_smb2_request_read_send(TALLOC_CTX *mem_ctx,
 	return req;
 }
 
+/*
+ * Check if the payload of a WRITE can be left on the socket
+ * for SMB_VFS_RECVFILE(), like we do for SMB1 writeX.
+ * Only unsigned, unchained writes to a file share qualify.
+ */
+static bool smbd_smb2_is_recvfile_write(struct smbd_server_connection *sconn,
+					const uint8_t *hdr,
+					size_t body_size,
+					size_t dyn_size)
+{
+	int min_recv_size = lp_min_receive_file_size();
+	uint64_t in_session_id;
+	uint32_t in_tid;
+	struct smbd_smb2_session *session;
+	struct smbd_smb2_tcon *tcon;
+	void *p;
+
+	if (min_recv_size <= 0 || dyn_size < (size_t)min_recv_size) {
+		return false;
+	}
+	if (SVAL(hdr, SMB2_HDR_OPCODE) != SMB2_OP_WRITE) {
+		return false;
+	}
+	if ((IVAL(hdr, SMB2_HDR_FLAGS) & ~SMB2_HDR_FLAG_DFS) != 0) {
+		/* signed, chained or async */
+		return false;
+	}
+	if (IVAL(hdr, SMB2_HDR_NEXT_COMMAND) != 0) {
+		return false;
+	}
+	if (body_size != 0x30) {
+		return false;
+	}
+
+	in_session_id = BVAL(hdr, SMB2_HDR_SESSION_ID);
+	p = idr_find(sconn->smb2.sessions.idtree, in_session_id);
+	if (p == NULL) {
+		return false;
+	}
+	session = talloc_get_type_abort(p, struct smbd_smb2_session);
+	if (!NT_STATUS_IS_OK(session->status) || session->do_signing) {
+		return false;
+	}
+
+	in_tid = IVAL(hdr, SMB2_HDR_TID);
+	p = idr_find(session->tcons.idtree, in_tid);
+	if (p == NULL) {
+		return false;
+	}
+	tcon = talloc_get_type_abort(p, struct smbd_smb2_tcon);
+	if (IS_IPC(tcon->compat_conn) || IS_PRINT(tcon->compat_conn)) {
+		return false;
+	}
+
+	DEBUG(10,("smbd_smb2_is_recvfile_write: leaving %u bytes "
+		  "on the socket\n", (unsigned int)dyn_size));
+	return true;
+}
+
 static int smbd_smb2_request_next_vector(struct tstream_context *stream,
 					 void *private_data,
 					 TALLOC_CTX *mem_ctx,
@@ -2449,6 +2689,17 @@ static int smbd_smb2_request_next_vector(struct tstream_context *stream,
 
 		state->missing -= (body_size - 2) + dyn_size;
 
+		if (!invalid &&
+		    smbd_smb2_is_recvfile_write(req->sconn, hdr,
+						body_size, dyn_size)) {
+			/*
+			 * Only read the body, smbd_smb2_write_send()
+			 * takes the payload straight from the socket.
+			 */
+			req->sconn->smb2.unread_bytes = dyn_size;
+			dyn_size = 0;
+		}
+
 		body = talloc_array(req->in.vector, uint8_t, body_size);
 		if (body == NULL) {
 			return -1;
@@ -2660,6 +2911,28 @@ void smbd_smb2_first_negprot(struct smbd_server_connection *sconn,
 	sconn->num_requests++;
 }
 
+static NTSTATUS smbd_smb2_drain_unread(struct smbd_server_connection *sconn)
+{
+	size_t unread = sconn->smb2.unread_bytes;
+	int old_flags;
+	ssize_t ret;
+
+	sconn->smb2.unread_bytes = 0;
+
+	old_flags = fcntl(sconn->sock, F_GETFL, 0);
+	if (old_flags == -1 || set_blocking(sconn->sock, true) == -1) {
+		return map_nt_error_from_unix(errno);
+	}
+	ret = drain_socket(sconn->sock, unread);
+	if (fcntl(sconn->sock, F_SETFL, old_flags) == -1) {
+		return map_nt_error_from_unix(errno);
+	}
+	if (ret != (ssize_t)unread) {
+		return NT_STATUS_END_OF_FILE;
+	}
+	return NT_STATUS_OK;
+}
+
 static void smbd_smb2_request_incoming(struct tevent_req *subreq)
 {
 	struct smbd_server_connection *sconn = tevent_req_callback_data(subreq,
@@ -2706,6 +2979,20 @@ static void smbd_smb2_request_incoming(struct tevent_req *subreq)
 		return;
 	}
 
+	if (sconn->smb2.unread_bytes) {
+		/*
+		 * The WRITE failed before it got to recvfile or
+		 * didn't use all of the payload, throw the rest
+		 * away before we read the next request.
+		 */
+		status = smbd_smb2_drain_unread(sconn);
+		if (!NT_STATUS_IS_OK(status)) {
+			smbd_server_connection_terminate(sconn,
+							 nt_errstr(status));
+			return;
+		}
+	}
+
 next:
 	status = smbd_smb2_request_next_incoming(sconn);
 	if (!NT_STATUS_IS_OK(status)) {
@@ -73,7 +73,13 @@ NTSTATUS smbd_smb2_request_process_write(struct smbd_smb2_request *req)
 		return smbd_smb2_request_error(req, NT_STATUS_INVALID_PARAMETER);
 	}
 
-	if (in_data_length > req->in.vector[i+2].iov_len) {
+	if (req->sconn->smb2.unread_bytes) {
+		/* recvfile: the payload is still on the socket */
+		if (in_data_length > req->sconn->smb2.unread_bytes) {
+			return smbd_smb2_request_error(req,
+						NT_STATUS_INVALID_PARAMETER);
+		}
+	} else if (in_data_length > req->in.vector[i+2].iov_len) {
 		return smbd_smb2_request_error(req, NT_STATUS_INVALID_PARAMETER);
 	}
 
@@ -88,7 +94,11 @@ NTSTATUS smbd_smb2_request_process_write(struct smbd_smb2_request *req)
 #endif
 	}
 
-	in_data_buffer.data = (uint8_t *)req->in.vector[i+2].iov_base;
+	if (req->sconn->smb2.unread_bytes) {
+		in_data_buffer.data = NULL;
+	} else {
+		in_data_buffer.data = (uint8_t *)req->in.vector[i+2].iov_base;
+	}
 	in_data_buffer.length = in_data_length;
 
 	if (req->compat_chain_fsp) {
@@ -295,13 +305,18 @@ static struct tevent_req *smbd_smb2_write_send(TALLOC_CTX *mem_ctx,
 		return tevent_req_post(req, ev);
 	}
 
-	/* Try and do an asynchronous write. */
-	status = schedule_aio_smb2_write(conn,
-					smbreq,
-					fsp,
-					in_offset,
-					in_data,
-					state->write_through);
+	if (smb2req->sconn->smb2.unread_bytes) {
+		/* recvfile has to run while we own the socket */
+		status = NT_STATUS_RETRY;
+	} else {
+		/* Try and do an asynchronous write. */
+		status = schedule_aio_smb2_write(conn,
+						smbreq,
+						fsp,
+						in_offset,
+						in_data,
+						state->write_through);
+	}
 
 	if (NT_STATUS_IS_OK(status)) {
 		/*
@@ -335,11 +350,23 @@ static struct tevent_req *smbd_smb2_write_send(TALLOC_CTX *mem_ctx,
 		return tevent_req_post(req, ev);
 	}
 
+	if (smb2req->sconn->smb2.unread_bytes && in_data.length) {
+		/* write_file() hands the payload to SMB_VFS_RECVFILE() */
+		smbreq->unread_bytes = in_data.length;
+		smb2req->sconn->smb2.unread_bytes -= in_data.length;
+	}
+
 	nwritten = write_file(smbreq, fsp,
 			      (const char *)in_data.data,
 			      in_offset,
 			      in_data.length);
 
+	if (smbreq->unread_bytes) {
+		/* not consumed, smbd_smb2_request_incoming() drains it */
+		smb2req->sconn->smb2.unread_bytes += smbreq->unread_bytes;
+		smbreq->unread_bytes = 0;
+	}
+
 	status = smb2_write_complete(req, nwritten, errno);
 
 	SMB_VFS_STRICT_UNLOCK(conn, fsp, &lock);
@@ -26,6 +26,7 @@
 #include "messages.h"
 #include "smbprofile.h"
 #include "tdb_compat.h"
+#include "util_tdb.h"
 
 /****************************************************************************
  Stat cache code used in unix_convert.
@@ -397,6 +398,352 @@ bool reset_stat_cache( void )
 		return True;
 
 	memcache_flush(smbd_memcache(), STAT_CACHE);
+	memcache_flush(smbd_memcache(), DIR_NAME_INDEX_CACHE);
 
 	return True;
 }
+
+/****************************************************************************
+ Case insensitive name index of a directory, used by get_real_filename()
+ instead of a readdir scan on every lookup of a name in the wrong case.
+*****************************************************************************/
+
+/*
+ * All names of a directory, hashed by their upper case form. The index
+ * is valid as long as the directory has the device, inode and mtime it
+ * had when the index was built. Changes made by this process drop the
+ * index, see dir_name_index_notify().
+ */
+
+struct dir_name_index_entry {
+	struct dir_name_index_entry *next;
+	char *upper;
+	char *name;
+};
+
+struct dir_name_index {
+	SMB_DEV_T dev;
+	SMB_INO_T ino;
+	struct timespec mtime;
+
+	/* What the index is charged against "dir name index max size" */
+	size_t size;
+
+	uint32_t num_entries;
+	uint32_t num_buckets;
+	struct dir_name_index_entry **buckets;
+};
+
+/*
+ * The memcache only charges the pointer of a talloc object, so the
+ * indexes it holds are accounted for here.
+ */
+static size_t dir_name_index_cached_size;
+
+static int dir_name_index_destructor(struct dir_name_index *idx)
+{
+	dir_name_index_cached_size -= idx->size;
+	return 0;
+}
+
+static DATA_BLOB dir_name_index_key(connection_struct *conn, const char *path)
+{
+	char *key;
+
+	if ((path[0] == '.') && (path[1] == '/')) {
+		path += 2;
+	}
+	if (*path == '\0') {
+		path = ".";
+	}
+
+	key = talloc_asprintf(talloc_tos(), "%d/%s/%s", SNUM(conn),
+			      conn->connectpath, path);
+	if (key == NULL) {
+		return data_blob_null;
+	}
+	return data_blob_const(key, strlen(key));
+}
+
+static struct dir_name_index_entry **dir_name_index_bucket(
+	struct dir_name_index *idx, const char *upper)
+{
+	TDB_DATA key = string_tdb_data(upper);
+
+	return &idx->buckets[fast_string_hash(&key) % idx->num_buckets];
+}
+
+static struct dir_name_index_entry **dir_name_index_find(
+	struct dir_name_index *idx, const char *upper)
+{
+	struct dir_name_index_entry **pe;
+
+	for (pe = dir_name_index_bucket(idx, upper); *pe != NULL;
+	     pe = &(*pe)->next) {
+		if (strcmp((*pe)->upper, upper) == 0) {
+			break;
+		}
+	}
+	return pe;
+}
+
+static bool dir_name_index_add(struct dir_name_index *idx, const char *name)
+{
+	struct dir_name_index_entry *e;
+	struct dir_name_index_entry **pe;
+
+	e = talloc(idx, struct dir_name_index_entry);
+	if (e == NULL) {
+		return false;
+	}
+	e->name = talloc_strdup(e, name);
+	if (e->name == NULL) {
+		TALLOC_FREE(e);
+		return false;
+	}
+	e->upper = talloc_strdup_upper(e, name);
+	if (e->upper == NULL) {
+		TALLOC_FREE(e);
+		return false;
+	}
+
+	/*
+	 * Names that only differ in case can coexist on disk. Keep the
+	 * first one, that is what the directory scan would return.
+	 */
+	pe = dir_name_index_find(idx, e->upper);
+	if (*pe != NULL) {
+		TALLOC_FREE(e);
+		return true;
+	}
+
+	e->next = NULL;
+	*pe = e;
+	idx->num_entries += 1;
+	return true;
+}
+
+/*
+ * Read the whole directory into a new index. The directory is stat'ed
+ * before it is read, so a change made while reading shows up as an
+ * mtime change on the next lookup.
+ */
+
+static struct dir_name_index *dir_name_index_build(connection_struct *conn,
+						   const char *path,
+						   const SMB_STRUCT_STAT *psbuf)
+{
+	struct dir_name_index *idx;
+	struct smb_Dir *cur_dir;
+	const char *dname;
+	char *talloced = NULL;
+	long curpos = 0;
+
+	idx = talloc_zero(talloc_tos(), struct dir_name_index);
+	if (idx == NULL) {
+		return NULL;
+	}
+	talloc_set_destructor(idx, dir_name_index_destructor);
+	idx->dev = psbuf->st_ex_dev;
+	idx->ino = psbuf->st_ex_ino;
+	idx->mtime = psbuf->st_ex_mtime;
+
+	/* roughly one bucket per name, grown ahead of the directory */
+	idx->num_buckets = MAX(psbuf->st_ex_size / 16, 1024);
+	idx->buckets = talloc_zero_array(idx, struct dir_name_index_entry *,
+					 idx->num_buckets);
+	if (idx->buckets == NULL) {
+		TALLOC_FREE(idx);
+		return NULL;
+	}
+
+	cur_dir = OpenDir(talloc_tos(), conn, path, NULL, 0);
+	if (cur_dir == NULL) {
+		DEBUG(3,("dir_name_index_build: could not open [%s]\n", path));
+		TALLOC_FREE(idx);
+		return NULL;
+	}
+
+	while ((dname = ReadDirName(cur_dir, &curpos, NULL, &talloced))) {
+		bool ok = true;
+
+		if (!ISDOT(dname) && !ISDOTDOT(dname)) {
+			ok = dir_name_index_add(idx, dname);
+		}
+		TALLOC_FREE(talloced);
+		if (!ok) {
+			TALLOC_FREE(cur_dir);
+			TALLOC_FREE(idx);
+			return NULL;
+		}
+	}
+	TALLOC_FREE(cur_dir);
+
+	DEBUG(10,("dir_name_index_build: indexed %u names in [%s]\n",
+		  (unsigned)idx->num_entries, path));
+
+	return idx;
+}
+
+/**
+ * Find the name on disk that matches name case insensitively in the
+ * directory path. Directories with at least "smbd:dir name index
+ * min entries" names get an index that is kept for later lookups;
+ * setting it to 0 disables the index. All kept indexes together use
+ * at most "smbd:dir name index max size" kilobytes.
+ *
+ * @param found_name Set to the name on disk, or NULL if there is none.
+ *
+ * @return False if the index could not answer, the caller has to scan
+ *	   the directory itself.
+ */
+
+bool dir_name_index_lookup(connection_struct *conn, const char *path,
+			   const char *name, TALLOC_CTX *mem_ctx,
+			   char **found_name)
+{
+	struct smb_filename smb_fname;
+	struct dir_name_index *idx;
+	struct dir_name_index_entry *e;
+	DATA_BLOB key;
+	char *upper;
+	int min_entries;
+	size_t max_size;
+	bool built = false;
+
+	*found_name = NULL;
+
+	if (!lp_stat_cache() || conn->case_sensitive) {
+		return false;
+	}
+	min_entries = lp_parm_int(SNUM(conn), "smbd",
+				  "dir name index min entries", 1000);
+	if (min_entries <= 0) {
+		return false;
+	}
+
+	key = dir_name_index_key(conn, path);
+	if (key.data == NULL) {
+		return false;
+	}
+
+	ZERO_STRUCT(smb_fname);
+	smb_fname.base_name = discard_const_p(char, path);
+	if (SMB_VFS_STAT(conn, &smb_fname) != 0) {
+		TALLOC_FREE(key.data);
+		return false;
+	}
+
+	DO_PROFILE_INC(dirindex_lookups);
+
+	idx = (struct dir_name_index *)memcache_lookup_talloc(
+		smbd_memcache(), DIR_NAME_INDEX_CACHE, key);
+	if ((idx != NULL) &&
+	    (idx->dev == smb_fname.st.st_ex_dev) &&
+	    (idx->ino == smb_fname.st.st_ex_ino) &&
+	    (timespec_compare(&idx->mtime, &smb_fname.st.st_ex_mtime) == 0)) {
+		DO_PROFILE_INC(dirindex_hits);
+	} else {
+		DO_PROFILE_INC(dirindex_misses);
+
+		idx = dir_name_index_build(conn, path, &smb_fname.st);
+		if (idx == NULL) {
+			memcache_delete(smbd_memcache(), DIR_NAME_INDEX_CACHE,
+					key);
+			TALLOC_FREE(key.data);
+			return false;
+		}
+		built = true;
+	}
+
+	upper = talloc_strdup_upper(talloc_tos(), name);
+	if (upper == NULL) {
+		TALLOC_FREE(key.data);
+		return false;
+	}
+	e = *dir_name_index_find(idx, upper);
+	TALLOC_FREE(upper);
+
+	if (e != NULL) {
+		*found_name = talloc_strdup(mem_ctx, e->name);
+		if (*found_name == NULL) {
+			TALLOC_FREE(key.data);
+			return false;
+		}
+	}
+
+	if (built) {
+		/*
+		 * Freshly built. As in the security descriptor cache,
+		 * keep the index only if the directory did not change in
+		 * the last second, a change in the same mtime tick could
+		 * otherwise go unnoticed.
+		 */
+		max_size = (size_t)lp_parm_int(SNUM(conn), "smbd",
+					       "dir name index max size",
+					       16384) * 1024;
+		idx->size = talloc_total_size(idx);
+
+		/* an index with the same key is replaced */
+		memcache_delete(smbd_memcache(), DIR_NAME_INDEX_CACHE, key);
+
+		if ((idx->num_entries >= (uint32_t)min_entries) &&
+		    (idx->mtime.tv_sec < time(NULL) - 1) &&
+		    (idx->size <= max_size)) {
+			if (dir_name_index_cached_size + idx->size >
+			    max_size) {
+				/*
+				 * The memcache can't evict by type, start
+				 * over with the indexes.
+				 */
+				memcache_flush(smbd_memcache(),
+					       DIR_NAME_INDEX_CACHE);
+			}
+			dir_name_index_cached_size += idx->size;
+			memcache_add_talloc(smbd_memcache(),
+					    DIR_NAME_INDEX_CACHE, key, &idx);
+		} else {
+			idx->size = 0;
+			TALLOC_FREE(idx);
+		}
+	}
+
+	TALLOC_FREE(key.data);
+	return true;
+}
+
+/**
+ * Drop the name index of a directory this process added a name to or
+ * removed one from.
+ *
+ * The change is not applied to the index: the directory's new mtime
+ * may also cover a change another process made in the same tick,
+ * adopting it would hide that change.
+ */
+
+void dir_name_index_notify(connection_struct *conn, const char *path,
+			   uint32 action)
+{
+	DATA_BLOB key;
+
+	if (!lp_stat_cache()) {
+		return;
+	}
+
+	switch (action) {
+	case NOTIFY_ACTION_ADDED:
+	case NOTIFY_ACTION_REMOVED:
+	case NOTIFY_ACTION_OLD_NAME:
+	case NOTIFY_ACTION_NEW_NAME:
+		break;
+	default:
+		return;
+	}
+
+	key = dir_name_index_key(conn, path);
+	if (key.data == NULL) {
+		return;
+	}
+	memcache_delete(smbd_memcache(), DIR_NAME_INDEX_CACHE, key);
+	TALLOC_FREE(key.data);
+}
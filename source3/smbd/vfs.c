@@ -30,6 +30,7 @@
 #include "memcache.h"
 #include "transfer_file.h"
 #include "ntioctl.h"
+#include "../lib/util/tevent_unix.h"
 
 #undef DBGC_CLASS
 #define DBGC_CLASS DBGC_VFS
@@ -394,14 +395,26 @@ ssize_t vfs_write_data(struct smb_request *req,
 	ssize_t ret;
 
 	if (req && req->unread_bytes) {
+		int sockfd = req->sconn->sock;
+		int old_flags;
 		SMB_ASSERT(req->unread_bytes == N);
+		/* Ensure the socket is blocking, SMB2 runs it
+		 * non-blocking. */
+		old_flags = fcntl(sockfd, F_GETFL, 0);
+		if (old_flags == -1 || set_blocking(sockfd, true) == -1) {
+			return (ssize_t)-1;
+		}
 		/* VFS_RECVFILE must drain the socket
 		 * before returning. */
 		req->unread_bytes = 0;
-		return SMB_VFS_RECVFILE(req->sconn->sock,
+		ret = SMB_VFS_RECVFILE(sockfd,
 					fsp,
 					(SMB_OFF_T)-1,
 					N);
+		if (fcntl(sockfd, F_SETFL, old_flags) == -1) {
+			return (ssize_t)-1;
+		}
+		return ret;
 	}
 
 	while (total < N) {
@@ -427,14 +440,26 @@ ssize_t vfs_pwrite_data(struct smb_request *req,
 	ssize_t ret;
 
 	if (req && req->unread_bytes) {
+		int sockfd = req->sconn->sock;
+		int old_flags;
 		SMB_ASSERT(req->unread_bytes == N);
+		/* Ensure the socket is blocking, SMB2 runs it
+		 * non-blocking. */
+		old_flags = fcntl(sockfd, F_GETFL, 0);
+		if (old_flags == -1 || set_blocking(sockfd, true) == -1) {
+			return (ssize_t)-1;
+		}
 		/* VFS_RECVFILE must drain the socket
 		 * before returning. */
 		req->unread_bytes = 0;
-		return SMB_VFS_RECVFILE(req->sconn->sock,
+		ret = SMB_VFS_RECVFILE(sockfd,
 					fsp,
 					offset,
 					N);
+		if (fcntl(sockfd, F_SETFL, old_flags) == -1) {
+			return (ssize_t)-1;
+		}
+		return ret;
 	}
 
 	while (total < N) {
@@ -1325,6 +1350,70 @@ ssize_t smb_vfs_call_pread(struct vfs_handle_struct *handle,
 	return handle->fns->pread(handle, fsp, data, n, offset);
 }
 
+struct smb_vfs_call_pread_state {
+	ssize_t (*recv_fn)(struct tevent_req *req, int *perrno);
+	ssize_t retval;
+};
+
+static void smb_vfs_call_pread_done(struct tevent_req *subreq);
+
+struct tevent_req *smb_vfs_call_pread_send(struct vfs_handle_struct *handle,
+					   TALLOC_CTX *mem_ctx,
+					   struct tevent_context *ev,
+					   struct files_struct *fsp,
+					   void *data,
+					   size_t n, SMB_OFF_T offset)
+{
+	struct tevent_req *req, *subreq;
+	struct smb_vfs_call_pread_state *state;
+
+	req = tevent_req_create(mem_ctx, &state,
+				struct smb_vfs_call_pread_state);
+	if (req == NULL) {
+		return NULL;
+	}
+	VFS_FIND(pread_send);
+	state->recv_fn = handle->fns->pread_recv;
+
+	subreq = handle->fns->pread_send(handle, state, ev, fsp, data, n,
+					 offset);
+	if (tevent_req_nomem(subreq, req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(subreq, smb_vfs_call_pread_done, req);
+	return req;
+}
+
+static void smb_vfs_call_pread_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct smb_vfs_call_pread_state *state = tevent_req_data(
+		req, struct smb_vfs_call_pread_state);
+	int err;
+
+	state->retval = state->recv_fn(subreq, &err);
+	TALLOC_FREE(subreq);
+	if (state->retval == -1) {
+		tevent_req_error(req, err);
+		return;
+	}
+	tevent_req_done(req);
+}
+
+ssize_t smb_vfs_call_pread_recv(struct tevent_req *req, int *perrno)
+{
+	struct smb_vfs_call_pread_state *state = tevent_req_data(
+		req, struct smb_vfs_call_pread_state);
+	int err;
+
+	if (tevent_req_is_unix_error(req, &err)) {
+		*perrno = err;
+		return -1;
+	}
+	return state->retval;
+}
+
 ssize_t smb_vfs_call_write(struct vfs_handle_struct *handle,
 			   struct files_struct *fsp, const void *data,
 			   size_t n)
@@ -1341,6 +1430,70 @@ ssize_t smb_vfs_call_pwrite(struct vfs_handle_struct *handle,
 	return handle->fns->pwrite(handle, fsp, data, n, offset);
 }
 
+struct smb_vfs_call_pwrite_state {
+	ssize_t (*recv_fn)(struct tevent_req *req, int *perrno);
+	ssize_t retval;
+};
+
+static void smb_vfs_call_pwrite_done(struct tevent_req *subreq);
+
+struct tevent_req *smb_vfs_call_pwrite_send(struct vfs_handle_struct *handle,
+					    TALLOC_CTX *mem_ctx,
+					    struct tevent_context *ev,
+					    struct files_struct *fsp,
+					    const void *data,
+					    size_t n, SMB_OFF_T offset)
+{
+	struct tevent_req *req, *subreq;
+	struct smb_vfs_call_pwrite_state *state;
+
+	req = tevent_req_create(mem_ctx, &state,
+				struct smb_vfs_call_pwrite_state);
+	if (req == NULL) {
+		return NULL;
+	}
+	VFS_FIND(pwrite_send);
+	state->recv_fn = handle->fns->pwrite_recv;
+
+	subreq = handle->fns->pwrite_send(handle, state, ev, fsp, data, n,
+					  offset);
+	if (tevent_req_nomem(subreq, req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(subreq, smb_vfs_call_pwrite_done, req);
+	return req;
+}
+
+static void smb_vfs_call_pwrite_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct smb_vfs_call_pwrite_state *state = tevent_req_data(
+		req, struct smb_vfs_call_pwrite_state);
+	int err;
+
+	state->retval = state->recv_fn(subreq, &err);
+	TALLOC_FREE(subreq);
+	if (state->retval == -1) {
+		tevent_req_error(req, err);
+		return;
+	}
+	tevent_req_done(req);
+}
+
+ssize_t smb_vfs_call_pwrite_recv(struct tevent_req *req, int *perrno)
+{
+	struct smb_vfs_call_pwrite_state *state = tevent_req_data(
+		req, struct smb_vfs_call_pwrite_state);
+	int err;
+
+	if (tevent_req_is_unix_error(req, &err)) {
+		*perrno = err;
+		return -1;
+	}
+	return state->retval;
+}
+
 SMB_OFF_T smb_vfs_call_lseek(struct vfs_handle_struct *handle,
 			     struct files_struct *fsp, SMB_OFF_T offset,
 			     int whence)
@@ -1381,6 +1534,67 @@ int smb_vfs_call_fsync(struct vfs_handle_struct *handle,
 	return handle->fns->fsync(handle, fsp);
 }
 
+struct smb_vfs_call_fsync_state {
+	int (*recv_fn)(struct tevent_req *req, int *perrno);
+	int retval;
+};
+
+static void smb_vfs_call_fsync_done(struct tevent_req *subreq);
+
+struct tevent_req *smb_vfs_call_fsync_send(struct vfs_handle_struct *handle,
+					   TALLOC_CTX *mem_ctx,
+					   struct tevent_context *ev,
+					   struct files_struct *fsp)
+{
+	struct tevent_req *req, *subreq;
+	struct smb_vfs_call_fsync_state *state;
+
+	req = tevent_req_create(mem_ctx, &state,
+				struct smb_vfs_call_fsync_state);
+	if (req == NULL) {
+		return NULL;
+	}
+	VFS_FIND(fsync_send);
+	state->recv_fn = handle->fns->fsync_recv;
+
+	subreq = handle->fns->fsync_send(handle, state, ev, fsp);
+	if (tevent_req_nomem(subreq, req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(subreq, smb_vfs_call_fsync_done, req);
+	return req;
+}
+
+static void smb_vfs_call_fsync_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct smb_vfs_call_fsync_state *state = tevent_req_data(
+		req, struct smb_vfs_call_fsync_state);
+	int err;
+
+	state->retval = state->recv_fn(subreq, &err);
+	TALLOC_FREE(subreq);
+	if (state->retval == -1) {
+		tevent_req_error(req, err);
+		return;
+	}
+	tevent_req_done(req);
+}
+
+int smb_vfs_call_fsync_recv(struct tevent_req *req, int *perrno)
+{
+	struct smb_vfs_call_fsync_state *state = tevent_req_data(
+		req, struct smb_vfs_call_fsync_state);
+	int err;
+
+	if (tevent_req_is_unix_error(req, &err)) {
+		*perrno = err;
+		return -1;
+	}
+	return state->retval;
+}
+
 int smb_vfs_call_stat(struct vfs_handle_struct *handle,
 		      struct smb_filename *smb_fname)
 {
@@ -4529,6 +4529,7 @@ static NTSTATUS rpc_aliaslist_internals(struct net_context *c,
 
 static void init_user_token(struct security_token *token, struct dom_sid *user_sid)
 {
+	ZERO_STRUCTP(token);
 	token->num_sids = 4;
 
 	if (!(token->sids = SMB_MALLOC_ARRAY(struct dom_sid, 4))) {
@@ -129,6 +129,16 @@ bool status_profile_dump(bool verbose)
 	d_printf("misses:                         %u\n", profile_p->statcache_misses);
 	d_printf("hits:                           %u\n", profile_p->statcache_hits);
 
+	profile_separator("Security Descriptor Cache");
+	d_printf("lookups:                        %u\n", profile_p->sdcache_lookups);
+	d_printf("misses:                         %u\n", profile_p->sdcache_misses);
+	d_printf("hits:                           %u\n", profile_p->sdcache_hits);
+
+	profile_separator("Directory Name Index");
+	d_printf("lookups:                        %u\n", profile_p->dirindex_lookups);
+	d_printf("misses:                         %u\n", profile_p->dirindex_misses);
+	d_printf("hits:                           %u\n", profile_p->dirindex_hits);
+
 	profile_separator("Write Cache");
 	d_printf("read_hits:                      %u\n", profile_p->writecache_read_hits);
 	d_printf("abutted_writes:                 %u\n", profile_p->writecache_abutted_writes);
@@ -170,6 +170,13 @@ struct auth_session_info *auth_session_info_from_transport(TALLOC_CTX *mem_ctx,
 	struct auth_session_info *session_info;
 	session_info = talloc_steal(mem_ctx, session_info_transport->session_info);
 
+	/* the SID index is not marshalled */
+	if (session_info->security_token != NULL &&
+	    !NT_STATUS_IS_OK(security_token_index_sids(session_info->security_token))) {
+		*reason = "Out of memory in security_token_index_sids()";
+		return NULL;
+	}
+
 	if (session_info_transport->exported_gssapi_credentials.length) {
 		struct cli_credentials *creds;
 		OM_uint32 minor_status;
@@ -0,0 +1,222 @@
+/*
+   Unix SMB/CIFS implementation.
+
+   DNS server caches
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "includes.h"
+#include "lib/util/dlinklist.h"
+#include "dns_server/dns_cache.h"
+
+struct dns_cache_entry {
+	/* LRU list, most recently used first */
+	struct dns_cache_entry *prev, *next;
+	/* hash chain */
+	struct dns_cache_entry *hnext;
+	uint32_t hash;
+	DATA_BLOB key;
+	void *value;
+	size_t size;
+};
+
+struct dns_cache {
+	struct dns_cache_entry **buckets;
+	uint32_t num_buckets;
+	struct dns_cache_entry *lru;
+	size_t max_size;
+	struct dns_cache_stats stats;
+};
+
+#define DNS_CACHE_MIN_BUCKETS 256
+
+static uint32_t dns_cache_hash(DATA_BLOB key)
+{
+	/* FNV-1a */
+	uint32_t h = 2166136261U;
+	size_t i;
+
+	for (i = 0; i < key.length; i++) {
+		h ^= key.data[i];
+		h *= 16777619U;
+	}
+	return h;
+}
+
+struct dns_cache *dns_cache_init(TALLOC_CTX *mem_ctx, size_t max_size)
+{
+	struct dns_cache *cache;
+
+	cache = talloc_zero(mem_ctx, struct dns_cache);
+	if (cache == NULL) {
+		return NULL;
+	}
+	cache->max_size = max_size;
+	cache->num_buckets = DNS_CACHE_MIN_BUCKETS;
+	cache->buckets = talloc_zero_array(cache, struct dns_cache_entry *,
+					   cache->num_buckets);
+	if (cache->buckets == NULL) {
+		talloc_free(cache);
+		return NULL;
+	}
+	return cache;
+}
+
+static struct dns_cache_entry **dns_cache_find(struct dns_cache *cache,
+					       DATA_BLOB key, uint32_t hash)
+{
+	struct dns_cache_entry **pe;
+
+	for (pe = &cache->buckets[hash % cache->num_buckets]; *pe != NULL;
+	     pe = &(*pe)->hnext) {
+		struct dns_cache_entry *e = *pe;
+
+		if (e->hash == hash && data_blob_cmp(&e->key, &key) == 0) {
+			break;
+		}
+	}
+	return pe;
+}
+
+static void dns_cache_remove(struct dns_cache *cache,
+			     struct dns_cache_entry **pe)
+{
+	struct dns_cache_entry *e = *pe;
+
+	*pe = e->hnext;
+	DLIST_REMOVE(cache->lru, e);
+	cache->stats.num_entries -= 1;
+	cache->stats.size -= e->size;
+	talloc_free(e);
+}
+
+static void dns_cache_grow(struct dns_cache *cache)
+{
+	struct dns_cache_entry **buckets;
+	struct dns_cache_entry *e;
+	uint32_t num_buckets = cache->num_buckets * 2;
+
+	buckets = talloc_zero_array(cache, struct dns_cache_entry *,
+				    num_buckets);
+	if (buckets == NULL) {
+		/* longer chains then, no harm done */
+		return;
+	}
+
+	for (e = cache->lru; e != NULL; e = e->next) {
+		uint32_t b = e->hash % num_buckets;
+
+		e->hnext = buckets[b];
+		buckets[b] = e;
+	}
+
+	talloc_free(cache->buckets);
+	cache->buckets = buckets;
+	cache->num_buckets = num_buckets;
+}
+
+void *dns_cache_lookup(struct dns_cache *cache, DATA_BLOB key)
+{
+	struct dns_cache_entry *e;
+
+	cache->stats.lookups += 1;
+
+	e = *dns_cache_find(cache, key, dns_cache_hash(key));
+	if (e == NULL) {
+		return NULL;
+	}
+	cache->stats.hits += 1;
+
+	if (e != cache->lru) {
+		DLIST_PROMOTE(cache->lru, e);
+	}
+
+	return e->value;
+}
+
+bool dns_cache_add(struct dns_cache *cache, DATA_BLOB key,
+		   void *value, size_t size)
+{
+	struct dns_cache_entry *e, **pe;
+	uint32_t hash = dns_cache_hash(key);
+
+	size += sizeof(struct dns_cache_entry) + key.length;
+	if (size > cache->max_size) {
+		return false;
+	}
+
+	pe = dns_cache_find(cache, key, hash);
+	if (*pe != NULL) {
+		dns_cache_remove(cache, pe);
+	}
+
+	while (cache->stats.size + size > cache->max_size) {
+		struct dns_cache_entry *victim = DLIST_TAIL(cache->lru);
+
+		dns_cache_remove(cache, dns_cache_find(cache, victim->key,
+						       victim->hash));
+	}
+
+	e = talloc(cache, struct dns_cache_entry);
+	if (e == NULL) {
+		return false;
+	}
+	e->key = data_blob_talloc(e, key.data, key.length);
+	if (e->key.data == NULL) {
+		talloc_free(e);
+		return false;
+	}
+	e->hash = hash;
+	e->size = size;
+	e->value = talloc_steal(e, value);
+
+	DLIST_ADD(cache->lru, e);
+
+	pe = &cache->buckets[hash % cache->num_buckets];
+	e->hnext = *pe;
+	*pe = e;
+
+	cache->stats.num_entries += 1;
+	cache->stats.size += size;
+
+	if (cache->stats.num_entries > cache->num_buckets * 2) {
+		dns_cache_grow(cache);
+	}
+
+	return true;
+}
+
+void dns_cache_flush(struct dns_cache *cache)
+{
+	struct dns_cache_entry *e, *next;
+
+	for (e = cache->lru; e != NULL; e = next) {
+		next = e->next;
+		talloc_free(e);
+	}
+	cache->lru = NULL;
+	memset(cache->buckets, 0,
+	       sizeof(struct dns_cache_entry *) * cache->num_buckets);
+
+	cache->stats.num_entries = 0;
+	cache->stats.size = 0;
+	cache->stats.flushes += 1;
+}
+
+void dns_cache_get_stats(struct dns_cache *cache,
+			 struct dns_cache_stats *stats)
+{
+	*stats = cache->stats;
+}
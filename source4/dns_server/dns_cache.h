@@ -0,0 +1,57 @@
+/*
+   Unix SMB/CIFS implementation.
+
+   DNS server caches
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __DNS_CACHE_H__
+#define __DNS_CACHE_H__
+
+/*
+ * A size bounded LRU cache of talloc objects keyed by blobs. The dns
+ * server keeps decoded dnsNode records and complete responses in it.
+ */
+struct dns_cache;
+
+struct dns_cache_stats {
+	uint64_t lookups;
+	uint64_t hits;
+	uint64_t flushes;
+	unsigned int num_entries;
+	size_t size;
+};
+
+struct dns_cache *dns_cache_init(TALLOC_CTX *mem_ctx, size_t max_size);
+
+/*
+ * The object still belongs to the cache. It stays valid until the
+ * next dns_cache_add() or dns_cache_flush().
+ */
+void *dns_cache_lookup(struct dns_cache *cache, DATA_BLOB key);
+
+/*
+ * Steal value into the cache, size is what it accounts for. Returns
+ * false, and leaves value alone, if it does not fit.
+ */
+bool dns_cache_add(struct dns_cache *cache, DATA_BLOB key,
+		   void *value, size_t size);
+
+void dns_cache_flush(struct dns_cache *cache);
+
+void dns_cache_get_stats(struct dns_cache *cache,
+			 struct dns_cache_stats *stats);
+
+#endif /* __DNS_CACHE_H__ */
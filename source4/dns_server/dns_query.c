@@ -28,57 +28,128 @@
 #include "dsdb/samdb/samdb.h"
 #include "dsdb/common/util.h"
 #include "dns_server/dns_server.h"
+#include "dns_server/dns_cache.h"
 
-static WERROR handle_question(struct dns_server *dns,
+/*
+ * The decoded dnsRecord values of a dnsNode, num_recs == 0 caches the
+ * fact that the node does not exist.
+ */
+struct dns_node_records {
+	unsigned int num_recs;
+	struct dnsp_DnssrvRpcRecord *recs;
+};
+
+static WERROR dns_lookup_node(struct dns_server *dns,
 			      TALLOC_CTX *mem_ctx,
-			      const struct dns_name_question *question,
-			      struct dns_res_rec **answers, uint16_t *ancount)
+			      struct ldb_dn *dn,
+			      struct dns_node_records **_node)
 {
-	struct dns_res_rec *ans;
-	struct ldb_dn *dn = NULL;
-	WERROR werror;
 	static const char * const attrs[] = { "dnsRecord", NULL};
-	int ret;
-	uint16_t ai = *ancount;
-	unsigned int ri;
+	struct dns_node_records *node;
 	struct ldb_message *msg = NULL;
-	struct dnsp_DnssrvRpcRecord *recs;
 	struct ldb_message_element *el;
+	const char *key = NULL;
+	unsigned int ri;
+	int ret;
 
-	werror = dns_name2dn(dns, mem_ctx, question->name, &dn);
-	W_ERROR_NOT_OK_RETURN(werror);
+	if (dns->cache.nodes != NULL) {
+		key = ldb_dn_get_casefold(dn);
+		W_ERROR_HAVE_NO_MEMORY(key);
+
+		node = (struct dns_node_records *)dns_cache_lookup(
+			dns->cache.nodes, data_blob_const(key, strlen(key)));
+		if (node != NULL) {
+			*_node = node;
+			return WERR_OK;
+		}
+	}
 
-	ret = dsdb_search_one(dns->samdb, mem_ctx, &msg, dn,
+	node = talloc_zero(mem_ctx, struct dns_node_records);
+	W_ERROR_HAVE_NO_MEMORY(node);
+
+	ret = dsdb_search_one(dns->samdb, node, &msg, dn,
 			      LDB_SCOPE_BASE, attrs, 0, "%s", "(objectClass=dnsNode)");
+	if (ret == LDB_ERR_NO_SUCH_OBJECT) {
+		goto done;
+	}
 	if (ret != LDB_SUCCESS) {
-		return DNS_ERR(NAME_ERROR);
+		/*
+		 * Not proof that the name does not exist, so answer
+		 * with a failure that neither cache remembers.
+		 */
+		DEBUG(2, ("Failed to look up %s: %s\n",
+			  ldb_dn_get_linearized(dn), ldb_strerror(ret)));
+		return DNS_ERR(SERVER_FAILURE);
 	}
 
 	el = ldb_msg_find_element(msg, attrs[0]);
 	if (el == NULL) {
-		return DNS_ERR(NAME_ERROR);
+		goto done;
 	}
 
-	recs = talloc_array(mem_ctx, struct dnsp_DnssrvRpcRecord, el->num_values);
+	node->recs = talloc_array(node, struct dnsp_DnssrvRpcRecord,
+				  el->num_values);
+	W_ERROR_HAVE_NO_MEMORY(node->recs);
+
 	for (ri = 0; ri < el->num_values; ri++) {
 		struct ldb_val *v = &el->values[ri];
 		enum ndr_err_code ndr_err;
 
-		ndr_err = ndr_pull_struct_blob(v, recs, &recs[ri],
+		ndr_err = ndr_pull_struct_blob(v, node->recs, &node->recs[ri],
 				(ndr_pull_flags_fn_t)ndr_pull_dnsp_DnssrvRpcRecord);
 		if (!NDR_ERR_CODE_IS_SUCCESS(ndr_err)) {
 			DEBUG(0, ("Failed to grab dnsp_DnssrvRpcRecord\n"));
 			return DNS_ERR(SERVER_FAILURE);
 		}
 	}
+	node->num_recs = el->num_values;
+
+done:
+	TALLOC_FREE(msg);
+
+	if (key != NULL) {
+		dns_cache_add(dns->cache.nodes,
+			      data_blob_const(key, strlen(key)),
+			      node, talloc_total_size(node));
+	}
+
+	*_node = node;
+	return WERR_OK;
+}
+
+static WERROR handle_question(struct dns_server *dns,
+			      TALLOC_CTX *mem_ctx,
+			      const struct dns_name_question *question,
+			      struct dns_res_rec **answers, uint16_t *ancount)
+{
+	struct dns_res_rec *ans;
+	struct ldb_dn *dn = NULL;
+	WERROR werror;
+	uint16_t ai = *ancount;
+	unsigned int ri;
+	struct dns_node_records *node;
+	struct dnsp_DnssrvRpcRecord *recs;
+	unsigned int num_recs;
+
+	werror = dns_name2dn(dns, mem_ctx, question->name, &dn);
+	W_ERROR_NOT_OK_RETURN(werror);
+
+	werror = dns_lookup_node(dns, mem_ctx, dn, &node);
+	W_ERROR_NOT_OK_RETURN(werror);
+
+	if (node->num_recs == 0) {
+		return DNS_ERR(NAME_ERROR);
+	}
+	recs = node->recs;
+	num_recs = node->num_recs;
 
 	ans = talloc_realloc(mem_ctx, *answers, struct dns_res_rec,
-			     ai + el->num_values);
+			     ai + num_recs);
 	W_ERROR_HAVE_NO_MEMORY(ans);
 
 	switch (question->question_type) {
 	case DNS_QTYPE_CNAME:
-		for (ri = 0; ri < el->num_values; ri++) {
+		for (ri = 0; ri < num_recs; ri++) {
 			if (recs[ri].wType != question->question_type) {
 				continue;
 			}
@@ -94,7 +165,7 @@ static WERROR handle_question(struct dns_server *dns,
 		}
 		break;
 	case DNS_QTYPE_A:
-		for (ri = 0; ri < el->num_values; ri++) {
+		for (ri = 0; ri < num_recs; ri++) {
 			if (recs[ri].wType != question->question_type) {
 				continue;
 			}
@@ -112,7 +183,7 @@ static WERROR handle_question(struct dns_server *dns,
 		}
 		break;
 	case DNS_QTYPE_AAAA:
-		for (ri = 0; ri < el->num_values; ri++) {
+		for (ri = 0; ri < num_recs; ri++) {
 			if (recs[ri].wType != question->question_type) {
 				continue;
 			}
@@ -128,7 +199,7 @@ static WERROR handle_question(struct dns_server *dns,
 		}
 		break;
 	case DNS_QTYPE_NS:
-		for (ri = 0; ri < el->num_values; ri++) {
+		for (ri = 0; ri < num_recs; ri++) {
 			if (recs[ri].wType != question->question_type) {
 				continue;
 			}
@@ -144,7 +215,7 @@ static WERROR handle_question(struct dns_server *dns,
 		}
 		break;
 	case DNS_QTYPE_SRV:
-		for (ri = 0; ri < el->num_values; ri++) {
+		for (ri = 0; ri < num_recs; ri++) {
 			if (recs[ri].wType != question->question_type) {
 				continue;
 			}
@@ -163,7 +234,7 @@ static WERROR handle_question(struct dns_server *dns,
 		}
 		break;
 	case DNS_QTYPE_SOA:
-		for (ri = 0; ri < el->num_values; ri++) {
+		for (ri = 0; ri < num_recs; ri++) {
 			if (recs[ri].wType != question->question_type) {
 				continue;
 			}
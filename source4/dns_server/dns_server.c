@@ -33,6 +33,7 @@
 #include "lib/stream/packet.h"
 #include "lib/socket/netif.h"
 #include "dns_server/dns_server.h"
+#include "dns_server/dns_cache.h"
 #include "param/param.h"
 #include "librpc/ndr/libndr.h"
 #include "librpc/gen_ndr/ndr_dns.h"
@@ -93,6 +94,60 @@ static void dns_tcp_send(struct stream_connection *conn, uint16_t flags)
 	dns_tcp_terminate_connection(dnsconn, "dns_tcp_send: called");
 }
 
+/*
+ * Drop everything we cached once the sam.ldb sequence number moved,
+ * asking at most every "dns:cache check interval" milliseconds.
+ */
+static void dns_cache_check(struct dns_server *dns)
+{
+	struct timeval now;
+	uint64_t seq_num = 0;
+	int ret;
+
+	if (dns->cache.nodes == NULL && dns->cache.responses == NULL) {
+		return;
+	}
+
+	now = timeval_current();
+	if (dns->cache.check_interval > 0 &&
+	    !timeval_is_zero(&dns->cache.checked) &&
+	    timeval_elapsed2(&dns->cache.checked, &now) * 1000 <
+	    dns->cache.check_interval) {
+		return;
+	}
+	dns->cache.checked = now;
+
+	ret = ldb_sequence_number(dns->samdb, LDB_SEQ_HIGHEST_SEQ, &seq_num);
+	if (ret == LDB_SUCCESS && seq_num == dns->cache.seq_num) {
+		return;
+	}
+	dns->cache.seq_num = seq_num;
+
+	if (dns->cache.nodes != NULL) {
+		dns_cache_flush(dns->cache.nodes);
+	}
+	if (dns->cache.responses != NULL) {
+		dns_cache_flush(dns->cache.responses);
+	}
+}
+
+/*
+ * Queries are cached as the request without its id, which is the
+ * only thing that differs between two answers to it.
+ */
+static bool dns_response_cache_key(struct dns_server *dns,
+				   const DATA_BLOB *in, DATA_BLOB *key)
+{
+	if (dns->cache.responses == NULL) {
+		return false;
+	}
+	if ((RSVAL(in->data, 2) & DNS_OPCODE) != DNS_OPCODE_QUERY) {
+		return false;
+	}
+	*key = data_blob_const(in->data + 2, in->length - 2);
+	return true;
+}
+
 static NTSTATUS dns_process(struct dns_server *dns,
 			    TALLOC_CTX *mem_ctx,
 			    DATA_BLOB *in,
@@ -104,11 +159,34 @@ static NTSTATUS dns_process(struct dns_server *dns,
 	struct dns_name_packet *out_packet;
 	struct dns_res_rec *answers = NULL, *nsrecs = NULL, *additional = NULL;
 	uint16_t num_answers = 0 , num_nsrecs = 0, num_additional = 0;
+	DATA_BLOB cache_key;
+	bool cacheable;
 
 	if (in->length < 12) {
 		return NT_STATUS_INVALID_PARAMETER;
 	}
 
+	dns_cache_check(dns);
+
+	cacheable = dns_response_cache_key(dns, in, &cache_key);
+	if (cacheable) {
+		uint8_t *cached;
+
+		cached = (uint8_t *)dns_cache_lookup(dns->cache.responses,
+						     cache_key);
+		if (cached != NULL) {
+			*out = data_blob_talloc(mem_ctx, cached,
+						talloc_get_size(cached));
+			if (out->data == NULL) {
+				return NT_STATUS_NO_MEMORY;
+			}
+			/* the id is the one thing not in the key */
+			out->data[0] = in->data[0];
+			out->data[1] = in->data[1];
+			return NT_STATUS_OK;
+		}
+	}
+
 	in_packet = talloc_zero(mem_ctx, struct dns_name_packet);
 	/* TODO: We don't really need an out_packet. */
 	out_packet = talloc_zero(mem_ctx, struct dns_name_packet);
@@ -166,6 +244,13 @@ static NTSTATUS dns_process(struct dns_server *dns,
 		out_packet->additional = additional;
 	} else {
 		out_packet->operation |= werr_to_dns_err(ret);
+		/*
+		 * Only a name that really does not exist is worth
+		 * remembering, a SERVER_FAILURE may be gone next time.
+		 */
+		if (!W_ERROR_EQUAL(ret, DNS_ERR(NAME_ERROR))) {
+			cacheable = false;
+		}
 	}
 
 	NDR_PRINT_DEBUG(dns_name_packet, out_packet);
@@ -184,6 +269,19 @@ static NTSTATUS dns_process(struct dns_server *dns,
 	}
 
 	dump_data(2, out->data, out->length);
+
+	if (cacheable) {
+		uint8_t *cached;
+
+		cached = (uint8_t *)talloc_memdup(dns->cache.responses,
+						  out->data, out->length);
+		if (cached != NULL &&
+		    !dns_cache_add(dns->cache.responses, cache_key,
+				   cached, out->length)) {
+			TALLOC_FREE(cached);
+		}
+	}
+
 	return NT_STATUS_OK;
 }
 
@@ -603,6 +701,7 @@ static void dns_task_init(struct task_server *task)
 	struct ldb_result *res;
 	static const char * const attrs[] = { "name", NULL};
 	unsigned int i;
+	int cache_size;
 
 	switch (lpcfg_server_role(task->lp_ctx)) {
 	case ROLE_STANDALONE:
@@ -640,6 +739,20 @@ static void dns_task_init(struct task_server *task)
 		return;
 	}
 
+	dns->cache.check_interval = lpcfg_parm_int(task->lp_ctx, NULL, "dns",
+						   "cache check interval",
+						   1000);
+	cache_size = lpcfg_parm_int(task->lp_ctx, NULL, "dns",
+				    "node cache size", 4096);
+	if (cache_size > 0) {
+		dns->cache.nodes = dns_cache_init(dns, cache_size * 1024);
+	}
+	cache_size = lpcfg_parm_int(task->lp_ctx, NULL, "dns",
+				    "response cache size", 4096);
+	if (cache_size > 0) {
+		dns->cache.responses = dns_cache_init(dns, cache_size * 1024);
+	}
+
 	// TODO: this search does not work against windows
 	ret = dsdb_search(dns->samdb, dns, &res, NULL, LDB_SCOPE_SUBTREE,
 			  attrs, DSDB_SEARCH_SEARCH_ALL_PARTITIONS, "(objectClass=dnsZone)");
@@ -25,6 +25,7 @@
 #include "librpc/gen_ndr/dns.h"
 
 struct tsocket_address;
+struct dns_cache;
 
 struct dns_server_zone {
 	struct dns_server_zone *prev, *next;
@@ -36,6 +37,18 @@ struct dns_server {
 	struct task_server *task;
 	struct ldb_context *samdb;
 	struct dns_server_zone *zones;
+
+	/*
+	 * Decoded dnsNode records and whole responses, both are
+	 * thrown away when the sam.ldb sequence number moves.
+	 */
+	struct {
+		struct dns_cache *nodes;
+		struct dns_cache *responses;
+		uint64_t seq_num;
+		struct timeval checked;
+		int check_interval;
+	} cache;
 };
 
 
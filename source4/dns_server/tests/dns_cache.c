@@ -0,0 +1,393 @@
+/*
+   Unix SMB/CIFS implementation.
+
+   DNS server cache tests
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "includes.h"
+#include "torture/torture.h"
+#include "system/time.h"
+#include <ldb.h>
+#include "ldb_wrap.h"
+#include "librpc/gen_ndr/ndr_dnsp.h"
+#include "param/param.h"
+#include "dns_server/dns_cache.h"
+
+static bool cache_add_str(struct dns_cache *cache, const char *key,
+			  const char *value)
+{
+	char *v = talloc_strdup(NULL, value);
+	bool ok;
+
+	ok = dns_cache_add(cache, data_blob_string_const(key), v, strlen(v));
+	if (!ok) {
+		talloc_free(v);
+	}
+	return ok;
+}
+
+static const char *cache_get_str(struct dns_cache *cache, const char *key)
+{
+	return (const char *)dns_cache_lookup(cache,
+					      data_blob_string_const(key));
+}
+
+static bool test_dns_cache_lru(struct torture_context *tctx)
+{
+	struct dns_cache *cache;
+	struct dns_cache_stats stats;
+	char key[16];
+	int i, n;
+
+	cache = dns_cache_init(tctx, 4096);
+	torture_assert(tctx, cache != NULL, "dns_cache_init");
+
+	/* fill it up until something falls out */
+	for (n = 0; ; n++) {
+		snprintf(key, sizeof(key), "key%d", n);
+		torture_assert(tctx, cache_add_str(cache, key, "value"),
+			       "dns_cache_add");
+		if (cache_get_str(cache, "key0") == NULL) {
+			break;
+		}
+	}
+	torture_assert(tctx, n > 10, "cache holds too few entries");
+
+	dns_cache_get_stats(cache, &stats);
+	torture_assert(tctx, stats.size <= 4096, "cache is over its size");
+	torture_assert_int_equal(tctx, stats.num_entries, n,
+				 "wrong number of entries");
+
+	/* touch the oldest one, the next one has to go instead */
+	torture_assert_str_equal(tctx, cache_get_str(cache, "key1"), "value",
+				 "key1 missing");
+	torture_assert(tctx, cache_add_str(cache, "new", "value"),
+		       "dns_cache_add");
+	torture_assert(tctx, cache_get_str(cache, "key1") != NULL,
+		       "recently used entry was evicted");
+	torture_assert(tctx, cache_get_str(cache, "key2") == NULL,
+		       "least recently used entry was kept");
+
+	/* replacing a key keeps one entry */
+	torture_assert(tctx, cache_add_str(cache, "new", "other"),
+		       "dns_cache_add");
+	torture_assert_str_equal(tctx, cache_get_str(cache, "new"), "other",
+				 "replaced value");
+
+	for (i = 3; i <= n; i++) {
+		snprintf(key, sizeof(key), "key%d", i);
+		torture_assert(tctx, cache_get_str(cache, key) != NULL,
+			       "entry lost");
+	}
+
+	dns_cache_get_stats(cache, &stats);
+	torture_assert_int_equal(tctx, stats.num_entries, n,
+				 "wrong number of entries");
+
+	talloc_free(cache);
+	return true;
+}
+
+static bool test_dns_cache_flush(struct torture_context *tctx)
+{
+	struct dns_cache *cache;
+	struct dns_cache_stats stats;
+	char key[16];
+	char *big;
+	int i;
+
+	cache = dns_cache_init(tctx, 1024*1024);
+	torture_assert(tctx, cache != NULL, "dns_cache_init");
+
+	/* enough to make the hash table grow */
+	for (i = 0; i < 2000; i++) {
+		snprintf(key, sizeof(key), "key%d", i);
+		torture_assert(tctx, cache_add_str(cache, key, key),
+			       "dns_cache_add");
+	}
+	for (i = 0; i < 2000; i++) {
+		snprintf(key, sizeof(key), "key%d", i);
+		torture_assert_str_equal(tctx, cache_get_str(cache, key), key,
+					 "lookup after growing");
+	}
+
+	dns_cache_flush(cache);
+
+	dns_cache_get_stats(cache, &stats);
+	torture_assert_int_equal(tctx, stats.num_entries, 0, "entries left");
+	torture_assert_int_equal(tctx, stats.size, 0, "size left");
+	torture_assert_int_equal(tctx, stats.flushes, 1, "flushes");
+	torture_assert(tctx, cache_get_str(cache, "key0") == NULL,
+		       "entry survived the flush");
+
+	/* too big to ever fit, stays with the caller */
+	big = talloc_zero_array(tctx, char, 2*1024*1024);
+	torture_assert(tctx, big != NULL, "talloc_zero_array");
+	torture_assert(tctx, !dns_cache_add(cache, data_blob_string_const("big"),
+					    big, talloc_get_size(big)),
+		       "oversized entry accepted");
+	torture_assert(tctx, talloc_parent(big) == tctx,
+		       "oversized entry was stolen");
+
+	talloc_free(cache);
+	return true;
+}
+
+static bool add_dns_node(struct ldb_context *ldb, unsigned int i)
+{
+	struct ldb_message *msg;
+	struct dnsp_DnssrvRpcRecord rec;
+	struct ldb_val v;
+	enum ndr_err_code ndr_err;
+	int ret;
+
+	msg = ldb_msg_new(ldb);
+	if (msg == NULL) {
+		return false;
+	}
+	msg->dn = ldb_dn_new_fmt(msg, ldb,
+				 "DC=host%u,DC=example.com,CN=MicrosoftDNS", i);
+	if (msg->dn == NULL) {
+		goto failed;
+	}
+
+	ZERO_STRUCT(rec);
+	rec.wType = DNS_TYPE_A;
+	rec.rank = DNS_RANK_ZONE;
+	rec.dwTtlSeconds = 900;
+	rec.data.ipv4 = talloc_asprintf(msg, "10.%u.%u.%u",
+					(i >> 16) & 0xff, (i >> 8) & 0xff,
+					i & 0xff);
+
+	ndr_err = ndr_push_struct_blob(&v, msg, &rec,
+			(ndr_push_flags_fn_t)ndr_push_dnsp_DnssrvRpcRecord);
+	if (!NDR_ERR_CODE_IS_SUCCESS(ndr_err)) {
+		goto failed;
+	}
+
+	if (ldb_msg_add_string(msg, "objectClass", "dnsNode") != LDB_SUCCESS ||
+	    ldb_msg_add_value(msg, "dnsRecord", &v, NULL) != LDB_SUCCESS) {
+		goto failed;
+	}
+
+	ret = ldb_add(ldb, msg);
+	talloc_free(msg);
+	return ret == LDB_SUCCESS;
+
+failed:
+	talloc_free(msg);
+	return false;
+}
+
+struct node_records {
+	unsigned int num_recs;
+	struct dnsp_DnssrvRpcRecord *recs;
+};
+
+/* what the dns server does for a name it has not seen yet */
+static struct node_records *fetch_node(TALLOC_CTX *mem_ctx,
+				       struct ldb_context *ldb,
+				       struct ldb_dn *dn)
+{
+	static const char * const attrs[] = { "dnsRecord", NULL };
+	struct node_records *node;
+	struct ldb_result *res;
+	struct ldb_message_element *el;
+	unsigned int i;
+	int ret;
+
+	node = talloc_zero(mem_ctx, struct node_records);
+	if (node == NULL) {
+		return NULL;
+	}
+
+	ret = ldb_search(ldb, node, &res, dn, LDB_SCOPE_BASE, attrs,
+			 "(objectClass=dnsNode)");
+	if (ret == LDB_ERR_NO_SUCH_OBJECT) {
+		return node;
+	}
+	if (ret != LDB_SUCCESS || res->count != 1) {
+		talloc_free(node);
+		return NULL;
+	}
+
+	el = ldb_msg_find_element(res->msgs[0], "dnsRecord");
+	if (el == NULL) {
+		return node;
+	}
+
+	node->recs = talloc_array(node, struct dnsp_DnssrvRpcRecord,
+				  el->num_values);
+	for (i = 0; i < el->num_values; i++) {
+		enum ndr_err_code ndr_err;
+
+		ndr_err = ndr_pull_struct_blob(&el->values[i], node->recs,
+				&node->recs[i],
+				(ndr_pull_flags_fn_t)ndr_pull_dnsp_DnssrvRpcRecord);
+		if (!NDR_ERR_CODE_IS_SUCCESS(ndr_err)) {
+			talloc_free(node);
+			return NULL;
+		}
+	}
+	node->num_recs = el->num_values;
+	talloc_free(res);
+
+	return node;
+}
+
+/*
+  most lookups go to a few names, a few go to names that don't exist
+*/
+static unsigned int pick_name(unsigned int num_names)
+{
+	unsigned int r = random() % 100;
+
+	if (r < 5) {
+		return num_names + random() % num_names;
+	}
+	if (r < 90) {
+		return random() % (num_names / 10 + 1);
+	}
+	return random() % num_names;
+}
+
+static double replay_queries(struct torture_context *tctx,
+			     struct ldb_context *ldb,
+			     struct dns_cache *cache,
+			     unsigned int num_names,
+			     int timelimit)
+{
+	TALLOC_CTX *tmp_ctx = talloc_new(tctx);
+	struct timeval tv;
+	int count;
+
+	srandom(0);
+	tv = timeval_current();
+
+	for (count = 0; timeval_elapsed(&tv) < timelimit; count++) {
+		struct node_records *node = NULL;
+		struct ldb_dn *dn;
+		const char *key = NULL;
+		unsigned int i = pick_name(num_names);
+
+		dn = ldb_dn_new_fmt(tmp_ctx, ldb,
+				    "DC=host%u,DC=example.com,CN=MicrosoftDNS",
+				    i);
+		if (dn == NULL) {
+			count = -1;
+			break;
+		}
+
+		if (cache != NULL) {
+			key = ldb_dn_get_casefold(dn);
+			node = (struct node_records *)dns_cache_lookup(
+				cache, data_blob_string_const(key));
+		}
+		if (node == NULL) {
+			node = fetch_node(tmp_ctx, ldb, dn);
+			if (node == NULL) {
+				count = -1;
+				break;
+			}
+			if (cache != NULL) {
+				dns_cache_add(cache,
+					      data_blob_string_const(key),
+					      node, talloc_total_size(node));
+			}
+		}
+
+		if ((i < num_names) != (node->num_recs == 1)) {
+			count = -1;
+			break;
+		}
+
+		talloc_free_children(tmp_ctx);
+	}
+
+	talloc_free(tmp_ctx);
+
+	if (count < 0) {
+		return -1;
+	}
+	return count / timeval_elapsed(&tv);
+}
+
+/*
+  replay a query mix against dnsNode records in an ldb, once the way
+  the server used to and once through the node cache
+*/
+static bool test_dns_cache_speed(struct torture_context *tctx)
+{
+	int num_names = torture_setting_int(tctx, "dns_names", 5000);
+	int timelimit = torture_setting_int(tctx, "timelimit", 3);
+	struct ldb_context *ldb;
+	struct dns_cache *cache;
+	struct dns_cache_stats stats;
+	double uncached, cached;
+	int i;
+
+	unlink("./dns_cache.ldb");
+
+	ldb = ldb_wrap_connect(tctx, tctx->ev, tctx->lp_ctx,
+			       "tdb://dns_cache.ldb", NULL, NULL,
+			       LDB_FLG_NOSYNC);
+	torture_assert(tctx, ldb != NULL, "Failed to open dns_cache.ldb");
+
+	torture_comment(tctx, "Adding %d dnsNode records\n", num_names);
+
+	for (i = 0; i < num_names; i++) {
+		if (!add_dns_node(ldb, i)) {
+			unlink("./dns_cache.ldb");
+			torture_fail(tctx, "Failed to add dnsNode");
+		}
+	}
+
+	/* smaller than the zone, but bigger than the hot names */
+	cache = dns_cache_init(tctx, num_names * 100);
+	torture_assert(tctx, cache != NULL, "dns_cache_init");
+
+	uncached = replay_queries(tctx, ldb, NULL, num_names, timelimit);
+	cached = replay_queries(tctx, ldb, cache, num_names, timelimit);
+
+	talloc_free(ldb);
+	unlink("./dns_cache.ldb");
+
+	torture_assert(tctx, uncached > 0, "uncached replay failed");
+	torture_assert(tctx, cached > 0, "cached replay failed");
+
+	dns_cache_get_stats(cache, &stats);
+
+	torture_comment(tctx, "uncached: %.0f queries/sec\n", uncached);
+	torture_comment(tctx, "cached:   %.0f queries/sec, %.1f%% hits, "
+			"%u entries in %u bytes\n", cached,
+			stats.lookups ? 100.0 * stats.hits / stats.lookups : 0,
+			stats.num_entries, (unsigned)stats.size);
+
+	talloc_free(cache);
+	return true;
+}
+
+struct torture_suite *torture_local_dns_cache(TALLOC_CTX *mem_ctx)
+{
+	struct torture_suite *suite = torture_suite_create(mem_ctx,
+							   "dns.cache");
+
+	torture_suite_add_simple_test(suite, "lru", test_dns_cache_lru);
+	torture_suite_add_simple_test(suite, "flush", test_dns_cache_flush);
+	torture_suite_add_simple_test(suite, "speed", test_dns_cache_speed);
+
+	return suite;
+}
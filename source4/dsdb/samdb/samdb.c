@@ -247,6 +247,12 @@ NTSTATUS security_token_create(TALLOC_CTX *mem_ctx,
 		}
 	}
 
+	status = security_token_index_sids(ptoken);
+	if (!NT_STATUS_IS_OK(status)) {
+		talloc_free(ptoken);
+		return status;
+	}
+
 	security_token_debug(0, 10, ptoken);
 
 	*token = ptoken;
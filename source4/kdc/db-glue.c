@@ -37,6 +37,7 @@
 #include "kdc/kdc-glue.h"
 #include "kdc/kdc-policy.h"
 #include "kdc/db-glue.h"
+#include "lib/util/dlinklist.h"
 
 #define SAMBA_KVNO_GET_KRBTGT(kvno) \
 	((uint16_t)(((uint32_t)kvno) >> 16))
@@ -580,7 +581,7 @@ static krb5_error_code samba_kdc_message2entry(krb5_context context,
 
 	memset(entry_ex, 0, sizeof(*entry_ex));
 
-	p = talloc(mem_ctx, struct samba_kdc_entry);
+	p = talloc_zero(mem_ctx, struct samba_kdc_entry);
 	if (!p) {
 		ret = ENOMEM;
 		goto out;
@@ -845,7 +846,7 @@ static krb5_error_code samba_kdc_trust_message2entry(krb5_context context,
 	int ret, trust_direction_flags;
 	unsigned int i;
 
-	p = talloc(mem_ctx, struct samba_kdc_entry);
+	p = talloc_zero(mem_ctx, struct samba_kdc_entry);
 	if (!p) {
 		ret = ENOMEM;
 		goto out;
@@ -1372,6 +1373,411 @@ static krb5_error_code samba_kdc_fetch_server(krb5_context context,
 	return ret;
 }
 
+/*
+ * A bounded LRU cache of the entries samba_kdc_fetch() returned,
+ * keyed by what was asked for. Building an entry means an ldb search
+ * and unpacking supplementalCredentials, so a logon storm for the same
+ * few principals used to do the same work over and over.
+ *
+ * Everything is dropped when the sam.ldb sequence number moves, so a
+ * password change or a group membership change is seen by the next
+ * request.
+ */
+struct samba_kdc_cache_node {
+	struct samba_kdc_cache_node *prev, *next;
+	struct samba_kdc_cache_node *hnext;
+	uint32_t hash;
+	const char *key;
+	struct samba_kdc_cached_entry *cached;
+};
+
+struct samba_kdc_entry_cache {
+	struct samba_kdc_cache_node **buckets;
+	unsigned int num_buckets;
+	struct samba_kdc_cache_node *lru;
+	unsigned int num_entries;
+	unsigned int max_entries;
+	uint64_t seq_num;
+	uint64_t lookups;
+	uint64_t hits;
+	uint64_t flushes;
+	uint64_t evictions;
+};
+
+#define SAMBA_KDC_CACHE_STATS_INTERVAL 10000
+
+static int samba_kdc_cached_entry_destructor(struct samba_kdc_cached_entry *c)
+{
+	free_hdb_entry(&c->entry);
+	return 0;
+}
+
+static struct samba_kdc_entry_cache *samba_kdc_entry_cache_init(
+	TALLOC_CTX *mem_ctx, unsigned int max_entries)
+{
+	struct samba_kdc_entry_cache *cache;
+
+	cache = talloc_zero(mem_ctx, struct samba_kdc_entry_cache);
+	if (cache == NULL) {
+		return NULL;
+	}
+	cache->max_entries = max_entries;
+	cache->num_buckets = max_entries;
+	cache->buckets = talloc_zero_array(cache, struct samba_kdc_cache_node *,
+					   cache->num_buckets);
+	if (cache->buckets == NULL) {
+		talloc_free(cache);
+		return NULL;
+	}
+	return cache;
+}
+
+static uint32_t samba_kdc_cache_hash(const char *key)
+{
+	/* FNV-1a */
+	uint32_t h = 2166136261U;
+
+	for (; *key != '\0'; key++) {
+		h ^= (uint8_t)*key;
+		h *= 16777619U;
+	}
+	return h;
+}
+
+static struct samba_kdc_cache_node **samba_kdc_cache_find(
+	struct samba_kdc_entry_cache *cache, const char *key, uint32_t hash)
+{
+	struct samba_kdc_cache_node **pn;
+
+	for (pn = &cache->buckets[hash % cache->num_buckets]; *pn != NULL;
+	     pn = &(*pn)->hnext) {
+		if ((*pn)->hash == hash && strcmp((*pn)->key, key) == 0) {
+			break;
+		}
+	}
+	return pn;
+}
+
+static void samba_kdc_cache_remove(struct samba_kdc_entry_cache *cache,
+				   struct samba_kdc_cache_node **pn)
+{
+	struct samba_kdc_cache_node *n = *pn;
+
+	*pn = n->hnext;
+	DLIST_REMOVE(cache->lru, n);
+	cache->num_entries -= 1;
+	/* entries handed out keep their reference to n->cached */
+	talloc_free(n);
+}
+
+static void samba_kdc_cache_log_stats(struct samba_kdc_entry_cache *cache,
+				      const char *why)
+{
+	DEBUG(2, ("samba_kdc_fetch: entry cache %s: %llu lookups, "
+		  "%llu hits, %llu misses, %llu flushes, %llu evictions, "
+		  "%u entries\n", why,
+		  (unsigned long long)cache->lookups,
+		  (unsigned long long)cache->hits,
+		  (unsigned long long)(cache->lookups - cache->hits),
+		  (unsigned long long)cache->flushes,
+		  (unsigned long long)cache->evictions,
+		  cache->num_entries));
+}
+
+static void samba_kdc_cache_flush(struct samba_kdc_entry_cache *cache)
+{
+	struct samba_kdc_cache_node *n, *next;
+
+	for (n = cache->lru; n != NULL; n = next) {
+		next = n->next;
+		talloc_free(n);
+	}
+	cache->lru = NULL;
+	memset(cache->buckets, 0,
+	       sizeof(struct samba_kdc_cache_node *) * cache->num_buckets);
+	cache->num_entries = 0;
+	cache->flushes += 1;
+
+	samba_kdc_cache_log_stats(cache, "flushed");
+}
+
+/*
+ * Throw the cache away if the database changed since we filled it
+ */
+static void samba_kdc_cache_check(struct samba_kdc_db_context *kdc_db_ctx)
+{
+	struct samba_kdc_entry_cache *cache = kdc_db_ctx->entry_cache;
+	uint64_t seq_num = 0;
+	int ret;
+
+	ret = ldb_sequence_number(kdc_db_ctx->samdb, LDB_SEQ_HIGHEST_SEQ,
+				  &seq_num);
+	if (ret == LDB_SUCCESS && seq_num == cache->seq_num) {
+		return;
+	}
+	cache->seq_num = seq_num;
+
+	if (cache->num_entries > 0) {
+		samba_kdc_cache_flush(cache);
+	}
+}
+
+static char *samba_kdc_cache_key(krb5_context context,
+				 TALLOC_CTX *mem_ctx,
+				 krb5_const_principal principal,
+				 unsigned flags,
+				 unsigned int krbtgt_number)
+{
+	char *principal_string;
+	char *key;
+
+	if (krb5_unparse_name(context, principal, &principal_string) != 0) {
+		return NULL;
+	}
+	key = talloc_asprintf(mem_ctx, "%x:%u:%s", flags, krbtgt_number,
+			      principal_string);
+	free(principal_string);
+	return key;
+}
+
+/*
+ * copy_hdb_entry() is not exported by libhdb, so copy the entry with
+ * the pieces that are: copy_Keys(), copy_Event() and
+ * copy_HDB_extensions().
+ */
+#define SAMBA_KDC_COPY_OPTIONAL(field) do { \
+	if (from->field != NULL) { \
+		to->field = malloc(sizeof(*to->field)); \
+		if (to->field == NULL) { \
+			ret = ENOMEM; \
+			goto fail; \
+		} \
+		*to->field = *from->field; \
+	} \
+} while (0)
+
+static krb5_error_code samba_kdc_copy_hdb_entry(krb5_context context,
+						const hdb_entry *from,
+						hdb_entry *to)
+{
+	krb5_error_code ret;
+
+	memset(to, 0, sizeof(*to));
+
+	to->kvno = from->kvno;
+	to->flags = from->flags;
+
+	if (from->principal != NULL) {
+		ret = krb5_copy_principal(context, from->principal,
+					  &to->principal);
+		if (ret != 0) {
+			goto fail;
+		}
+	}
+
+	ret = copy_Keys(&from->keys, &to->keys);
+	if (ret != 0) {
+		goto fail;
+	}
+
+	ret = copy_Event(&from->created_by, &to->created_by);
+	if (ret != 0) {
+		goto fail;
+	}
+
+	if (from->modified_by != NULL) {
+		to->modified_by = calloc(1, sizeof(*to->modified_by));
+		if (to->modified_by == NULL) {
+			ret = ENOMEM;
+			goto fail;
+		}
+		ret = copy_Event(from->modified_by, to->modified_by);
+		if (ret != 0) {
+			goto fail;
+		}
+	}
+
+	SAMBA_KDC_COPY_OPTIONAL(valid_start);
+	SAMBA_KDC_COPY_OPTIONAL(valid_end);
+	SAMBA_KDC_COPY_OPTIONAL(pw_end);
+	SAMBA_KDC_COPY_OPTIONAL(max_life);
+	SAMBA_KDC_COPY_OPTIONAL(max_renew);
+	SAMBA_KDC_COPY_OPTIONAL(generation);
+
+	if (from->etypes != NULL) {
+		to->etypes = calloc(1, sizeof(*to->etypes));
+		if (to->etypes == NULL) {
+			ret = ENOMEM;
+			goto fail;
+		}
+		if (from->etypes->len > 0) {
+			to->etypes->val = calloc(from->etypes->len,
+						 sizeof(to->etypes->val[0]));
+			if (to->etypes->val == NULL) {
+				ret = ENOMEM;
+				goto fail;
+			}
+			memcpy(to->etypes->val, from->etypes->val,
+			       from->etypes->len * sizeof(to->etypes->val[0]));
+		}
+		to->etypes->len = from->etypes->len;
+	}
+
+	if (from->extensions != NULL) {
+		to->extensions = calloc(1, sizeof(*to->extensions));
+		if (to->extensions == NULL) {
+			ret = ENOMEM;
+			goto fail;
+		}
+		ret = copy_HDB_extensions(from->extensions, to->extensions);
+		if (ret != 0) {
+			goto fail;
+		}
+	}
+
+	return 0;
+
+fail:
+	free_hdb_entry(to);
+	memset(to, 0, sizeof(*to));
+	return ret;
+}
+
+#undef SAMBA_KDC_COPY_OPTIONAL
+
+/*
+ * Hand out a copy of a cached entry, it shares the ldb message and the
+ * PAC with the cache.
+ */
+static krb5_error_code samba_kdc_cache_lookup(krb5_context context,
+					      struct samba_kdc_db_context *kdc_db_ctx,
+					      const char *key,
+					      hdb_entry_ex *entry_ex)
+{
+	struct samba_kdc_entry_cache *cache = kdc_db_ctx->entry_cache;
+	struct samba_kdc_cache_node *n;
+	struct samba_kdc_entry *p;
+	krb5_error_code ret;
+
+	cache->lookups += 1;
+	if (cache->lookups % SAMBA_KDC_CACHE_STATS_INTERVAL == 0) {
+		samba_kdc_cache_log_stats(cache, "stats");
+	}
+
+	n = *samba_kdc_cache_find(cache, key, samba_kdc_cache_hash(key));
+	if (n == NULL) {
+		return HDB_ERR_NOENTRY;
+	}
+
+	memset(entry_ex, 0, sizeof(*entry_ex));
+
+	p = talloc_zero(kdc_db_ctx, struct samba_kdc_entry);
+	if (p == NULL) {
+		return ENOMEM;
+	}
+	p->cached = talloc_reference(p, n->cached);
+	if (p->cached == NULL) {
+		talloc_free(p);
+		return ENOMEM;
+	}
+
+	ret = samba_kdc_copy_hdb_entry(context, &n->cached->entry,
+				       &entry_ex->entry);
+	if (ret != 0) {
+		talloc_free(p);
+		return ret;
+	}
+
+	p->kdc_db_ctx = kdc_db_ctx;
+	p->entry_ex = entry_ex;
+	p->msg = n->cached->msg;
+	p->realm_dn = n->cached->realm_dn;
+	talloc_set_destructor(p, samba_kdc_entry_destructor);
+
+	entry_ex->ctx = p;
+	entry_ex->free_entry = samba_kdc_free_entry;
+
+	cache->hits += 1;
+	if (n != cache->lru) {
+		DLIST_PROMOTE(cache->lru, n);
+	}
+
+	return 0;
+}
+
+/*
+ * Remember a freshly built entry. Failing to do so is not an error,
+ * the entry is still good to return.
+ */
+static void samba_kdc_cache_add(krb5_context context,
+				struct samba_kdc_db_context *kdc_db_ctx,
+				const char *key,
+				hdb_entry_ex *entry_ex)
+{
+	struct samba_kdc_entry_cache *cache = kdc_db_ctx->entry_cache;
+	struct samba_kdc_entry *p = talloc_get_type(entry_ex->ctx,
+						    struct samba_kdc_entry);
+	struct samba_kdc_cache_node *n, **pn;
+	struct samba_kdc_cached_entry *c;
+	uint32_t hash = samba_kdc_cache_hash(key);
+
+	if (p == NULL) {
+		return;
+	}
+
+	n = talloc_zero(cache, struct samba_kdc_cache_node);
+	if (n == NULL) {
+		return;
+	}
+	n->hash = hash;
+	n->key = talloc_strdup(n, key);
+	c = talloc_zero(n, struct samba_kdc_cached_entry);
+	if (n->key == NULL || c == NULL) {
+		talloc_free(n);
+		return;
+	}
+	if (samba_kdc_copy_hdb_entry(context, &entry_ex->entry,
+				     &c->entry) != 0) {
+		talloc_free(n);
+		return;
+	}
+	talloc_set_destructor(c, samba_kdc_cached_entry_destructor);
+
+	if (p->realm_dn != NULL) {
+		c->realm_dn = talloc_reference(c, p->realm_dn);
+		if (c->realm_dn == NULL) {
+			talloc_free(n);
+			return;
+		}
+	}
+	p->cached = talloc_reference(p, c);
+	if (p->cached == NULL) {
+		talloc_free(n);
+		return;
+	}
+	c->msg = talloc_steal(c, p->msg);
+	n->cached = c;
+
+	pn = samba_kdc_cache_find(cache, key, hash);
+	if (*pn != NULL) {
+		samba_kdc_cache_remove(cache, pn);
+	}
+	while (cache->num_entries >= cache->max_entries) {
+		struct samba_kdc_cache_node *victim = DLIST_TAIL(cache->lru);
+
+		samba_kdc_cache_remove(cache,
+				       samba_kdc_cache_find(cache, victim->key,
+							    victim->hash));
+		cache->evictions += 1;
+	}
+
+	DLIST_ADD(cache->lru, n);
+	pn = &cache->buckets[hash % cache->num_buckets];
+	n->hnext = *pn;
+	*pn = n;
+	cache->num_entries += 1;
+}
+
 krb5_error_code samba_kdc_fetch(krb5_context context,
 				struct samba_kdc_db_context *kdc_db_ctx,
 				krb5_const_principal principal,
@@ -1382,6 +1788,7 @@ krb5_error_code samba_kdc_fetch(krb5_context context,
 	krb5_error_code ret = HDB_ERR_NOENTRY;
 	TALLOC_CTX *mem_ctx;
 	unsigned int krbtgt_number;
+	char *cache_key = NULL;
 	if (flags & HDB_F_KVNO_SPECIFIED) {
 		krbtgt_number = SAMBA_KVNO_GET_KRBTGT(kvno);
 		if (kdc_db_ctx->rodc) {
@@ -1400,6 +1807,21 @@ krb5_error_code samba_kdc_fetch(krb5_context context,
 		return ret;
 	}
 
+	if (kdc_db_ctx->entry_cache != NULL) {
+		samba_kdc_cache_check(kdc_db_ctx);
+
+		cache_key = samba_kdc_cache_key(context, mem_ctx, principal,
+						flags, krbtgt_number);
+		if (cache_key != NULL) {
+			ret = samba_kdc_cache_lookup(context, kdc_db_ctx,
+						     cache_key, entry_ex);
+			if (ret != HDB_ERR_NOENTRY) {
+				talloc_free(mem_ctx);
+				return ret;
+			}
+		}
+	}
+
 	if (flags & HDB_F_GET_CLIENT) {
 		ret = samba_kdc_fetch_client(context, kdc_db_ctx, mem_ctx, principal, flags, entry_ex);
 		if (ret != HDB_ERR_NOENTRY) goto done;
@@ -1419,6 +1841,9 @@ krb5_error_code samba_kdc_fetch(krb5_context context,
 	}
 
 done:
+	if (ret == 0 && cache_key != NULL) {
+		samba_kdc_cache_add(context, kdc_db_ctx, cache_key, entry_ex);
+	}
 	talloc_free(mem_ctx);
 	return ret;
 }
@@ -1797,6 +2222,7 @@ NTSTATUS samba_kdc_setup_db_ctx(TALLOC_CTX *mem_ctx, struct samba_kdc_base_conte
 	struct ldb_message *msg;
 	struct auth_session_info *session_info;
 	struct samba_kdc_db_context *kdc_db_ctx;
+	int cache_size;
 	/* The idea here is very simple.  Using Kerberos to
 	 * authenticate the KDC to the LDAP server is higly likely to
 	 * be circular.
@@ -1909,6 +2335,14 @@ NTSTATUS samba_kdc_setup_db_ctx(TALLOC_CTX *mem_ctx, struct samba_kdc_base_conte
 		kdc_db_ctx->my_krbtgt_number = 0;
 		talloc_free(msg);
 	}
+
+	cache_size = lpcfg_parm_int(kdc_db_ctx->lp_ctx, NULL, "kdc",
+				    "entry cache size", 1000);
+	if (cache_size > 0) {
+		kdc_db_ctx->entry_cache = samba_kdc_entry_cache_init(kdc_db_ctx,
+								     cache_size);
+	}
+
 	*kdc_db_ctx_out = kdc_db_ctx;
 	return NT_STATUS_OK;
 }
@@ -181,6 +181,18 @@ NTSTATUS samba_kdc_get_pac_blob(TALLOC_CTX *mem_ctx,
 		return NT_STATUS_NO_MEMORY;
 	}
 
+	/* Expanding the groups again is what we want to avoid */
+	if (p->cached != NULL && p->cached->pac_blob != NULL) {
+		*pac_blob = data_blob_talloc(pac_blob,
+					     p->cached->pac_blob->data,
+					     p->cached->pac_blob->length);
+		if (pac_blob->data == NULL) {
+			return NT_STATUS_NO_MEMORY;
+		}
+		*_pac_blob = pac_blob;
+		return NT_STATUS_OK;
+	}
+
 	nt_status = authsam_make_user_info_dc(mem_ctx, p->kdc_db_ctx->samdb,
 					     lpcfg_netbios_name(p->kdc_db_ctx->lp_ctx),
 					     lpcfg_sam_name(p->kdc_db_ctx->lp_ctx),
@@ -202,6 +214,21 @@ NTSTATUS samba_kdc_get_pac_blob(TALLOC_CTX *mem_ctx,
 		return nt_status;
 	}
 
+	if (p->cached != NULL) {
+		DATA_BLOB *cached_blob = talloc(p->cached, DATA_BLOB);
+
+		if (cached_blob != NULL) {
+			*cached_blob = data_blob_talloc(cached_blob,
+							pac_blob->data,
+							pac_blob->length);
+			if (cached_blob->data != NULL) {
+				p->cached->pac_blob = cached_blob;
+			} else {
+				TALLOC_FREE(cached_blob);
+			}
+		}
+	}
+
 	*_pac_blob = pac_blob;
 	return NT_STATUS_OK;
 }
@@ -30,6 +30,7 @@ struct samba_kdc_base_context {
 };
 
 struct samba_kdc_seq;
+struct samba_kdc_entry_cache;
 
 struct samba_kdc_db_context {
 	struct tevent_context *ev_ctx;
@@ -40,6 +41,19 @@ struct samba_kdc_db_context {
 	unsigned int my_krbtgt_number;
 	struct ldb_dn *krbtgt_dn;
 	struct lsa_DomainInfoKerberos policy;
+	struct samba_kdc_entry_cache *entry_cache;
+};
+
+/*
+ * What the entry cache keeps of an entry, shared with all the
+ * entries handed out from it. The PAC is filled in the first time
+ * one of them needs it.
+ */
+struct samba_kdc_cached_entry {
+	hdb_entry entry;
+	struct ldb_message *msg;
+	struct ldb_dn *realm_dn;
+	DATA_BLOB *pac_blob;
 };
 
 struct samba_kdc_entry {
@@ -47,6 +61,7 @@ struct samba_kdc_entry {
 	struct ldb_message *msg;
 	struct ldb_dn *realm_dn;
 	hdb_entry_ex *entry_ex;
+	struct samba_kdc_cached_entry *cached;
 };
 
 #endif /* _SAMBA_KDC_H_ */
@@ -478,16 +478,121 @@ static int ldapsrv_rename_with_controls(struct ldapsrv_call *call,
 	return ret;
 }
 
+struct ldapsrv_search_state {
+	struct ldapsrv_call *call;
+	struct ldap_SearchRequest *req;
+	int extended_type;
+	unsigned int count;
+	struct ldb_control **controls;
+};
+
+/*
+  Each entry and referral is encoded and queued as the search returns
+  it, instead of collecting the whole result first.
+*/
+static int ldapsrv_search_callback(struct ldb_request *lreq,
+				   struct ldb_reply *ares)
+{
+	struct ldapsrv_search_state *state =
+		talloc_get_type(lreq->context, struct ldapsrv_search_state);
+	struct ldapsrv_call *call = state->call;
+	struct ldapsrv_reply *ent_r;
+	struct ldap_SearchResEntry *ent;
+	struct ldap_SearchResRef *ent_ref;
+	struct ldb_message *msg;
+	NTSTATUS status;
+	unsigned int j;
+
+	if (!ares) {
+		return ldb_request_done(lreq, LDB_ERR_OPERATIONS_ERROR);
+	}
+	if (ares->error != LDB_SUCCESS) {
+		return ldb_request_done(lreq, ares->error);
+	}
+
+	switch (ares->type) {
+	case LDB_REPLY_ENTRY:
+		ent_r = ldapsrv_init_reply(call, LDAP_TAG_SearchResultEntry);
+		if (ent_r == NULL) {
+			return ldb_request_done(lreq, LDB_ERR_OPERATIONS_ERROR);
+		}
+
+		/* Better to have the whole message kept here,
+		 * than to find someone further up didn't put
+		 * a value in the right spot in the talloc tree */
+		msg = talloc_move(ent_r, &ares->message);
+
+		ent = &ent_r->msg->r.SearchResultEntry;
+		ent->dn = ldb_dn_get_extended_linearized(ent_r, msg->dn,
+							 state->extended_type);
+		ent->num_attributes = 0;
+		ent->attributes = NULL;
+		if (msg->num_elements == 0) {
+			goto queue_reply;
+		}
+		ent->num_attributes = msg->num_elements;
+		ent->attributes = talloc_array(ent_r, struct ldb_message_element,
+					       ent->num_attributes);
+		if (ent->attributes == NULL) {
+			TALLOC_FREE(ent_r);
+			return ldb_request_done(lreq, LDB_ERR_OPERATIONS_ERROR);
+		}
+		for (j=0; j < ent->num_attributes; j++) {
+			ent->attributes[j].name = msg->elements[j].name;
+			ent->attributes[j].num_values = 0;
+			ent->attributes[j].values = NULL;
+			if (state->req->attributesonly &&
+			    (msg->elements[j].num_values == 0)) {
+				continue;
+			}
+			ent->attributes[j].num_values = msg->elements[j].num_values;
+			ent->attributes[j].values = msg->elements[j].values;
+		}
+queue_reply:
+		state->count++;
+		break;
+
+	case LDB_REPLY_REFERRAL:
+		ent_r = ldapsrv_init_reply(call, LDAP_TAG_SearchResultReference);
+		if (ent_r == NULL) {
+			return ldb_request_done(lreq, LDB_ERR_OPERATIONS_ERROR);
+		}
+
+		ent_ref = &ent_r->msg->r.SearchResultReference;
+		ent_ref->referral = talloc_move(ent_r, &ares->referral);
+		break;
+
+	case LDB_REPLY_DONE:
+		state->controls = talloc_move(state, &ares->controls);
+		talloc_free(ares);
+		return ldb_request_done(lreq, LDB_SUCCESS);
+
+	default:
+		talloc_free(ares);
+		return LDB_SUCCESS;
+	}
+
+	talloc_free(ares);
+
+	status = ldapsrv_queue_encoded_reply(call, ent_r);
+	if (!NT_STATUS_IS_OK(status)) {
+		DEBUG(1,("SearchRequest: failed to queue entry %u: %s\n",
+			 state->count, nt_errstr(status)));
+		return ldb_request_done(lreq, LDB_ERR_OPERATIONS_ERROR);
+	}
+
+	return LDB_SUCCESS;
+}
+
 static NTSTATUS ldapsrv_SearchRequest(struct ldapsrv_call *call)
 {
 	struct ldap_SearchRequest *req = &call->request->r.SearchRequest;
-	struct ldap_SearchResEntry *ent;
 	struct ldap_Result *done;
-	struct ldapsrv_reply *ent_r, *done_r;
+	struct ldapsrv_reply *done_r;
 	TALLOC_CTX *local_ctx;
 	struct ldb_context *samdb = talloc_get_type(call->conn->ldb, struct ldb_context);
 	struct ldb_dn *basedn;
-	struct ldb_result *res = NULL;
+	struct ldapsrv_search_state *state = NULL;
 	struct ldb_request *lreq;
 	struct ldb_control *search_control;
 	struct ldb_search_options_control *search_options;
@@ -499,7 +604,7 @@ static NTSTATUS ldapsrv_SearchRequest(struct ldapsrv_call *call)
 	int success_limit = 1;
 	int result = -1;
 	int ldb_ret = -1;
-	unsigned int i, j;
+	unsigned int i;
 	int extended_type = 1;
 
 	DEBUG(10, ("SearchRequest"));
@@ -555,14 +660,16 @@ static NTSTATUS ldapsrv_SearchRequest(struct ldapsrv_call *call)
 	DEBUG(5,("ldb_request %s dn=%s filter=%s\n", 
 		 scope_str, req->basedn, ldb_filter_from_tree(call, req->tree)));
 
-	res = talloc_zero(local_ctx, struct ldb_result);
-	NT_STATUS_HAVE_NO_MEMORY(res);
+	state = talloc_zero(local_ctx, struct ldapsrv_search_state);
+	NT_STATUS_HAVE_NO_MEMORY(state);
+	state->call = call;
+	state->req = req;
 
 	ldb_ret = ldb_build_search_req_ex(&lreq, samdb, local_ctx,
 					  basedn, scope,
 					  req->tree, attrs,
 					  call->request->controls,
-					  res, ldb_search_default_callback,
+					  state, ldapsrv_search_callback,
 					  NULL);
 
 	if (ldb_ret != LDB_SUCCESS) {
@@ -597,6 +704,8 @@ static NTSTATUS ldapsrv_SearchRequest(struct ldapsrv_call *call)
 		}
 	}
 
+	state->extended_type = extended_type;
+
 	ldb_set_timeout(samdb, lreq, req->timelimit);
 
 	if (!call->conn->is_privileged) {
@@ -613,63 +722,6 @@ static NTSTATUS ldapsrv_SearchRequest(struct ldapsrv_call *call)
 
 	ldb_ret = ldb_wait(lreq->handle, LDB_WAIT_ALL);
 
-	if (ldb_ret == LDB_SUCCESS) {
-		for (i = 0; i < res->count; i++) {
-			ent_r = ldapsrv_init_reply(call, LDAP_TAG_SearchResultEntry);
-			NT_STATUS_HAVE_NO_MEMORY(ent_r);
-
-			/* Better to have the whole message kept here,
-			 * than to find someone further up didn't put
-			 * a value in the right spot in the talloc tree */
-			talloc_steal(ent_r, res->msgs[i]);
-			
-			ent = &ent_r->msg->r.SearchResultEntry;
-			ent->dn = ldb_dn_get_extended_linearized(ent_r, res->msgs[i]->dn, extended_type);
-			ent->num_attributes = 0;
-			ent->attributes = NULL;
-			if (res->msgs[i]->num_elements == 0) {
-				goto queue_reply;
-			}
-			ent->num_attributes = res->msgs[i]->num_elements;
-			ent->attributes = talloc_array(ent_r, struct ldb_message_element, ent->num_attributes);
-			NT_STATUS_HAVE_NO_MEMORY(ent->attributes);
-			for (j=0; j < ent->num_attributes; j++) {
-				ent->attributes[j].name = res->msgs[i]->elements[j].name;
-				ent->attributes[j].num_values = 0;
-				ent->attributes[j].values = NULL;
-				if (req->attributesonly && (res->msgs[i]->elements[j].num_values == 0)) {
-					continue;
-				}
-				ent->attributes[j].num_values = res->msgs[i]->elements[j].num_values;
-				ent->attributes[j].values = res->msgs[i]->elements[j].values;
-			}
-queue_reply:
-			ldapsrv_queue_reply(call, ent_r);
-		}
-
-		/* Send back referrals if they do exist (search operations) */
-		if (res->refs != NULL) {
-			char **ref;
-			struct ldap_SearchResRef *ent_ref;
-
-			for (ref = res->refs; *ref != NULL; ++ref) {
-				ent_r = ldapsrv_init_reply(call, LDAP_TAG_SearchResultReference);
-				NT_STATUS_HAVE_NO_MEMORY(ent_r);
-
-				/* Better to have the whole referrals kept here,
-				 * than to find someone further up didn't put
-				 * a value in the right spot in the talloc tree
-				 */
-				talloc_steal(ent_r, *ref);
-
-				ent_ref = &ent_r->msg->r.SearchResultReference;
-				ent_ref->referral = *ref;
-
-				ldapsrv_queue_reply(call, ent_r);
-			}
-		}
-	}
-
 reply:
 	done_r = ldapsrv_init_reply(call, LDAP_TAG_SearchResultDone);
 	NT_STATUS_HAVE_NO_MEMORY(done_r);
@@ -680,14 +732,14 @@ reply:
 
 	if (result != -1) {
 	} else if (ldb_ret == LDB_SUCCESS) {
-		if (res->count >= success_limit) {
-			DEBUG(10,("SearchRequest: results: [%d]\n", res->count));
+		if (state->count >= success_limit) {
+			DEBUG(10,("SearchRequest: results: [%u]\n", state->count));
 			result = LDAP_SUCCESS;
 			errstr = NULL;
 		}
-		if (res->controls) {
-			done_r->msg->controls = res->controls;
-			talloc_steal(done_r, res->controls);
+		if (state->controls) {
+			done_r->msg->controls = state->controls;
+			talloc_steal(done_r, state->controls);
 		}
 	} else {
 		DEBUG(10,("SearchRequest: error\n"));
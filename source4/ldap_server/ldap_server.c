@@ -537,6 +537,119 @@ static void ldapsrv_call_read_done(struct tevent_req *subreq)
 	conn->active_call = subreq;
 }
 
+/*
+  encoded search entries are queued in chunks of at least this size
+*/
+#define LDAPSRV_ENCODED_CHUNK_SIZE 16384
+
+struct ldapsrv_encoded_chunk {
+	struct ldapsrv_call *call;
+	struct iovec iov;
+};
+
+static void ldapsrv_encoded_chunk_done(struct tevent_req *subreq);
+
+static bool ldapsrv_encoded_flush(struct ldapsrv_call *call)
+{
+	struct ldapsrv_connection *conn = call->conn;
+	struct ldapsrv_encoded_chunk *chunk;
+	struct tevent_req *subreq;
+
+	if (call->encoded.blob.length == 0) {
+		return true;
+	}
+
+	chunk = talloc(call, struct ldapsrv_encoded_chunk);
+	if (chunk == NULL) {
+		return false;
+	}
+	chunk->call = call;
+	chunk->iov.iov_base = talloc_steal(chunk, call->encoded.blob.data);
+	chunk->iov.iov_len = call->encoded.blob.length;
+	call->encoded.blob = data_blob_null;
+
+	/*
+	 * Nothing is written before the call returns to the event
+	 * loop, but the chunk no longer needs the ldb and ldap
+	 * messages it was built from.
+	 */
+	subreq = tstream_writev_queue_send(chunk,
+					   conn->connection->event.ctx,
+					   conn->sockets.active,
+					   conn->sockets.send_queue,
+					   &chunk->iov, 1);
+	if (subreq == NULL) {
+		TALLOC_FREE(chunk);
+		return false;
+	}
+	tevent_req_set_callback(subreq, ldapsrv_encoded_chunk_done, chunk);
+
+	return true;
+}
+
+static void ldapsrv_encoded_chunk_done(struct tevent_req *subreq)
+{
+	struct ldapsrv_encoded_chunk *chunk =
+		tevent_req_callback_data(subreq,
+		struct ldapsrv_encoded_chunk);
+	struct ldapsrv_call *call = chunk->call;
+	int sys_errno;
+	int rc;
+
+	rc = tstream_writev_queue_recv(subreq, &sys_errno);
+	TALLOC_FREE(subreq);
+	TALLOC_FREE(chunk);
+
+	/*
+	 * The call may not be done yet, the connection is terminated
+	 * in ldapsrv_call_process_done() or when the final reply
+	 * fails to go out.
+	 */
+	if (rc == -1 && call->encoded.sys_errno == 0) {
+		call->encoded.sys_errno = sys_errno;
+	}
+}
+
+/*
+  encode a reply of a call that is still being processed and queue it
+  ahead of the final replies. This is used for search entries, so that
+  a large search is held in memory in its encoded form only, not also
+  as ldb and ldap messages.
+
+  Nothing is written before the call returns to the event loop, so the
+  whole encoded result is still in memory at that point.
+*/
+NTSTATUS ldapsrv_queue_encoded_reply(struct ldapsrv_call *call,
+				     struct ldapsrv_reply *reply)
+{
+	DATA_BLOB b;
+	bool ok;
+
+	ok = ldap_encode(reply->msg, samba_ldap_control_handlers(), &b, call);
+	if (!ok) {
+		DEBUG(0,("Failed to encode ldap reply of type %d\n",
+			 reply->msg->type));
+		TALLOC_FREE(reply);
+		return NT_STATUS_INTERNAL_ERROR;
+	}
+	TALLOC_FREE(reply);
+
+	ok = data_blob_append(call, &call->encoded.blob, b.data, b.length);
+	data_blob_free(&b);
+	if (!ok) {
+		return NT_STATUS_NO_MEMORY;
+	}
+
+	if (call->encoded.blob.length < LDAPSRV_ENCODED_CHUNK_SIZE) {
+		return NT_STATUS_OK;
+	}
+
+	if (!ldapsrv_encoded_flush(call)) {
+		return NT_STATUS_NO_MEMORY;
+	}
+	return NT_STATUS_OK;
+}
+
 static void ldapsrv_call_writev_done(struct tevent_req *subreq);
 
 static void ldapsrv_call_process_done(struct tevent_req *subreq)
@@ -557,6 +670,26 @@ static void ldapsrv_call_process_done(struct tevent_req *subreq)
 		return;
 	}
 
+	if (call->encoded.sys_errno != 0) {
+		const char *reason;
+
+		reason = talloc_asprintf(call, "ldapsrv_call_process_done: "
+					 "queued replies failed - %d:%s",
+					 call->encoded.sys_errno,
+					 strerror(call->encoded.sys_errno));
+		if (reason == NULL) {
+			reason = "ldapsrv_call_process_done: "
+				 "queued replies failed";
+		}
+
+		ldapsrv_terminate_connection(conn, reason);
+		return;
+	}
+
+	/* what is left of the early encoded replies goes first */
+	blob = call->encoded.blob;
+	call->encoded.blob = data_blob_null;
+
 	/* build all the replies into a single blob */
 	while (call->replies) {
 		DATA_BLOB b;
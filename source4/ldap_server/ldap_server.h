@@ -64,6 +64,15 @@ struct ldapsrv_call {
 	} *replies;
 	struct iovec out_iov;
 
+	/*
+	 * Replies that are encoded while the call is still being
+	 * processed, see ldapsrv_queue_encoded_reply().
+	 */
+	struct {
+		DATA_BLOB blob;
+		int sys_errno;
+	} encoded;
+
 	struct tevent_req *(*postprocess_send)(TALLOC_CTX *mem_ctx,
 					       struct tevent_context *ev,
 					       void *private_data);
@@ -0,0 +1,215 @@
+/*
+   Unix SMB/CIFS implementation.
+
+   local testing of security token SID lookups
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "includes.h"
+#include "libcli/security/security.h"
+#include "torture/torture.h"
+#include "system/time.h"
+
+#define TEST_DOMAIN_SID "S-1-5-21-1111111111-2222222222-3333333333"
+
+/*
+  make a token with the user, num_groups domain groups and the usual
+  well known SIDs
+*/
+static struct security_token *test_token(TALLOC_CTX *mem_ctx,
+					 uint32_t num_groups)
+{
+	struct security_token *token;
+	struct dom_sid domain;
+	uint32_t i;
+
+	token = security_token_initialise(mem_ctx);
+	if (token == NULL || !dom_sid_parse(TEST_DOMAIN_SID, &domain)) {
+		return NULL;
+	}
+
+	token->sids = talloc_array(token, struct dom_sid, num_groups + 4);
+	if (token->sids == NULL) {
+		return NULL;
+	}
+
+	sid_compose(&token->sids[token->num_sids++], &domain, 1000);
+	for (i = 0; i < num_groups; i++) {
+		sid_compose(&token->sids[token->num_sids++], &domain,
+			    10000 + i * 7);
+	}
+	token->sids[token->num_sids++] = global_sid_World;
+	token->sids[token->num_sids++] = global_sid_Network;
+	token->sids[token->num_sids++] = global_sid_Authenticated_Users;
+
+	return token;
+}
+
+static bool linear_has_sid(const struct security_token *token,
+			   const struct dom_sid *sid)
+{
+	uint32_t i;
+
+	for (i = 0; i < token->num_sids; i++) {
+		if (dom_sid_equal(&token->sids[i], sid)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+  check the indexed lookup gives the same answers as a linear search,
+  and that the index is not trusted once the SIDs change
+*/
+static bool test_has_sid(struct torture_context *tctx)
+{
+	struct security_token *token;
+	struct dom_sid domain, sid;
+	uint32_t rid;
+	int i;
+
+	token = test_token(tctx, 500);
+	torture_assert(tctx, token != NULL, "test_token");
+	torture_assert_ntstatus_ok(tctx, security_token_index_sids(token),
+				   "security_token_index_sids");
+	torture_assert(tctx, token->sid_index != NULL, "token not indexed");
+
+	torture_assert(tctx, dom_sid_parse(TEST_DOMAIN_SID, &domain),
+		       "dom_sid_parse");
+
+	for (rid = 0; rid < 15000; rid++) {
+		sid_compose(&sid, &domain, rid);
+		torture_assert(tctx, security_token_has_sid(token, &sid) ==
+			       linear_has_sid(token, &sid),
+			       talloc_asprintf(tctx, "rid %u", rid));
+	}
+
+	/* SIDs that differ from members only outside the last RID */
+	sid_compose(&sid, &domain, 1000);
+	sid.id_auth[5] = 6;
+	torture_assert(tctx, !security_token_has_sid(token, &sid), "id_auth");
+	sid_compose(&sid, &domain, 1000);
+	sid.sid_rev_num = 2;
+	torture_assert(tctx, !security_token_has_sid(token, &sid), "revision");
+	torture_assert(tctx, !security_token_has_sid(token, &domain), "domain");
+
+	for (i = 0; i < 3; i++) {
+		const struct dom_sid *wk[] = {
+			&global_sid_World,
+			&global_sid_Network,
+			&global_sid_Authenticated_Users
+		};
+		torture_assert(tctx, security_token_has_sid(token, wk[i]),
+			       "well known SID");
+	}
+	torture_assert(tctx, !security_token_has_sid(token, &global_sid_System),
+		       "SYSTEM");
+	torture_assert(tctx, !security_token_has_sid(token, NULL), "NULL");
+
+	/* a SID added after the index was built must still be found */
+	token->sids = talloc_realloc(token, token->sids, struct dom_sid,
+				     token->num_sids + 1);
+	torture_assert(tctx, token->sids != NULL, "talloc_realloc");
+	token->sids[token->num_sids++] = global_sid_Builtin_Administrators;
+	torture_assert(tctx, security_token_has_builtin_administrators(token),
+		       "SID added after indexing");
+
+	return true;
+}
+
+/*
+  report the rate of access checks for a user in many groups against
+  a DACL that only grants access on its last ACE
+*/
+static bool test_access_check_speed(struct torture_context *tctx)
+{
+	const int num_aces = 40;
+	const int timelimit = torture_setting_int(tctx, "timelimit", 2);
+	struct security_token *token;
+	struct security_descriptor *sd;
+	struct dom_sid domain;
+	double rate[2];
+	int pass, i;
+
+	torture_assert(tctx, dom_sid_parse(TEST_DOMAIN_SID, &domain),
+		       "dom_sid_parse");
+
+	token = test_token(tctx, 1000);
+	torture_assert(tctx, token != NULL, "test_token");
+
+	sd = security_descriptor_initialise(tctx);
+	torture_assert(tctx, sd != NULL, "security_descriptor_initialise");
+	sd->type |= SEC_DESC_DACL_PRESENT;
+	sd->owner_sid = dom_sid_add_rid(sd, &domain, 500);
+	torture_assert(tctx, sd->owner_sid != NULL, "owner");
+
+	for (i = 0; i < num_aces; i++) {
+		struct security_ace ace;
+
+		ZERO_STRUCT(ace);
+		ace.type = SEC_ACE_TYPE_ACCESS_ALLOWED;
+		ace.access_mask = SEC_FILE_READ_DATA;
+		/* only the last ACE matches one of the token's groups */
+		sid_compose(&ace.trustee, &domain,
+			    (i == num_aces - 1) ? 10000 + 999 * 7 : 20000 + i);
+		torture_assert_ntstatus_ok(tctx,
+					   security_descriptor_dacl_add(sd, &ace),
+					   "security_descriptor_dacl_add");
+	}
+
+	for (pass = 0; pass < 2; pass++) {
+		struct timeval tv;
+		int count;
+
+		if (pass == 0) {
+			TALLOC_FREE(token->sid_index);
+		} else {
+			torture_assert_ntstatus_ok(tctx,
+						   security_token_index_sids(token),
+						   "security_token_index_sids");
+		}
+
+		tv = timeval_current();
+		for (count = 0; timeval_elapsed(&tv) < timelimit; count++) {
+			uint32_t granted;
+			NTSTATUS status;
+
+			status = se_access_check(sd, token, SEC_FILE_READ_DATA,
+						 &granted);
+			torture_assert_ntstatus_ok(tctx, status,
+						   "se_access_check");
+		}
+		rate[pass] = count / timeval_elapsed(&tv);
+	}
+
+	torture_comment(tctx, "%u SIDs, %d ACEs: %.0f checks/sec linear, "
+			"%.0f checks/sec indexed\n",
+			token->num_sids, num_aces, rate[0], rate[1]);
+
+	return true;
+}
+
+struct torture_suite *torture_local_security_token(TALLOC_CTX *mem_ctx)
+{
+	struct torture_suite *suite = torture_suite_create(mem_ctx,
+							   "security_token");
+
+	torture_suite_add_simple_test(suite, "has_sid", test_has_sid);
+	torture_suite_add_simple_test(suite, "access_check_speed",
+				      test_access_check_speed);
+
+	return suite;
+}
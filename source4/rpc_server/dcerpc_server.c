@@ -81,6 +81,12 @@ static struct dcesrv_assoc_group *dcesrv_assoc_group_reference(TALLOC_CTX *mem_c
 static int dcesrv_assoc_group_destructor(struct dcesrv_assoc_group *assoc_group)
 {
 	int ret;
+
+	/* the handles need the handle table to go away */
+	while (assoc_group->handles != NULL) {
+		talloc_free(assoc_group->handles);
+	}
+
 	ret = idr_remove(assoc_group->dce_ctx->assoc_groups_idr, assoc_group->id);
 	if (ret != 0) {
 		DEBUG(0,(__location__ ": Failed to remove assoc_group 0x%08x\n",
@@ -102,6 +108,12 @@ static struct dcesrv_assoc_group *dcesrv_assoc_group_new(TALLOC_CTX *mem_ctx,
 	if (assoc_group == NULL) {
 		return NULL;
 	}
+
+	assoc_group->handle_table = rpc_handle_table_init(assoc_group);
+	if (assoc_group->handle_table == NULL) {
+		talloc_free(assoc_group);
+		return NULL;
+	}
 	
 	id = idr_get_new_random(dce_ctx->assoc_groups_idr, assoc_group, UINT16_MAX);
 	if (id == -1) {
@@ -26,6 +26,7 @@
 #include "librpc/gen_ndr/server_id.h"
 #include "librpc/rpc/dcerpc.h"
 #include "librpc/ndr/libndr.h"
+#include "librpc/rpc/rpc_handle_table.h"
 
 /* modules can use the following to determine if the interface has changed
  * please increment the version number after each interface change
@@ -259,6 +260,9 @@ struct dcesrv_assoc_group {
 	/* list of handles in this association group */
 	struct dcesrv_handle *handles;
 
+	/* the same handles, by wire uuid */
+	struct rpc_handle_table *handle_table;
+
 	/* parent context */
 	struct dcesrv_context *dce_ctx;
 
@@ -30,6 +30,8 @@
 */
 static int dcesrv_handle_destructor(struct dcesrv_handle *h)
 {
+	rpc_handle_table_remove(h->assoc_group->handle_table,
+				&h->wire_handle.uuid, h);
 	DLIST_REMOVE(h->assoc_group->handles, h);
 	return 0;
 }
@@ -60,7 +62,12 @@ _PUBLIC_ struct dcesrv_handle *dcesrv_handle_new(struct dcesrv_connection_contex
 	h->iface = context->iface;
 	h->wire_handle.handle_type = handle_type;
 	h->wire_handle.uuid = GUID_random();
-	
+
+	if (!rpc_handle_table_add(context->assoc_group->handle_table,
+				  &h->wire_handle.uuid, h)) {
+		talloc_free(h);
+		return NULL;
+	}
 	DLIST_ADD(context->assoc_group->handles, h);
 
 	talloc_set_destructor(h, dcesrv_handle_destructor);
@@ -87,28 +94,27 @@ _PUBLIC_ struct dcesrv_handle *dcesrv_handle_fetch(
 		return dcesrv_handle_new(context, handle_type);
 	}
 
-	for (h=context->assoc_group->handles; h; h=h->next) {
-		if (h->wire_handle.handle_type == p->handle_type &&
-		    GUID_equal(&p->uuid, &h->wire_handle.uuid)) {
-			if (handle_type != DCESRV_HANDLE_ANY &&
-			    p->handle_type != handle_type) {
-				DEBUG(0,("client gave us the wrong handle type (%d should be %d)\n",
-					 p->handle_type, handle_type));
-				return NULL;
-			}
-			if (!dom_sid_equal(h->sid, sid)) {
-				DEBUG(0,(__location__ ": Attempt to use invalid sid %s - %s\n",
-					 dom_sid_string(context, h->sid),
-					 dom_sid_string(context, sid)));
-				return NULL;
-			}
-			if (h->iface != context->iface) {
-				DEBUG(0,(__location__ ": Attempt to use invalid iface\n"));
-				return NULL;
-			}
-			return h;
-		}
+	h = (struct dcesrv_handle *)rpc_handle_table_find(
+		context->assoc_group->handle_table, &p->uuid);
+	if (h == NULL || h->wire_handle.handle_type != p->handle_type) {
+		return NULL;
 	}
 
-	return NULL;
+	if (handle_type != DCESRV_HANDLE_ANY &&
+	    p->handle_type != handle_type) {
+		DEBUG(0,("client gave us the wrong handle type (%d should be %d)\n",
+			 p->handle_type, handle_type));
+		return NULL;
+	}
+	if (!dom_sid_equal(h->sid, sid)) {
+		DEBUG(0,(__location__ ": Attempt to use invalid sid %s - %s\n",
+			 dom_sid_string(context, h->sid),
+			 dom_sid_string(context, sid)));
+		return NULL;
+	}
+	if (h->iface != context->iface) {
+		DEBUG(0,(__location__ ": Attempt to use invalid iface\n"));
+		return NULL;
+	}
+	return h;
 }
@@ -283,6 +283,12 @@ if os.path.exists(tdbtorture4):
 else:
     skiptestsuite("tdb.stress", "Using system TDB, tdbtorture not available")
 
+tdbhashtest = binpath("tdbhashtest")
+if os.path.exists(tdbhashtest):
+    plantestsuite("tdb.hash", "none", valgrindify(tdbhashtest))
+else:
+    skiptestsuite("tdb.hash", "Using system TDB, tdbhashtest not available")
+
 plansmbtorturetestsuite("drs.unit", "none", "ncalrpc:")
 
 # Pidl tests
@@ -56,6 +56,9 @@
 	torture_pac, 
 	torture_local_resolve,
 	torture_local_sddl,
+	torture_local_security_token,
+	torture_local_crypto_sha256,
+	torture_local_dns_cache,
 	torture_local_ndr, 
 	torture_local_tdr, 
 	torture_local_share,
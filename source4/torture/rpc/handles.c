@@ -583,6 +583,103 @@ static bool test_handles_drsuapi(struct torture_context *torture)
 	return true;
 }
 
+/*
+  open a lot of handles on one pipe, the server has to find them
+  by uuid without walking all of them
+*/
+static bool test_handles_many(struct torture_context *torture)
+{
+	NTSTATUS status;
+	struct dcerpc_pipe *p1;
+	struct dcerpc_binding_handle *b1;
+	struct policy_handle *handles;
+	struct policy_handle handle2;
+	struct lsa_ObjectAttribute attr;
+	struct lsa_QosInfo qos;
+	struct lsa_OpenPolicy r;
+	struct lsa_Close c;
+	uint16_t system_name = '\\';
+	int num_handles = torture_setting_int(torture, "num_handles", 50000);
+	int i, num_open;
+	struct timeval tv;
+	TALLOC_CTX *mem_ctx = talloc_new(torture);
+
+	torture_comment(torture, "RPC-HANDLE-MANY\n");
+
+	status = torture_rpc_connection(torture, &p1, &ndr_table_lsarpc);
+	torture_assert_ntstatus_ok(torture, status, "opening lsa pipe1");
+	b1 = p1->binding_handle;
+
+	handles = talloc_array(mem_ctx, struct policy_handle, num_handles);
+	torture_assert(torture, handles != NULL, "no memory");
+
+	qos.len = 0;
+	qos.impersonation_level = 2;
+	qos.context_mode = 1;
+	qos.effective_only = 0;
+
+	attr.len = 0;
+	attr.root_dir = NULL;
+	attr.object_name = NULL;
+	attr.attributes = 0;
+	attr.sec_desc = NULL;
+	attr.sec_qos = &qos;
+
+	r.in.system_name = &system_name;
+	r.in.attr = &attr;
+	r.in.access_mask = SEC_FLAG_MAXIMUM_ALLOWED;
+
+	tv = timeval_current();
+
+	for (num_open = 0; num_open < num_handles; num_open++) {
+		r.out.handle = &handles[num_open];
+
+		status = dcerpc_lsa_OpenPolicy_r(b1, mem_ctx, &r);
+		if (NT_STATUS_IS_OK(status)) {
+			status = r.out.result;
+		}
+		if (NT_STATUS_IS_OK(status)) {
+			continue;
+		}
+		if (num_open == 0) {
+			torture_comment(torture, "lsa_OpenPolicy not supported - skipping\n");
+			talloc_free(mem_ctx);
+			return true;
+		}
+		/* the s3 server limits the handles per pipe */
+		torture_comment(torture, "server refused handle %d - %s\n",
+				num_open, nt_errstr(status));
+		break;
+	}
+
+	torture_comment(torture, "opened %d handles, %.1f per second\n",
+			num_open, num_open / timeval_elapsed(&tv));
+
+	tv = timeval_current();
+
+	c.out.handle = &handle2;
+
+	for (i = num_open - 1; i >= 0; i--) {
+		c.in.handle = &handles[i];
+
+		torture_assert_ntstatus_ok(torture, dcerpc_lsa_Close_r(b1, mem_ctx, &c),
+			"Close failed");
+		torture_assert_ntstatus_ok(torture, c.out.result, "closing policy handle");
+	}
+
+	torture_comment(torture, "closed %d handles, %.1f per second\n",
+			num_open, num_open / timeval_elapsed(&tv));
+
+	c.in.handle = &handles[0];
+	status = dcerpc_lsa_Close_r(b1, mem_ctx, &c);
+	torture_assert_ntstatus_equal(torture, status, NT_STATUS_RPC_SS_CONTEXT_MISMATCH,
+				      "closing policy handle again");
+
+	talloc_free(mem_ctx);
+
+	return true;
+}
+
 struct torture_suite *torture_rpc_handles(TALLOC_CTX *mem_ctx)
 {
 	struct torture_suite *suite;
@@ -594,5 +691,6 @@ struct torture_suite *torture_rpc_handles(TALLOC_CTX *mem_ctx)
 	torture_suite_add_simple_test(suite, "mixed-shared", test_handles_mixed_shared);
 	torture_suite_add_simple_test(suite, "random-assoc", test_handles_random_assoc);
 	torture_suite_add_simple_test(suite, "drsuapi", test_handles_drsuapi);
+	torture_suite_add_simple_test(suite, "many", test_handles_many);
 	return suite;
 }
@@ -1382,6 +1382,99 @@ done:
 /*
    basic testing of SMB2 read
 */
+/*
+  open many handles and measure how fast requests on them are answered,
+  spreading the requests over all the handles
+*/
+bool test_smb2_bench_handles(struct torture_context *tctx,
+			     struct smb2_tree *tree)
+{
+	const char *dname = "bench_handles";
+	int num_handles = torture_setting_int(tctx, "handles", 5000);
+	int timelimit = torture_setting_int(tctx, "timelimit", 10);
+	struct smb2_handle *handles;
+	struct smb2_handle h;
+	union smb_open io;
+	struct timeval tv;
+	NTSTATUS status;
+	bool ret = true;
+	int i, num_open = 0, count = 0;
+
+	smb2_deltree(tree, dname);
+	status = torture_smb2_testdir(tree, dname, &h);
+	torture_assert_ntstatus_ok(tctx, status, "Error creating directory");
+	smb2_util_close(tree, h);
+
+	handles = talloc_array(tctx, struct smb2_handle, num_handles);
+	torture_assert(tctx, handles != NULL, "talloc_array failed");
+
+	ZERO_STRUCT(io.smb2);
+	io.generic.level = RAW_OPEN_SMB2;
+	io.smb2.in.desired_access = SEC_RIGHTS_FILE_ALL;
+	io.smb2.in.file_attributes = FILE_ATTRIBUTE_NORMAL;
+	io.smb2.in.share_access = NTCREATEX_SHARE_ACCESS_READ|
+		NTCREATEX_SHARE_ACCESS_WRITE|
+		NTCREATEX_SHARE_ACCESS_DELETE;
+	io.smb2.in.create_disposition = NTCREATEX_DISP_OPEN_IF;
+	io.smb2.in.impersonation_level = SMB2_IMPERSONATION_ANONYMOUS;
+
+	torture_comment(tctx, "Opening %d handles\n", num_handles);
+	tv = timeval_current();
+	for (i = 0; i < num_handles; i++) {
+		io.smb2.in.fname = talloc_asprintf(tctx, "%s\\file%d",
+						   dname, i);
+		status = smb2_create(tree, tctx, &io.smb2);
+		talloc_free(discard_const(io.smb2.in.fname));
+		if (NT_STATUS_EQUAL(status, NT_STATUS_TOO_MANY_OPENED_FILES)) {
+			torture_comment(tctx, "Server allows only %d open "
+					"handles\n", i);
+			break;
+		}
+		torture_assert_ntstatus_ok_goto(tctx, status, ret, done,
+						"Error opening file");
+		handles[num_open++] = io.smb2.out.file.handle;
+	}
+	torture_comment(tctx, "%.2f opens/second\n",
+			num_open/timeval_elapsed(&tv));
+	torture_assert_goto(tctx, num_open > 0, ret, done,
+			    "Could not open any handle");
+
+	/*
+	  query the handles round robin, so that the server can't
+	  benefit from finding the same handle again and again
+	*/
+	torture_comment(tctx, "Running for %d seconds\n", timelimit);
+	tv = timeval_current();
+	while (timeval_elapsed(&tv) < timelimit) {
+		union smb_fileinfo finfo;
+
+		ZERO_STRUCT(finfo);
+		finfo.basic_info.level = RAW_FILEINFO_BASIC_INFORMATION;
+		finfo.basic_info.in.file.handle = handles[count % num_open];
+		status = smb2_getinfo_file(tree, tctx, &finfo);
+		torture_assert_ntstatus_ok_goto(tctx, status, ret, done,
+						"Error querying file");
+		count++;
+
+		if (torture_setting_bool(tctx, "progress", true) &&
+		    (count % 1000) == 0) {
+			torture_comment(tctx, "%.2f ops/second\r",
+					count/timeval_elapsed(&tv));
+		}
+	}
+
+	torture_comment(tctx, "%d handles: %.2f ops/second\n", num_open,
+			count/timeval_elapsed(&tv));
+
+done:
+	for (i = 0; i < num_open; i++) {
+		smb2_util_close(tree, handles[i]);
+	}
+	smb2_deltree(tree, dname);
+	talloc_free(handles);
+	return ret;
+}
+
 struct torture_suite *torture_smb2_create_init(void)
 {
 	struct torture_suite *suite = torture_suite_create(talloc_autofree_context(), "create");
@@ -20,8 +20,10 @@
 */
 
 #include "includes.h"
+#include "system/filesys.h"
 #include "libcli/smb2/smb2.h"
 #include "libcli/smb2/smb2_calls.h"
+#include "libcli/smb_composite/smb_composite.h"
 
 #include "torture/torture.h"
 #include "torture/smb2/proto.h"
@@ -234,6 +236,314 @@ done:
 	return ret;
 }
 
+static void large_write_fill(uint8_t *buf, uint64_t offset, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		buf[i] = (uint8_t)((offset + i) % 251);
+	}
+}
+
+/*
+  large writes (that the server may receive straight into the file)
+  must land at the right offset, and failed ones must not leave the
+  connection out of sync
+*/
+static bool test_write_large(struct torture_context *torture,
+			     struct smb2_tree *tree)
+{
+	bool ret = true;
+	NTSTATUS status;
+	struct smb2_handle h, h_ro;
+	struct smb2_create io;
+	struct smb2_read rd;
+	struct timeval tv;
+	const int chunk = torture_setting_int(torture, "writesize", 65536);
+	const int num_chunks = torture_setting_int(torture, "writechunks", 64);
+	uint8_t *buf, *expected;
+	double secs;
+	int i;
+	TALLOC_CTX *tmp_ctx = talloc_new(tree);
+
+	buf = talloc_array(tmp_ctx, uint8_t, chunk);
+	expected = talloc_array(tmp_ctx, uint8_t, chunk);
+	torture_assert(torture, buf != NULL && expected != NULL, "no memory");
+
+	smb2_util_unlink(tree, FNAME);
+
+	status = torture_smb2_testfile(tree, FNAME, &h);
+	CHECK_STATUS(status, NT_STATUS_OK);
+
+	/* write the chunks backwards so each needs an explicit offset */
+	tv = timeval_current();
+	for (i = num_chunks - 1; i >= 0; i--) {
+		uint64_t ofs = (uint64_t)i * chunk;
+
+		large_write_fill(buf, ofs, chunk);
+		status = smb2_util_write(tree, h, buf, ofs, chunk);
+		CHECK_STATUS(status, NT_STATUS_OK);
+	}
+	secs = timeval_elapsed(&tv);
+	torture_comment(torture, "wrote %d x %d bytes: %.2f MB/sec\n",
+			num_chunks, chunk,
+			(double)num_chunks * chunk / (1024.0 * 1024.0) / secs);
+
+	/* a large write on a read-only handle */
+	ZERO_STRUCT(io);
+	io.in.desired_access = SEC_FILE_READ_DATA;
+	io.in.file_attributes = FILE_ATTRIBUTE_NORMAL;
+	io.in.create_disposition = NTCREATEX_DISP_OPEN;
+	io.in.share_access =
+		NTCREATEX_SHARE_ACCESS_DELETE|
+		NTCREATEX_SHARE_ACCESS_READ|
+		NTCREATEX_SHARE_ACCESS_WRITE;
+	io.in.fname = FNAME;
+	status = smb2_create(tree, tmp_ctx, &io);
+	CHECK_STATUS(status, NT_STATUS_OK);
+	h_ro = io.out.file.handle;
+
+	memset(buf, 0xff, chunk);
+	status = smb2_util_write(tree, h_ro, buf, 0, chunk);
+	CHECK_STATUS(status, NT_STATUS_ACCESS_DENIED);
+
+	/* and one on a closed handle */
+	status = smb2_util_close(tree, h_ro);
+	CHECK_STATUS(status, NT_STATUS_OK);
+	status = smb2_util_write(tree, h_ro, buf, 0, chunk);
+	CHECK_STATUS(status, NT_STATUS_FILE_CLOSED);
+
+	for (i = 0; i < num_chunks; i++) {
+		uint64_t ofs = (uint64_t)i * chunk;
+
+		ZERO_STRUCT(rd);
+		rd.in.file.handle = h;
+		rd.in.length = chunk;
+		rd.in.offset = ofs;
+		status = smb2_read(tree, tmp_ctx, &rd);
+		CHECK_STATUS(status, NT_STATUS_OK);
+		CHECK_VALUE(rd.out.data.length, chunk);
+
+		large_write_fill(expected, ofs, chunk);
+		torture_assert(torture,
+			       memcmp(rd.out.data.data, expected, chunk) == 0,
+			       talloc_asprintf(tmp_ctx,
+					       "data mismatch at offset %llu",
+					       (unsigned long long)ofs));
+		talloc_free(rd.out.data.data);
+	}
+
+	/* and one that doesn't start on a page boundary */
+	ZERO_STRUCT(rd);
+	rd.in.file.handle = h;
+	rd.in.length = chunk - 1;
+	rd.in.offset = 4097;
+	status = smb2_read(tree, tmp_ctx, &rd);
+	CHECK_STATUS(status, NT_STATUS_OK);
+	CHECK_VALUE(rd.out.data.length, chunk - 1);
+	large_write_fill(expected, 4097, chunk - 1);
+	torture_assert(torture,
+		       memcmp(rd.out.data.data, expected, chunk - 1) == 0,
+		       "data mismatch at offset 4097");
+
+done:
+	smb2_util_close(tree, h);
+	smb2_util_unlink(tree, FNAME);
+	talloc_free(tmp_ctx);
+	return ret;
+}
+
+/*
+  truncate a file through another connection while it is open and read
+  the old range. smbd still has the old size, so with "smbd:signed
+  sendfile" on a signed session it maps a range that is no longer
+  there and faults while signing. The read has to fail on its own,
+  without the connection going away.
+*/
+static bool test_read_truncated_sendfile(struct torture_context *torture,
+					 struct smb2_tree *tree)
+{
+	bool ret = true;
+	NTSTATUS status;
+	struct smb2_tree *tree2;
+	struct smb2_handle h;
+	struct smb2_read rd;
+	union smb_setfileinfo sfi;
+	const int len = 1024*1024;
+	uint8_t *buf;
+	TALLOC_CTX *tmp_ctx = talloc_new(tree);
+
+	ZERO_STRUCT(h);
+
+	buf = talloc_zero_array(tmp_ctx, uint8_t, len);
+	torture_assert(torture, buf != NULL, "no memory");
+
+	if (!torture_smb2_connection(torture, &tree2)) {
+		talloc_free(tmp_ctx);
+		return false;
+	}
+
+	torture_comment(torture, "session %ssigned\n",
+			tree->session->signing_active ? "" : "not ");
+
+	smb2_util_unlink(tree, FNAME);
+
+	status = torture_smb2_testfile(tree, FNAME, &h);
+	CHECK_STATUS(status, NT_STATUS_OK);
+
+	status = smb2_util_write(tree, h, buf, 0, len);
+	CHECK_STATUS(status, NT_STATUS_OK);
+
+	ZERO_STRUCT(sfi);
+	sfi.generic.level = RAW_SFILEINFO_END_OF_FILE_INFORMATION;
+	sfi.generic.in.file.path = FNAME;
+	sfi.end_of_file_info.in.size = 0;
+	status = smb2_composite_setpathinfo(tree2, &sfi);
+	CHECK_STATUS(status, NT_STATUS_OK);
+
+	ZERO_STRUCT(rd);
+	rd.in.file.handle = h;
+	rd.in.length = len;
+	rd.in.offset = 0;
+	status = smb2_read(tree, tmp_ctx, &rd);
+	torture_comment(torture, "read of the truncated range: %s\n",
+			nt_errstr(status));
+	if (!NT_STATUS_EQUAL(status, NT_STATUS_FILE_INVALID) &&
+	    !NT_STATUS_EQUAL(status, NT_STATUS_END_OF_FILE)) {
+		CHECK_STATUS(status, NT_STATUS_FILE_INVALID);
+	}
+
+	/* the connection is still there */
+	status = smb2_util_write(tree, h, buf, 0, 10);
+	CHECK_STATUS(status, NT_STATUS_OK);
+
+	ZERO_STRUCT(rd);
+	rd.in.file.handle = h;
+	rd.in.length = 10;
+	rd.in.offset = 0;
+	status = smb2_read(tree, tmp_ctx, &rd);
+	CHECK_STATUS(status, NT_STATUS_OK);
+	CHECK_VALUE(rd.out.data.length, 10);
+
+done:
+	smb2_util_close(tree, h);
+	smb2_util_unlink(tree, FNAME);
+	talloc_free(tree2);
+	talloc_free(tmp_ctx);
+	return ret;
+}
+
+/*
+  busy CPU seconds of the whole system so far, which on a loopback
+  benchmark includes the server. Returns -1 where /proc/stat isn't
+  available.
+*/
+static double bench_read_system_cpu(void)
+{
+	unsigned long long user, nice, sys, idle, iowait, irq, softirq;
+	FILE *f;
+	int n;
+
+	f = fopen("/proc/stat", "r");
+	if (f == NULL) {
+		return -1;
+	}
+	n = fscanf(f, "cpu %llu %llu %llu %llu %llu %llu %llu",
+		   &user, &nice, &sys, &idle, &iowait, &irq, &softirq);
+	fclose(f);
+	if (n != 7) {
+		return -1;
+	}
+	return (double)(user + nice + sys + irq + softirq) /
+		sysconf(_SC_CLK_TCK);
+}
+
+static double bench_read_self_cpu(void)
+{
+	struct rusage ru;
+
+	if (getrusage(RUSAGE_SELF, &ru) != 0) {
+		return 0;
+	}
+	return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1.0e6 +
+		ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1.0e6;
+}
+
+/*
+  read a file over and over in large chunks and report the
+  throughput and the CPU time used per GB. Run it with and without
+  signing, and with "smbd:signed sendfile" on the server, to compare
+  the cost of signed reads
+*/
+bool test_smb2_bench_read(struct torture_context *torture,
+			  struct smb2_tree *tree)
+{
+	const char *fname = "bench_read.dat";
+	const int timelimit = torture_setting_int(torture, "timelimit", 10);
+	const int chunk = torture_setting_int(torture, "readsize", 1024*1024);
+	const int num_chunks = torture_setting_int(torture, "readchunks", 32);
+	bool ret = true;
+	NTSTATUS status;
+	struct smb2_handle h;
+	struct smb2_read rd;
+	struct timeval tv;
+	double secs, gb, self_cpu, sys_cpu;
+	uint64_t total = 0;
+	uint8_t *buf;
+	int i;
+	TALLOC_CTX *tmp_ctx = talloc_new(tree);
+
+	buf = talloc_zero_array(tmp_ctx, uint8_t, chunk);
+	torture_assert(torture, buf != NULL, "no memory");
+
+	smb2_util_unlink(tree, fname);
+	status = torture_smb2_testfile(tree, fname, &h);
+	CHECK_STATUS(status, NT_STATUS_OK);
+
+	for (i = 0; i < num_chunks; i++) {
+		status = smb2_util_write(tree, h, buf, (uint64_t)i * chunk,
+					 chunk);
+		CHECK_STATUS(status, NT_STATUS_OK);
+	}
+
+	torture_comment(torture, "Reading %d x %d bytes for %d seconds "
+			"(session %ssigned)\n", num_chunks, chunk, timelimit,
+			tree->session->signing_active ? "" : "not ");
+
+	self_cpu = bench_read_self_cpu();
+	sys_cpu = bench_read_system_cpu();
+	tv = timeval_current();
+
+	for (i = 0; timeval_elapsed(&tv) < timelimit; i++) {
+		ZERO_STRUCT(rd);
+		rd.in.file.handle = h;
+		rd.in.length = chunk;
+		rd.in.offset = (uint64_t)(i % num_chunks) * chunk;
+		status = smb2_read(tree, tmp_ctx, &rd);
+		CHECK_STATUS(status, NT_STATUS_OK);
+		CHECK_VALUE(rd.out.data.length, chunk);
+		total += rd.out.data.length;
+		talloc_free(rd.out.data.data);
+	}
+
+	secs = timeval_elapsed(&tv);
+	self_cpu = bench_read_self_cpu() - self_cpu;
+	gb = total / (1024.0 * 1024.0 * 1024.0);
+
+	torture_comment(torture, "%.2f MB/sec, client %.2f CPU sec/GB\n",
+			total / (1024.0 * 1024.0) / secs, self_cpu / gb);
+	if (sys_cpu >= 0) {
+		sys_cpu = bench_read_system_cpu() - sys_cpu;
+		torture_comment(torture, "system %.2f CPU sec/GB\n",
+				sys_cpu / gb);
+	}
+
+done:
+	smb2_util_close(tree, h);
+	smb2_util_unlink(tree, fname);
+	talloc_free(tmp_ctx);
+	return ret;
+}
 
 /* 
    basic testing of SMB2 read
@@ -245,6 +555,9 @@ struct torture_suite *torture_smb2_read_init(void)
 	torture_suite_add_1smb2_test(suite, "eof", test_read_eof);
 	torture_suite_add_1smb2_test(suite, "position", test_read_position);
 	torture_suite_add_1smb2_test(suite, "dir", test_read_dir);
+	torture_suite_add_1smb2_test(suite, "write-large", test_write_large);
+	torture_suite_add_1smb2_test(suite, "truncated-sendfile",
+				     test_read_truncated_sendfile);
 
 	suite->description = talloc_strdup(suite, "SMB2-READ tests");
 
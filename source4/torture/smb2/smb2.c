@@ -146,6 +146,8 @@ NTSTATUS torture_smb2_init(void)
 	torture_suite_add_suite(suite, torture_smb2_streams_init());
 	torture_suite_add_suite(suite, torture_smb2_ioctl_init());
 	torture_suite_add_1smb2_test(suite, "bench-oplock", test_smb2_bench_oplock);
+	torture_suite_add_1smb2_test(suite, "bench-handles", test_smb2_bench_handles);
+	torture_suite_add_1smb2_test(suite, "bench-read", test_smb2_bench_read);
 	torture_suite_add_1smb2_test(suite, "hold-oplock", test_smb2_hold_oplock);
 
 	suite->description = talloc_strdup(suite, "SMB2-specific tests");